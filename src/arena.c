@@ -0,0 +1,130 @@
+#include "arena.h"
+
+#include <stdlib.h>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+///
+/// Utility Methods
+///
+/**
+ * Size of a transparent huge page on x86-64 Linux, chunks are rounded up to a multiple of this
+ */
+#define ARENA_HUGE_PAGE (2 * 1024 * 1024)
+/**
+ * Granularity of the padding which staggers the start of consecutive allocations, a page plus a cache line
+ */
+#define ARENA_STAGGER (4096 + 64)
+/**
+ * Number of distinct staggers applied, before repeating
+ */
+#define ARENA_STAGGER_COUNT 16
+/**
+ * Minimum capacity of a chunk, so that small allocations do not each create a chunk
+ */
+#define ARENA_MIN_CHUNK ARENA_HUGE_PAGE
+/**
+ * Create a chunk with capacity for at least size bytes
+ * @param huge_pages Treated as boolean, request that the chunk is backed by transparent huge pages (Linux only)
+ * @return The new chunk, or 0 if the memory could not be allocated
+ */
+static ArenaChunk *arena_chunk_create(size_t size, unsigned char huge_pages);
+/**
+ * Return a chunk's memory to the system
+ */
+static void arena_chunk_destroy(ArenaChunk *chunk);
+
+///
+/// Implementation
+///
+void *arena_alloc(Arena *arena, const size_t size) {
+    // Pad each allocation by a varying multiple of ARENA_STAGGER, so that consecutive buffers of power of two size
+    // do not start at the same offset within a page, where they would compete for the same cache sets
+    const size_t aligned_size = ((size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1))
+        + (arena->count % ARENA_STAGGER_COUNT) * ARENA_STAGGER;
+    if (!arena->head || arena->head->used + aligned_size > arena->head->capacity) {
+        // Grow by at least doubling, so that a run with many growing allocations creates few chunks
+        size_t capacity = arena->head ? arena->head->capacity * 2 : ARENA_MIN_CHUNK;
+        capacity = capacity < aligned_size ? aligned_size : capacity;
+        ArenaChunk *chunk = arena_chunk_create(capacity, arena->huge_pages);
+        if (!chunk)
+            return 0;
+        chunk->next = arena->head;
+        arena->head = chunk;
+    }
+    void *ptr = arena->head->data + arena->head->used;
+    arena->head->used += aligned_size;
+    arena->used += aligned_size;
+    ++arena->count;
+    return ptr;
+}
+void arena_reset(Arena *arena) {
+    if (arena->head && arena->head->next) {
+        // The arena grew, replace its chunks with one which fits everything allocated since the last reset
+        const size_t total = arena->used;
+        arena_release(arena);
+        arena->head = arena_chunk_create(total, arena->huge_pages);
+    }
+    if (arena->head)
+        arena->head->used = 0;
+    arena->used = 0;
+    arena->count = 0;
+}
+void arena_release(Arena *arena) {
+    while (arena->head) {
+        ArenaChunk *next = arena->head->next;
+        arena_chunk_destroy(arena->head);
+        arena->head = next;
+    }
+    arena->used = 0;
+    arena->count = 0;
+}
+
+static ArenaChunk *arena_chunk_create(size_t size, const unsigned char huge_pages) {
+    size = (size + ARENA_HUGE_PAGE - 1) & ~(size_t)(ARENA_HUGE_PAGE - 1);
+    ArenaChunk *chunk = (ArenaChunk*)malloc(sizeof(ArenaChunk));
+    if (!chunk)
+        return 0;
+#ifdef __linux__
+    // mmap returns page aligned memory, and allows the kernel to back it with huge pages
+    void *data = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED) {
+        free(chunk);
+        return 0;
+    }
+#ifdef MADV_HUGEPAGE
+    // This is only advice, if transparent huge pages are disabled the chunk uses regular pages
+    if (huge_pages)
+        madvise(data, size, MADV_HUGEPAGE);
+#else
+    (void)huge_pages;
+#endif
+    chunk->data = (unsigned char*)data;
+#else
+    (void)huge_pages;
+    // malloc()'s alignment is only guaranteed to suit fundamental types, so over allocate to align the chunk
+    unsigned char *data = (unsigned char*)malloc(size + ARENA_ALIGNMENT);
+    if (!data) {
+        free(chunk);
+        return 0;
+    }
+    // Store the offset of the aligned data from the allocation, in the byte before it
+    const size_t offset = ARENA_ALIGNMENT - ((size_t)data & (ARENA_ALIGNMENT - 1));
+    data[offset - 1] = (unsigned char)offset;
+    chunk->data = data + offset;
+#endif
+    chunk->capacity = size;
+    chunk->used = 0;
+    chunk->next = 0;
+    return chunk;
+}
+static void arena_chunk_destroy(ArenaChunk *chunk) {
+#ifdef __linux__
+    munmap(chunk->data, chunk->capacity);
+#else
+    free(chunk->data - chunk->data[-1]);
+#endif
+    free(chunk);
+}
@@ -0,0 +1,294 @@
+#include "bench.h"
+
+#include <ctype.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <omp.h>
+
+///
+/// Utility Methods
+///
+/**
+ * The compiler flags and version of this build, these are defined by the Makefile
+ */
+#ifndef BUILD_FLAGS
+#define BUILD_FLAGS "unknown"
+#endif
+#ifndef BUILD_VERSION
+#define BUILD_VERSION "unknown"
+#endif
+#define BENCH_STRINGIFY(x) #x
+#define BENCH_XSTRINGIFY(x) BENCH_STRINGIFY(x)
+#if defined(__clang__)
+#define BENCH_COMPILER __VERSION__
+#elif defined(__GNUC__)
+#define BENCH_COMPILER "GCC " __VERSION__
+#elif defined(_MSC_FULL_VER)
+#define BENCH_COMPILER "MSVC " BENCH_XSTRINGIFY(_MSC_FULL_VER)
+#else
+#define BENCH_COMPILER "unknown"
+#endif
+/**
+ * Details of the machine running the benchmark
+ */
+struct BenchMachine {
+    char cpu_model[256];
+    int threads;
+    /**
+     * UTC time the report was written, ISO 8601
+     */
+    char timestamp[32];
+};
+typedef struct BenchMachine BenchMachine;
+/**
+ * qsort() comparator of float, ascending
+ */
+static int bench_float_compare(const void *a, const void *b);
+/**
+ * Return the sample at quantile q (nearest rank) of sorted
+ */
+static float bench_quantile(const float *sorted, unsigned int count, float q);
+/**
+ * Collect the details of this machine
+ */
+static void bench_machine(BenchMachine *machine);
+/**
+ * Return the command line joined by spaces, which must be freed by the caller
+ */
+static char *bench_command(int argc, char **argv);
+/**
+ * Write str as a JSON string literal, or a CSV field, escaping as required
+ */
+static void bench_json_string(FILE *file, const char *str);
+static void bench_csv_string(FILE *file, const char *str);
+/**
+ * Write the report in each format
+ */
+static void bench_write_json(FILE *file, const BenchMachine *machine, const char *command, const BenchResult *results, unsigned int results_count);
+static void bench_write_csv(FILE *file, const BenchMachine *machine, const char *command, const BenchResult *results, unsigned int results_count);
+
+///
+/// Implementation
+///
+const char *const bench_stage_names[BENCH_STAGES] = { "init", "stage1", "stage2", "stage3", "free", "write", "total" };
+
+void bench_stats(const float *samples, const unsigned int count, BenchStats *stats) {
+    float *sorted = (float*)malloc(count * sizeof(float));
+    memcpy(sorted, samples, count * sizeof(float));
+    qsort(sorted, count, sizeof(float), bench_float_compare);
+    double sum = 0;
+    for (unsigned int i = 0; i < count; ++i)
+        sum += sorted[i];
+    const double mean = sum / count;
+    double squares = 0;
+    for (unsigned int i = 0; i < count; ++i)
+        squares += (sorted[i] - mean) * (sorted[i] - mean);
+    stats->mean = (float)mean;
+    stats->stddev = count > 1 ? (float)sqrt(squares / (count - 1)) : 0;
+    stats->min = sorted[0];
+    stats->median = count % 2 ? sorted[count / 2] : (sorted[count / 2 - 1] + sorted[count / 2]) / 2;
+    stats->p95 = bench_quantile(sorted, count, 0.95f);
+    stats->p99 = bench_quantile(sorted, count, 0.99f);
+    stats->max = sorted[count - 1];
+    // Tukey's fences
+    const float q1 = bench_quantile(sorted, count, 0.25f);
+    const float q3 = bench_quantile(sorted, count, 0.75f);
+    const float fence = 1.5f * (q3 - q1);
+    stats->outliers = 0;
+    for (unsigned int i = 0; i < count; ++i) {
+        if (sorted[i] < q1 - fence || sorted[i] > q3 + fence)
+            ++stats->outliers;
+    }
+    free(sorted);
+}
+void bench_print(const BenchResult *result) {
+    printf("%-8s %10s %10s %10s %10s %10s %10s %10s %8s\n", "Stage", "Mean", "Stddev", "Min", "Median", "p95", "p99", "Max", "Outliers");
+    for (int s = 0; s < BENCH_STAGES; ++s) {
+        const BenchStats *stats = &result->stages[s];
+        printf("%-8s %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f %8u\n", bench_stage_names[s],
+            stats->mean, stats->stddev, stats->min, stats->median, stats->p95, stats->p99, stats->max, stats->outliers);
+    }
+}
+int bench_write(const char *path, const int argc, char **argv, const BenchResult *results, const unsigned int results_count) {
+    if (!bench_format_supported(path))
+        return 0;
+    FILE *file = fopen(path, "w");
+    if (!file)
+        return 0;
+    BenchMachine machine;
+    bench_machine(&machine);
+    char *command = bench_command(argc, argv);
+    if (bench_has_extension(path, ".json"))
+        bench_write_json(file, &machine, command, results, results_count);
+    else
+        bench_write_csv(file, &machine, command, results, results_count);
+    free(command);
+    const int success = !ferror(file);
+    return (fclose(file) == 0) && success;
+}
+int bench_format_supported(const char *path) {
+    return bench_has_extension(path, ".json") || bench_has_extension(path, ".csv");
+}
+int bench_has_extension(const char *path, const char *extension) {
+    const size_t path_len = strlen(path);
+    const size_t extension_len = strlen(extension);
+    if (path_len <= extension_len)
+        return 0;
+    path += path_len - extension_len;
+    for (size_t i = 0; i < extension_len; ++i) {
+        if (tolower(path[i]) != tolower(extension[i]))
+            return 0;
+    }
+    return 1;
+}
+int bench_parse_dimensions(const char *arg, const char *delimiters, unsigned int *width, unsigned int *height) {
+    // Parsed in place rather than with strtok(), so that concurrent server jobs may share it
+    long values[2] = {0, 0};
+    int values_count = 0;
+    for (arg += strspn(arg, delimiters); *arg; arg += strspn(arg, delimiters)) {
+        const size_t length = strcspn(arg, delimiters);
+        char *end;
+        if (values_count == 2 || !isdigit((unsigned char)*arg))
+            return 0;
+        values[values_count++] = strtol(arg, &end, 10);
+        if (end != arg + length || values[values_count - 1] <= 0 || values[values_count - 1] > INT_MAX)
+            return 0;
+        arg = end;
+    }
+    if (!values_count)
+        return 0;
+    if (values_count == 1)  // Only width provided
+        values[1] = values[0];
+    // The implementations address the RGB image with int
+    if ((unsigned long long)values[0] * (unsigned long long)values[1] * 3 > INT_MAX)
+        return 0;
+    *width = (unsigned int)values[0];
+    *height = (unsigned int)values[1];
+    return 1;
+}
+
+static int bench_float_compare(const void *a, const void *b) {
+    const float fa = *(const float*)a;
+    const float fb = *(const float*)b;
+    return fa < fb ? -1 : fa > fb;
+}
+static float bench_quantile(const float *sorted, const unsigned int count, const float q) {
+    unsigned int rank = (unsigned int)ceilf(q * count);
+    rank = rank < 1 ? 1 : rank;
+    rank = rank > count ? count : rank;
+    return sorted[rank - 1];
+}
+static void bench_machine(BenchMachine *machine) {
+    memset(machine, 0, sizeof(BenchMachine));
+    strcpy(machine->cpu_model, "unknown");
+    machine->threads = omp_get_max_threads();
+#ifdef __linux__
+    FILE *cpuinfo = fopen("/proc/cpuinfo", "r");
+    if (cpuinfo) {
+        char line[512];
+        while (fgets(line, sizeof(line), cpuinfo)) {
+            if (!strncmp(line, "model name", 10)) {
+                const char *value = strchr(line, ':');
+                if (value) {
+                    value += strspn(value + 1, " \t") + 1;
+                    strncpy(machine->cpu_model, value, sizeof(machine->cpu_model) - 1);
+                    machine->cpu_model[strcspn(machine->cpu_model, "\r\n")] = '\0';
+                }
+                break;
+            }
+        }
+        fclose(cpuinfo);
+    }
+#endif
+    const time_t now = time(0);
+    strftime(machine->timestamp, sizeof(machine->timestamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+}
+static char *bench_command(const int argc, char **argv) {
+    size_t length = 1;
+    for (int i = 0; i < argc; ++i)
+        length += strlen(argv[i]) + 1;
+    char *command = (char*)malloc(length);
+    command[0] = '\0';
+    for (int i = 0; i < argc; ++i) {
+        if (i)
+            strcat(command, " ");
+        strcat(command, argv[i]);
+    }
+    return command;
+}
+static void bench_json_string(FILE *file, const char *str) {
+    fputc('"', file);
+    for (; *str; ++str) {
+        if (*str == '"' || *str == '\\')
+            fprintf(file, "\\%c", *str);
+        else if ((unsigned char)*str < 0x20)
+            fprintf(file, "\\u%04x", (unsigned char)*str);
+        else
+            fputc(*str, file);
+    }
+    fputc('"', file);
+}
+static void bench_csv_string(FILE *file, const char *str) {
+    fputc('"', file);
+    for (; *str; ++str) {
+        if (*str == '"')
+            fputc('"', file);
+        fputc(*str, file);
+    }
+    fputc('"', file);
+}
+static void bench_write_json(FILE *file, const BenchMachine *machine, const char *command, const BenchResult *results, const unsigned int results_count) {
+    fprintf(file, "{\n  \"timestamp\": ");
+    bench_json_string(file, machine->timestamp);
+    fprintf(file, ",\n  \"machine\": {\n    \"cpu\": ");
+    bench_json_string(file, machine->cpu_model);
+    fprintf(file, ",\n    \"threads\": %d\n  },\n  \"build\": {\n    \"version\": ", machine->threads);
+    bench_json_string(file, BUILD_VERSION);
+    fprintf(file, ",\n    \"compiler\": ");
+    bench_json_string(file, BENCH_COMPILER);
+    fprintf(file, ",\n    \"flags\": ");
+    bench_json_string(file, BUILD_FLAGS);
+    fprintf(file, "\n  },\n  \"command\": ");
+    bench_json_string(file, command);
+    fprintf(file, ",\n  \"results\": [");
+    for (unsigned int r = 0; r < results_count; ++r) {
+        const BenchResult *result = &results[r];
+        fprintf(file, "%s\n    {\n      \"mode\": ", r ? "," : "");
+        bench_json_string(file, result->mode);
+        fprintf(file, ",\n      \"particles\": %u,\n      \"width\": %u,\n      \"height\": %u,\n      \"warmup\": %u,\n      \"runs\": %u,\n      \"stages\": {",
+            result->particles_count, result->width, result->height, result->warmup, result->runs);
+        for (int s = 0; s < BENCH_STAGES; ++s) {
+            const BenchStats *stats = &result->stages[s];
+            fprintf(file, "%s\n        \"%s\": {\"mean\": %.4f, \"stddev\": %.4f, \"min\": %.4f, \"median\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f, \"outliers\": %u}",
+                s ? "," : "", bench_stage_names[s], stats->mean, stats->stddev, stats->min, stats->median, stats->p95, stats->p99, stats->max, stats->outliers);
+        }
+        fprintf(file, "\n      }\n    }");
+    }
+    fprintf(file, "\n  ]\n}\n");
+}
+static void bench_write_csv(FILE *file, const BenchMachine *machine, const char *command, const BenchResult *results, const unsigned int results_count) {
+    fprintf(file, "timestamp,cpu,threads,version,compiler,flags,command,mode,particles,width,height,warmup,runs,stage,mean,stddev,min,median,p95,p99,max,outliers\n");
+    for (unsigned int r = 0; r < results_count; ++r) {
+        const BenchResult *result = &results[r];
+        for (int s = 0; s < BENCH_STAGES; ++s) {
+            const BenchStats *stats = &result->stages[s];
+            fprintf(file, "%s,", machine->timestamp);
+            bench_csv_string(file, machine->cpu_model);
+            fprintf(file, ",%d,", machine->threads);
+            bench_csv_string(file, BUILD_VERSION);
+            fputc(',', file);
+            bench_csv_string(file, BENCH_COMPILER);
+            fputc(',', file);
+            bench_csv_string(file, BUILD_FLAGS);
+            fputc(',', file);
+            bench_csv_string(file, command);
+            fprintf(file, ",%s,%u,%u,%u,%u,%u,%s,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%u\n",
+                result->mode, result->particles_count, result->width, result->height, result->warmup, result->runs, bench_stage_names[s],
+                stats->mean, stats->stddev, stats->min, stats->median, stats->p95, stats->p99, stats->max, stats->outliers);
+        }
+    }
+}
@@ -0,0 +1,96 @@
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Benchmark statistics and machine readable reports
+ *
+ * Each stage's samples (one per timed run, after warmup runs) are summarised by their mean and standard deviation,
+ * and by order statistics (min, median, p95, p99, max) which are robust to the occasional slow run
+ * Outliers are counted with Tukey's fences (beyond 1.5 interquartile ranges from the quartiles), but not discarded
+ *
+ * Reports are written as JSON or CSV (selected by extension), alongside the machine and build which produced them,
+ * so that results can be compared across versions and machines
+ */
+
+/**
+ * Number of timed stages of a run, and their names as reported
+ */
+#define BENCH_STAGES 7
+extern const char *const bench_stage_names[BENCH_STAGES];
+/**
+ * Summary statistics of a stage's samples (in milliseconds)
+ */
+struct BenchStats {
+    float mean;
+    float stddev;
+    float min;
+    float median;
+    float p95;
+    float p99;
+    float max;
+    unsigned int outliers;
+};
+typedef struct BenchStats BenchStats;
+/**
+ * The results of benchmarking one configuration
+ */
+struct BenchResult {
+    const char *mode;
+    unsigned int particles_count;
+    unsigned int width;
+    unsigned int height;
+    unsigned int warmup;
+    unsigned int runs;
+    /**
+     * Statistics of each stage, in the order of bench_stage_names
+     */
+    BenchStats stages[BENCH_STAGES];
+};
+typedef struct BenchResult BenchResult;
+
+/**
+ * Compute the summary statistics of samples
+ * @param samples The samples, which are not modified
+ * @param count The number of samples, must be at least 1
+ * @param stats Pointer to a struct to store the statistics
+ */
+void bench_stats(const float *samples, unsigned int count, BenchStats *stats);
+/**
+ * Print a table of each stage's statistics to stdout
+ */
+void bench_print(const BenchResult *result);
+/**
+ * Write a report of the results, with the CPU model, thread count, compiler, build flags and command line
+ * @param path The path of the report, .json or .csv
+ * @param argc argc from main(), the command line is recorded
+ * @param argv argv from main()
+ * @param results Pointer to an array of results
+ * @param results_count The number of elements within the results array
+ * @return Non-zero on success
+ */
+int bench_write(const char *path, int argc, char **argv, const BenchResult *results, unsigned int results_count);
+/**
+ * Return non-zero if path has an extension bench_write() supports
+ */
+int bench_format_supported(const char *path);
+/**
+ * Return non-zero if path ends with extension (case insensitive), shared by every file type selected by extension
+ */
+int bench_has_extension(const char *path, const char *extension);
+/**
+ * Parse image dimensions, as two positive integers separated by one of delimiters, or one for square dimensions
+ * Dimensions whose RGB image exceeds INT_MAX bytes are rejected, as the implementations address the image with int
+ * Shared by the command line and the jobs of SERVE mode
+ * @return Non-zero on success
+ */
+int bench_parse_dimensions(const char *arg, const char *delimiters, unsigned int *width, unsigned int *height);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // BENCH_H_
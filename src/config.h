@@ -11,6 +11,14 @@
  * Number of runs to complete for benchmarking
  */
 #define BENCHMARK_RUNS 100
+/**
+ * Number of untimed runs before the benchmarking runs, so caches, page tables and allocators reach a steady state
+ */
+#define BENCHMARK_WARMUP_RUNS 5
+/**
+ * Only every VALIDATION_SAMPLE_STRIDE'th row of the output is validated by --validate sample
+ */
+#define VALIDATION_SAMPLE_STRIDE 16
 
 /**
  * Particle generation Config
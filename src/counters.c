@@ -0,0 +1,206 @@
+#include "counters.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+#ifdef __linux__
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+///
+/// Utility Methods
+///
+/**
+ * Names of the events as reported, in the order of CounterEvent
+ */
+static const char *const counters_event_names[COUNTER_EVENTS] = { "Cycles", "Instructions", "LLC misses", "Branch misses", "dTLB misses" };
+/**
+ * File descriptor of each thread's counter of each event, -1 if it failed to open
+ * Indexed [thread * COUNTER_EVENTS + event]
+ */
+static int *counters_fds = 0;
+static int counters_threads = 0;
+/**
+ * Treated as boolean, the event opened on every thread
+ */
+static unsigned char counters_event_available[COUNTER_EVENTS];
+#ifdef __linux__
+/**
+ * Open a counter of event for the calling thread
+ * @return The file descriptor, or -1 with errno set
+ */
+static int counters_open_event(CounterEvent event);
+#endif
+/**
+ * Print count right aligned in width characters, or n/a if the event is unavailable
+ */
+static void counters_print_count(double count, int available, int width);
+
+///
+/// Implementation
+///
+int counters_open(void) {
+    counters_close();
+    memset(counters_event_available, 0, sizeof(counters_event_available));
+#ifdef __linux__
+    counters_threads = omp_get_max_threads();
+    counters_fds = (int*)malloc(counters_threads * COUNTER_EVENTS * sizeof(int));
+    for (int i = 0; i < counters_threads * COUNTER_EVENTS; ++i)
+        counters_fds[i] = -1;
+    int errors[COUNTER_EVENTS];
+    memset(errors, 0, sizeof(errors));
+    // Each thread of the pool opens its own counters, perf_event counts the thread which opened it
+#pragma omp parallel num_threads(counters_threads)
+    {
+        const int thread = omp_get_thread_num();
+        for (int e = 0; e < COUNTER_EVENTS; ++e) {
+            const int fd = counters_open_event((CounterEvent)e);
+            counters_fds[thread * COUNTER_EVENTS + e] = fd;
+            if (fd < 0) {
+#pragma omp critical
+                errors[e] = errno;
+            }
+        }
+    }
+    int available = 0;
+    for (int e = 0; e < COUNTER_EVENTS; ++e) {
+        counters_event_available[e] = 1;
+        for (int t = 0; t < counters_threads; ++t)
+            counters_event_available[e] &= counters_fds[t * COUNTER_EVENTS + e] >= 0;
+        if (counters_event_available[e]) {
+            ++available;
+        } else {
+            printf("Performance counter %s is unavailable: %s\n", counters_event_names[e], strerror(errors[e] ? errors[e] : ENOENT));
+        }
+    }
+    if (!available) {
+        printf("No performance counters are available (check /proc/sys/kernel/perf_event_paranoid, and that the PMU is exposed to this machine)\n");
+        counters_close();
+    }
+    return available;
+#else
+    printf("Performance counters are only supported on Linux\n");
+    return 0;
+#endif
+}
+int counters_available(const CounterEvent event) {
+    return counters_fds && counters_event_available[event];
+}
+void counters_sample(CounterSample *sample) {
+    memset(sample, 0, sizeof(CounterSample));
+#ifdef __linux__
+    if (!counters_fds)
+        return;
+    for (int t = 0; t < counters_threads; ++t) {
+        for (int e = 0; e < COUNTER_EVENTS; ++e) {
+            const int fd = counters_fds[t * COUNTER_EVENTS + e];
+            // PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING: value, time enabled, time running
+            unsigned long long data[3];
+            if (fd >= 0 && read(fd, data, sizeof(data)) == (ssize_t)sizeof(data)) {
+                sample->value[e] += data[0];
+                sample->enabled[e] += data[1];
+                sample->running[e] += data[2];
+            }
+        }
+    }
+#endif
+}
+void counters_accumulate(const CounterSample *start, const CounterSample *stop, double *counts) {
+    for (int e = 0; e < COUNTER_EVENTS; ++e) {
+        const double value = (double)(stop->value[e] - start->value[e]);
+        const double enabled = (double)(stop->enabled[e] - start->enabled[e]);
+        const double running = (double)(stop->running[e] - start->running[e]);
+        // Scale for the time the counter was not scheduled, due to multiplexing
+        counts[e] += running > 0 ? value * (enabled / running) : value;
+    }
+}
+void counters_print(const double counts[COUNTER_STAGES][COUNTER_EVENTS], const float milliseconds[COUNTER_STAGES],
+    const unsigned int runs, const unsigned long long contributions) {
+    printf("Performance counters (per run, summed over %d threads)\n", counters_threads);
+    printf("%-8s", "Stage");
+    for (int e = 0; e < COUNTER_EVENTS; ++e)
+        printf(" %14s", counters_event_names[e]);
+    printf(" %6s %12s %10s %14s\n", "IPC", "Moved (MB)", "GB/s", "Mcontribs/s");
+    for (int s = 0; s < COUNTER_STAGES; ++s) {
+        printf("stage%-3d", s + 1);
+        for (int e = 0; e < COUNTER_EVENTS; ++e)
+            counters_print_count(counts[s][e] / runs, counters_available((CounterEvent)e), 15);
+        const double seconds = milliseconds[s] / 1000.0;
+        // Instructions per cycle
+        if (counters_available(COUNTER_CYCLES) && counters_available(COUNTER_INSTRUCTIONS) && counts[s][COUNTER_CYCLES] > 0)
+            printf(" %6.2f", counts[s][COUNTER_INSTRUCTIONS] / counts[s][COUNTER_CYCLES]);
+        else
+            printf(" %6s", "n/a");
+        // Estimated memory traffic, a cache line per last level cache miss
+        if (counters_available(COUNTER_LLC_MISSES)) {
+            const double bytes = counts[s][COUNTER_LLC_MISSES] * COUNTER_LINE_BYTES;
+            printf(" %12.1f %10.2f", bytes / runs / (1024.0 * 1024.0), seconds > 0 ? bytes / seconds / 1e9 : 0.0);
+        } else {
+            printf(" %12s %10s", "n/a", "n/a");
+        }
+        // Every stage processes each contribution once
+        printf(" %14.2f\n", seconds > 0 ? (double)contributions * runs / seconds / 1e6 : 0.0);
+    }
+}
+void counters_close(void) {
+#ifdef __linux__
+    if (counters_fds) {
+        for (int i = 0; i < counters_threads * COUNTER_EVENTS; ++i) {
+            if (counters_fds[i] >= 0)
+                close(counters_fds[i]);
+        }
+    }
+#endif
+    free(counters_fds);
+    counters_fds = 0;
+    counters_threads = 0;
+}
+
+#ifdef __linux__
+static int counters_open_event(const CounterEvent event) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(struct perf_event_attr));
+    attr.size = sizeof(struct perf_event_attr);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    switch (event) {
+    case COUNTER_CYCLES:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        break;
+    case COUNTER_INSTRUCTIONS:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        break;
+    case COUNTER_LLC_MISSES:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        break;
+    case COUNTER_BRANCH_MISSES:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+        break;
+    case COUNTER_DTLB_MISSES:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        break;
+    default:
+        errno = EINVAL;
+        return -1;
+    }
+    // pid 0 and cpu -1, count the calling thread on any CPU
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+static void counters_print_count(const double count, const int available, const int width) {
+    if (available)
+        printf("%*.0f", width, count);
+    else
+        printf("%*s", width, "n/a");
+}
@@ -0,0 +1,75 @@
+#ifndef COUNTERS_H_
+#define COUNTERS_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Hardware performance counters (Linux perf_event), sampled around each stage of a run
+ *
+ * Counters are opened by each OpenMP thread for itself, and summed over threads when sampled,
+ * so they cover stages which run on the OpenMP thread pool, as well as those on the calling thread
+ * Only user space events are counted, which perf_event_paranoid <= 2 permits for the process's own threads
+ * Counters the kernel or hardware do not provide (e.g. within a VM) are reported as unavailable, rather than failing
+ * When counters are multiplexed, counts are scaled by the fraction of time they were scheduled
+ */
+
+/**
+ * Events counted, and the number of stages they are reported for
+ */
+enum CounterEvent { COUNTER_CYCLES, COUNTER_INSTRUCTIONS, COUNTER_LLC_MISSES, COUNTER_BRANCH_MISSES, COUNTER_DTLB_MISSES, COUNTER_EVENTS };
+typedef enum CounterEvent CounterEvent;
+#define COUNTER_STAGES 3
+/**
+ * Bytes transferred from memory per last level cache miss (a cache line), used to estimate bytes moved
+ */
+#define COUNTER_LINE_BYTES 64
+/**
+ * A snapshot of the counters, summed over threads
+ */
+struct CounterSample {
+    unsigned long long value[COUNTER_EVENTS];
+    unsigned long long enabled[COUNTER_EVENTS];
+    unsigned long long running[COUNTER_EVENTS];
+};
+typedef struct CounterSample CounterSample;
+
+/**
+ * Open the counters for each thread of the OpenMP thread pool
+ * The reason counters are unavailable is printed to stdout
+ * @return The number of events available, 0 if none
+ */
+int counters_open(void);
+/**
+ * Return non-zero if event was opened successfully for every thread
+ */
+int counters_available(CounterEvent event);
+/**
+ * Take a snapshot of the counters, does nothing if none are open
+ */
+void counters_sample(CounterSample *sample);
+/**
+ * Add the counts (scaled for multiplexing) between two snapshots to counts
+ * @param counts Array of COUNTER_EVENTS counts to accumulate into
+ */
+void counters_accumulate(const CounterSample *start, const CounterSample *stop, double *counts);
+/**
+ * Print a table of each stage's counters and derived metrics (IPC, estimated bytes moved, contributions per second)
+ * @param counts The counts of each stage, accumulated over runs
+ * @param milliseconds The time of each stage, accumulated over the same runs
+ * @param runs The number of runs accumulated, counts are reported per run
+ * @param contributions The number of pixel contributions of a run
+ */
+void counters_print(const double counts[COUNTER_STAGES][COUNTER_EVENTS], const float milliseconds[COUNTER_STAGES],
+    unsigned int runs, unsigned long long contributions);
+/**
+ * Close the counters
+ */
+void counters_close(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // COUNTERS_H_
@@ -1,6 +1,11 @@
 #include "cpu.h"
 #include "helper.h"
+#include "sort.h"
+#include "simd.h"
+#include "arena.h"
+#include "scan.h"
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
@@ -9,233 +14,1427 @@
 /// Utility Methods
 ///
 /**
- * Simple (in place) quicksort pair sort implementation
- * Items at the matching index within keys and values are sorted according to keys in ascending order
- * @param keys_start Pointer to the start of the keys (depth) buffer
- * @param colours_start Pointer to the start of the values (colours) buffer (each color consists of three unsigned char)
- * @param first Index of the first item to be sorted
- * @param last Index of the last item to be sorted
- * @note This function is implemented at the bottom of cpu.c
+ * Allocate size bytes, from arena if options.arena is set, otherwise with malloc()
+ * A failed allocation sets alloc_failed, and returns null
  */
-void cpu_sort_pairs(float* keys_start, unsigned char* colours_start, int first, int last);
+static void *cpu_alloc(CpuContext *cpu, size_t size);
+/**
+ * Free an allocation from cpu_alloc(), arena allocations are instead released together when the arena is reset
+ */
+static void cpu_free(CpuContext *cpu, void *ptr);
+/**
+ * If any allocation since cpu_begin() has failed, report it to stderr as an error of caller
+ * @return Non-zero if every allocation succeeded
+ */
+static int cpu_alloc_check(CpuContext *cpu, const char *caller);
+/**
+ * Copy the particles to particles and the structure of arrays, sorting them by depth if required
+ * The storage must already be allocated for particles_count particles
+ */
+static void cpu_load_particles(CpuContext *cpu, const Particle *particles);
+/**
+ * Copy particle i of particles to the structure of arrays
+ */
+static void cpu_split_particle(CpuContext *cpu, unsigned int i);
+/**
+ * Compute particle i's bounding box [inclusive-inclusive], clamped to the output image
+ * @return 0 if the clamped bounding box is empty (the particle does not touch the image)
+ */
+static int cpu_particle_bounds(CpuContext *cpu, unsigned int i, int *x_min, int *y_min, int *x_max, int *y_max);
+/**
+ * Increment pixel_contribs for every pixel within the (inclusive) region which falls within particle i's radius
+ * Each row is tested with the simd.row_covered kernel
+ */
+static void cpu_count_contribs(CpuContext *cpu, unsigned int i, int x_min, int y_min, int x_max, int y_max);
+/**
+ * Store particle i's colour and depth to the pixel_contrib buffers for every pixel within the (inclusive) region
+ * which falls within its radius, using pixel_index and pixel_contribs to locate the storage
+ */
+static void cpu_store_contribs(CpuContext *cpu, unsigned int i, int x_min, int y_min, int x_max, int y_max);
+/**
+ * Return particle i's packed contribution record (see CpuOptions::packed)
+ */
+static unsigned long long cpu_particle_record(CpuContext *cpu, unsigned int i);
+/**
+ * Test whether the centre of pixel x, of a row y_ab from particle i's centre, falls within its radius
+ */
+static int cpu_pixel_covered(CpuContext *cpu, unsigned int i, int x, float y_ab);
+/**
+ * Find the span of pixels [x_start, x_end] within row y and columns [x_min, x_max] which falls within particle i's radius
+ * The span is found analytically, and then corrected against the exact per pixel test of cpu_count_contribs()
+ * @return 0 if no pixel of the row falls within the radius
+ */
+static int cpu_row_span(CpuContext *cpu, unsigned int i, int y, int x_min, int x_max, int *x_start, int *x_end);
+/**
+ * Calculate and cache the span of every row of every particle's bounding box, building span_index and spans
+ */
+static void cpu_build_spans(CpuContext *cpu);
+/**
+ * Equivalent to cpu_count_contribs(), using a particle's cached spans starting at row y_min
+ * Only the first and one past the last pixel of each span is written, cpu_integrate_rows() must be applied after
+ */
+static void cpu_count_spans(CpuContext *cpu, const int *row_spans, int x_min, int y_min, int x_max, int y_max);
+/**
+ * Inclusive prefix sum along each row of the (inclusive) region of pixel_contribs
+ * This converts the difference values written by cpu_count_spans() into contribution counts
+ */
+static void cpu_integrate_rows(CpuContext *cpu, int x_min, int y_min, int x_max, int y_max);
+/**
+ * Equivalent to cpu_store_contribs(), using a particle's cached spans starting at row y_min
+ */
+static void cpu_store_spans(CpuContext *cpu, unsigned int i, const int *row_spans, int x_min, int y_min, int x_max, int y_max);
+/**
+ * Bin the particles into screen tiles of options.tile_size, building tile_index and tile_particles
+ * If tile binning is disabled, a single tile covers the whole image and contains every particle
+ */
+static void cpu_bin_particles(CpuContext *cpu);
+/**
+ * Compute the region of the image [inclusive-inclusive] covered by a tile
+ */
+static void cpu_tile_bounds(CpuContext *cpu, int tile, int *x_min, int *y_min, int *x_max, int *y_max);
+/**
+ * Return the particle index stored at index j of tile_particles
+ */
+static unsigned int cpu_tile_particle(CpuContext *cpu, unsigned int j);
+/**
+ * Banded stage 1, count the contributions to each row, divide the rows into bands which fit within options.band_budget,
+ * bin the particles into the bands, and allocate storage for the largest band
+ * @return Non-zero on success, 0 if a single row has too many contributions for a 32-bit index
+ */
+static int cpu_band_plan(CpuContext *cpu);
+/**
+ * Banded stage 2, for each band in turn, count, store and sort its contributions, then blend its rows
+ * The rows are blended into the output image, or a band sized buffer passed to options.band_sink
+ */
+static void cpu_band_render(CpuContext *cpu);
+/**
+ * Per tile storage of incremental rendering, see incremental_tiles
+ */
+typedef struct CpuTile CpuTile;
+/**
+ * Incremental binning, add every particle to the lists of the tiles its bounding box overlaps, and mark every tile dirty
+ */
+static void cpu_incremental_bin(CpuContext *cpu);
+/**
+ * Incremental update, replace the particles which differ from particles
+ * Each changed particle is moved between the tile lists of its old and new bounding box, and both sets of tiles are marked dirty
+ */
+static void cpu_incremental_update(CpuContext *cpu, const Particle *particles);
+/**
+ * Add (or remove) particle i to (from) the list of every tile overlapped by its current bounding box, marking them dirty
+ */
+static void cpu_incremental_add(CpuContext *cpu, unsigned int i);
+static void cpu_incremental_remove(CpuContext *cpu, unsigned int i);
+/**
+ * Return the position within the tile's particle list of the first particle index not less than i
+ */
+static unsigned int cpu_incremental_find(CpuContext *cpu, const CpuTile *tile, unsigned int i);
+/**
+ * Incremental stage 1, count the contributions to each pixel of the dirty tiles
+ */
+static void cpu_incremental_count(CpuContext *cpu);
+/**
+ * Incremental stage 2, build each dirty tile's local pixel index, then store and sort its contributions in its own buffers
+ */
+static void cpu_incremental_store(CpuContext *cpu);
+/**
+ * Incremental stage 3, blend each dirty tile's pixels into the retained output image, and clear the dirty flags
+ */
+static void cpu_incremental_blend(CpuContext *cpu);
+/**
+ * Streaming stage 1, visit the particles front to back (descending depth) accumulating each pixel's transmittance
+ * Once a pixel's transmittance falls to CPU_STREAM_TRANSMITTANCE, the current particle is stored as its cutoff,
+ * and deeper particles are skipped
+ */
+static void cpu_stream_transmittance(CpuContext *cpu);
+/**
+ * Streaming stage 2, visit the particles back to front (ascending depth) blending each pixel's layers from its cutoff
+ * The colour beneath the cutoff is unknown, so a low and high bound are blended, starting from black and white
+ * Pixels without a cutoff start both bounds from the white background, so are exact
+ */
+static void cpu_stream_blend(CpuContext *cpu);
+/**
+ * Streaming stage 3, each channel is the midpoint of its bounds, which is within 1 of the exact blend if they differ by at most 2
+ * Any pixel with wider bounds is reblended with every layer by a second cpu_stream_blend()
+ */
+static void cpu_stream_resolve(CpuContext *cpu);
 
 
+/**
+ * Maximum number of contributions addressed by a 32-bit index, so that their byte offsets in the colour buffer do not overflow
+ */
+#define CPU_MAX_CONTRIBS (0xFFFFFFFFu / 4)
+/**
+ * Tile size used by incremental rendering when options.tile_size is 0
+ */
+#define CPU_INCREMENTAL_TILE 32
+/**
+ * Transmittance at which the colour beneath a pixel is assumed to no longer affect its 8-bit value
+ * Smaller values cut off fewer layers, but fewer pixels need to be reblended by cpu_stream_resolve()
+ */
+#define CPU_STREAM_TRANSMITTANCE (1.0f / 1024.0f)
+
 ///
 /// Algorithm storage
 ///
-unsigned int cpu_particles_count;
-Particle *cpu_particles;
-unsigned int *cpu_pixel_contribs;
-unsigned int *cpu_pixel_index;
-unsigned char *cpu_pixel_contrib_colours;
-float *cpu_pixel_contrib_depth;
-unsigned int cpu_pixel_contrib_count;
-CImage cpu_output_image;
+// Incremental storage, each screen tile retains the particles which overlap it and its contributions,
+// so that it can be re-rendered alone
+struct CpuTile {
+    // Indices of the particles overlapping the tile, in ascending particle order
+    unsigned int *particles;
+    unsigned int particles_count;
+    unsigned int particles_capacity;
+    // The colours and depths contributing to the tile's pixels, located by the tile's region of incremental_index
+    unsigned char *contrib_colours;
+    float *contrib_depth;
+    unsigned int contrib_capacity;
+    // Treated as boolean, the tile must be re-rendered as a particle overlapping it has changed
+    unsigned char dirty;
+};
+// Every buffer and option of a single instance of the CPU implementation
+struct CpuContext {
+    // The options passed to cpu_begin(), fixed until cpu_end()
+    CpuOptions options;
+    unsigned int particles_count;
+    Particle *particles;
+    // Structure of arrays copy of particles, so that the per pixel loops only load the fields they use
+    float *particle_x;
+    float *particle_y;
+    float *particle_depth;
+    float *particle_radius;
+    // RGBA colour of each particle (4 unsigned char per particle)
+    unsigned char *particle_colour;
+    // Depth sort storage, only used when options.presort or options.stream is set
+    float *presort_depths;
+    unsigned int *presort_order;
+    // Vectorised kernels selected by options.simd and options.blend
+    SimdKernels simd;
+    // The columns covered by the row being tested, returned by simd.row_covered (output_image.width + SIMD_ROW_PADDING elements)
+    int *covered_x;
+    unsigned int *pixel_contribs;
+    unsigned int *pixel_index;
+    unsigned char *pixel_contrib_colours;
+    float *pixel_contrib_depth;
+    // Packed storage, used in place of the colour and depth buffers when options.packed is set
+    unsigned long long *pixel_contrib_records;
+    unsigned int pixel_contrib_count;
+    CImage output_image;
+    // Tile binning storage, if options.tile_size is 0 a single tile the size of the image is used
+    int tile_width;
+    int tile_height;
+    int tiles_x;
+    int tiles_y;
+    // Exclusive prefix sum of the number of particles overlapping each tile (tiles_x * tiles_y + 1 elements)
+    unsigned int *tile_index;
+    // Indices of the particles overlapping each tile, in ascending particle order within each tile
+    // This is not allocated when there is a single tile, as it would contain every particle
+    unsigned int *tile_particles;
+    // The number of elements tile_particles has been allocated for
+    unsigned int tile_particles_capacity;
+    // Span storage, only used when options.span_coverage is set
+    // Exclusive prefix sum of the number of rows in each particle's clamped bounding box (particles_count + 1 elements)
+    unsigned int *span_index;
+    // The [x_start, x_end] span of pixels covered by each row of each particle's bounding box, empty rows store [0, -1]
+    int *spans;
+    // The number of rows spans has been allocated for
+    unsigned int spans_capacity;
+    // Streaming storage, only used when options.stream is set
+    // The remaining transmittance of each pixel, accumulated front to back
+    float *stream_transmittance_buffer;
+    // The depth rank of the deepest particle to be blended into each pixel, 0 blends every layer
+    unsigned int *stream_cutoff;
+    // The high bound of each pixel's colour (RGB), the low bound is blended directly into output_image
+    unsigned char *stream_high;
+    // Incremental storage, only used when options.incremental is set
+    CpuTile *incremental_tiles;
+    // Tile local exclusive prefix sum of each tile's pixel contributions, in row major order within the tile
+    // Each tile has (tile_width * tile_height + 1) elements, starting at tile * (tile_width * tile_height + 1)
+    unsigned int *incremental_index;
+    // Banded storage, only used when options.band_budget is set
+    // The bands reuse the tile index/particles to cull particles, and the histogram, index and contribution buffers for each band
+    // The number of contributions to each row, 64-bit as the image total may exceed 2^32
+    unsigned long long *band_row_contribs;
+    // The first row of each band, followed by the image height
+    int *band_first_row;
+    int bands_count;
+    // The number of rows which the band histogram and index have been allocated for
+    int band_rows_capacity;
+    // Storage for a band's rows of the output image, only used when options.band_sink is set
+    unsigned char *band_image;
+    // Persistent storage which every buffer is carved from when options.arena is set
+    // This is reset by cpu_begin(), and retained after cpu_end() so that the next run can reuse it
+    Arena arena;
+    // Treated as boolean, an allocation since cpu_begin() failed, so every stage fails until the next cpu_begin()
+    unsigned char alloc_failed;
+};
+
+///
+/// Options
+///
+const CpuOptions cpu_default_options = {
+    0,  // tile_size
+    0,  // span_coverage
+    0,  // presort
+    0,  // stream
+    SIMD_AUTO,  // simd
+    SIMD_BLEND_FLOAT,  // blend
+    0,  // arena
+    0,  // incremental
+    0,  // band_budget
+    0,  // band_sink
+    0,  // band_sink_user
+    0   // packed
+};
 
 ///
 /// Implementation
 ///
-void cpu_begin(const Particle* init_particles, const unsigned int init_particles_count,
+CpuContext *cpu_create() {
+    CpuContext *cpu = (CpuContext*)malloc(sizeof(CpuContext));
+    if (!cpu)
+        return 0;
+    memset(cpu, 0, sizeof(CpuContext));
+    cpu->options = cpu_default_options;
+    return cpu;
+}
+int cpu_begin(CpuContext *cpu, const CpuOptions *options, const Particle* init_particles, const unsigned int init_particles_count,
     const unsigned int out_image_width, const unsigned int out_image_height) {
-    // Allocate a opy of the initial particles, to be used during computation
-    cpu_particles_count = init_particles_count;
-    cpu_particles = malloc(init_particles_count * sizeof(Particle));
-    memcpy(cpu_particles, init_particles, init_particles_count * sizeof(Particle));
+    cpu->options = options ? *options : cpu_default_options;
+    cpu->alloc_failed = 0;
+    // Release the previous run's buffers for reuse
+    if (cpu->options.arena) {
+        cpu->arena.huge_pages = cpu->options.arena == 2;
+        arena_reset(&cpu->arena);
+    }
+    // Allocate a copy of the initial particles, to be used during computation
+    cpu->particles_count = init_particles_count;
+    cpu->particles = cpu_alloc(cpu, init_particles_count * sizeof(Particle));
+    // Allocate the structure of arrays copy
+    cpu->particle_x = (float*)cpu_alloc(cpu, init_particles_count * sizeof(float));
+    cpu->particle_y = (float*)cpu_alloc(cpu, init_particles_count * sizeof(float));
+    cpu->particle_depth = (float*)cpu_alloc(cpu, init_particles_count * sizeof(float));
+    cpu->particle_radius = (float*)cpu_alloc(cpu, init_particles_count * sizeof(float));
+    cpu->particle_colour = (unsigned char*)cpu_alloc(cpu, init_particles_count * 4 * sizeof(unsigned char));
+    // Allocate the depth sort's storage, it is retained so that cpu_update() can sort without allocating
+    if ((cpu->options.presort || cpu->options.stream) && !cpu->options.incremental) {
+        cpu->presort_depths = (float*)cpu_alloc(cpu, init_particles_count * sizeof(float));
+        cpu->presort_order = (unsigned int*)cpu_alloc(cpu, init_particles_count * sizeof(unsigned int));
+    } else {
+        cpu->presort_depths = 0;
+        cpu->presort_order = 0;
+    }
+    if (!cpu_alloc_check(cpu, "cpu_begin"))
+        return 0;
+    cpu_load_particles(cpu, init_particles);
+    // Select the vectorised kernels, and allocate the storage for a row's covered columns
+    cpu->simd = simd_kernels(cpu->options.simd, cpu->options.blend);
+    cpu->covered_x = (int*)cpu_alloc(cpu, (out_image_width + SIMD_ROW_PADDING) * sizeof(int));
+
+    // Allocate output image
+    cpu->output_image.width = (int)out_image_width;
+    cpu->output_image.height = (int)out_image_height;
+    cpu->output_image.channels = 3;  // RGB
+    // A banded render passing its rows to a sink never holds the full image
+    const int banded = cpu->options.band_budget && !cpu->options.stream && !cpu->options.incremental;
+    cpu->output_image.data = banded && cpu->options.band_sink ? 0 :
+        (unsigned char *)cpu_alloc(cpu, cpu->output_image.width * cpu->output_image.height * cpu->output_image.channels * sizeof(unsigned char));
+
+    if (cpu->options.stream) {
+        // Streaming requires only per pixel storage, the contribution, tile and span buffers are not used
+        cpu->stream_transmittance_buffer = (float*)cpu_alloc(cpu, out_image_width * out_image_height * sizeof(float));
+        cpu->stream_cutoff = (unsigned int*)cpu_alloc(cpu, out_image_width * out_image_height * sizeof(unsigned int));
+        cpu->stream_high = (unsigned char*)cpu_alloc(cpu, out_image_width * out_image_height * 3 * sizeof(unsigned char));
+        cpu->pixel_contribs = 0;
+        cpu->pixel_index = 0;
+        cpu->pixel_contrib_colours = 0;
+        cpu->pixel_contrib_depth = 0;
+        cpu->pixel_contrib_records = 0;
+        cpu->pixel_contrib_count = 0;
+        cpu->tile_index = 0;
+        cpu->tile_particles = 0;
+        cpu->tile_particles_capacity = 0;
+        cpu->span_index = 0;
+        cpu->spans = 0;
+        cpu->spans_capacity = 0;
+        return cpu_alloc_check(cpu, "cpu_begin");
+    }
+    cpu->stream_transmittance_buffer = 0;
+    cpu->stream_cutoff = 0;
+    cpu->stream_high = 0;
+
+    if (cpu->options.incremental) {
+        // Incremental rendering requires the histogram, and per tile storage in place of the contribution buffers
+        cpu->pixel_contribs = (unsigned int *)cpu_alloc(cpu, out_image_width * out_image_height * sizeof(unsigned int));
+        cpu->tile_width = cpu->options.tile_size ? (int)cpu->options.tile_size : CPU_INCREMENTAL_TILE;
+        cpu->tile_height = cpu->tile_width;
+        cpu->tiles_x = ((int)out_image_width + cpu->tile_width - 1) / cpu->tile_width;
+        cpu->tiles_y = ((int)out_image_height + cpu->tile_height - 1) / cpu->tile_height;
+        cpu->incremental_tiles = (CpuTile*)cpu_alloc(cpu, cpu->tiles_x * cpu->tiles_y * sizeof(CpuTile));
+        cpu->incremental_index = (unsigned int*)cpu_alloc(cpu, cpu->tiles_x * cpu->tiles_y * (cpu->tile_width * cpu->tile_height + 1) * sizeof(unsigned int));
+        if (cpu->incremental_tiles) {
+            memset(cpu->incremental_tiles, 0, cpu->tiles_x * cpu->tiles_y * sizeof(CpuTile));
+            if (!cpu->alloc_failed)
+                cpu_incremental_bin(cpu);
+        }
+        cpu->pixel_index = 0;
+        cpu->pixel_contrib_colours = 0;
+        cpu->pixel_contrib_depth = 0;
+        cpu->pixel_contrib_records = 0;
+        cpu->pixel_contrib_count = 0;
+        cpu->tile_index = 0;
+        cpu->tile_particles = 0;
+        cpu->tile_particles_capacity = 0;
+        cpu->span_index = 0;
+        cpu->spans = 0;
+        cpu->spans_capacity = 0;
+        return cpu_alloc_check(cpu, "cpu_begin");
+    }
+    cpu->incremental_tiles = 0;
+    cpu->incremental_index = 0;
+
+    if (banded) {
+        // Banded rendering allocates its per band storage in stage 1, once the bands are known
+        cpu->band_row_contribs = (unsigned long long*)cpu_alloc(cpu, out_image_height * sizeof(unsigned long long));
+        cpu->band_first_row = (int*)cpu_alloc(cpu, (out_image_height + 1) * sizeof(int));
+        cpu->tile_index = (unsigned int*)cpu_alloc(cpu, (out_image_height + 1) * sizeof(unsigned int));
+        cpu->bands_count = 0;
+        cpu->band_rows_capacity = 0;
+        cpu->band_image = 0;
+        cpu->pixel_contribs = 0;
+        cpu->pixel_index = 0;
+        cpu->pixel_contrib_colours = 0;
+        cpu->pixel_contrib_depth = 0;
+        cpu->pixel_contrib_records = 0;
+        cpu->pixel_contrib_count = 0;
+        cpu->tile_particles = 0;
+        cpu->tile_particles_capacity = 0;
+        cpu->span_index = 0;
+        cpu->spans = 0;
+        cpu->spans_capacity = 0;
+        return cpu_alloc_check(cpu, "cpu_begin");
+    }
+    cpu->band_row_contribs = 0;
+    cpu->band_first_row = 0;
+    cpu->band_image = 0;
 
     // Allocate a histogram to track how many particles contribute to each pixel
-    cpu_pixel_contribs = (unsigned int *)malloc(out_image_width * out_image_height * sizeof(unsigned int));
+    cpu->pixel_contribs = (unsigned int *)cpu_alloc(cpu, out_image_width * out_image_height * sizeof(unsigned int));
     // Allocate an index to track where data for each pixel's contributing colour starts/ends
-    cpu_pixel_index = (unsigned int*)malloc((out_image_width * out_image_height + 1) * sizeof(unsigned int));
+    cpu->pixel_index = (unsigned int*)cpu_alloc(cpu, (out_image_width * out_image_height + 1) * sizeof(unsigned int));
     // Init a buffer to store colours contributing to each pixel into (allocated in stage 2)
-    cpu_pixel_contrib_colours = 0;
+    cpu->pixel_contrib_colours = 0;
     // Init a buffer to store depth of colours contributing to each pixel into (allocated in stage 2)
-    cpu_pixel_contrib_depth = 0;
+    cpu->pixel_contrib_depth = 0;
+    // Init a buffer to store the packed records of each contribution into, in place of the above (allocated in stage 2)
+    cpu->pixel_contrib_records = 0;
     // This tracks the number of contributes the two above buffers are allocated for, init 0
-    cpu_pixel_contrib_count = 0;
+    cpu->pixel_contrib_count = 0;
 
-    // Allocate output image
-    cpu_output_image.width = (int)out_image_width;
-    cpu_output_image.height = (int)out_image_height;
-    cpu_output_image.channels = 3;  // RGB
-    cpu_output_image.data = (unsigned char *)malloc(cpu_output_image.width * cpu_output_image.height * cpu_output_image.channels * sizeof(unsigned char));
+    // Allocate the tile bin index, tile particle storage is allocated in stage 1
+    cpu->tile_width = cpu->options.tile_size ? (int)cpu->options.tile_size : (int)out_image_width;
+    cpu->tile_height = cpu->options.tile_size ? (int)cpu->options.tile_size : (int)out_image_height;
+    cpu->tiles_x = ((int)out_image_width + cpu->tile_width - 1) / cpu->tile_width;
+    cpu->tiles_y = ((int)out_image_height + cpu->tile_height - 1) / cpu->tile_height;
+    cpu->tile_index = (unsigned int*)cpu_alloc(cpu, (cpu->tiles_x * cpu->tiles_y + 1) * sizeof(unsigned int));
+    cpu->tile_particles = 0;
+    cpu->tile_particles_capacity = 0;
+
+    // Allocate the span index, span storage is allocated in stage 1
+    cpu->span_index = cpu->options.span_coverage ? (unsigned int*)cpu_alloc(cpu, (init_particles_count + 1) * sizeof(unsigned int)) : 0;
+    cpu->spans = 0;
+    cpu->spans_capacity = 0;
+    return cpu_alloc_check(cpu, "cpu_begin");
+}
+void cpu_update(CpuContext *cpu, const Particle *particles) {
+    if (cpu->alloc_failed)
+        return;
+    if (cpu->options.incremental) {
+        cpu_incremental_update(cpu, particles);
+        return;
+    }
+    cpu_load_particles(cpu, particles);
 }
-void cpu_stage1() {
+int cpu_stage1(CpuContext *cpu) {
+    if (cpu->alloc_failed)
+        return 0;
+    if (cpu->options.incremental) {
+        cpu_incremental_count(cpu);
+        return 1;
+    }
+    if (cpu->options.stream) {
+        cpu_stream_transmittance(cpu);
+        return 1;
+    }
+    if (cpu->band_first_row) {
+        const int planned = cpu_band_plan(cpu);
+        return cpu_alloc_check(cpu, "cpu_stage1") && planned;
+    }
     // Reset the pixel contributions histogram
-    memset(cpu_pixel_contribs, 0, cpu_output_image.width * cpu_output_image.height * sizeof(unsigned int));
-    // Update each particle & calculate how many particles contribute to each image
-    for (unsigned int i = 0; i < cpu_particles_count; ++i) {
-        // Compute bounding box [inclusive-inclusive]
-        int x_min = (int)roundf(cpu_particles[i].location[0] - cpu_particles[i].radius);
-        int y_min = (int)roundf(cpu_particles[i].location[1] - cpu_particles[i].radius);
-        int x_max = (int)roundf(cpu_particles[i].location[0] + cpu_particles[i].radius);
-        int y_max = (int)roundf(cpu_particles[i].location[1] + cpu_particles[i].radius);
-        // Clamp bounding box to image bounds
-        x_min = x_min < 0 ? 0 : x_min;
-        y_min = y_min < 0 ? 0 : y_min;
-        x_max = x_max >= cpu_output_image.width ? cpu_output_image.width - 1 : x_max;
-        y_max = y_max >= cpu_output_image.height ? cpu_output_image.height - 1 : y_max;
-        // For each pixel in the bounding box, check that it falls within the radius
-        for (int x = x_min; x <= x_max; ++x) {
-            for (int y = y_min; y <= y_max; ++y) {
-                const float x_ab = (float)x + 0.5f - cpu_particles[i].location[0];
-                const float y_ab = (float)y + 0.5f - cpu_particles[i].location[1];
-                const float pixel_distance = sqrtf(x_ab * x_ab + y_ab * y_ab);
-                if (pixel_distance <= cpu_particles[i].radius) {
-                    const unsigned int pixel_offset = y * cpu_output_image.width + x;
-                    ++cpu_pixel_contribs[pixel_offset];
-                }
+    memset(cpu->pixel_contribs, 0, cpu->output_image.width * cpu->output_image.height * sizeof(unsigned int));
+    // Bin particles into tiles, then count the contributions to one tile at a time
+    if (cpu->options.span_coverage) {
+        cpu_build_spans(cpu);
+    }
+    cpu_bin_particles(cpu);
+    if (!cpu_alloc_check(cpu, "cpu_stage1"))
+        return 0;
+    for (int t = 0; t < cpu->tiles_x * cpu->tiles_y; ++t) {
+        int tile_x_min, tile_y_min, tile_x_max, tile_y_max;
+        cpu_tile_bounds(cpu, t, &tile_x_min, &tile_y_min, &tile_x_max, &tile_y_max);
+        for (unsigned int j = cpu->tile_index[t]; j < cpu->tile_index[t + 1]; ++j) {
+            const unsigned int i = cpu_tile_particle(cpu, j);
+            int x_min, y_min, x_max, y_max;
+            if (!cpu_particle_bounds(cpu, i, &x_min, &y_min, &x_max, &y_max))
+                continue;
+            // Clip bounding box to the tile
+            const int row_offset = y_min < tile_y_min ? tile_y_min - y_min : 0;
+            x_min = x_min < tile_x_min ? tile_x_min : x_min;
+            y_min = y_min < tile_y_min ? tile_y_min : y_min;
+            x_max = x_max > tile_x_max ? tile_x_max : x_max;
+            y_max = y_max > tile_y_max ? tile_y_max : y_max;
+            if (cpu->options.span_coverage) {
+                cpu_count_spans(cpu, cpu->spans + 2 * (cpu->span_index[i] + row_offset), x_min, y_min, x_max, y_max);
+            } else {
+                cpu_count_contribs(cpu, i, x_min, y_min, x_max, y_max);
             }
         }
+        if (cpu->options.span_coverage) {
+            cpu_integrate_rows(cpu, tile_x_min, tile_y_min, tile_x_max, tile_y_max);
+        }
     }
 #ifdef VALIDATION
-    validate_pixel_contribs(cpu_particles, cpu_particles_count, cpu_pixel_contribs, cpu_output_image.width, cpu_output_image.height);
+    validate_pixel_contribs(cpu->particles, cpu->particles_count, cpu->pixel_contribs, cpu->output_image.width, cpu->output_image.height);
 #endif
+    return 1;
 }
-void cpu_stage2() {
+int cpu_stage2(CpuContext *cpu) {
+    if (cpu->alloc_failed)
+        return 0;
+    if (cpu->options.incremental) {
+        cpu_incremental_store(cpu);
+        return cpu_alloc_check(cpu, "cpu_stage2");
+    }
+    if (cpu->options.stream) {
+        cpu_stream_blend(cpu);
+        return 1;
+    }
+    if (cpu->band_first_row) {
+        cpu_band_render(cpu);
+        return 1;
+    }
     // Exclusive prefix sum across the histogram to create an index
-    cpu_pixel_index[0] = 0;
-    for (int i = 0; i < cpu_output_image.width * cpu_output_image.height; ++i) {
-        cpu_pixel_index[i + 1] = cpu_pixel_index[i] + cpu_pixel_contribs[i];
+    // The histogram is reset as it is scanned, ready to be used as a counter whilst storing
+    const unsigned long long total_contribs = scan_exclusive_reset_serial(cpu->pixel_contribs, cpu->pixel_index,
+        (size_t)cpu->output_image.width * cpu->output_image.height);
+    if (total_contribs > CPU_MAX_CONTRIBS) {
+        fprintf(stderr, "cpu_stage2() The image has too many contributions for a 32-bit index, use banded rendering (--band-budget).\n");
+        return 0;
     }
     // Recover the total from the index
-    const unsigned int TOTAL_CONTRIBS = cpu_pixel_index[cpu_output_image.width * cpu_output_image.height];
-    if (TOTAL_CONTRIBS > cpu_pixel_contrib_count) {
+    const unsigned int TOTAL_CONTRIBS = cpu->pixel_index[cpu->output_image.width * cpu->output_image.height];
+    if (TOTAL_CONTRIBS > cpu->pixel_contrib_count) {
         // (Re)Allocate colour storage
-        if (cpu_pixel_contrib_colours) free(cpu_pixel_contrib_colours);
-        if (cpu_pixel_contrib_depth) free(cpu_pixel_contrib_depth);
-        cpu_pixel_contrib_colours = (unsigned char*)malloc(TOTAL_CONTRIBS * 4 * sizeof(unsigned char));
-        cpu_pixel_contrib_depth = (float*)malloc(TOTAL_CONTRIBS * sizeof(float));
-        cpu_pixel_contrib_count = TOTAL_CONTRIBS;
+        if (cpu->pixel_contrib_colours) cpu_free(cpu, cpu->pixel_contrib_colours);
+        if (cpu->pixel_contrib_depth) cpu_free(cpu, cpu->pixel_contrib_depth);
+        if (cpu->pixel_contrib_records) cpu_free(cpu, cpu->pixel_contrib_records);
+        if (cpu->options.packed) {
+            cpu->pixel_contrib_records = (unsigned long long*)cpu_alloc(cpu, (size_t)TOTAL_CONTRIBS * sizeof(unsigned long long));
+        } else {
+            cpu->pixel_contrib_colours = (unsigned char*)cpu_alloc(cpu, TOTAL_CONTRIBS * 4 * sizeof(unsigned char));
+            cpu->pixel_contrib_depth = (float*)cpu_alloc(cpu, TOTAL_CONTRIBS * sizeof(float));
+        }
+        cpu->pixel_contrib_count = TOTAL_CONTRIBS;
+        if (!cpu_alloc_check(cpu, "cpu_stage2"))
+            return 0;
     }
 
-    // Reset the pixel contributions histogram
-    memset(cpu_pixel_contribs, 0, cpu_output_image.width * cpu_output_image.height * sizeof(unsigned int));
-    // Store colours according to index
-    // For each particle, store a copy of the colour/depth in cpu_pixel_contribs for each contributed pixel
-    for (unsigned int i = 0; i < cpu_particles_count; ++i) {
-        // Compute bounding box [inclusive-inclusive]
-        int x_min = (int)roundf(cpu_particles[i].location[0] - cpu_particles[i].radius);
-        int y_min = (int)roundf(cpu_particles[i].location[1] - cpu_particles[i].radius);
-        int x_max = (int)roundf(cpu_particles[i].location[0] + cpu_particles[i].radius);
-        int y_max = (int)roundf(cpu_particles[i].location[1] + cpu_particles[i].radius);
-        // Clamp bounding box to image bounds
-        x_min = x_min < 0 ? 0 : x_min;
-        y_min = y_min < 0 ? 0 : y_min;
-        x_max = x_max >= cpu_output_image.width ? cpu_output_image.width - 1 : x_max;
-        y_max = y_max >= cpu_output_image.height ? cpu_output_image.height - 1 : y_max;
-        // Store data for every pixel within the bounding box that falls within the radius
-        for (int x = x_min; x <= x_max; ++x) {
-            for (int y = y_min; y <= y_max; ++y) {
-                const float x_ab = (float)x + 0.5f - cpu_particles[i].location[0];
-                const float y_ab = (float)y + 0.5f - cpu_particles[i].location[1];
-                const float pixel_distance = sqrtf(x_ab * x_ab + y_ab * y_ab);
-                if (pixel_distance <= cpu_particles[i].radius) {
-                    const unsigned int pixel_offset = y * cpu_output_image.width + x;
-                    // Offset into cpu_pixel_contrib buffers is index + histogram
-                    // Increment cpu_pixel_contribs, so next contributor stores to correct offset
-                    const unsigned int storage_offset = cpu_pixel_index[pixel_offset] + (cpu_pixel_contribs[pixel_offset]++);
-                    // Copy data to cpu_pixel_contrib buffers
-                    memcpy(cpu_pixel_contrib_colours + (4 * storage_offset), cpu_particles[i].color, 4 * sizeof(unsigned char));
-                    memcpy(cpu_pixel_contrib_depth + storage_offset, &cpu_particles[i].location[2], sizeof(float));
+    // Store colours according to index, one tile at a time
+    // For each particle, store a copy of the colour/depth in pixel_contribs for each contributed pixel
+    for (int t = 0; t < cpu->tiles_x * cpu->tiles_y; ++t) {
+        int tile_x_min, tile_y_min, tile_x_max, tile_y_max;
+        cpu_tile_bounds(cpu, t, &tile_x_min, &tile_y_min, &tile_x_max, &tile_y_max);
+        for (unsigned int j = cpu->tile_index[t]; j < cpu->tile_index[t + 1]; ++j) {
+            const unsigned int i = cpu_tile_particle(cpu, j);
+            int x_min, y_min, x_max, y_max;
+            if (!cpu_particle_bounds(cpu, i, &x_min, &y_min, &x_max, &y_max))
+                continue;
+            // Clip bounding box to the tile
+            const int row_offset = y_min < tile_y_min ? tile_y_min - y_min : 0;
+            x_min = x_min < tile_x_min ? tile_x_min : x_min;
+            y_min = y_min < tile_y_min ? tile_y_min : y_min;
+            x_max = x_max > tile_x_max ? tile_x_max : x_max;
+            y_max = y_max > tile_y_max ? tile_y_max : y_max;
+            if (cpu->options.span_coverage) {
+                cpu_store_spans(cpu, i, cpu->spans + 2 * (cpu->span_index[i] + row_offset), x_min, y_min, x_max, y_max);
+            } else {
+                cpu_store_contribs(cpu, i, x_min, y_min, x_max, y_max);
+            }
+        }
+        // Pair sort the colours contributing to each of the tile's pixels based on ascending depth
+        // When tile binning is enabled, this occurs whilst the tile's contributions are still in cache
+        // Presorted particles are stored in depth order (binning preserves particle order), so need no sort
+        if (cpu->options.presort)
+            continue;
+        for (int y = tile_y_min; y <= tile_y_max; ++y) {
+            for (int x = tile_x_min; x <= tile_x_max; ++x) {
+                const int i = y * cpu->output_image.width + x;
+                if (cpu->pixel_contrib_records) {
+                    sort_records(cpu->pixel_contrib_records, cpu->pixel_index[i], cpu->pixel_index[i + 1] - 1);
+                } else {
+                    sort_pairs(
+                        cpu->pixel_contrib_depth,
+                        cpu->pixel_contrib_colours,
+                        cpu->pixel_index[i],
+                        cpu->pixel_index[i + 1] - 1
+                    );
                 }
             }
         }
     }
-
-    // Pair sort the colours contributing to each pixel based on ascending depth
-    for (int i = 0; i < cpu_output_image.width * cpu_output_image.height; ++i) {
-        // Pair sort the colours which contribute to a single pigment
-        cpu_sort_pairs(
-            cpu_pixel_contrib_depth,
-            cpu_pixel_contrib_colours,
-            cpu_pixel_index[i],
-            cpu_pixel_index[i + 1] - 1
-        );
-    }
 #ifdef VALIDATION
-    validate_pixel_index(cpu_pixel_contribs, cpu_pixel_index, cpu_output_image.width, cpu_output_image.height);
-    validate_sorted_pairs(cpu_particles, cpu_particles_count, cpu_pixel_index, cpu_output_image.width, cpu_output_image.height,
-        cpu_pixel_contrib_colours, cpu_pixel_contrib_depth);
+    validate_pixel_index(cpu->pixel_contribs, cpu->pixel_index, cpu->output_image.width, cpu->output_image.height);
+    // Packed records are only validated by the output image
+    if (!cpu->pixel_contrib_records) {
+        validate_sorted_pairs(cpu->particles, cpu->particles_count, cpu->pixel_index, cpu->output_image.width, cpu->output_image.height,
+            cpu->pixel_contrib_colours, cpu->pixel_contrib_depth);
+    }
 #endif
+    return 1;
 }
-void cpu_stage3() {
+int cpu_stage3(CpuContext *cpu) {
+    if (cpu->alloc_failed)
+        return 0;
+    if (cpu->options.incremental) {
+        cpu_incremental_blend(cpu);
+        return 1;
+    }
+    if (cpu->options.stream) {
+        cpu_stream_resolve(cpu);
+        return cpu_alloc_check(cpu, "cpu_stage3");
+    }
+    if (cpu->band_first_row) {
+        // Each band was blended as soon as it was sorted, as the band's buffers are reused by the next band
+        return 1;
+    }
     // Memset output image data to 255 (white)
-    memset(cpu_output_image.data, 255, cpu_output_image.width * cpu_output_image.height * cpu_output_image.channels * sizeof(unsigned char));
+    memset(cpu->output_image.data, 255, cpu->output_image.width * cpu->output_image.height * cpu->output_image.channels * sizeof(unsigned char));
 
     // Order dependent blending into output image
-    for (int i = 0; i < cpu_output_image.width * cpu_output_image.height; ++i) {
-        for (unsigned int j = cpu_pixel_index[i]; j < cpu_pixel_index[i + 1]; ++j) {
-            // Blend each of the red/green/blue colours according to the below blend formula
-            // dest = src * opacity + dest * (1 - opacity);
-            const float opacity = (float)cpu_pixel_contrib_colours[j * 4 + 3]/ (float)255;
-            cpu_output_image.data[(i * 3) + 0] = (unsigned char)((float)cpu_pixel_contrib_colours[j * 4 + 0] * opacity + (float)cpu_output_image.data[(i * 3) + 0] * (1 - opacity));
-            cpu_output_image.data[(i * 3) + 1] = (unsigned char)((float)cpu_pixel_contrib_colours[j * 4 + 1] * opacity + (float)cpu_output_image.data[(i * 3) + 1] * (1 - opacity));
-            cpu_output_image.data[(i * 3) + 2] = (unsigned char)((float)cpu_pixel_contrib_colours[j * 4 + 2] * opacity + (float)cpu_output_image.data[(i * 3) + 2] * (1 - opacity));
-            // cpu_pixel_contrib_colours is RGBA
-            // cpu_output_image.data is RGB (final output image does not have an alpha channel!)
-        }
+    // dest = src * opacity + dest * (1 - opacity), see simd_blend_scalar()
+    // pixel_contrib_colours is RGBA
+    // output_image.data is RGB (final output image does not have an alpha channel!)
+    if (cpu->pixel_contrib_records) {
+        cpu->simd.blend_records(cpu->pixel_index, cpu->pixel_contrib_records, cpu->output_image.data, 0, cpu->output_image.width * cpu->output_image.height - 1);
+        return 1;
     }
+    cpu->simd.blend(cpu->pixel_index, cpu->pixel_contrib_colours, cpu->output_image.data, 0, cpu->output_image.width * cpu->output_image.height - 1);
 #ifdef VALIDATION
-    validate_blend(cpu_pixel_index, cpu_pixel_contrib_colours, &cpu_output_image);
+    validate_blend(cpu->pixel_index, cpu->pixel_contrib_colours, &cpu->output_image);
 #endif
+    return 1;
+}
+void cpu_output(CpuContext *cpu, CImage *output_image) {
+    output_image->width = cpu->output_image.width;
+    output_image->height = cpu->output_image.height;
+    output_image->channels = cpu->output_image.channels;
+    if (!cpu->output_image.data || !output_image->data)
+        return;
+    memcpy(output_image->data, cpu->output_image.data, cpu->output_image.width * cpu->output_image.height * cpu->output_image.channels * sizeof(unsigned char));
 }
-void cpu_end(CImage *output_image) {
+void cpu_end(CpuContext *cpu, CImage *output_image) {
     // Store return value
-    output_image->width = cpu_output_image.width;
-    output_image->height = cpu_output_image.height;
-    output_image->channels = cpu_output_image.channels;
-    memcpy(output_image->data, cpu_output_image.data, cpu_output_image.width * cpu_output_image.height * cpu_output_image.channels * sizeof(unsigned char));
+    cpu_output(cpu, output_image);
     // Release allocations
-    free(cpu_pixel_contrib_depth);
-    free(cpu_pixel_contrib_colours);
-    free(cpu_output_image.data);
-    free(cpu_pixel_index);
-    free(cpu_pixel_contribs);
-    free(cpu_particles);
+    if (cpu->incremental_tiles) {
+        for (int t = 0; t < cpu->tiles_x * cpu->tiles_y; ++t) {
+            cpu_free(cpu, cpu->incremental_tiles[t].contrib_depth);
+            cpu_free(cpu, cpu->incremental_tiles[t].contrib_colours);
+            cpu_free(cpu, cpu->incremental_tiles[t].particles);
+        }
+    }
+    cpu_free(cpu, cpu->band_image);
+    cpu_free(cpu, cpu->band_first_row);
+    cpu_free(cpu, cpu->band_row_contribs);
+    cpu_free(cpu, cpu->incremental_index);
+    cpu_free(cpu, cpu->incremental_tiles);
+    cpu_free(cpu, cpu->presort_order);
+    cpu_free(cpu, cpu->presort_depths);
+    cpu_free(cpu, cpu->stream_high);
+    cpu_free(cpu, cpu->stream_cutoff);
+    cpu_free(cpu, cpu->stream_transmittance_buffer);
+    cpu_free(cpu, cpu->spans);
+    cpu_free(cpu, cpu->span_index);
+    cpu_free(cpu, cpu->tile_particles);
+    cpu_free(cpu, cpu->tile_index);
+    cpu_free(cpu, cpu->pixel_contrib_records);
+    cpu_free(cpu, cpu->pixel_contrib_depth);
+    cpu_free(cpu, cpu->pixel_contrib_colours);
+    cpu_free(cpu, cpu->output_image.data);
+    cpu_free(cpu, cpu->pixel_index);
+    cpu_free(cpu, cpu->pixel_contribs);
+    cpu_free(cpu, cpu->covered_x);
+    cpu_free(cpu, cpu->particle_colour);
+    cpu_free(cpu, cpu->particle_radius);
+    cpu_free(cpu, cpu->particle_depth);
+    cpu_free(cpu, cpu->particle_y);
+    cpu_free(cpu, cpu->particle_x);
+    cpu_free(cpu, cpu->particles);
     // Return ptrs to nullptr
-    cpu_pixel_contrib_depth = 0;
-    cpu_pixel_contrib_colours = 0;
-    cpu_output_image.data = 0;
-    cpu_pixel_index = 0;
-    cpu_pixel_contribs = 0;
-    cpu_particles = 0;
-}
-
-void cpu_sort_pairs(float* keys_start, unsigned char* colours_start, const int first, const int last) {
-    // Based on https://www.tutorialspoint.com/explain-the-quick-sort-technique-in-c-language
-    int i, j, pivot;
-    float depth_t;
-    unsigned char color_t[4];
-    if (first < last) {
-        pivot = first;
-        i = first;
-        j = last;
-        while (i < j) {
-            while (keys_start[i] <= keys_start[pivot] && i < last)
-                i++;
-            while (keys_start[j] > keys_start[pivot])
-                j--;
-            if (i < j) {
-                // Swap key
-                depth_t = keys_start[i];
-                keys_start[i] = keys_start[j];
-                keys_start[j] = depth_t;
-                // Swap color
-                memcpy(color_t, colours_start + (4 * i), 4 * sizeof(unsigned char));
-                memcpy(colours_start + (4 * i), colours_start + (4 * j), 4 * sizeof(unsigned char));
-                memcpy(colours_start + (4 * j), color_t, 4 * sizeof(unsigned char));
-            }
-        }
-        // Swap key
-        depth_t = keys_start[pivot];
-        keys_start[pivot] = keys_start[j];
-        keys_start[j] = depth_t;
-        // Swap color
-        memcpy(color_t, colours_start + (4 * pivot), 4 * sizeof(unsigned char));
-        memcpy(colours_start + (4 * pivot), colours_start + (4 * j), 4 * sizeof(unsigned char));
-        memcpy(colours_start + (4 * j), color_t, 4 * sizeof(unsigned char));
-        // Recurse
-        cpu_sort_pairs(keys_start, colours_start, first, j - 1);
-        cpu_sort_pairs(keys_start, colours_start, j + 1, last);
+    cpu->stream_high = 0;
+    cpu->stream_cutoff = 0;
+    cpu->stream_transmittance_buffer = 0;
+    cpu->spans = 0;
+    cpu->span_index = 0;
+    cpu->tile_particles = 0;
+    cpu->tile_index = 0;
+    cpu->pixel_contrib_records = 0;
+    cpu->pixel_contrib_depth = 0;
+    cpu->pixel_contrib_colours = 0;
+    cpu->output_image.data = 0;
+    cpu->pixel_index = 0;
+    cpu->pixel_contribs = 0;
+    cpu->band_image = 0;
+    cpu->band_first_row = 0;
+    cpu->band_row_contribs = 0;
+    cpu->incremental_index = 0;
+    cpu->incremental_tiles = 0;
+    cpu->presort_order = 0;
+    cpu->presort_depths = 0;
+    cpu->covered_x = 0;
+    cpu->particle_colour = 0;
+    cpu->particle_radius = 0;
+    cpu->particle_depth = 0;
+    cpu->particle_y = 0;
+    cpu->particle_x = 0;
+    cpu->particles = 0;
+}
+void cpu_release(CpuContext *cpu) {
+    arena_release(&cpu->arena);
+}
+void cpu_destroy(CpuContext *cpu) {
+    if (!cpu)
+        return;
+    cpu_release(cpu);
+    free(cpu);
+}
+
+static void *cpu_alloc(CpuContext *cpu, const size_t size) {
+    void *ptr = cpu->options.arena ? arena_alloc(&cpu->arena, size) : malloc(size);
+    if (!ptr && size)
+        cpu->alloc_failed = 1;
+    return ptr;
+}
+static void cpu_free(CpuContext *cpu, void *ptr) {
+    if (!cpu->options.arena)
+        free(ptr);
+}
+static int cpu_alloc_check(CpuContext *cpu, const char *caller) {
+    if (!cpu->alloc_failed)
+        return 1;
+    fprintf(stderr, "%s() Unable to allocate memory to render %u particles to a %dx%d image.\n",
+        caller, cpu->particles_count, cpu->output_image.width, cpu->output_image.height);
+    return 0;
+}
+static void cpu_load_particles(CpuContext *cpu, const Particle *particles) {
+    if ((cpu->options.presort || cpu->options.stream) && !cpu->options.incremental && cpu->particles_count) {
+        // Sort the particles by depth, so that every pixel receives its contributions in ascending depth order
+        for (unsigned int i = 0; i < cpu->particles_count; ++i) {
+            cpu->presort_depths[i] = particles[i].location[2];
+        }
+        sort_index_radix(cpu->presort_depths, cpu->particles_count, cpu->presort_order);
+        for (unsigned int i = 0; i < cpu->particles_count; ++i) {
+            memcpy(&cpu->particles[i], &particles[cpu->presort_order[i]], sizeof(Particle));
+        }
+    } else {
+        memcpy(cpu->particles, particles, cpu->particles_count * sizeof(Particle));
+    }
+    // Split the particles into a structure of arrays
+    for (unsigned int i = 0; i < cpu->particles_count; ++i) {
+        cpu_split_particle(cpu, i);
+    }
+}
+static void cpu_split_particle(CpuContext *cpu, const unsigned int i) {
+    cpu->particle_x[i] = cpu->particles[i].location[0];
+    cpu->particle_y[i] = cpu->particles[i].location[1];
+    cpu->particle_depth[i] = cpu->particles[i].location[2];
+    cpu->particle_radius[i] = cpu->particles[i].radius;
+    memcpy(cpu->particle_colour + (4 * i), cpu->particles[i].color, 4 * sizeof(unsigned char));
+}
+static int cpu_particle_bounds(CpuContext *cpu, const unsigned int i, int *x_min, int *y_min, int *x_max, int *y_max) {
+    // Compute bounding box [inclusive-inclusive]
+    *x_min = (int)roundf(cpu->particle_x[i] - cpu->particle_radius[i]);
+    *y_min = (int)roundf(cpu->particle_y[i] - cpu->particle_radius[i]);
+    *x_max = (int)roundf(cpu->particle_x[i] + cpu->particle_radius[i]);
+    *y_max = (int)roundf(cpu->particle_y[i] + cpu->particle_radius[i]);
+    // Clamp bounding box to image bounds
+    *x_min = *x_min < 0 ? 0 : *x_min;
+    *y_min = *y_min < 0 ? 0 : *y_min;
+    *x_max = *x_max >= cpu->output_image.width ? cpu->output_image.width - 1 : *x_max;
+    *y_max = *y_max >= cpu->output_image.height ? cpu->output_image.height - 1 : *y_max;
+    return *x_min <= *x_max && *y_min <= *y_max;
+}
+static void cpu_count_contribs(CpuContext *cpu, const unsigned int i, const int x_min, const int y_min, const int x_max, const int y_max) {
+    // For each row in the region, find the pixels which fall within the radius
+    for (int y = y_min; y <= y_max; ++y) {
+        const float y_ab = (float)y + 0.5f - cpu->particle_y[i];
+        const int covered = cpu->simd.row_covered(x_min, x_max, cpu->particle_x[i], y_ab, cpu->particle_radius[i], cpu->covered_x);
+        unsigned int *row = cpu->pixel_contribs + y * cpu->output_image.width;
+        for (int k = 0; k < covered; ++k) {
+            ++row[cpu->covered_x[k]];
+        }
+    }
+}
+static void cpu_store_contribs(CpuContext *cpu, const unsigned int i, const int x_min, const int y_min, const int x_max, const int y_max) {
+    const unsigned long long record = cpu_particle_record(cpu, i);
+    // Store data for every pixel within the region that falls within the radius
+    for (int y = y_min; y <= y_max; ++y) {
+        const float y_ab = (float)y + 0.5f - cpu->particle_y[i];
+        const int covered = cpu->simd.row_covered(x_min, x_max, cpu->particle_x[i], y_ab, cpu->particle_radius[i], cpu->covered_x);
+        for (int k = 0; k < covered; ++k) {
+            const unsigned int pixel_offset = y * cpu->output_image.width + cpu->covered_x[k];
+            // Offset into pixel_contrib buffers is index + histogram
+            // Increment pixel_contribs, so next contributor stores to correct offset
+            const unsigned int storage_offset = cpu->pixel_index[pixel_offset] + (cpu->pixel_contribs[pixel_offset]++);
+            // Copy data to pixel_contrib buffers
+            if (cpu->pixel_contrib_records) {
+                cpu->pixel_contrib_records[storage_offset] = record;
+            } else {
+                memcpy(cpu->pixel_contrib_colours + (4 * storage_offset), cpu->particle_colour + (4 * i), 4 * sizeof(unsigned char));
+                cpu->pixel_contrib_depth[storage_offset] = cpu->particle_depth[i];
+            }
+        }
+    }
+}
+static unsigned long long cpu_particle_record(CpuContext *cpu, const unsigned int i) {
+    unsigned int colour;
+    memcpy(&colour, cpu->particle_colour + (4 * i), sizeof(unsigned int));
+    return ((unsigned long long)sort_key_bits(cpu->particle_depth[i]) << 32) | colour;
+}
+static int cpu_pixel_covered(CpuContext *cpu, const unsigned int i, const int x, const float y_ab) {
+    // Same coverage test as cpu_count_contribs(), so that spans are bit identical to testing every pixel
+    const float x_ab = (float)x + 0.5f - cpu->particle_x[i];
+    const float pixel_distance = sqrtf(x_ab * x_ab + y_ab * y_ab);
+    return pixel_distance <= cpu->particle_radius[i];
+}
+static int cpu_row_span(CpuContext *cpu, const unsigned int i, const int y, const int x_min, const int x_max, int *x_start, int *x_end) {
+    const float y_ab = (float)y + 0.5f - cpu->particle_y[i];
+    // Coverage only decreases moving away from the particle's centre column
+    // So if no pixel adjacent to the centre column (within the bounding box) is covered, no pixel in the row is
+    int seed = (int)floorf(cpu->particle_x[i]);
+    seed = seed < x_min ? x_min : (seed > x_max ? x_max : seed);
+    if (!cpu_pixel_covered(cpu, i, seed, y_ab)) {
+        if (seed > x_min && cpu_pixel_covered(cpu, i, seed - 1, y_ab)) {
+            --seed;
+        } else if (seed < x_max && cpu_pixel_covered(cpu, i, seed + 1, y_ab)) {
+            ++seed;
+        } else {
+            return 0;
+        }
+    }
+    // Estimate the edges of the span from the half chord length at the row's pixel centres
+    const float half_chord_sq = cpu->particle_radius[i] * cpu->particle_radius[i] - y_ab * y_ab;
+    const float half_chord = half_chord_sq > 0 ? sqrtf(half_chord_sq) : 0;
+    int start = (int)ceilf(cpu->particle_x[i] - half_chord - 0.5f);
+    int end = (int)floorf(cpu->particle_x[i] + half_chord - 0.5f);
+    start = start < x_min ? x_min : (start > seed ? seed : start);
+    end = end > x_max ? x_max : (end < seed ? seed : end);
+    // Correct the estimate by at most a pixel or two, as the covered pixels are contiguous and include seed
+    while (!cpu_pixel_covered(cpu, i, start, y_ab))
+        ++start;
+    while (start > x_min && cpu_pixel_covered(cpu, i, start - 1, y_ab))
+        --start;
+    while (!cpu_pixel_covered(cpu, i, end, y_ab))
+        --end;
+    while (end < x_max && cpu_pixel_covered(cpu, i, end + 1, y_ab))
+        ++end;
+    *x_start = start;
+    *x_end = end;
+    return 1;
+}
+static void cpu_build_spans(CpuContext *cpu) {
+    int x_min, y_min, x_max, y_max;
+    // Count the rows of each particle's bounding box
+    unsigned int total_rows = 0;
+    for (unsigned int i = 0; i < cpu->particles_count; ++i) {
+        cpu->span_index[i] = total_rows;
+        if (cpu_particle_bounds(cpu, i, &x_min, &y_min, &x_max, &y_max)) {
+            total_rows += y_max - y_min + 1;
+        }
+    }
+    cpu->span_index[cpu->particles_count] = total_rows;
+    if (total_rows > cpu->spans_capacity) {
+        // (Re)Allocate span storage
+        if (cpu->spans) cpu_free(cpu, cpu->spans);
+        cpu->spans = (int*)cpu_alloc(cpu, total_rows * 2 * sizeof(int));
+        cpu->spans_capacity = total_rows;
+        if (!cpu->spans)
+            return;
+    }
+    // Calculate the span of each row
+    for (unsigned int i = 0; i < cpu->particles_count; ++i) {
+        if (cpu_particle_bounds(cpu, i, &x_min, &y_min, &x_max, &y_max)) {
+            int *row_spans = cpu->spans + 2 * cpu->span_index[i];
+            for (int y = y_min; y <= y_max; ++y, row_spans += 2) {
+                if (!cpu_row_span(cpu, i, y, x_min, x_max, &row_spans[0], &row_spans[1])) {
+                    row_spans[0] = 0;
+                    row_spans[1] = -1;
+                }
+            }
+        }
+    }
+}
+static void cpu_count_spans(CpuContext *cpu, const int *row_spans, const int x_min, const int y_min, const int x_max, const int y_max) {
+    // Difference array, mark the start of each span and one past its end (if within the region)
+    for (int y = y_min; y <= y_max; ++y, row_spans += 2) {
+        const int x_start = row_spans[0] < x_min ? x_min : row_spans[0];
+        const int x_end = row_spans[1] > x_max ? x_max : row_spans[1];
+        if (x_start <= x_end) {
+            ++cpu->pixel_contribs[y * cpu->output_image.width + x_start];
+            if (x_end < x_max) {
+                --cpu->pixel_contribs[y * cpu->output_image.width + x_end + 1];
+            }
+        }
+    }
+}
+static void cpu_integrate_rows(CpuContext *cpu, const int x_min, const int y_min, const int x_max, const int y_max) {
+    for (int y = y_min; y <= y_max; ++y) {
+        unsigned int *row = cpu->pixel_contribs + y * cpu->output_image.width;
+        unsigned int sum = 0;
+        for (int x = x_min; x <= x_max; ++x) {
+            sum += row[x];
+            row[x] = sum;
+        }
+    }
+}
+static void cpu_store_spans(CpuContext *cpu, const unsigned int i, const int *row_spans, const int x_min, const int y_min, const int x_max, const int y_max) {
+    const unsigned long long record = cpu_particle_record(cpu, i);
+    // Store data for every pixel of each span within the region
+    for (int y = y_min; y <= y_max; ++y, row_spans += 2) {
+        const int x_start = row_spans[0] < x_min ? x_min : row_spans[0];
+        const int x_end = row_spans[1] > x_max ? x_max : row_spans[1];
+        for (int x = x_start; x <= x_end; ++x) {
+            const unsigned int pixel_offset = y * cpu->output_image.width + x;
+            const unsigned int storage_offset = cpu->pixel_index[pixel_offset] + (cpu->pixel_contribs[pixel_offset]++);
+            if (cpu->pixel_contrib_records) {
+                cpu->pixel_contrib_records[storage_offset] = record;
+            } else {
+                memcpy(cpu->pixel_contrib_colours + (4 * storage_offset), cpu->particle_colour + (4 * i), 4 * sizeof(unsigned char));
+                cpu->pixel_contrib_depth[storage_offset] = cpu->particle_depth[i];
+            }
+        }
+    }
+}
+static void cpu_bin_particles(CpuContext *cpu) {
+    const int TILES = cpu->tiles_x * cpu->tiles_y;
+    int x_min, y_min, x_max, y_max;
+    if (TILES == 1) {
+        // The single tile implicitly contains every particle, those outside the image are skipped when clamped
+        cpu->tile_index[0] = 0;
+        cpu->tile_index[1] = cpu->particles_count;
+        return;
+    }
+    // Count the particles overlapping each tile
+    memset(cpu->tile_index, 0, (TILES + 1) * sizeof(unsigned int));
+    for (unsigned int i = 0; i < cpu->particles_count; ++i) {
+        if (cpu_particle_bounds(cpu, i, &x_min, &y_min, &x_max, &y_max)) {
+            for (int ty = y_min / cpu->tile_height; ty <= y_max / cpu->tile_height; ++ty) {
+                for (int tx = x_min / cpu->tile_width; tx <= x_max / cpu->tile_width; ++tx) {
+                    ++cpu->tile_index[ty * cpu->tiles_x + tx + 1];
+                }
+            }
+        }
+    }
+    // Inclusive prefix sum (offset by 1) to convert counts to an exclusive index
+    for (int t = 0; t < TILES; ++t) {
+        cpu->tile_index[t + 1] += cpu->tile_index[t];
+    }
+    const unsigned int TOTAL_ENTRIES = cpu->tile_index[TILES];
+    if (TOTAL_ENTRIES > cpu->tile_particles_capacity) {
+        // (Re)Allocate tile storage
+        if (cpu->tile_particles) cpu_free(cpu, cpu->tile_particles);
+        cpu->tile_particles = (unsigned int*)cpu_alloc(cpu, TOTAL_ENTRIES * sizeof(unsigned int));
+        cpu->tile_particles_capacity = TOTAL_ENTRIES;
+        if (!cpu->tile_particles)
+            return;
+    }
+    // Store each particle's index to the tiles it overlaps, using the start of each tile's range as a counter
+    for (unsigned int i = 0; i < cpu->particles_count; ++i) {
+        if (cpu_particle_bounds(cpu, i, &x_min, &y_min, &x_max, &y_max)) {
+            for (int ty = y_min / cpu->tile_height; ty <= y_max / cpu->tile_height; ++ty) {
+                for (int tx = x_min / cpu->tile_width; tx <= x_max / cpu->tile_width; ++tx) {
+                    cpu->tile_particles[cpu->tile_index[ty * cpu->tiles_x + tx]++] = i;
+                }
+            }
+        }
+    }
+    // Each tile's start was advanced to its end (the next tile's start), shift the index back by one tile
+    memmove(cpu->tile_index + 1, cpu->tile_index, TILES * sizeof(unsigned int));
+    cpu->tile_index[0] = 0;
+}
+static void cpu_tile_bounds(CpuContext *cpu, const int tile, int *x_min, int *y_min, int *x_max, int *y_max) {
+    *x_min = (tile % cpu->tiles_x) * cpu->tile_width;
+    *y_min = (tile / cpu->tiles_x) * cpu->tile_height;
+    *x_max = *x_min + cpu->tile_width - 1;
+    *y_max = *y_min + cpu->tile_height - 1;
+    // Clamp the final row/column of tiles to image bounds
+    *x_max = *x_max >= cpu->output_image.width ? cpu->output_image.width - 1 : *x_max;
+    *y_max = *y_max >= cpu->output_image.height ? cpu->output_image.height - 1 : *y_max;
+}
+static unsigned int cpu_tile_particle(CpuContext *cpu, const unsigned int j) {
+    return cpu->tile_particles ? cpu->tile_particles[j] : j;
+}
+static void cpu_stream_transmittance(CpuContext *cpu) {
+    const int PIXELS = cpu->output_image.width * cpu->output_image.height;
+    for (int i = 0; i < PIXELS; ++i) {
+        cpu->stream_transmittance_buffer[i] = 1.0f;
+        cpu->stream_cutoff[i] = 0;
+    }
+    // Particles are sorted by ascending depth, so iterate in reverse to visit them front to back
+    for (unsigned int r = cpu->particles_count; r-- > 0;) {
+        int x_min, y_min, x_max, y_max;
+        if (!cpu_particle_bounds(cpu, r, &x_min, &y_min, &x_max, &y_max))
+            continue;
+        const float transparency = 1 - (float)cpu->particle_colour[(r * 4) + 3] / (float)255;
+        for (int y = y_min; y <= y_max; ++y) {
+            int x_start, x_end;
+            if (!cpu_row_span(cpu, r, y, x_min, x_max, &x_start, &x_end))
+                continue;
+            for (int x = x_start; x <= x_end; ++x) {
+                const unsigned int pixel_offset = y * cpu->output_image.width + x;
+                // Skip pixels which have already saturated
+                if (cpu->stream_transmittance_buffer[pixel_offset] <= CPU_STREAM_TRANSMITTANCE)
+                    continue;
+                cpu->stream_transmittance_buffer[pixel_offset] *= transparency;
+                if (cpu->stream_transmittance_buffer[pixel_offset] <= CPU_STREAM_TRANSMITTANCE) {
+                    cpu->stream_cutoff[pixel_offset] = r;
+                }
+            }
+        }
+    }
+}
+static void cpu_stream_blend(CpuContext *cpu) {
+    const int PIXELS = cpu->output_image.width * cpu->output_image.height;
+    // The low bound starts from black beneath a cutoff, otherwise both bounds start from the white background
+    for (int i = 0; i < PIXELS; ++i) {
+        const unsigned char low = cpu->stream_cutoff[i] ? 0 : 255;
+        cpu->output_image.data[(i * 3) + 0] = low;
+        cpu->output_image.data[(i * 3) + 1] = low;
+        cpu->output_image.data[(i * 3) + 2] = low;
+    }
+    memset(cpu->stream_high, 255, PIXELS * 3 * sizeof(unsigned char));
+    for (unsigned int r = 0; r < cpu->particles_count; ++r) {
+        int x_min, y_min, x_max, y_max;
+        if (!cpu_particle_bounds(cpu, r, &x_min, &y_min, &x_max, &y_max))
+            continue;
+        const float opacity = (float)cpu->particle_colour[(r * 4) + 3] / (float)255;
+        for (int y = y_min; y <= y_max; ++y) {
+            int x_start, x_end;
+            if (!cpu_row_span(cpu, r, y, x_min, x_max, &x_start, &x_end))
+                continue;
+            for (int x = x_start; x <= x_end; ++x) {
+                const unsigned int i = y * cpu->output_image.width + x;
+                // Skip layers beneath the pixel's cutoff
+                if (r < cpu->stream_cutoff[i])
+                    continue;
+                // Blend both bounds with the same formula as stage 3
+                for (int ch = 0; ch < 3; ++ch) {
+                    cpu->output_image.data[(i * 3) + ch] = (unsigned char)((float)cpu->particle_colour[(r * 4) + ch] * opacity + (float)cpu->output_image.data[(i * 3) + ch] * (1 - opacity));
+                    cpu->stream_high[(i * 3) + ch] = (unsigned char)((float)cpu->particle_colour[(r * 4) + ch] * opacity + (float)cpu->stream_high[(i * 3) + ch] * (1 - opacity));
+                }
+            }
+        }
+    }
+}
+static void cpu_stream_resolve(CpuContext *cpu) {
+    const int PIXELS = cpu->output_image.width * cpu->output_image.height;
+    // The blend is monotonic in the colour beneath, so the exact result lies within the bounds
+    int unresolved = 0;
+    for (int i = 0; i < PIXELS; ++i) {
+        int resolved = 1;
+        for (int ch = 0; ch < 3; ++ch) {
+            resolved &= cpu->stream_high[(i * 3) + ch] - cpu->output_image.data[(i * 3) + ch] <= 2;
+        }
+        if (resolved) {
+            for (int ch = 0; ch < 3; ++ch) {
+                cpu->output_image.data[(i * 3) + ch] = (unsigned char)((cpu->output_image.data[(i * 3) + ch] + cpu->stream_high[(i * 3) + ch]) / 2);
+            }
+            // Pixels which are already resolved are skipped if reblending
+            cpu->stream_cutoff[i] = cpu->particles_count;
+        } else {
+            // Reblend this pixel from the background
+            cpu->stream_cutoff[i] = 0;
+            ++unresolved;
+        }
+    }
+    if (!unresolved)
+        return;
+    // Backup the resolved pixels, as cpu_stream_blend() resets the image
+    unsigned char *resolved_image = (unsigned char*)cpu_alloc(cpu, PIXELS * 3 * sizeof(unsigned char));
+    if (!resolved_image)
+        return;
+    memcpy(resolved_image, cpu->output_image.data, PIXELS * 3 * sizeof(unsigned char));
+    cpu_stream_blend(cpu);
+    for (int i = 0; i < PIXELS; ++i) {
+        if (cpu->stream_cutoff[i]) {
+            memcpy(cpu->output_image.data + (i * 3), resolved_image + (i * 3), 3 * sizeof(unsigned char));
+        }
+    }
+    cpu_free(cpu, resolved_image);
+}
+static void cpu_incremental_bin(CpuContext *cpu) {
+    // Particles are visited in ascending order, so each is appended to the end of its tiles' lists
+    for (unsigned int i = 0; i < cpu->particles_count; ++i) {
+        cpu_incremental_add(cpu, i);
+    }
+    // Tiles without particles must also be rendered once, to clear them to the background
+    for (int t = 0; t < cpu->tiles_x * cpu->tiles_y; ++t) {
+        cpu->incremental_tiles[t].dirty = 1;
+    }
+}
+static void cpu_incremental_update(CpuContext *cpu, const Particle *particles) {
+    for (unsigned int i = 0; i < cpu->particles_count; ++i) {
+        if (!memcmp(&cpu->particles[i], &particles[i], sizeof(Particle)))
+            continue;
+        // Remove using the old bounding box, before replacing the particle
+        cpu_incremental_remove(cpu, i);
+        memcpy(&cpu->particles[i], &particles[i], sizeof(Particle));
+        cpu_split_particle(cpu, i);
+        cpu_incremental_add(cpu, i);
+    }
+}
+static void cpu_incremental_add(CpuContext *cpu, const unsigned int i) {
+    int x_min, y_min, x_max, y_max;
+    if (!cpu_particle_bounds(cpu, i, &x_min, &y_min, &x_max, &y_max))
+        return;
+    for (int ty = y_min / cpu->tile_height; ty <= y_max / cpu->tile_height; ++ty) {
+        for (int tx = x_min / cpu->tile_width; tx <= x_max / cpu->tile_width; ++tx) {
+            CpuTile *tile = &cpu->incremental_tiles[ty * cpu->tiles_x + tx];
+            if (tile->particles_count == tile->particles_capacity) {
+                // Grow the tile's list by doubling
+                const unsigned int capacity = tile->particles_capacity ? tile->particles_capacity * 2 : 16;
+                unsigned int *particles = (unsigned int*)cpu_alloc(cpu, capacity * sizeof(unsigned int));
+                if (!particles)
+                    return;
+                if (tile->particles) {
+                    memcpy(particles, tile->particles, tile->particles_count * sizeof(unsigned int));
+                    cpu_free(cpu, tile->particles);
+                }
+                tile->particles = particles;
+                tile->particles_capacity = capacity;
+            }
+            // Keep the list in ascending order, so contributions are stored in the same order as a full render
+            const unsigned int j = cpu_incremental_find(cpu, tile, i);
+            memmove(tile->particles + j + 1, tile->particles + j, (tile->particles_count - j) * sizeof(unsigned int));
+            tile->particles[j] = i;
+            ++tile->particles_count;
+            tile->dirty = 1;
+        }
+    }
+}
+static void cpu_incremental_remove(CpuContext *cpu, const unsigned int i) {
+    int x_min, y_min, x_max, y_max;
+    if (!cpu_particle_bounds(cpu, i, &x_min, &y_min, &x_max, &y_max))
+        return;
+    for (int ty = y_min / cpu->tile_height; ty <= y_max / cpu->tile_height; ++ty) {
+        for (int tx = x_min / cpu->tile_width; tx <= x_max / cpu->tile_width; ++tx) {
+            CpuTile *tile = &cpu->incremental_tiles[ty * cpu->tiles_x + tx];
+            const unsigned int j = cpu_incremental_find(cpu, tile, i);
+            if (j < tile->particles_count && tile->particles[j] == i) {
+                memmove(tile->particles + j, tile->particles + j + 1, (tile->particles_count - j - 1) * sizeof(unsigned int));
+                --tile->particles_count;
+            }
+            tile->dirty = 1;
+        }
+    }
+}
+static unsigned int cpu_incremental_find(CpuContext *cpu, const CpuTile *tile, const unsigned int i) {
+    unsigned int low = 0;
+    unsigned int high = tile->particles_count;
+    while (low < high) {
+        const unsigned int mid = low + (high - low) / 2;
+        if (tile->particles[mid] < i) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+static void cpu_incremental_count(CpuContext *cpu) {
+    for (int t = 0; t < cpu->tiles_x * cpu->tiles_y; ++t) {
+        const CpuTile *tile = &cpu->incremental_tiles[t];
+        if (!tile->dirty)
+            continue;
+        int tile_x_min, tile_y_min, tile_x_max, tile_y_max;
+        cpu_tile_bounds(cpu, t, &tile_x_min, &tile_y_min, &tile_x_max, &tile_y_max);
+        // Reset the tile's region of the histogram
+        for (int y = tile_y_min; y <= tile_y_max; ++y) {
+            memset(cpu->pixel_contribs + y * cpu->output_image.width + tile_x_min, 0, (tile_x_max - tile_x_min + 1) * sizeof(unsigned int));
+        }
+        for (unsigned int j = 0; j < tile->particles_count; ++j) {
+            const unsigned int i = tile->particles[j];
+            int x_min, y_min, x_max, y_max;
+            cpu_particle_bounds(cpu, i, &x_min, &y_min, &x_max, &y_max);
+            // Clip bounding box to the tile
+            x_min = x_min < tile_x_min ? tile_x_min : x_min;
+            y_min = y_min < tile_y_min ? tile_y_min : y_min;
+            x_max = x_max > tile_x_max ? tile_x_max : x_max;
+            y_max = y_max > tile_y_max ? tile_y_max : y_max;
+            cpu_count_contribs(cpu, i, x_min, y_min, x_max, y_max);
+        }
+    }
+}
+static void cpu_incremental_store(CpuContext *cpu) {
+    const int TILE_INDEX_STRIDE = cpu->tile_width * cpu->tile_height + 1;
+    for (int t = 0; t < cpu->tiles_x * cpu->tiles_y; ++t) {
+        CpuTile *tile = &cpu->incremental_tiles[t];
+        if (!tile->dirty)
+            continue;
+        int tile_x_min, tile_y_min, tile_x_max, tile_y_max;
+        cpu_tile_bounds(cpu, t, &tile_x_min, &tile_y_min, &tile_x_max, &tile_y_max);
+        const int tile_width = tile_x_max - tile_x_min + 1;
+        unsigned int *tile_index = cpu->incremental_index + t * TILE_INDEX_STRIDE;
+        // Exclusive prefix sum across the tile's region of the histogram, resetting it to be used as a counter
+        tile_index[0] = 0;
+        unsigned int k = 0;
+        for (int y = tile_y_min; y <= tile_y_max; ++y) {
+            unsigned int *row = cpu->pixel_contribs + y * cpu->output_image.width;
+            for (int x = tile_x_min; x <= tile_x_max; ++x, ++k) {
+                tile_index[k + 1] = tile_index[k] + row[x];
+                row[x] = 0;
+            }
+        }
+        const unsigned int TOTAL_CONTRIBS = tile_index[k];
+        if (TOTAL_CONTRIBS > tile->contrib_capacity) {
+            // (Re)Allocate the tile's colour storage, with headroom so particles moving in do not reallocate every frame
+            const unsigned int capacity = TOTAL_CONTRIBS + TOTAL_CONTRIBS / 4;
+            if (tile->contrib_colours) cpu_free(cpu, tile->contrib_colours);
+            if (tile->contrib_depth) cpu_free(cpu, tile->contrib_depth);
+            tile->contrib_colours = (unsigned char*)cpu_alloc(cpu, capacity * 4 * sizeof(unsigned char));
+            tile->contrib_depth = (float*)cpu_alloc(cpu, capacity * sizeof(float));
+            tile->contrib_capacity = capacity;
+            if (cpu->alloc_failed)
+                return;
+        }
+        // Store each particle's colour/depth for every pixel of the tile it contributes to
+        for (unsigned int j = 0; j < tile->particles_count; ++j) {
+            const unsigned int i = tile->particles[j];
+            int x_min, y_min, x_max, y_max;
+            cpu_particle_bounds(cpu, i, &x_min, &y_min, &x_max, &y_max);
+            // Clip bounding box to the tile
+            x_min = x_min < tile_x_min ? tile_x_min : x_min;
+            y_min = y_min < tile_y_min ? tile_y_min : y_min;
+            x_max = x_max > tile_x_max ? tile_x_max : x_max;
+            y_max = y_max > tile_y_max ? tile_y_max : y_max;
+            for (int y = y_min; y <= y_max; ++y) {
+                const float y_ab = (float)y + 0.5f - cpu->particle_y[i];
+                const int covered = cpu->simd.row_covered(x_min, x_max, cpu->particle_x[i], y_ab, cpu->particle_radius[i], cpu->covered_x);
+                unsigned int *row = cpu->pixel_contribs + y * cpu->output_image.width;
+                const unsigned int *row_index = tile_index + (y - tile_y_min) * tile_width;
+                for (int c = 0; c < covered; ++c) {
+                    const int x = cpu->covered_x[c];
+                    const unsigned int storage_offset = row_index[x - tile_x_min] + (row[x]++);
+                    memcpy(tile->contrib_colours + (4 * storage_offset), cpu->particle_colour + (4 * i), 4 * sizeof(unsigned char));
+                    tile->contrib_depth[storage_offset] = cpu->particle_depth[i];
+                }
+            }
+        }
+        // Pair sort the colours contributing to each of the tile's pixels based on ascending depth
+        for (unsigned int p = 0; p < k; ++p) {
+            sort_pairs(tile->contrib_depth, tile->contrib_colours, tile_index[p], tile_index[p + 1] - 1);
+        }
+    }
+}
+static void cpu_incremental_blend(CpuContext *cpu) {
+    const int TILE_INDEX_STRIDE = cpu->tile_width * cpu->tile_height + 1;
+    for (int t = 0; t < cpu->tiles_x * cpu->tiles_y; ++t) {
+        CpuTile *tile = &cpu->incremental_tiles[t];
+        if (!tile->dirty)
+            continue;
+        int tile_x_min, tile_y_min, tile_x_max, tile_y_max;
+        cpu_tile_bounds(cpu, t, &tile_x_min, &tile_y_min, &tile_x_max, &tile_y_max);
+        const int tile_width = tile_x_max - tile_x_min + 1;
+        const unsigned int *tile_index = cpu->incremental_index + t * TILE_INDEX_STRIDE;
+        // Each row of the tile is contiguous in both the tile's index and the retained output image
+        for (int y = tile_y_min; y <= tile_y_max; ++y) {
+            unsigned char *row = cpu->output_image.data + (y * cpu->output_image.width + tile_x_min) * cpu->output_image.channels;
+            memset(row, 255, tile_width * cpu->output_image.channels * sizeof(unsigned char));
+            cpu->simd.blend(tile_index + (y - tile_y_min) * tile_width, tile->contrib_colours, row, 0, tile_width - 1);
+        }
+        tile->dirty = 0;
+    }
+}
+static int cpu_band_plan(CpuContext *cpu) {
+    const int WIDTH = cpu->output_image.width;
+    const int HEIGHT = cpu->output_image.height;
+    int x_min, y_min, x_max, y_max;
+    // Count the contributions to each row, from the span each particle covers
+    memset(cpu->band_row_contribs, 0, HEIGHT * sizeof(unsigned long long));
+    for (unsigned int i = 0; i < cpu->particles_count; ++i) {
+        if (!cpu_particle_bounds(cpu, i, &x_min, &y_min, &x_max, &y_max))
+            continue;
+        for (int y = y_min; y <= y_max; ++y) {
+            int x_start, x_end;
+            if (cpu_row_span(cpu, i, y, x_min, x_max, &x_start, &x_end))
+                cpu->band_row_contribs[y] += x_end - x_start + 1;
+        }
+    }
+    // Greedily add rows to each band, until the next row would exceed the budget or the band's 32-bit index
+    // Each row requires its histogram, index, colours (4 bytes) and depths (4 bytes), and its output rows if they are not retained
+    const size_t ROW_BYTES = WIDTH * (2 * sizeof(unsigned int) + (cpu->options.band_sink ? 3 * sizeof(unsigned char) : 0));
+    const size_t CONTRIB_BYTES = 4 * sizeof(unsigned char) + sizeof(float);
+    int max_rows = 0;
+    unsigned long long max_contribs = 0;
+    cpu->bands_count = 0;
+    for (int y = 0; y < HEIGHT;) {
+        const int first_row = y;
+        size_t band_bytes = 0;
+        unsigned long long band_contribs = 0;
+        for (; y < HEIGHT; ++y) {
+            const size_t row_bytes = ROW_BYTES + (size_t)cpu->band_row_contribs[y] * CONTRIB_BYTES;
+            if (band_contribs + cpu->band_row_contribs[y] > CPU_MAX_CONTRIBS) {
+                if (y == first_row) {
+                    fprintf(stderr, "cpu_band_plan() Row %d has too many contributions for a 32-bit index.\n", y);
+                    return 0;
+                }
+                break;
+            }
+            // A row which alone exceeds the budget still forms a band
+            if (y > first_row && band_bytes + row_bytes > cpu->options.band_budget)
+                break;
+            band_bytes += row_bytes;
+            band_contribs += cpu->band_row_contribs[y];
+        }
+        cpu->band_first_row[cpu->bands_count++] = first_row;
+        max_rows = y - first_row > max_rows ? y - first_row : max_rows;
+        max_contribs = band_contribs > max_contribs ? band_contribs : max_contribs;
+    }
+    cpu->band_first_row[cpu->bands_count] = HEIGHT;
+
+    // Cull the particles to the bands they overlap, using the tile index/particles with a band per tile
+    memset(cpu->tile_index, 0, (cpu->bands_count + 1) * sizeof(unsigned int));
+    for (int pass = 0; pass < 2; ++pass) {
+        for (unsigned int i = 0; i < cpu->particles_count; ++i) {
+            if (!cpu_particle_bounds(cpu, i, &x_min, &y_min, &x_max, &y_max))
+                continue;
+            // Binary search for the band containing the particle's first row
+            int low = 0;
+            int high = cpu->bands_count - 1;
+            while (low < high) {
+                const int mid = (low + high + 1) / 2;
+                if (cpu->band_first_row[mid] <= y_min) {
+                    low = mid;
+                } else {
+                    high = mid - 1;
+                }
+            }
+            for (int b = low; b < cpu->bands_count && cpu->band_first_row[b] <= y_max; ++b) {
+                if (pass == 0) {
+                    ++cpu->tile_index[b + 1];
+                } else {
+                    cpu->tile_particles[cpu->tile_index[b]++] = i;
+                }
+            }
+        }
+        if (pass == 0) {
+            // Inclusive prefix sum (offset by 1) to convert counts to an exclusive index
+            for (int b = 0; b < cpu->bands_count; ++b) {
+                cpu->tile_index[b + 1] += cpu->tile_index[b];
+            }
+            const unsigned int TOTAL_ENTRIES = cpu->tile_index[cpu->bands_count];
+            if (TOTAL_ENTRIES > cpu->tile_particles_capacity) {
+                // (Re)Allocate band particle storage
+                if (cpu->tile_particles) cpu_free(cpu, cpu->tile_particles);
+                cpu->tile_particles = (unsigned int*)cpu_alloc(cpu, TOTAL_ENTRIES * sizeof(unsigned int));
+                cpu->tile_particles_capacity = TOTAL_ENTRIES;
+                if (!cpu->tile_particles)
+                    return 0;
+            }
+        }
+    }
+    // Each band's start was advanced to its end (the next band's start), shift the index back by one band
+    memmove(cpu->tile_index + 1, cpu->tile_index, cpu->bands_count * sizeof(unsigned int));
+    cpu->tile_index[0] = 0;
+
+    // Allocate storage for the largest band
+    if (max_rows > cpu->band_rows_capacity) {
+        // (Re)Allocate band histogram, index and output rows
+        if (cpu->pixel_contribs) cpu_free(cpu, cpu->pixel_contribs);
+        if (cpu->pixel_index) cpu_free(cpu, cpu->pixel_index);
+        if (cpu->band_image) cpu_free(cpu, cpu->band_image);
+        cpu->pixel_contribs = (unsigned int*)cpu_alloc(cpu, (size_t)max_rows * WIDTH * sizeof(unsigned int));
+        cpu->pixel_index = (unsigned int*)cpu_alloc(cpu, ((size_t)max_rows * WIDTH + 1) * sizeof(unsigned int));
+        cpu->band_image = cpu->options.band_sink ? (unsigned char*)cpu_alloc(cpu, (size_t)max_rows * WIDTH * 3 * sizeof(unsigned char)) : 0;
+        cpu->band_rows_capacity = max_rows;
+    }
+    if (max_contribs > cpu->pixel_contrib_count) {
+        // (Re)Allocate colour storage
+        if (cpu->pixel_contrib_colours) cpu_free(cpu, cpu->pixel_contrib_colours);
+        if (cpu->pixel_contrib_depth) cpu_free(cpu, cpu->pixel_contrib_depth);
+        cpu->pixel_contrib_colours = (unsigned char*)cpu_alloc(cpu, (size_t)max_contribs * 4 * sizeof(unsigned char));
+        cpu->pixel_contrib_depth = (float*)cpu_alloc(cpu, (size_t)max_contribs * sizeof(float));
+        cpu->pixel_contrib_count = (unsigned int)max_contribs;
+    }
+    return !cpu->alloc_failed;
+}
+static void cpu_band_render(CpuContext *cpu) {
+    const int WIDTH = cpu->output_image.width;
+    for (int b = 0; b < cpu->bands_count; ++b) {
+        const int band_y_min = cpu->band_first_row[b];
+        const int band_y_max = cpu->band_first_row[b + 1] - 1;
+        const int BAND_PIXELS = (band_y_max - band_y_min + 1) * WIDTH;
+        // Count the contributions to each of the band's pixels
+        memset(cpu->pixel_contribs, 0, BAND_PIXELS * sizeof(unsigned int));
+        for (unsigned int j = cpu->tile_index[b]; j < cpu->tile_index[b + 1]; ++j) {
+            const unsigned int i = cpu->tile_particles[j];
+            int x_min, y_min, x_max, y_max;
+            cpu_particle_bounds(cpu, i, &x_min, &y_min, &x_max, &y_max);
+            y_min = y_min < band_y_min ? band_y_min : y_min;
+            y_max = y_max > band_y_max ? band_y_max : y_max;
+            for (int y = y_min; y <= y_max; ++y) {
+                const float y_ab = (float)y + 0.5f - cpu->particle_y[i];
+                const int covered = cpu->simd.row_covered(x_min, x_max, cpu->particle_x[i], y_ab, cpu->particle_radius[i], cpu->covered_x);
+                unsigned int *row = cpu->pixel_contribs + (y - band_y_min) * WIDTH;
+                for (int k = 0; k < covered; ++k) {
+                    ++row[cpu->covered_x[k]];
+                }
+            }
+        }
+        // Exclusive prefix sum across the band's histogram to create its index, stage 1 limited each band to CPU_MAX_CONTRIBS
+        // The histogram is reset as it is scanned
+        scan_exclusive_reset_serial(cpu->pixel_contribs, cpu->pixel_index, BAND_PIXELS);
+        // Store the band's contributions, using the histogram as a counter
+        for (unsigned int j = cpu->tile_index[b]; j < cpu->tile_index[b + 1]; ++j) {
+            const unsigned int i = cpu->tile_particles[j];
+            int x_min, y_min, x_max, y_max;
+            cpu_particle_bounds(cpu, i, &x_min, &y_min, &x_max, &y_max);
+            y_min = y_min < band_y_min ? band_y_min : y_min;
+            y_max = y_max > band_y_max ? band_y_max : y_max;
+            for (int y = y_min; y <= y_max; ++y) {
+                const float y_ab = (float)y + 0.5f - cpu->particle_y[i];
+                const int covered = cpu->simd.row_covered(x_min, x_max, cpu->particle_x[i], y_ab, cpu->particle_radius[i], cpu->covered_x);
+                for (int k = 0; k < covered; ++k) {
+                    const unsigned int pixel_offset = (y - band_y_min) * WIDTH + cpu->covered_x[k];
+                    const unsigned int storage_offset = cpu->pixel_index[pixel_offset] + (cpu->pixel_contribs[pixel_offset]++);
+                    memcpy(cpu->pixel_contrib_colours + (4 * storage_offset), cpu->particle_colour + (4 * i), 4 * sizeof(unsigned char));
+                    cpu->pixel_contrib_depth[storage_offset] = cpu->particle_depth[i];
+                }
+            }
+        }
+        // Pair sort each pixel's contributions by ascending depth, presorted particles were stored in depth order
+        if (!cpu->options.presort) {
+            for (int i = 0; i < BAND_PIXELS; ++i) {
+                // Offset the buffers to the pixel, as the band's index may exceed the range of sort_pairs()'s int arguments
+                sort_pairs(cpu->pixel_contrib_depth + cpu->pixel_index[i], cpu->pixel_contrib_colours + 4 * (size_t)cpu->pixel_index[i],
+                    0, (int)(cpu->pixel_index[i + 1] - cpu->pixel_index[i]) - 1);
+            }
+        }
+        // Blend the band's rows, into the output image or the band buffer
+        unsigned char *band_image = cpu->band_image ? cpu->band_image : cpu->output_image.data + (size_t)band_y_min * WIDTH * 3;
+        memset(band_image, 255, BAND_PIXELS * 3 * sizeof(unsigned char));
+        cpu->simd.blend(cpu->pixel_index, cpu->pixel_contrib_colours, band_image, 0, BAND_PIXELS - 1);
+        if (cpu->options.band_sink) {
+            cpu->options.band_sink(band_image, (unsigned int)band_y_min, (unsigned int)(band_y_max - band_y_min + 1), cpu->options.band_sink_user);
+        }
     }
 }
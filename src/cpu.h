@@ -2,39 +2,170 @@
 #define CPU_H_
 
 #include "common.h"
+#include "simd.h"
+
+#include <stddef.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/**
+ * Receives rows of the output image as each band of a banded render completes (see CpuOptions::band_budget)
+ * @param rows The RGB rows, row_count * width * 3 bytes, only valid during the call
+ * @param first_row The index of the first row within the image
+ * @param row_count The number of rows
+ * @param user CpuOptions::band_sink_user
+ */
+typedef void (*CpuBandSink)(const unsigned char *rows, unsigned int first_row, unsigned int row_count, void *user);
+/**
+ * Runtime options which select between the optional variants of the CPU implementation
+ * These are copied by cpu_begin(), and apply until cpu_end()
+ */
+struct CpuOptions {
+    /**
+     * Width and height (in pixels) of the square screen tiles used to bin particles in stages 1 and 2
+     * Each tile is then processed in turn, so that its region of the buffers remains in cache
+     * 0 disables tile binning, each particle's bounding box is instead scanned in particle order
+     */
+    unsigned int tile_size;
+    /**
+     * Treated as boolean, compute the horizontal span of pixels covered by each row of each particle once in stage 1
+     * Stages 1 and 2 then use the cached spans, rather than testing every pixel of each bounding box
+     */
+    unsigned char span_coverage;
+    /**
+     * Treated as boolean, sort the particles by ascending depth once in cpu_begin()
+     * Stage 2 then stores each pixel's contributions already in depth order, so the per pixel sort is skipped
+     */
+    unsigned char presort;
+    /**
+     * Treated as boolean, render by streaming the depth sorted particles, without the contribution buffers
+     * Stage 1 accumulates each pixel's transmittance front to back, finding the deepest layer which can affect its 8-bit colour
+     * Stage 2 blends back to front from that layer, stage 3 resolves the result (see cpu_stream_resolve())
+     * This implies presort, and ignores tile_size and span_coverage
+     */
+    unsigned char stream;
+    /**
+     * Instruction set of the vectorised coverage and blend kernels, SIMD_AUTO selects the highest supported by the host
+     * Every level produces identical results
+     */
+    SimdLevel simd;
+    /**
+     * Arithmetic of the blend kernels, SIMD_BLEND_FIXED is exact and faster, but may differ from the float reference by 1
+     * Streaming (stream) always blends with float arithmetic
+     */
+    SimdBlendMode blend;
+    /**
+     * If non zero, carve every buffer from a persistent arena rather than calling malloc()/free() each run
+     * The arena is reset by cpu_begin() and retained by cpu_end(), so repeated runs reuse already faulted memory
+     * cpu_release() returns the memory once all runs are complete
+     * A value of 2 also requests transparent huge pages for the arena (Linux only)
+     */
+    unsigned char arena;
+    /**
+     * Treated as boolean, retain each screen tile's particles and contributions between frames
+     * cpu_update() marks the tiles overlapped by changed particles dirty, and stages 1-3 only recompute those tiles
+     * Tiles are tile_size pixels square (CPU_INCREMENTAL_TILE if 0), presort, stream and span_coverage are ignored
+     */
+    unsigned char incremental;
+    /**
+     * If non zero, render the image as horizontal bands, each sized so that its buffers fit within this many bytes
+     * Stage 1 counts the contributions to each row and plans the bands, stage 2 culls, stores, sorts and blends one band at a time
+     * Image wide totals are 64-bit, and each band is also limited in contributions so that its index remains 32-bit
+     * A row which alone exceeds the budget forms a band of its own, tile_size and span_coverage are ignored
+     * Ignored if stream or incremental is set
+     */
+    size_t band_budget;
+    /**
+     * If set with band_budget, each band's rows are passed to this as soon as they are blended
+     * The full output image is then never allocated, so cpu_output() only reports the image's dimensions
+     */
+    CpuBandSink band_sink;
+    void *band_sink_user;
+    /**
+     * Treated as boolean, store each contribution as a single 64-bit record (depth << 32 | RGBA colour, see sort_records())
+     * rather than in separate colour and depth buffers, so stage 2 sorts a single integer key and stage 3 streams a single array
+     * Ignored if stream, incremental or band_budget is set
+     */
+    unsigned char packed;
+};
+typedef struct CpuOptions CpuOptions;
+/**
+ * The options used when none are passed to cpu_begin(), every variant is disabled and the SIMD level is selected automatically
+ */
+extern const CpuOptions cpu_default_options;
+/**
+ * An instance of the CPU implementation, holding its options, particles, and every buffer of the algorithm
+ * Contexts share no state, so separate contexts may be used concurrently by different threads
+ * A single context must only be used by one thread at a time
+ */
+typedef struct CpuContext CpuContext;
+
+/**
+ * Create a context, no memory is allocated for the algorithm until cpu_begin()
+ * @return The context, or null if it could not be allocated
+ */
+CpuContext *cpu_create();
 /**
  * The initialisation function for the CPU Particles implementation
  * Memory allocation and initialisation occurs here, so that it can be timed separate to the algorithm
+ * @param cpu The context, which must not already be between cpu_begin() and cpu_end()
+ * @param options The options of this run, null selects cpu_default_options
  * @param init_particles Pointer to an array of particle structures
  * @param init_particles_count The number of elements within the particles array
  * @param out_image_width The width of the final image to be output
  * @param out_image_height The height of the final image to be output
+ * @return Non-zero on success, 0 if a buffer could not be allocated (reported to stderr), the stages then fail until the
+ *         next cpu_begin(), but the context must still be ended with cpu_end()
  */
-void cpu_begin(const Particle * init_particles, unsigned int init_particles_count,
+int cpu_begin(CpuContext *cpu, const CpuOptions *options, const Particle *init_particles, unsigned int init_particles_count,
     unsigned int out_image_width, unsigned int out_image_height);
+/**
+ * Replace the particles with the next frame of an animation, reusing every allocation made by cpu_begin()
+ * @param particles Pointer to an array of particle structures, the same number as passed to cpu_begin()
+ */
+void cpu_update(CpuContext *cpu, const Particle *particles);
 /**
  * Create a localised histogram for each tile of the image
+ * @return Non-zero on success, 0 if a buffer could not be allocated, or a single row of a banded render has too many
+ *         contributions for a 32-bit index
  */
-void cpu_stage1();
+int cpu_stage1(CpuContext *cpu);
 /**
  * Equalise the histograms
+ * @return Non-zero on success, 0 if a buffer could not be allocated, or the image has too many contributions for a
+ *         32-bit index (without band_budget)
+ *         The error of every stage is reported to stderr, the context may still be ended or released
  */
-void cpu_stage2();
+int cpu_stage2(CpuContext *cpu);
 /**
  * Interpolate the histograms to construct the contrast enhanced image for output
+ * @return Non-zero on success, 0 if a buffer could not be allocated
+ */
+int cpu_stage3(CpuContext *cpu);
+/**
+ * Copy the image produced by the last cpu_stage3() to output_image, without releasing any memory
+ * @param output_image Pointer to a struct to store the image to be output, output_image->data is pre-allocated
+ *        If output_image->data is null, only the image's dimensions are stored
  */
-void cpu_stage3();
+void cpu_output(CpuContext *cpu, CImage *output_image);
 /**
  * The cleanup and return function for the CPU CLAHE implementation
  * Memory should be freed, and the final image copied to output_image
  * @param output_image Pointer to a struct to store the final image to be output, output_image->data is pre-allocated
  */
-void cpu_end(CImage *output_image);
+void cpu_end(CpuContext *cpu, CImage *output_image);
+/**
+ * Return any memory the CPU implementation retains between runs (see CpuOptions::arena) to the system
+ * This may be called at any point outside of cpu_begin() and cpu_end()
+ */
+void cpu_release(CpuContext *cpu);
+/**
+ * Release the context, and any memory it retains
+ * This may be called at any point outside of cpu_begin() and cpu_end(), passing null does nothing
+ */
+void cpu_destroy(CpuContext *cpu);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,212 @@
+#include "diagnostics.h"
+#include "image_writer.h"
+#include "sort.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+///
+/// Utility Methods
+///
+/**
+ * Number of rows of the heatmap coloured (in parallel) before each write
+ */
+#define DIAGNOSTICS_HEATMAP_ROWS 64
+/**
+ * Colour stops of the heatmap, evenly spaced over log(1 + count) / log(1 + max)
+ */
+#define DIAGNOSTICS_HEATMAP_STOPS 5
+static const unsigned char diagnostics_heatmap_stops[DIAGNOSTICS_HEATMAP_STOPS][3] = {
+    { 0, 0, 0 }, { 87, 16, 110 }, { 188, 55, 84 }, { 249, 142, 9 }, { 252, 255, 164 }
+};
+/**
+ * Return the index within diagnostics_sort_class_names of a segment of length count
+ */
+static int diagnostics_sort_class(unsigned int count);
+/**
+ * Return the value at quantile q (nearest rank) of the histogram of counts
+ * @param histogram The number of pixels with each count, max + 1 elements
+ * @param pixels The number of pixels within the histogram
+ */
+static unsigned int diagnostics_quantile(const unsigned long long *histogram, unsigned int max, unsigned long long pixels, double q);
+/**
+ * Compute the imbalance of the contributions of units
+ */
+static void diagnostics_imbalance(const unsigned long long *units, unsigned int units_count, DiagnosticsImbalance *imbalance);
+
+///
+/// Implementation
+///
+const char *const diagnostics_sort_class_names[DIAGNOSTICS_SORT_CLASSES] = { "none", "insertion", "network", "insertion", "radix" };
+
+void diagnostics_analyse(const unsigned int *pixel_contribs, const unsigned int width, const unsigned int height,
+    unsigned int tile_size, unsigned int threads, DepthComplexity *stats) {
+    memset(stats, 0, sizeof(DepthComplexity));
+    stats->width = width;
+    stats->height = height;
+    tile_size = tile_size ? tile_size : DIAGNOSTICS_TILE_SIZE;
+    threads = threads ? threads : (unsigned int)omp_get_max_threads();
+    stats->tile_size = tile_size;
+    const unsigned int tiles_x = (width + tile_size - 1) / tile_size;
+    const unsigned int tiles_y = (height + tile_size - 1) / tile_size;
+    // Sum each row, and each tile a row contributes to, rows of a tile row are summed by the same thread
+    unsigned long long *row_sums = (unsigned long long*)malloc((height ? height : 1) * sizeof(unsigned long long));
+    unsigned long long *tile_sums = (unsigned long long*)calloc((size_t)tiles_x * tiles_y + 1, sizeof(unsigned long long));
+    unsigned int max = 0;
+#pragma omp parallel for schedule(dynamic) reduction(max: max)
+    for (int ty = 0; ty < (int)tiles_y; ++ty) {
+        const unsigned int y_end = ((unsigned int)ty + 1) * tile_size < height ? ((unsigned int)ty + 1) * tile_size : height;
+        for (unsigned int y = (unsigned int)ty * tile_size; y < y_end; ++y) {
+            const unsigned int *row = pixel_contribs + (size_t)y * width;
+            unsigned long long row_sum = 0;
+            for (unsigned int x = 0; x < width; ++x) {
+                row_sum += row[x];
+                tile_sums[(size_t)ty * tiles_x + x / tile_size] += row[x];
+                max = row[x] > max ? row[x] : max;
+            }
+            row_sums[y] = row_sum;
+        }
+    }
+    stats->max = max;
+    // Histogram of the count of every pixel, from which the percentiles and sort classes follow
+    unsigned long long *histogram = (unsigned long long*)calloc((size_t)max + 1, sizeof(unsigned long long));
+    const size_t pixels = (size_t)width * height;
+    for (size_t i = 0; i < pixels; ++i)
+        ++histogram[pixel_contribs[i]];
+    unsigned long long sort_pixels[DIAGNOSTICS_SORT_CLASSES] = { 0 };
+    unsigned long long sort_contributions[DIAGNOSTICS_SORT_CLASSES] = { 0 };
+    for (unsigned int c = 0; c <= max; ++c) {
+        stats->total += (unsigned long long)c * histogram[c];
+        sort_pixels[diagnostics_sort_class(c)] += histogram[c];
+        sort_contributions[diagnostics_sort_class(c)] += (unsigned long long)c * histogram[c];
+    }
+    if (pixels) {
+        stats->mean = (double)stats->total / pixels;
+        stats->coverage = (double)(pixels - histogram[0]) / pixels;
+        stats->p50 = diagnostics_quantile(histogram, max, pixels, 0.5);
+        stats->p90 = diagnostics_quantile(histogram, max, pixels, 0.9);
+        stats->p99 = diagnostics_quantile(histogram, max, pixels, 0.99);
+        stats->p999 = diagnostics_quantile(histogram, max, pixels, 0.999);
+        for (int s = 0; s < DIAGNOSTICS_SORT_CLASSES; ++s) {
+            stats->sort_pixels[s] = (double)sort_pixels[s] / pixels;
+            stats->sort_contributions[s] = stats->total ? (double)sort_contributions[s] / stats->total : 0;
+        }
+    }
+    free(histogram);
+    diagnostics_imbalance(row_sums, height, &stats->rows);
+    diagnostics_imbalance(tile_sums, tiles_x * tiles_y, &stats->tiles);
+    // Each thread's share of contiguous rows, as distributed by schedule(static)
+    threads = threads > height ? (height ? height : 1) : threads;
+    unsigned long long *thread_sums = (unsigned long long*)calloc(threads, sizeof(unsigned long long));
+    for (unsigned int t = 0; t < threads; ++t) {
+        const unsigned int first = (unsigned int)((unsigned long long)height * t / threads);
+        const unsigned int last = (unsigned int)((unsigned long long)height * (t + 1) / threads);
+        for (unsigned int y = first; y < last; ++y)
+            thread_sums[t] += row_sums[y];
+    }
+    diagnostics_imbalance(thread_sums, threads, &stats->threads);
+    free(thread_sums);
+    free(tile_sums);
+    free(row_sums);
+}
+void diagnostics_print(const DepthComplexity *stats) {
+    printf("Depth complexity (%ux%u)\n", stats->width, stats->height);
+    printf("Contributions: %llu, coverage %.1f%%\n", stats->total, stats->coverage * 100);
+    printf("Per pixel: mean %.2f, p50 %u, p90 %u, p99 %u, p99.9 %u, max %u\n",
+        stats->mean, stats->p50, stats->p90, stats->p99, stats->p999, stats->max);
+    printf("%-10s %-9s %10s %14s\n", "Segment", "Sort", "Pixels", "Contributions");
+    for (int s = 0; s < DIAGNOSTICS_SORT_CLASSES; ++s) {
+        char range[32];
+        switch (s) {
+        case 0: sprintf(range, "0-1"); break;
+        case 1: sprintf(range, "2-%d", SORT_NETWORK_MIN - 1); break;
+        case 2: sprintf(range, "%d-%d", SORT_NETWORK_MIN, SORT_NETWORK_MAX); break;
+        case 3: sprintf(range, "%d-%d", SORT_NETWORK_MAX + 1, SORT_INSERTION_MAX); break;
+        default: sprintf(range, ">%d", SORT_INSERTION_MAX); break;
+        }
+        printf("%-10s %-9s %9.2f%% %13.2f%%\n", range, diagnostics_sort_class_names[s],
+            stats->sort_pixels[s] * 100, stats->sort_contributions[s] * 100);
+    }
+    printf("%-22s %8s %10s %8s\n", "Imbalance", "Units", "Max/mean", "CV");
+    printf("%-22s %8u %10.2f %8.2f\n", "Rows", stats->rows.units, stats->rows.max_mean, stats->rows.cv);
+    char tiles[32];
+    sprintf(tiles, "Tiles (%ux%u)", stats->tile_size, stats->tile_size);
+    printf("%-22s %8u %10.2f %8.2f\n", tiles, stats->tiles.units, stats->tiles.max_mean, stats->tiles.cv);
+    printf("%-22s %8u %10.2f %8.2f\n", "Threads (static rows)", stats->threads.units, stats->threads.max_mean, stats->threads.cv);
+}
+int diagnostics_heatmap(const char *path, const unsigned int *pixel_contribs, const unsigned int width, const unsigned int height, const unsigned int max) {
+    ImageWriter *writer = image_writer_open(path, width, height);
+    if (!writer)
+        return 0;
+    const float scale = max ? (float)(DIAGNOSTICS_HEATMAP_STOPS - 1) / logf(1.0f + (float)max) : 0.0f;
+    unsigned char *rows = (unsigned char*)malloc((size_t)DIAGNOSTICS_HEATMAP_ROWS * width * 3);
+    int success = 1;
+    for (unsigned int first = 0; first < height && success; first += DIAGNOSTICS_HEATMAP_ROWS) {
+        const unsigned int row_count = height - first < DIAGNOSTICS_HEATMAP_ROWS ? height - first : DIAGNOSTICS_HEATMAP_ROWS;
+#pragma omp parallel for
+        for (int r = 0; r < (int)row_count; ++r) {
+            const unsigned int *counts = pixel_contribs + (size_t)(first + r) * width;
+            unsigned char *row = rows + (size_t)r * width * 3;
+            for (unsigned int x = 0; x < width; ++x) {
+                // Interpolate between the stops either side of the log scaled count
+                const float t = logf(1.0f + (float)counts[x]) * scale;
+                int stop = (int)t;
+                stop = stop >= DIAGNOSTICS_HEATMAP_STOPS - 1 ? DIAGNOSTICS_HEATMAP_STOPS - 2 : stop;
+                const float f = t - (float)stop;
+                for (int c = 0; c < 3; ++c) {
+                    row[x * 3 + c] = (unsigned char)((float)diagnostics_heatmap_stops[stop][c] * (1 - f) +
+                        (float)diagnostics_heatmap_stops[stop + 1][c] * f + 0.5f);
+                }
+            }
+        }
+        success = image_writer_write_rows(writer, rows, first, row_count);
+    }
+    free(rows);
+    return image_writer_close(writer) && success;
+}
+
+static int diagnostics_sort_class(const unsigned int count) {
+    if (count < 2)
+        return 0;
+    if (count < SORT_NETWORK_MIN)
+        return 1;
+    if (count <= SORT_NETWORK_MAX)
+        return 2;
+    if (count <= SORT_INSERTION_MAX)
+        return 3;
+    return 4;
+}
+static unsigned int diagnostics_quantile(const unsigned long long *histogram, const unsigned int max, const unsigned long long pixels, const double q) {
+    unsigned long long rank = (unsigned long long)ceil(q * (double)pixels);
+    rank = rank < 1 ? 1 : rank;
+    unsigned long long cumulative = 0;
+    for (unsigned int c = 0; c <= max; ++c) {
+        cumulative += histogram[c];
+        if (cumulative >= rank)
+            return c;
+    }
+    return max;
+}
+static void diagnostics_imbalance(const unsigned long long *units, const unsigned int units_count, DiagnosticsImbalance *imbalance) {
+    imbalance->units = units_count;
+    imbalance->max_mean = 0;
+    imbalance->cv = 0;
+    if (!units_count)
+        return;
+    double sum = 0, largest = 0;
+    for (unsigned int i = 0; i < units_count; ++i) {
+        sum += (double)units[i];
+        largest = (double)units[i] > largest ? (double)units[i] : largest;
+    }
+    const double mean = sum / units_count;
+    if (mean <= 0)
+        return;
+    double squares = 0;
+    for (unsigned int i = 0; i < units_count; ++i)
+        squares += ((double)units[i] - mean) * ((double)units[i] - mean);
+    imbalance->max_mean = largest / mean;
+    imbalance->cv = sqrt(squares / units_count) / mean;
+}
@@ -0,0 +1,102 @@
+#ifndef DIAGNOSTICS_H_
+#define DIAGNOSTICS_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Depth complexity diagnostics, describing the distribution of contributions (overdraw) over the pixels of a scene
+ *
+ * The cost of each stage is set by the number of particles contributing to each pixel (cpu_pixel_contribs), so these
+ * statistics are intended to guide the choice of tile size, sort thresholds and thread schedule for each class of scene:
+ * - The max, mean and percentiles of per pixel depth complexity
+ * - The fraction of pixels, and of contributions, sorted by each of sort_pairs()'s algorithms (see sort.h)
+ * - The load imbalance (max / mean, and coefficient of variation) of the contributions within each row, each tile,
+ *   and each thread's share of rows under a static schedule
+ *
+ * The overdraw may also be written as a heatmap image, coloured on a log scale from black (none) to pale yellow (the max)
+ */
+
+/**
+ * Tile size used to measure tile imbalance when tile binning is disabled
+ */
+#define DIAGNOSTICS_TILE_SIZE 32
+/**
+ * Segment lengths distinguished by sort_pairs(), in ascending order
+ */
+#define DIAGNOSTICS_SORT_CLASSES 5
+extern const char *const diagnostics_sort_class_names[DIAGNOSTICS_SORT_CLASSES];
+/**
+ * Imbalance of the contributions divided between a number of units of work
+ */
+struct DiagnosticsImbalance {
+    unsigned int units;
+    /**
+     * The largest unit's contributions divided by the mean, 1 is perfectly balanced
+     */
+    double max_mean;
+    /**
+     * Standard deviation of the units' contributions divided by the mean
+     */
+    double cv;
+};
+typedef struct DiagnosticsImbalance DiagnosticsImbalance;
+/**
+ * Depth complexity statistics of a scene
+ */
+struct DepthComplexity {
+    unsigned int width;
+    unsigned int height;
+    unsigned long long total;
+    unsigned int max;
+    double mean;
+    /**
+     * The fraction of pixels with at least one contribution
+     */
+    double coverage;
+    unsigned int p50;
+    unsigned int p90;
+    unsigned int p99;
+    unsigned int p999;
+    /**
+     * The fraction of pixels, and of contributions, within each sort class of diagnostics_sort_class_names
+     */
+    double sort_pixels[DIAGNOSTICS_SORT_CLASSES];
+    double sort_contributions[DIAGNOSTICS_SORT_CLASSES];
+    unsigned int tile_size;
+    DiagnosticsImbalance rows;
+    DiagnosticsImbalance tiles;
+    DiagnosticsImbalance threads;
+};
+typedef struct DepthComplexity DepthComplexity;
+
+/**
+ * Compute the depth complexity statistics of a scene
+ * @param pixel_contribs The number of contributions to each pixel, width * height counts (see reference_pixel_contribs())
+ * @param width The width of the image
+ * @param height The height of the image
+ * @param tile_size The size of the tiles whose imbalance is measured, 0 uses DIAGNOSTICS_TILE_SIZE
+ * @param threads The number of threads whose share of rows (under a static schedule) is measured, 0 uses the OpenMP thread count
+ * @param stats Pointer to a struct to store the statistics
+ */
+void diagnostics_analyse(const unsigned int *pixel_contribs, unsigned int width, unsigned int height,
+    unsigned int tile_size, unsigned int threads, DepthComplexity *stats);
+/**
+ * Print the depth complexity statistics to stdout
+ */
+void diagnostics_print(const DepthComplexity *stats);
+/**
+ * Write a heatmap of the overdraw of each pixel
+ * @param path The path of the image, its format is selected by extension (see image_writer.h)
+ * @param pixel_contribs The number of contributions to each pixel, width * height counts
+ * @param max The largest count, which is coloured pale yellow
+ * @return Non-zero on success
+ */
+int diagnostics_heatmap(const char *path, const unsigned int *pixel_contribs, unsigned int width, unsigned int height, unsigned int max);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // DIAGNOSTICS_H_
@@ -0,0 +1,154 @@
+#include "generator.h"
+#include "config.h"
+
+#include <math.h>
+#include <string.h>
+
+///
+/// Utility Methods
+///
+/**
+ * Philox4x32 multipliers and Weyl sequence key increments (Salmon et al. 2011)
+ */
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+/**
+ * Independent streams of the counter space (counter[1]), so each use of the generator draws unrelated values
+ */
+#define GENERATOR_STREAM_ATTRIBUTES 0
+#define GENERATOR_STREAM_PALETTE 1
+#define GENERATOR_STREAM_PERMUTATION 2
+/**
+ * Number of rounds of the Feistel network which permutes depths
+ */
+#define GENERATOR_FEISTEL_ROUNDS 4
+/**
+ * Seeded bijection over [0, count), evaluated per index
+ */
+struct GeneratorPermutation {
+    unsigned int count;
+    /**
+     * Number of bits in each half of the Feistel network's domain, [0, 2^(2*half_bits)) covers [0, count)
+     */
+    unsigned int half_bits;
+    unsigned int half_mask;
+    unsigned int keys[GENERATOR_FEISTEL_ROUNDS];
+};
+typedef struct GeneratorPermutation GeneratorPermutation;
+/**
+ * Philox4x32-10, encrypt counter with key to produce 4 random words
+ */
+static void philox4x32(const unsigned int counter[4], const unsigned int key[2], unsigned int out[4]);
+/**
+ * Set up the permutation of [0, count) for seed
+ */
+static void generator_permutation_init(GeneratorPermutation *permutation, unsigned long long seed, unsigned int count);
+/**
+ * Return the image of index under permutation
+ */
+static unsigned int generator_permute(const GeneratorPermutation *permutation, unsigned int index);
+/**
+ * Map a random word to a float in [0, 1)
+ */
+static float generator_uniform(unsigned int x);
+
+///
+/// Implementation
+///
+void generator_particles(const unsigned long long seed, const unsigned int particles_count, const unsigned int width, const unsigned int height,
+    const unsigned int first, const unsigned int count, Particle *particles) {
+    const unsigned int key[2] = { (unsigned int)seed, (unsigned int)(seed >> 32) };
+    const unsigned int palette_size = sizeof(base_color_palette) / sizeof(base_color_palette[0]);
+    GeneratorPermutation permutation;
+    generator_permutation_init(&permutation, seed, particles_count);
+#pragma omp parallel for schedule(static)
+    for (int j = 0; j < (int)count; ++j) {
+        const unsigned int i = first + (unsigned int)j;
+        unsigned int counter[4] = { i, GENERATOR_STREAM_ATTRIBUTES, 0, 0 };
+        unsigned int r[4];
+        Particle *particle = &particles[j];
+        // Location
+        philox4x32(counter, key, r);
+        particle->location[0] = generator_uniform(r[0]) * width;
+        particle->location[1] = generator_uniform(r[1]) * height;
+        // Depth, the permuted index's float bit pattern, which is the index'th float after 0
+        const unsigned int depth_bits = generator_permute(&permutation, i);
+        memcpy(&particle->location[2], &depth_bits, sizeof(float));
+        // Radius and opacity, a pair of normal samples by Box-Muller
+        const float u1 = 1.0f - generator_uniform(r[2]);  // (0, 1], so log() is finite
+        const float u2 = generator_uniform(r[3]);
+        const float magnitude = sqrtf(-2.0f * logf(u1));
+        float t_radius = CIRCLE_RAD_AVERAGE + CIRCLE_RAD_STDDEV * magnitude * cosf(6.28318530718f * u2);
+        t_radius = t_radius < MIN_RADIUS ? MIN_RADIUS : t_radius;
+        t_radius = t_radius > MAX_RADIUS ? MAX_RADIUS : t_radius;
+        particle->radius = t_radius;
+        float t_opacity = CIRCLE_OPACITY_AVERAGE + CIRCLE_OPACITY_STDDEV * magnitude * sinf(6.28318530718f * u2);
+        t_opacity = t_opacity < MIN_OPACITY ? MIN_OPACITY : t_opacity;
+        t_opacity = t_opacity > MAX_OPACITY ? MAX_OPACITY : t_opacity;
+        particle->color[3] = (unsigned char)(255 * t_opacity);
+        // Colour
+        counter[1] = GENERATOR_STREAM_PALETTE;
+        philox4x32(counter, key, r);
+        const unsigned int palette_index = (unsigned int)(((unsigned long long)r[0] * palette_size) >> 32);
+        particle->color[0] = base_color_palette[palette_index][0];
+        particle->color[1] = base_color_palette[palette_index][1];
+        particle->color[2] = base_color_palette[palette_index][2];
+    }
+}
+
+static void philox4x32(const unsigned int counter[4], const unsigned int key[2], unsigned int out[4]) {
+    unsigned int c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+    unsigned int k0 = key[0], k1 = key[1];
+    for (int round = 0; round < 10; ++round) {
+        const unsigned long long p0 = (unsigned long long)PHILOX_M0 * c0;
+        const unsigned long long p1 = (unsigned long long)PHILOX_M1 * c2;
+        c0 = (unsigned int)(p1 >> 32) ^ c1 ^ k0;
+        c1 = (unsigned int)p1;
+        c2 = (unsigned int)(p0 >> 32) ^ c3 ^ k1;
+        c3 = (unsigned int)p0;
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+    out[0] = c0;
+    out[1] = c1;
+    out[2] = c2;
+    out[3] = c3;
+}
+static void generator_permutation_init(GeneratorPermutation *permutation, const unsigned long long seed, const unsigned int count) {
+    permutation->count = count;
+    // Smallest even number of bits which covers count, so the domain is at most 4x count
+    unsigned int half_bits = 1;
+    while (half_bits < 16 && ((unsigned long long)1 << (2 * half_bits)) < count)
+        ++half_bits;
+    permutation->half_bits = half_bits;
+    permutation->half_mask = (1u << half_bits) - 1;
+    const unsigned int key[2] = { (unsigned int)seed, (unsigned int)(seed >> 32) };
+    const unsigned int counter[4] = { 0, GENERATOR_STREAM_PERMUTATION, 0, 0 };
+    philox4x32(counter, key, permutation->keys);
+}
+static unsigned int generator_permute(const GeneratorPermutation *permutation, unsigned int index) {
+    // Cycle walk, re-applying the bijection over the power of 2 domain until the result falls within [0, count)
+    // As the domain is at most 4x count, this averages fewer than 4 iterations
+    do {
+        unsigned int left = index >> permutation->half_bits;
+        unsigned int right = index & permutation->half_mask;
+        for (int round = 0; round < GENERATOR_FEISTEL_ROUNDS; ++round) {
+            // Round function, a multiply-xorshift hash of the right half and round key
+            unsigned int f = (right ^ permutation->keys[round]) * 0x7FEB352Du;
+            f ^= f >> 15;
+            f *= 0x846CA68Bu;
+            f ^= f >> 16;
+            const unsigned int t_right = left ^ (f & permutation->half_mask);
+            left = right;
+            right = t_right;
+        }
+        index = (left << permutation->half_bits) | right;
+    } while (index >= permutation->count);
+    return index;
+}
+static float generator_uniform(const unsigned int x) {
+    // The top 24 bits fill a float's significand exactly
+    return (float)(x >> 8) * (1.0f / 16777216.0f);
+}
@@ -0,0 +1,39 @@
+#ifndef GENERATOR_H_
+#define GENERATOR_H_
+
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Parallel, seekable particle generator
+ *
+ * Each particle is a pure function of (seed, index, particles_count, width, height), drawn from a counter based
+ * random number generator (Philox4x32-10), so any range of particles can be generated independently
+ * The output is therefore identical regardless of how the range is split across threads
+ *
+ * As with the original generator, depths are the first particles_count representable floats from 0 upwards,
+ * assigned by a seeded permutation of [0, particles_count) (a Feistel network with cycle walking), rather than a shuffle
+ * The distributions (palette, location, radius, opacity) and their bounds are those of config.h
+ */
+
+/**
+ * Generate particles [first, first + count) of a scene of particles_count particles, in parallel with OpenMP
+ * @param seed The seed of the scene
+ * @param particles_count The number of particles in the full scene, this determines the depth permutation
+ * @param width The width of the image the particles are generated for
+ * @param height The height of the image the particles are generated for
+ * @param first The index of the first particle to generate
+ * @param count The number of particles to generate, first + count must not exceed particles_count
+ * @param particles Pointer to storage for count particle structures
+ */
+void generator_particles(unsigned long long seed, unsigned int particles_count, unsigned int width, unsigned int height,
+    unsigned int first, unsigned int count, Particle *particles);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // GENERATOR_H_
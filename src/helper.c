@@ -1,4 +1,5 @@
 #include "helper.h"
+#include "scan.h"
 
 
 #include <stdio.h>
@@ -115,10 +116,7 @@ void validate_pixel_index(const unsigned int *pixel_contribs, const unsigned int
 }
 void skip_pixel_index(const unsigned int *pixel_contribs, unsigned int *return_pixel_index, const unsigned int out_image_width, const unsigned int out_image_height) {
     // Exclusive prefix sum across the histogram to create an index
-    return_pixel_index[0] = 0;
-    for (unsigned int i = 0; i < out_image_width * out_image_height; ++i) {
-        return_pixel_index[i + 1] = return_pixel_index[i] + pixel_contribs[i];
-    }
+    scan_exclusive(pixel_contribs, return_pixel_index, (size_t)out_image_width * out_image_height);
     skip_pixel_index_used++;
 }
 
@@ -289,17 +287,19 @@ void skip_blend(const unsigned int *pixel_index, const unsigned char *pixel_cont
     skip_blend_used++;
 }
 
+// The counters start at -1 to discount the reference render, which is skipped when the output is streamed
+#define SKIP_USED(count) ((count) > 0 ? (count) : 0)
 int getSkipUsed() {
-    return skip_pixel_contribs_used + skip_pixel_index_used + skip_sorted_pairs_used + skip_blend_used;
+    return SKIP_USED(skip_pixel_contribs_used) + SKIP_USED(skip_pixel_index_used) + SKIP_USED(skip_sorted_pairs_used) + SKIP_USED(skip_blend_used);
 }
 int getStage1SkipUsed() {
-    return skip_pixel_contribs_used;
+    return SKIP_USED(skip_pixel_contribs_used);
 }
 int getStage2SkipUsed() {
-    return skip_pixel_index_used + skip_sorted_pairs_used;
+    return SKIP_USED(skip_pixel_index_used) + SKIP_USED(skip_sorted_pairs_used);
 }
 int getStage3SkipUsed() {
-    return skip_blend_used;
+    return SKIP_USED(skip_blend_used);
 }
 
 void help_sort_pairs(float* keys_start, unsigned char* colours_start, const int first, const int last) {
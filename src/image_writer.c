@@ -0,0 +1,519 @@
+#include "image_writer.h"
+
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+///
+/// Utility Methods
+///
+/**
+ * Number of entries of each job's LZ77 hash table, a power of 2
+ */
+#define IMAGE_WRITER_HASH_BITS 15
+/**
+ * Maximum number of earlier positions compared when searching for a match, more find longer matches but are slower
+ */
+#define IMAGE_WRITER_CHAIN 8
+/**
+ * Maximum distance of a deflate match
+ */
+#define IMAGE_WRITER_WINDOW 32768
+/**
+ * Storage for the deflate output of a job, written least significant bit first
+ */
+struct BitWriter {
+    unsigned char *data;
+    size_t length;
+    unsigned long long buffer;
+    int count;
+};
+typedef struct BitWriter BitWriter;
+/**
+ * Append the low bits of value to the output
+ */
+static void bits_add(BitWriter *writer, unsigned int value, int bits);
+/**
+ * Build the fixed Huffman code, deflate length/distance lookup and CRC tables, if not already built
+ * Writers may be opened concurrently (e.g. by the workers of server.h), so the tables are built within a critical section
+ */
+static void image_writer_init_tables();
+/**
+ * Build the tables of image_writer_init_tables()
+ */
+static void image_writer_build_tables();
+/**
+ * Filter the rows [first_row, first_row + row_count) of a PNG, prefixing each with the filter type which minimises
+ * the sum of its absolute (signed) filtered bytes
+ * @param rows The first row to filter
+ * @param previous_row The row preceding rows, or 0 for the first row of the image
+ * @param filtered Storage for row_count * (1 + width * 3) bytes
+ */
+static void png_filter_rows(const unsigned char *rows, const unsigned char *previous_row, unsigned int width, unsigned int row_count, unsigned char *filtered);
+/**
+ * Compress data with a single non-final fixed Huffman deflate block, followed by a sync flush
+ * @param out Storage for at least length + length / 8 + 64 bytes
+ * @return The number of bytes written to out
+ */
+static size_t deflate_fixed(const unsigned char *data, size_t length, unsigned char *out);
+/**
+ * Return the Adler-32 checksum of data, continuing from adler
+ */
+static unsigned int adler32_update(unsigned int adler, const unsigned char *data, size_t length);
+/**
+ * Return the Adler-32 checksum of the concatenation of two buffers from their checksums, and the length of the second
+ */
+static unsigned int adler32_combine(unsigned int adler1, unsigned int adler2, size_t length2);
+/**
+ * Return the CRC-32 of data, continuing from crc (pass 0 initially)
+ */
+static unsigned int crc32_update(unsigned int crc, const unsigned char *data, size_t length);
+/**
+ * Write a PNG chunk, with its length and CRC
+ */
+static int png_write_chunk(FILE *file, const char *type, const unsigned char *data, unsigned int length);
+/**
+ * Store value to out as a 4 byte big endian integer
+ */
+static void store_be32(unsigned char *out, unsigned int value);
+
+///
+/// Writer storage
+///
+struct ImageWriter {
+    ImageFormat format;
+    FILE *file;
+    unsigned int width;
+    unsigned int height;
+    // Bytes preceding the pixel data within the file (the PPM header)
+    size_t header_size;
+    // The memory mapped file, or 0 if rows are written with fwrite()
+    unsigned char *mapped;
+    size_t mapped_size;
+    // PNG only, the next row expected, the checksum of the filtered rows so far, and a copy of the last row written
+    unsigned int next_row;
+    unsigned int adler;
+    unsigned char *previous_row;
+    // Treated as boolean, a write has failed
+    int failed;
+};
+// Reversed fixed Huffman codes (and lengths) of each literal/length symbol, deflate writes Huffman codes most significant bit first
+static unsigned short image_writer_literal_code[288];
+static unsigned char image_writer_literal_bits[288];
+// Reversed fixed 5 bit codes of each distance symbol
+static unsigned char image_writer_distance_code[30];
+// The length symbol (less 257) of each match length [3, 258]
+static unsigned char image_writer_length_symbol[259];
+// The distance symbol of each distance - 1 < 256, then of each (distance - 1) >> 7 offset by 256
+static unsigned char image_writer_distance_symbol[512];
+static unsigned int image_writer_crc_table[256];
+static int image_writer_tables_built = 0;
+static const unsigned short length_base[29] = { 3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258 };
+static const unsigned char length_extra[29] = { 0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0 };
+static const unsigned short distance_base[30] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577 };
+static const unsigned char distance_extra[30] = { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13 };
+
+///
+/// Implementation
+///
+ImageFormat image_format_from_path(const char *path) {
+    if (bench_has_extension(path, ".png"))
+        return IMAGE_FORMAT_PNG;
+    if (bench_has_extension(path, ".raw"))
+        return IMAGE_FORMAT_RAW;
+    if (bench_has_extension(path, ".ppm"))
+        return IMAGE_FORMAT_PPM;
+    return IMAGE_FORMAT_UNKNOWN;
+}
+ImageWriter *image_writer_open(const char *path, const unsigned int width, const unsigned int height) {
+    const ImageFormat format = image_format_from_path(path);
+    if (format == IMAGE_FORMAT_UNKNOWN)
+        return 0;
+    image_writer_init_tables();
+    ImageWriter *writer = (ImageWriter*)malloc(sizeof(ImageWriter));
+    memset(writer, 0, sizeof(ImageWriter));
+    writer->format = format;
+    writer->width = width;
+    writer->height = height;
+    writer->adler = 1;
+    writer->file = fopen(path, format == IMAGE_FORMAT_PNG ? "wb" : "wb+");
+    if (!writer->file) {
+        free(writer);
+        return 0;
+    }
+    if (format == IMAGE_FORMAT_PNG) {
+        static const unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+        unsigned char ihdr[13];
+        store_be32(ihdr + 0, width);
+        store_be32(ihdr + 4, height);
+        ihdr[8] = 8;  // Bit depth
+        ihdr[9] = 2;  // Colour type, RGB
+        ihdr[10] = 0;  // Compression method, deflate
+        ihdr[11] = 0;  // Filter method, adaptive
+        ihdr[12] = 0;  // Interlace method, none
+        // The zlib header (32K window, fastest) has its own IDAT chunk, as the jobs' IDAT chunks are written as they complete
+        static const unsigned char zlib_header[2] = { 0x78, 0x01 };
+        writer->failed |= fwrite(signature, 1, sizeof(signature), writer->file) != sizeof(signature);
+        writer->failed |= !png_write_chunk(writer->file, "IHDR", ihdr, sizeof(ihdr));
+        writer->failed |= !png_write_chunk(writer->file, "IDAT", zlib_header, sizeof(zlib_header));
+        writer->previous_row = (unsigned char*)malloc((size_t)width * 3 * sizeof(unsigned char));
+        return writer;
+    }
+    char header[64];
+    writer->header_size = format == IMAGE_FORMAT_PPM ? (size_t)sprintf(header, "P6\n%u %u\n255\n", width, height) : 0;
+#ifdef __linux__
+    // Size the file, then map it so rows are copied straight into the page cache
+    writer->mapped_size = writer->header_size + (size_t)width * height * 3;
+    if (writer->mapped_size && !ftruncate(fileno(writer->file), (off_t)writer->mapped_size)) {
+        void *mapped = mmap(0, writer->mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fileno(writer->file), 0);
+        if (mapped != MAP_FAILED) {
+            writer->mapped = (unsigned char*)mapped;
+            memcpy(writer->mapped, header, writer->header_size);
+            return writer;
+        }
+    }
+#endif
+    // Fall back to writing rows with fwrite()
+    writer->failed |= fwrite(header, 1, writer->header_size, writer->file) != writer->header_size;
+    return writer;
+}
+unsigned char *image_writer_mapped(ImageWriter *writer) {
+    return writer->mapped ? writer->mapped + writer->header_size : 0;
+}
+int image_writer_write_rows(ImageWriter *writer, const unsigned char *rows, const unsigned int first_row, const unsigned int row_count) {
+    const size_t row_bytes = (size_t)writer->width * 3;
+    if (first_row + row_count > writer->height)
+        return 0;
+    if (writer->format != IMAGE_FORMAT_PNG) {
+        if (writer->mapped) {
+            unsigned char *dest = writer->mapped + writer->header_size + first_row * row_bytes;
+            // Rows blended directly into the mapping need not be copied
+            if (dest != rows)
+                memcpy(dest, rows, row_count * row_bytes);
+            return 1;
+        }
+        // Seek to the rows, as they may arrive in any order
+#ifdef _MSC_VER
+        _fseeki64(writer->file, (long long)(writer->header_size + first_row * row_bytes), SEEK_SET);
+#else
+        fseeko(writer->file, (off_t)(writer->header_size + first_row * row_bytes), SEEK_SET);
+#endif
+        const int success = fwrite(rows, 1, row_count * row_bytes, writer->file) == row_count * row_bytes;
+        writer->failed |= !success;
+        return success;
+    }
+    if (first_row != writer->next_row) {
+        writer->failed = 1;
+        return 0;
+    }
+    if (!row_count)
+        return 1;
+    // Split the rows into jobs, which are filtered and compressed in parallel
+    const size_t filtered_row_bytes = 1 + row_bytes;
+    unsigned int job_rows = (unsigned int)(IMAGE_WRITER_JOB_BYTES / filtered_row_bytes);
+    job_rows = job_rows ? job_rows : 1;
+    const int JOBS = (int)((row_count + job_rows - 1) / job_rows);
+    unsigned char **job_output = (unsigned char**)malloc(JOBS * sizeof(unsigned char*));
+    size_t *job_output_length = (size_t*)malloc(JOBS * sizeof(size_t));
+    unsigned int *job_adler = (unsigned int*)malloc(JOBS * sizeof(unsigned int));
+    size_t *job_filtered_length = (size_t*)malloc(JOBS * sizeof(size_t));
+#pragma omp parallel for schedule(dynamic)
+    for (int j = 0; j < JOBS; ++j) {
+        const unsigned int job_first = j * job_rows;
+        const unsigned int job_count = job_first + job_rows > row_count ? row_count - job_first : job_rows;
+        const unsigned char *job_previous = job_first ? rows + (job_first - 1) * row_bytes : (first_row ? writer->previous_row : 0);
+        const size_t filtered_length = job_count * filtered_row_bytes;
+        unsigned char *filtered = (unsigned char*)malloc(filtered_length);
+        png_filter_rows(rows + job_first * row_bytes, job_previous, writer->width, job_count, filtered);
+        job_output[j] = (unsigned char*)malloc(filtered_length + filtered_length / 8 + 64);
+        job_output_length[j] = deflate_fixed(filtered, filtered_length, job_output[j]);
+        job_adler[j] = adler32_update(1, filtered, filtered_length);
+        job_filtered_length[j] = filtered_length;
+        free(filtered);
+    }
+    // Write the jobs' output in order, each as an IDAT chunk
+    for (int j = 0; j < JOBS; ++j) {
+        writer->failed |= !png_write_chunk(writer->file, "IDAT", job_output[j], (unsigned int)job_output_length[j]);
+        writer->adler = adler32_combine(writer->adler, job_adler[j], job_filtered_length[j]);
+        free(job_output[j]);
+    }
+    free(job_filtered_length);
+    free(job_adler);
+    free(job_output_length);
+    free(job_output);
+    memcpy(writer->previous_row, rows + (row_count - 1) * row_bytes, row_bytes);
+    writer->next_row += row_count;
+    return !writer->failed;
+}
+int image_writer_close(ImageWriter *writer) {
+    int success = !writer->failed;
+    if (writer->format == IMAGE_FORMAT_PNG) {
+        success &= writer->next_row == writer->height;
+        // Finish the zlib stream with an empty final fixed Huffman block, and the checksum of the filtered rows
+        unsigned char zlib_footer[6] = { 0x03, 0x00 };
+        store_be32(zlib_footer + 2, writer->adler);
+        success &= png_write_chunk(writer->file, "IDAT", zlib_footer, sizeof(zlib_footer));
+        success &= png_write_chunk(writer->file, "IEND", 0, 0);
+        free(writer->previous_row);
+    }
+#ifdef __linux__
+    if (writer->mapped)
+        munmap(writer->mapped, writer->mapped_size);
+#endif
+    success &= fclose(writer->file) == 0;
+    free(writer);
+    return success;
+}
+
+static void bits_add(BitWriter *writer, const unsigned int value, const int bits) {
+    writer->buffer |= (unsigned long long)value << writer->count;
+    writer->count += bits;
+    while (writer->count >= 8) {
+        writer->data[writer->length++] = (unsigned char)writer->buffer;
+        writer->buffer >>= 8;
+        writer->count -= 8;
+    }
+}
+static void image_writer_init_tables() {
+#pragma omp critical(image_writer_tables)
+    {
+        if (!image_writer_tables_built) {
+            image_writer_build_tables();
+            image_writer_tables_built = 1;
+        }
+    }
+}
+static void image_writer_build_tables() {
+    for (int s = 0; s < 288; ++s) {
+        // Fixed Huffman code (RFC 1951 3.2.6)
+        unsigned int code, bits;
+        if (s < 144) {
+            code = 0x30 + s; bits = 8;
+        } else if (s < 256) {
+            code = 0x190 + s - 144; bits = 9;
+        } else if (s < 280) {
+            code = s - 256; bits = 7;
+        } else {
+            code = 0xC0 + s - 280; bits = 8;
+        }
+        unsigned int reversed = 0;
+        for (unsigned int b = 0; b < bits; ++b) {
+            reversed |= ((code >> b) & 1) << (bits - 1 - b);
+        }
+        image_writer_literal_code[s] = (unsigned short)reversed;
+        image_writer_literal_bits[s] = (unsigned char)bits;
+    }
+    for (int s = 0; s < 30; ++s) {
+        unsigned int reversed = 0;
+        for (int b = 0; b < 5; ++b) {
+            reversed |= ((s >> b) & 1) << (4 - b);
+        }
+        image_writer_distance_code[s] = (unsigned char)reversed;
+    }
+    for (int length = 3, s = 0; length <= 258; ++length) {
+        while (s < 28 && length >= length_base[s + 1])
+            ++s;
+        image_writer_length_symbol[length] = (unsigned char)s;
+    }
+    for (int d = 0, s = 0; d < 256; ++d) {
+        while (s < 29 && d + 1 >= distance_base[s + 1])
+            ++s;
+        image_writer_distance_symbol[d] = (unsigned char)s;
+    }
+    for (int d = 256, s = 0; d < 512; ++d) {
+        // Distances above 256 share a symbol across (at least) 128 consecutive distances
+        const int distance = ((d - 256) << 7) + 1;
+        while (s < 29 && distance >= distance_base[s + 1])
+            ++s;
+        image_writer_distance_symbol[d] = (unsigned char)s;
+    }
+    for (unsigned int n = 0; n < 256; ++n) {
+        unsigned int c = n;
+        for (int k = 0; k < 8; ++k) {
+            c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        }
+        image_writer_crc_table[n] = c;
+    }
+}
+static void png_filter_rows(const unsigned char *rows, const unsigned char *previous_row, const unsigned int width, const unsigned int row_count, unsigned char *filtered) {
+    const int ROW_BYTES = (int)width * 3;
+    const int BPP = 3;
+    for (unsigned int r = 0; r < row_count; ++r) {
+        const unsigned char *row = rows + r * ROW_BYTES;
+        const unsigned char *up = r ? row - ROW_BYTES : previous_row;
+        unsigned char *out = filtered + r * (size_t)(1 + ROW_BYTES);
+        // Select the filter (None, Sub, Up, Average, Paeth) with the smallest sum of absolute differences
+        int best_filter = 0;
+        unsigned long best_sum = 0;
+        for (int f = 0; f < 5; ++f) {
+            unsigned long sum = 0;
+            for (int i = 0; i < ROW_BYTES; ++i) {
+                const int a = i >= BPP ? row[i - BPP] : 0;
+                const int b = up ? up[i] : 0;
+                const int c = up && i >= BPP ? up[i - BPP] : 0;
+                int predicted = 0;
+                if (f == 1) {
+                    predicted = a;
+                } else if (f == 2) {
+                    predicted = b;
+                } else if (f == 3) {
+                    predicted = (a + b) / 2;
+                } else if (f == 4) {
+                    const int p = a + b - c;
+                    const int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+                    predicted = pa <= pb && pa <= pc ? a : (pb <= pc ? b : c);
+                }
+                const signed char value = (signed char)(unsigned char)(row[i] - predicted);
+                sum += (unsigned long)abs(value);
+            }
+            if (f == 0 || sum < best_sum) {
+                best_sum = sum;
+                best_filter = f;
+            }
+        }
+        out[0] = (unsigned char)best_filter;
+        for (int i = 0; i < ROW_BYTES; ++i) {
+            const int a = i >= BPP ? row[i - BPP] : 0;
+            const int b = up ? up[i] : 0;
+            const int c = up && i >= BPP ? up[i - BPP] : 0;
+            int predicted = 0;
+            if (best_filter == 1) {
+                predicted = a;
+            } else if (best_filter == 2) {
+                predicted = b;
+            } else if (best_filter == 3) {
+                predicted = (a + b) / 2;
+            } else if (best_filter == 4) {
+                const int p = a + b - c;
+                const int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+                predicted = pa <= pb && pa <= pc ? a : (pb <= pc ? b : c);
+            }
+            out[1 + i] = (unsigned char)(row[i] - predicted);
+        }
+    }
+}
+static size_t deflate_fixed(const unsigned char *data, const size_t length, unsigned char *out) {
+    BitWriter writer = { out, 0, 0, 0 };
+    int *head = (int*)malloc((1 << IMAGE_WRITER_HASH_BITS) * sizeof(int));
+    int *prev = (int*)malloc((length ? length : 1) * sizeof(int));
+    memset(head, -1, (1 << IMAGE_WRITER_HASH_BITS) * sizeof(int));
+    // Non-final block, fixed Huffman codes
+    bits_add(&writer, 0, 1);
+    bits_add(&writer, 1, 2);
+    size_t i = 0;
+    while (i < length) {
+        int best_length = 0;
+        size_t best_distance = 0;
+        if (i + 3 <= length) {
+            // Search the chain of earlier positions with the same hash of the next 3 bytes, for the longest match
+            const unsigned int h = ((data[i] << 16 | data[i + 1] << 8 | data[i + 2]) * 2654435761u) >> (32 - IMAGE_WRITER_HASH_BITS);
+            const size_t max_length = length - i < 258 ? length - i : 258;
+            int candidate = head[h];
+            for (int c = 0; c < IMAGE_WRITER_CHAIN && candidate >= 0 && i - candidate <= IMAGE_WRITER_WINDOW; ++c) {
+                size_t l = 0;
+                while (l < max_length && data[candidate + l] == data[i + l])
+                    ++l;
+                if ((int)l > best_length) {
+                    best_length = (int)l;
+                    best_distance = i - candidate;
+                    if (l == max_length)
+                        break;
+                }
+                candidate = prev[candidate];
+            }
+            prev[i] = head[h];
+            head[h] = (int)i;
+        }
+        if (best_length >= 3) {
+            const int ls = image_writer_length_symbol[best_length];
+            bits_add(&writer, image_writer_literal_code[257 + ls], image_writer_literal_bits[257 + ls]);
+            bits_add(&writer, best_length - length_base[ls], length_extra[ls]);
+            const int ds = image_writer_distance_symbol[best_distance <= 256 ? best_distance - 1 : 256 + ((best_distance - 1) >> 7)];
+            bits_add(&writer, image_writer_distance_code[ds], 5);
+            bits_add(&writer, (unsigned int)(best_distance - distance_base[ds]), distance_extra[ds]);
+            // Insert the matched positions, so later matches may reference them
+            for (size_t k = i + 1; k < i + best_length && k + 3 <= length; ++k) {
+                const unsigned int h = ((data[k] << 16 | data[k + 1] << 8 | data[k + 2]) * 2654435761u) >> (32 - IMAGE_WRITER_HASH_BITS);
+                prev[k] = head[h];
+                head[h] = (int)k;
+            }
+            i += best_length;
+        } else {
+            bits_add(&writer, image_writer_literal_code[data[i]], image_writer_literal_bits[data[i]]);
+            ++i;
+        }
+    }
+    // End of block
+    bits_add(&writer, image_writer_literal_code[256], image_writer_literal_bits[256]);
+    // Sync flush, an empty non-final stored block byte aligns the output so that the next job's output may follow it
+    bits_add(&writer, 0, 3);
+    if (writer.count)
+        bits_add(&writer, 0, 8 - writer.count);
+    bits_add(&writer, 0x0000, 16);
+    bits_add(&writer, 0xFFFF, 16);
+    free(prev);
+    free(head);
+    return writer.length;
+}
+static unsigned int adler32_update(const unsigned int adler, const unsigned char *data, const size_t length) {
+    unsigned int s1 = adler & 0xFFFF;
+    unsigned int s2 = adler >> 16;
+    size_t i = 0;
+    while (i < length) {
+        // 5552 is the most bytes which may be summed before s2 can overflow 32 bits
+        const size_t block_end = length - i > 5552 ? i + 5552 : length;
+        for (; i < block_end; ++i) {
+            s1 += data[i];
+            s2 += s1;
+        }
+        s1 %= 65521;
+        s2 %= 65521;
+    }
+    return s2 << 16 | s1;
+}
+static unsigned int adler32_combine(const unsigned int adler1, const unsigned int adler2, const size_t length2) {
+    const unsigned int BASE = 65521;
+    const unsigned int remainder = (unsigned int)(length2 % BASE);
+    unsigned int s1 = adler1 & 0xFFFF;
+    unsigned int s2 = (unsigned int)(((unsigned long long)remainder * s1) % BASE);
+    // The second buffer's sums assumed s1 started at 1, rather than at the first buffer's s1
+    s1 += (adler2 & 0xFFFF) + BASE - 1;
+    s2 += (adler1 >> 16) + (adler2 >> 16) + BASE - remainder;
+    s1 = s1 >= BASE ? s1 - BASE : s1;
+    s1 = s1 >= BASE ? s1 - BASE : s1;
+    s2 = s2 >= 2 * BASE ? s2 - 2 * BASE : s2;
+    s2 = s2 >= BASE ? s2 - BASE : s2;
+    return s2 << 16 | s1;
+}
+static unsigned int crc32_update(unsigned int crc, const unsigned char *data, const size_t length) {
+    crc = ~crc;
+    for (size_t i = 0; i < length; ++i) {
+        crc = image_writer_crc_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+static int png_write_chunk(FILE *file, const char *type, const unsigned char *data, const unsigned int length) {
+    unsigned char length_be[4], crc_be[4];
+    store_be32(length_be, length);
+    unsigned int crc = crc32_update(0, (const unsigned char*)type, 4);
+    crc = crc32_update(crc, data, length);
+    store_be32(crc_be, crc);
+    return fwrite(length_be, 1, 4, file) == 4 &&
+        fwrite(type, 1, 4, file) == 4 &&
+        (!length || fwrite(data, 1, length, file) == length) &&
+        fwrite(crc_be, 1, 4, file) == 4;
+}
+static void store_be32(unsigned char *out, const unsigned int value) {
+    out[0] = (unsigned char)(value >> 24);
+    out[1] = (unsigned char)(value >> 16);
+    out[2] = (unsigned char)(value >> 8);
+    out[3] = (unsigned char)value;
+}
@@ -0,0 +1,69 @@
+#ifndef IMAGE_WRITER_H_
+#define IMAGE_WRITER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Streaming image writer, rows may be written as soon as they are produced rather than once the image is complete
+ *
+ * PNG rows are filtered and deflated in independent jobs across OpenMP threads, each job's deflate stream ends with a
+ * sync flush (byte aligned empty stored block) so that the jobs concatenate into the single zlib stream of the IDAT chunks
+ * Each job only references its own rows, which costs a little compression ratio in exchange for parallelism
+ *
+ * RAW (8-bit RGB) and PPM (binary P6) files are created at their final size and memory mapped (Linux only),
+ * so rows are copied straight into the page cache, and image_writer_mapped() allows them to be produced in place
+ */
+
+/**
+ * Output file formats, selected by extension
+ */
+enum ImageFormat { IMAGE_FORMAT_UNKNOWN, IMAGE_FORMAT_PNG, IMAGE_FORMAT_RAW, IMAGE_FORMAT_PPM };
+typedef enum ImageFormat ImageFormat;
+/**
+ * Target size (in bytes) of the rows compressed by each parallel PNG job
+ */
+#define IMAGE_WRITER_JOB_BYTES (256 * 1024)
+/**
+ * Opaque handle to an open image file
+ */
+typedef struct ImageWriter ImageWriter;
+
+/**
+ * Return the format matching path's extension (.png, .raw or .ppm, case insensitive)
+ */
+ImageFormat image_format_from_path(const char *path);
+/**
+ * Create the file at path, and write the header of its format
+ * @param path The path of the file, the format is selected by its extension
+ * @param width The width of the image in pixels
+ * @param height The height of the image in pixels
+ * @return The writer, or 0 if the format is unknown or the file could not be created
+ */
+ImageWriter *image_writer_open(const char *path, unsigned int width, unsigned int height);
+/**
+ * Return the image's RGB pixel data within the memory mapped file, or 0 if the file is not mapped
+ * Pixels written here directly need not also be passed to image_writer_write_rows()
+ */
+unsigned char *image_writer_mapped(ImageWriter *writer);
+/**
+ * Write rows of the image
+ * RAW and PPM rows may be written in any order, PNG rows must be written in order, each exactly once
+ * @param rows The RGB rows, row_count * width * 3 bytes
+ * @param first_row The index of the first row within the image
+ * @param row_count The number of rows
+ * @return Non-zero on success
+ */
+int image_writer_write_rows(ImageWriter *writer, const unsigned char *rows, unsigned int first_row, unsigned int row_count);
+/**
+ * Complete the file, and release the writer
+ * @return Non-zero on success, PNG files also fail if not every row was written
+ */
+int image_writer_close(ImageWriter *writer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // IMAGE_WRITER_H_
@@ -2,7 +2,13 @@
 #include <stdlib.h>
 #include <ctype.h>
 #include <string.h>
+
+// CUDA mode is only available when this file is compiled by nvcc
+// The cpu build targets compile it as C++ with the host compiler, so that it can be built without the CUDA toolkit
+#ifdef __CUDACC__
+#define CUDA_ENABLED
 #include <cuda_runtime.h>
+#endif
 
 #ifdef _MSC_VER
 #include <windows.h>
@@ -18,23 +24,76 @@
 #include <cmath>
 #include <algorithm>
 #include <cfloat>
+#ifndef CUDA_ENABLED
+#include <chrono>
+#endif
 
 // Presumes all coloured IO in this file is to stdout
 #define CONSOLE_RED isatty(fileno(stdout))?"\x1b[91m":""
 #define CONSOLE_GREEN isatty(fileno(stdout))?"\x1b[92m":""
 #define CONSOLE_YELLOW isatty(fileno(stdout))?"\x1b[93m":""
 #define CONSOLE_RESET isatty(fileno(stdout))?"\x1b[39m":""
-
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "external/stb_image_write.h"
+// Expand a macro to a string literal of its value
+#define STRINGIFY(x) #x
+#define XSTRINGIFY(x) STRINGIFY(x)
 
 #include "main.h"
 #include "config.h"
 #include "common.h"
 #include "cpu.h"
 #include "openmp.h"
+#ifdef CUDA_ENABLED
 #include "cuda.cuh"
+#endif
 #include "helper.h"
+#include "image_writer.h"
+#include "scene.h"
+#include "generator.h"
+#include "reference.h"
+#include "bench.h"
+#include "counters.h"
+#include "diagnostics.h"
+#include "server.h"
+
+/**
+ * Timestamps used to time each stage of the algorithm
+ * CUDA builds record CUDA events, so that asynchronous device work is included in the timing
+ * Host only builds use a monotonic high resolution host clock instead
+ */
+#ifdef CUDA_ENABLED
+typedef cudaEvent_t Timestamp;
+void timestamp_create(Timestamp *t) { CUDA_CALL(cudaEventCreate(t)); }
+void timestamp_destroy(Timestamp t) { cudaEventDestroy(t); }
+void timestamp_record(Timestamp *t) {
+    CUDA_CALL(cudaEventRecord(*t));
+    CUDA_CALL(cudaEventSynchronize(*t));
+}
+float timestamp_elapsed(Timestamp start, Timestamp end) {
+    float milliseconds = 0;
+    CUDA_CALL(cudaEventElapsedTime(&milliseconds, start, end));
+    return milliseconds;
+}
+#else
+typedef std::chrono::steady_clock::time_point Timestamp;
+void timestamp_create(Timestamp *t) { *t = Timestamp(); }
+void timestamp_destroy(Timestamp t) { }
+void timestamp_record(Timestamp *t) { *t = std::chrono::steady_clock::now(); }
+float timestamp_elapsed(Timestamp start, Timestamp end) {
+    return std::chrono::duration<float, std::milli>(end - start).count();
+}
+#endif
+
+/**
+ * Runtime options and state of the CPU implementation
+ * The options are applied from the parsed config, then passed to each cpu_begin()
+ */
+CpuOptions cpu_options;
+CpuContext *cpu_context;
+/**
+ * Time (ms) write_band_rows() has spent writing rows during the current run
+ * Banded rows are written during stage 2, so this is moved from stage 2's time to the write's
+ */
+float band_write_time;
 
 int main(int argc, char **argv)
 {
@@ -51,242 +110,187 @@ int main(int argc, char **argv)
     Config config;
     parse_args(argc, argv, &config);
 
-    // Generate Initial Particles from user_config
-    const unsigned int particles_count = config.circle_count;
-    Particle* particles = (Particle *)malloc(particles_count * sizeof(Particle));
-    {
-        // Random engine with a fixed seed and several distributions to be used
-        std::mt19937 rng(12);
-        std::uniform_real_distribution<float> normalised_float_dist(0, 1);
-        std::normal_distribution<float> circle_rad_dist(CIRCLE_RAD_AVERAGE, CIRCLE_RAD_STDDEV);
-        std::normal_distribution<float> circle_opacity_dist(CIRCLE_OPACITY_AVERAGE, CIRCLE_OPACITY_STDDEV);
-        std::uniform_int_distribution<int> color_palette_dist(0, sizeof(base_color_palette)/sizeof(unsigned char[3]) - 1);
-        std::vector<float> depths(config.circle_count);
-        depths[0]=0;
-        for (unsigned int i = 1; i < config.circle_count; ++i) {
-            depths[i] = nextafterf(depths[i-1], FLT_MAX);
-        }
-        shuffle(depths.begin(), depths.end(), rng);
-        // Common
-        for (unsigned int i = 0; i < config.circle_count; ++i) {
-            const int palette_index = color_palette_dist(rng);
-            particles[i].color[0] = base_color_palette[palette_index][0];
-            particles[i].color[1] = base_color_palette[palette_index][1];
-            particles[i].color[2] = base_color_palette[palette_index][2];
-            particles[i].location[0] = normalised_float_dist(rng) * config.out_image_width;
-            particles[i].location[1] = normalised_float_dist(rng) * config.out_image_height;
-            particles[i].location[2] = depths[i];
-            // Circle specific
-            particles[i].radius = circle_rad_dist(rng);
-            float t_opacity = circle_opacity_dist(rng);
-            t_opacity = t_opacity < MIN_OPACITY ? MIN_OPACITY : t_opacity;
-            t_opacity = t_opacity > MAX_OPACITY ? MAX_OPACITY : t_opacity;
-            particles[i].color[3] = (unsigned char)(255 * t_opacity);
-        }
-        // Clamp radius to bounds (use OpenMP in an attempt to trigger OpenMPs hidden init cost)
-#pragma omp parallel for 
-        for (int i = 0; i < (int)particles_count; ++i) {
-            particles[i].radius = particles[i].radius < MIN_RADIUS ? MIN_RADIUS : particles[i].radius;
-            particles[i].radius = particles[i].radius > MAX_RADIUS ? MAX_RADIUS : particles[i].radius;
+    // Apply runtime options to the host implementations
+    cpu_options = cpu_default_options;
+    cpu_options.tile_size = config.tile_size;
+    cpu_options.span_coverage = config.span_coverage;
+    cpu_options.presort = config.presort;
+    cpu_options.stream = config.stream;
+    cpu_options.packed = config.packed;
+    cpu_options.simd = config.simd;
+    cpu_options.blend = config.blend;
+    cpu_options.arena = config.arena;
+    cpu_options.incremental = config.incremental;
+    cpu_options.band_budget = config.band_budget;
+    cpu_context = cpu_create();
+
+    // Serve mode loads each job's scene and writes its image itself, so neither particles nor a reference are prepared here
+    if (config.mode == SERVE) {
+        const int success = server_run(&cpu_options, config.serve_workers, config.serve_socket);
+        cpu_destroy(cpu_context);
+        if (config.serve_socket)
+            free(config.serve_socket);
+        return success ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // A sweep generates the particles of each configuration itself
+    if (config.sweep_counts_count || config.sweep_dims_count) {
+        sweep(&config, argc, argv);
+        cpu_destroy(cpu_context);
+        free(config.sweep_counts);
+        free(config.sweep_dims);
+        if (config.bench_output)
+            free(config.bench_output);
+        if (config.heatmap_file)
+            free(config.heatmap_file);
+        if (config.reference_cache)
+            free(config.reference_cache);
+        return EXIT_SUCCESS;
+    }
+
+    // Load the particles from a scene file, or generate them
+    Scene scene;
+    memset(&scene, 0, sizeof(Scene));
+    Particle *particles;
+    unsigned int particles_count;
+    if (config.scene_file && config.mode != EXPORT) {
+        Timestamp startT, stopT;
+        timestamp_create(&startT);
+        timestamp_create(&stopT);
+        timestamp_record(&startT);
+        if (!scene_open(config.scene_file, &scene)) {
+            return EXIT_FAILURE;
+        }
+        timestamp_record(&stopT);
+        particles = scene.particles;
+        particles_count = scene.particles_count;
+        printf("Loaded %u particles from %s in %.3fms\n", particles_count, config.scene_file, timestamp_elapsed(startT, stopT));
+        timestamp_destroy(startT);
+        timestamp_destroy(stopT);
+        // Trigger OpenMP's hidden init cost outside of timing, as generate_particles() does
+#pragma omp parallel
+        { }
+    } else {
+        particles_count = config.circle_count;
+        particles = (Particle *)malloc(particles_count * sizeof(Particle));
+        Timestamp startT, stopT;
+        timestamp_create(&startT);
+        timestamp_create(&stopT);
+        timestamp_record(&startT);
+        generate_particles(&config, particles);
+        timestamp_record(&stopT);
+        printf("Generated %u particles in %.3fms\n", particles_count, timestamp_elapsed(startT, stopT));
+        timestamp_destroy(startT);
+        timestamp_destroy(stopT);
+    }
+    if (config.mode == EXPORT) {
+        const int success = scene_write(config.scene_file, particles, particles_count, config.out_image_width, config.out_image_height);
+        if (success) {
+            printf("Exported %u particles to %s\n", particles_count, config.scene_file);
+        } else {
+            printf("%sUnable to export particles to %s.%s\n", CONSOLE_RED, config.scene_file, CONSOLE_RESET);
         }
+        free(particles);
+        free(config.scene_file);
+        return success ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (config.diagnostics) {
+        report_diagnostics(&config, particles, particles_count);
+    }
+
+    // Banded output is streamed to the image writer as each band completes, so neither the full image nor a reference is held
+    if (config.mode == CPU && config.band_budget && !config.frames && config.output_file &&
+        image_format_from_path(config.output_file) != IMAGE_FORMAT_UNKNOWN) {
+        cpu_options.band_sink = write_band_rows;
     }
 
     // Create result for validation
     CImage validation_image;
-    {
-        // Init metadata
-        validation_image.width = config.out_image_width;
-        validation_image.height = config.out_image_height;
-        validation_image.channels = 3;
-        // Allocate memory
-        validation_image.data = (unsigned char*)malloc(validation_image.width * validation_image.height * validation_image.channels * sizeof(unsigned char));
-        // Allocate algorithm storage
-        unsigned int *pixel_contribs = (unsigned int*)malloc(validation_image.width * validation_image.height * sizeof(unsigned int));;
-        unsigned int *pixel_index = (unsigned int*)malloc((validation_image.width * validation_image.height + 1) * sizeof(unsigned int));
-        // Run algorithm
-        skip_pixel_contribs(particles, particles_count, pixel_contribs, validation_image.width, validation_image.height);
-        skip_pixel_index(pixel_contribs, pixel_index, validation_image.width, validation_image.height);
-        const unsigned int TOTAL_CONTRIBS = pixel_index[validation_image.width * validation_image.height];
-        unsigned char *pixel_contrib_colours = (unsigned char*)malloc(TOTAL_CONTRIBS * 4 * sizeof(unsigned char));
-        float *pixel_contrib_depth = (float*)malloc(TOTAL_CONTRIBS * sizeof(float));
-        skip_sorted_pairs(particles, particles_count, pixel_index, validation_image.width, validation_image.height, pixel_contrib_colours, pixel_contrib_depth);
-        skip_blend(pixel_index, pixel_contrib_colours, &validation_image);
-        // Free algorithm storage
-        free(pixel_contrib_depth);
-        free(pixel_contrib_colours);
-        free(pixel_index);
-        free(pixel_contribs);
-    }
-       
+    if (cpu_options.band_sink) {
+        memset(&validation_image, 0, sizeof(CImage));
+    } else if (!config.frames) {
+        render_reference(&config, particles, particles_count, &validation_image);
+    } else {
+        // Animations are validated against the final frame, so skip the static benchmark
+        animate(&config, particles, particles_count);
+        cpu_destroy(cpu_context);
+        if (scene.data)
+            scene_close(&scene);
+        else
+            free(particles);
+        if (config.output_file)
+            free(config.output_file);
+        if (config.scene_file)
+            free(config.scene_file);
+        if (config.reference_cache)
+            free(config.reference_cache);
+        if (config.bench_output)
+            free(config.bench_output);
+        if (config.heatmap_file)
+            free(config.heatmap_file);
+        return EXIT_SUCCESS;
+    }
+
     CImage output_image;
     Runtimes timing_log;
-    const int TOTAL_RUNS = config.benchmark ? BENCHMARK_RUNS : 1;
+    BenchResult bench_result;
+    const int TOTAL_RUNS = (int)config.runs;
+    // Performance counters are accumulated over the timed runs
+    double stage_counts[COUNTER_STAGES][COUNTER_EVENTS];
+    memset(stage_counts, 0, sizeof(stage_counts));
+    const int counting = config.perf && (config.mode == CPU || config.mode == OPENMP) && counters_open();
+    if (config.perf && config.mode == CUDA)
+        printf("%sPerformance counters are only supported by the CPU and OPENMP modes.%s\n", CONSOLE_YELLOW, CONSOLE_RESET);
     {
-        //Init for run  
-        cudaEvent_t startT, initT, stage1T, stage2T, stage3T, stopT;
-        CUDA_CALL(cudaEventCreate(&startT));
-        CUDA_CALL(cudaEventCreate(&initT));
-        CUDA_CALL(cudaEventCreate(&stage1T));
-        CUDA_CALL(cudaEventCreate(&stage2T));
-        CUDA_CALL(cudaEventCreate(&stage3T));
-        CUDA_CALL(cudaEventCreate(&stopT));
-
-        // Run 1 or many times
-        memset(&timing_log, 0, sizeof(Runtimes));
-        for (int runs = 0; runs < TOTAL_RUNS; ++runs) {
-            if (TOTAL_RUNS > 1)
-                printf("\r%d/%d", runs + 1, TOTAL_RUNS);
-            memset(&output_image, 0, sizeof(CImage));
-            output_image.data = (unsigned char*)malloc(config.out_image_width * config.out_image_height * 3 * sizeof(unsigned char));
-            memset(output_image.data, 0, config.out_image_width * config.out_image_height * 3 * sizeof(unsigned char));
-            // Run Particles algorithm
-            CUDA_CALL(cudaEventRecord(startT));
-            CUDA_CALL(cudaEventSynchronize(startT));
-            switch (config.mode) {
-            case CPU:
-                {
-                    cpu_begin(particles, particles_count, config.out_image_width, config.out_image_height);
-                    CUDA_CALL(cudaEventRecord(initT));
-                    CUDA_CALL(cudaEventSynchronize(initT));
-                    cpu_stage1();
-                    CUDA_CALL(cudaEventRecord(stage1T));
-                    CUDA_CALL(cudaEventSynchronize(stage1T));
-                    cpu_stage2();
-                    CUDA_CALL(cudaEventRecord(stage2T));
-                    CUDA_CALL(cudaEventSynchronize(stage2T));
-                    cpu_stage3();
-                    CUDA_CALL(cudaEventRecord(stage3T));
-                    CUDA_CALL(cudaEventSynchronize(stage3T));
-                    cpu_end(&output_image);
-                }
-                break;
-            case OPENMP:
-                {
-                    openmp_begin(particles, particles_count, config.out_image_width, config.out_image_height);
-                    CUDA_CALL(cudaEventRecord(initT));
-                    CUDA_CALL(cudaEventSynchronize(initT));
-                    openmp_stage1();
-                    CUDA_CALL(cudaEventRecord(stage1T));
-                    CUDA_CALL(cudaEventSynchronize(stage1T));
-                    openmp_stage2();
-                    CUDA_CALL(cudaEventRecord(stage2T));
-                    CUDA_CALL(cudaEventSynchronize(stage2T));
-                    openmp_stage3();
-                    CUDA_CALL(cudaEventRecord(stage3T));
-                    CUDA_CALL(cudaEventSynchronize(stage3T));
-                    openmp_end(&output_image);
-                }
-                break;
-            case CUDA:
-                {
-                    cuda_begin(particles, particles_count, config.out_image_width, config.out_image_height);
-                    CUDA_CHECK();
-                    CUDA_CALL(cudaEventRecord(initT));
-                    CUDA_CALL(cudaEventSynchronize(initT));
-                    cuda_stage1();
-                    CUDA_CHECK();
-                    CUDA_CALL(cudaEventRecord(stage1T));
-                    CUDA_CALL(cudaEventSynchronize(stage1T));
-                    cuda_stage2();
-                    CUDA_CHECK();
-                    CUDA_CALL(cudaEventRecord(stage2T));
-                    CUDA_CALL(cudaEventSynchronize(stage2T));
-                    cuda_stage3();
-                    CUDA_CHECK();
-                    CUDA_CALL(cudaEventRecord(stage3T));
-                    CUDA_CALL(cudaEventSynchronize(stage3T));
-                    cuda_end(&output_image);
-                }
-                break;
-            }
-            CUDA_CALL(cudaEventRecord(stopT));
-            CUDA_CALL(cudaEventSynchronize(stopT));
-            // Sum timing info
-            float milliseconds = 0;
-            CUDA_CALL(cudaEventElapsedTime(&milliseconds, startT, initT));
-            timing_log.init += milliseconds;
-            CUDA_CALL(cudaEventElapsedTime(&milliseconds, initT, stage1T));
-            timing_log.stage1 += milliseconds;
-            CUDA_CALL(cudaEventElapsedTime(&milliseconds, stage1T, stage2T));
-            timing_log.stage2 += milliseconds;
-            CUDA_CALL(cudaEventElapsedTime(&milliseconds, stage2T, stage3T));
-            timing_log.stage3 += milliseconds;
-            CUDA_CALL(cudaEventElapsedTime(&milliseconds, stage3T, stopT));
-            timing_log.cleanup += milliseconds;
-            CUDA_CALL(cudaEventElapsedTime(&milliseconds, startT, stopT));
-            timing_log.total += milliseconds;
-            // Avoid memory leak
-            if (runs + 1 < TOTAL_RUNS) {
-                if (output_image.data)
-                    free(output_image.data);
+        // The output image is allocated once, and reused by every run, each run writes it to the output file (see render_run())
+        unsigned char *output_image_data = 0;
+        if (!cpu_options.band_sink)
+            output_image_data = (unsigned char*)malloc(config.out_image_width * config.out_image_height * 3 * sizeof(unsigned char));
+        // Warmup runs are timed but discarded, then run 1 or many times
+        Runtimes *run_log = (Runtimes*)malloc(TOTAL_RUNS * sizeof(Runtimes));
+        for (int runs = -(int)config.warmup; runs < TOTAL_RUNS; ++runs) {
+            if (TOTAL_RUNS > 1 || config.warmup) {
+                if (runs < 0)
+                    printf("\rWarmup %d/%u", runs + (int)config.warmup + 1, config.warmup);
+                else
+                    printf("\r%d/%d      ", runs + 1, TOTAL_RUNS);
+                fflush(stdout);
             }
+            memset(&output_image, 0, sizeof(CImage));
+            output_image.data = output_image_data;
+            if (output_image.data)
+                memset(output_image.data, 0, config.out_image_width * config.out_image_height * 3 * sizeof(unsigned char));
+            Runtimes warmup_log;
+            render_run(&config, particles, particles_count, &output_image, runs < 0 ? &warmup_log : &run_log[runs], runs < 0 ? 0 : stage_counts);
         }
-        // Convert timing info to average
-        timing_log.init /= TOTAL_RUNS;
-        timing_log.stage1 /= TOTAL_RUNS;
-        timing_log.stage2 /= TOTAL_RUNS;
-        timing_log.stage3 /= TOTAL_RUNS;
-        timing_log.cleanup /= TOTAL_RUNS;
-        timing_log.total /= TOTAL_RUNS;
-
-        // Cleanup timing
-        cudaEventDestroy(startT);
-        cudaEventDestroy(initT);
-        cudaEventDestroy(stage1T);
-        cudaEventDestroy(stage2T);
-        cudaEventDestroy(stage3T);
-        cudaEventDestroy(stopT);
-    }
+        // Summarise the timed runs, the mean is reported to the console
+        bench_summarise(&config, particles_count, run_log, TOTAL_RUNS, &bench_result);
+        free(run_log);
+        memset(&timing_log, 0, sizeof(Runtimes));
+        timing_log.init = bench_result.stages[0].mean;
+        timing_log.stage1 = bench_result.stages[1].mean;
+        timing_log.stage2 = bench_result.stages[2].mean;
+        timing_log.stage3 = bench_result.stages[3].mean;
+        timing_log.cleanup = bench_result.stages[4].mean;
+        timing_log.write = bench_result.stages[5].mean;
+        timing_log.total = bench_result.stages[6].mean;
 
-    // Validate and report    
-    {
-        printf("\rValidation Status: \n");
-        printf("\tImage width: %s%s%s\n", validation_image.width == output_image.width ? CONSOLE_GREEN : CONSOLE_RED, validation_image.width == output_image.width ? "Pass" :  "Fail", CONSOLE_RESET);
-        printf("\tImage height: %s%s%s\n", validation_image.height == output_image.height ? CONSOLE_GREEN : CONSOLE_RED, validation_image.height == output_image.height ? "Pass" : "Fail", CONSOLE_RESET);
-        printf("\tImage channels: %s%s%s\n", validation_image.channels == output_image.channels ? CONSOLE_GREEN : CONSOLE_RED, validation_image.channels == output_image.channels ? "Pass" : "Fail", CONSOLE_RESET);
-        const int v_size = validation_image.width * validation_image.height;
-        const int o_size = output_image.width * output_image.height;
-        const int s_size = v_size < o_size ? v_size : o_size;
-        const int max_channels = validation_image.channels > output_image.channels ? output_image.channels : validation_image.channels;
-        int bad_pixels = 0;
-        int close_pixels = 0;
-        if (output_image.data && s_size) {
-            for (int i = 0; i < s_size; ++i) {
-                for (int ch = 0; ch < max_channels; ++ch) {
-                    if (output_image.data[i * max_channels + ch] != validation_image.data[i * max_channels + ch]) {
-                        // Give a +-1 threshold for error (incase fast-math triggers a small difference in places)
-                        if (output_image.data[i * max_channels + ch]+1 == validation_image.data[i * max_channels + ch] ||
-                            output_image.data[i * max_channels + ch]-1 == validation_image.data[i * max_channels + ch]) {
-                            close_pixels++;
-                        } else {
-                            bad_pixels++;
-                        }
-                        break;
-                    }
-                }
-            }
-            printf("\tImage pixels: ");
-            if (bad_pixels) {
-                printf("%sFail%s (%d/%u pixels contain the wrong colour)\n", CONSOLE_RED, CONSOLE_RESET, bad_pixels, o_size);
-            } else {
-                printf("%sPass%s\n", CONSOLE_GREEN, CONSOLE_RESET);
-            }
+        // Validate and report
+        if (cpu_options.band_sink) {
+            printf("%sImage was streamed to %s as it was rendered, validation skipped.%s\n", CONSOLE_YELLOW, config.output_file, CONSOLE_RESET);
         } else {
-            printf("\tImage pixels: %sFail%s\n", CONSOLE_RED, CONSOLE_RESET);
-        }
-    }
-
-    // Export output image
-    if (config.output_file) {
-        if (!stbi_write_png(config.output_file, output_image.width, output_image.height, output_image.channels, output_image.data, output_image.width * output_image.channels)) {
-            printf( "%sUnable to save image output to %s.%s\n", CONSOLE_YELLOW, config.output_file, CONSOLE_RESET);
-            // return EXIT_FAILURE;
+            validate_image(&config, &validation_image, &output_image);
         }
     }
 
 
     // Report timing information    
-    printf("%s Average execution timing from %d runs\n", mode_to_string(config.mode), TOTAL_RUNS);
+    printf("%s Average execution timing from %d runs", mode_to_string(config.mode), TOTAL_RUNS);
+    if (config.warmup)
+        printf(" (after %u warmup runs)", config.warmup);
+    printf("\n");
+#ifdef CUDA_ENABLED
     if (config.mode == CUDA) {
         int device_id = 0;
         CUDA_CALL(cudaGetDevice(&device_id));
@@ -295,6 +299,7 @@ int main(int argc, char **argv)
         CUDA_CALL(cudaGetDeviceProperties(&props, device_id));
         printf("Using GPU: %s\n", props.name);
     }
+#endif
 #ifdef _DEBUG
     printf("%sCode built as DEBUG, timing results are invalid!\n%s", CONSOLE_YELLOW, CONSOLE_RESET);
 #endif
@@ -303,22 +308,627 @@ int main(int argc, char **argv)
     printf("Stage 2: %.3fms%s%s%s\n", timing_log.stage2, getStage2SkipUsed() ? CONSOLE_YELLOW : "", getStage2SkipUsed() ? " (helper method used, time invalid)" : "", CONSOLE_RESET);
     printf("Stage 3: %.3fms%s%s%s\n", timing_log.stage3, getStage3SkipUsed() ? CONSOLE_YELLOW : "", getStage3SkipUsed() ? " (helper method used, time invalid)" : "", CONSOLE_RESET);
     printf("Free: %.3fms\n", timing_log.cleanup);
+    printf("Write: %.3fms%s\n", timing_log.write, cpu_options.band_sink ? " (including rows written during stage 2)" : "");
     printf("Total: %.3fms%s%s%s\n", timing_log.total, getSkipUsed() ? CONSOLE_YELLOW : "", getSkipUsed() ? " (helper method used, time invalid)" : "", CONSOLE_RESET);
+    if (TOTAL_RUNS > 1)
+        bench_print(&bench_result);
+    if (counting) {
+        // Stage times are accumulated over the same runs as the counts
+        const float stage_milliseconds[COUNTER_STAGES] = {
+            bench_result.stages[1].mean * TOTAL_RUNS, bench_result.stages[2].mean * TOTAL_RUNS, bench_result.stages[3].mean * TOTAL_RUNS };
+        counters_print(stage_counts, stage_milliseconds, TOTAL_RUNS,
+            reference_contributions(particles, particles_count, config.out_image_width, config.out_image_height));
+        counters_close();
+    }
+    if (config.bench_output) {
+        if (bench_write(config.bench_output, argc, argv, &bench_result, 1))
+            printf("Benchmark report written to %s\n", config.bench_output);
+        else
+            printf("%sUnable to write benchmark report to %s.%s\n", CONSOLE_YELLOW, config.bench_output, CONSOLE_RESET);
+    }
 
     // Cleanup
+#ifdef CUDA_ENABLED
     cudaDeviceReset();
+#endif
+    cpu_destroy(cpu_context);
     free(validation_image.data);
-    free(particles);
+    if (scene.data)
+        scene_close(&scene);
+    else
+        free(particles);
     free(output_image.data);
     if (config.output_file)
         free(config.output_file);
+    if (config.scene_file)
+        free(config.scene_file);
+    if (config.reference_cache)
+        free(config.reference_cache);
+    if (config.bench_output)
+        free(config.bench_output);
+    if (config.heatmap_file)
+        free(config.heatmap_file);
     return EXIT_SUCCESS;
 }
+void render_run(const Config *config, const Particle *particles, const unsigned int particles_count, CImage *output_image, Runtimes *runtimes,
+    double stage_counts[COUNTER_STAGES][COUNTER_EVENTS]) {
+    Timestamp startT, initT, stage1T, stage2T, stage3T, stopT, writeT;
+    CounterSample samples[COUNTER_STAGES + 1];
+    timestamp_create(&startT);
+    timestamp_create(&initT);
+    timestamp_create(&stage1T);
+    timestamp_create(&stage2T);
+    timestamp_create(&stage3T);
+    timestamp_create(&stopT);
+    timestamp_create(&writeT);
+    memset(runtimes, 0, sizeof(Runtimes));
+    band_write_time = 0;
+    // Each run streams a complete file, rows are passed to the writer during the stages
+    if (cpu_options.band_sink) {
+        cpu_options.band_sink_user = image_writer_open(config->output_file, config->out_image_width, config->out_image_height);
+        if (!cpu_options.band_sink_user) {
+            printf("%sUnable to save image output to %s.%s\n", CONSOLE_YELLOW, config->output_file, CONSOLE_RESET);
+            cpu_options.band_sink = 0;
+        }
+    }
+    // Run Particles algorithm
+    timestamp_record(&startT);
+    switch (config->mode) {
+    case CPU:
+        {
+            // The stages have reported why they failed
+            if (!cpu_begin(cpu_context, &cpu_options, particles, particles_count, config->out_image_width, config->out_image_height))
+                exit(EXIT_FAILURE);
+            timestamp_record(&initT);
+            counters_sample(&samples[0]);
+            if (!cpu_stage1(cpu_context))
+                exit(EXIT_FAILURE);
+            counters_sample(&samples[1]);
+            timestamp_record(&stage1T);
+            if (!cpu_stage2(cpu_context))
+                exit(EXIT_FAILURE);
+            counters_sample(&samples[2]);
+            timestamp_record(&stage2T);
+            if (!cpu_stage3(cpu_context))
+                exit(EXIT_FAILURE);
+            counters_sample(&samples[3]);
+            timestamp_record(&stage3T);
+            cpu_end(cpu_context, output_image);
+        }
+        break;
+    case OPENMP:
+        {
+            openmp_begin(particles, particles_count, config->out_image_width, config->out_image_height);
+            timestamp_record(&initT);
+            counters_sample(&samples[0]);
+            openmp_stage1();
+            counters_sample(&samples[1]);
+            timestamp_record(&stage1T);
+            openmp_stage2();
+            counters_sample(&samples[2]);
+            timestamp_record(&stage2T);
+            openmp_stage3();
+            counters_sample(&samples[3]);
+            timestamp_record(&stage3T);
+            openmp_end(output_image);
+        }
+        break;
+    case CUDA:
+#ifdef CUDA_ENABLED
+        {
+            cuda_begin(particles, particles_count, config->out_image_width, config->out_image_height);
+            CUDA_CHECK();
+            timestamp_record(&initT);
+            cuda_stage1();
+            CUDA_CHECK();
+            timestamp_record(&stage1T);
+            cuda_stage2();
+            CUDA_CHECK();
+            timestamp_record(&stage2T);
+            cuda_stage3();
+            CUDA_CHECK();
+            timestamp_record(&stage3T);
+            cuda_end(output_image);
+        }
+#endif
+        break;
+    case EXPORT:
+    case SERVE:
+        break;  // Handled before rendering
+    }
+    timestamp_record(&stopT);
+    if (cpu_options.band_sink) {
+        if (!image_writer_close((ImageWriter*)cpu_options.band_sink_user))
+            printf("%sUnable to save image output to %s.%s\n", CONSOLE_YELLOW, config->output_file, CONSOLE_RESET);
+        cpu_options.band_sink_user = 0;
+        timestamp_record(&writeT);
+        runtimes->write = timestamp_elapsed(stopT, writeT) + band_write_time;
+    } else if (config->output_file && output_image->data) {
+        // Otherwise each run writes the complete image once rendered, so that every run's write is timed
+        ImageWriter *writer = image_writer_open(config->output_file, output_image->width, output_image->height);
+        int success = writer != 0;
+        if (writer) {
+            success &= image_writer_write_rows(writer, output_image->data, 0, output_image->height);
+            success &= image_writer_close(writer);
+        }
+        if (!success)
+            printf("%sUnable to save image output to %s.%s\n", CONSOLE_YELLOW, config->output_file, CONSOLE_RESET);
+        timestamp_record(&writeT);
+        runtimes->write = timestamp_elapsed(stopT, writeT);
+    }
+    runtimes->init = timestamp_elapsed(startT, initT);
+    runtimes->stage1 = timestamp_elapsed(initT, stage1T);
+    // The rows written during stage 2 are timed as part of the write, as when the image is written once rendered
+    runtimes->stage2 = timestamp_elapsed(stage1T, stage2T) - band_write_time;
+    runtimes->stage3 = timestamp_elapsed(stage2T, stage3T);
+    runtimes->cleanup = timestamp_elapsed(stage3T, stopT);
+    runtimes->total = timestamp_elapsed(startT, stopT) - band_write_time;
+    if (stage_counts && (config->mode == CPU || config->mode == OPENMP)) {
+        for (int stage = 0; stage < COUNTER_STAGES; ++stage)
+            counters_accumulate(&samples[stage], &samples[stage + 1], stage_counts[stage]);
+    }
+    timestamp_destroy(startT);
+    timestamp_destroy(initT);
+    timestamp_destroy(stage1T);
+    timestamp_destroy(stage2T);
+    timestamp_destroy(stage3T);
+    timestamp_destroy(stopT);
+    timestamp_destroy(writeT);
+}
+void bench_summarise(const Config *config, const unsigned int particles_count, const Runtimes *runtimes, const unsigned int runs, BenchResult *result) {
+    memset(result, 0, sizeof(BenchResult));
+    result->mode = mode_to_string(config->mode);
+    result->particles_count = particles_count;
+    result->width = config->out_image_width;
+    result->height = config->out_image_height;
+    result->warmup = config->warmup;
+    result->runs = runs;
+    // Gather each stage's samples, in the order of bench_stage_names
+    float *samples = (float*)malloc(runs * sizeof(float));
+    for (int s = 0; s < BENCH_STAGES; ++s) {
+        for (unsigned int r = 0; r < runs; ++r) {
+            const Runtimes *t = &runtimes[r];
+            const float stage_samples[BENCH_STAGES] = { t->init, t->stage1, t->stage2, t->stage3, t->cleanup, t->write, t->total };
+            samples[r] = stage_samples[s];
+        }
+        bench_stats(samples, runs, &result->stages[s]);
+    }
+    free(samples);
+}
+void sweep(const Config *config, int argc, char **argv) {
+    const unsigned int dims_count = config->sweep_dims_count ? config->sweep_dims_count : 1;
+    const unsigned int counts_count = config->sweep_counts_count ? config->sweep_counts_count : 1;
+    BenchResult *results = (BenchResult*)malloc(dims_count * counts_count * sizeof(BenchResult));
+    Runtimes *run_log = (Runtimes*)malloc(config->runs * sizeof(Runtimes));
+    printf("%s sweep, %u warmup and %u timed runs per configuration (validation and output are skipped)\n",
+        mode_to_string(config->mode), config->warmup, config->runs);
+    printf("%12s %12s %12s %12s %12s %12s\n", "Particles", "Dimensions", "Median (ms)", "p95 (ms)", "p99 (ms)", "Stddev (ms)");
+    unsigned int results_count = 0;
+    for (unsigned int d = 0; d < dims_count; ++d) {
+        for (unsigned int c = 0; c < counts_count; ++c) {
+            Config run_config = *config;
+            if (config->sweep_dims_count) {
+                run_config.out_image_width = config->sweep_dims[2 * d];
+                run_config.out_image_height = config->sweep_dims[2 * d + 1];
+            }
+            if (config->sweep_counts_count)
+                run_config.circle_count = config->sweep_counts[c];
+            run_config.output_file = 0;
+            Particle *particles = (Particle*)malloc(run_config.circle_count * sizeof(Particle));
+            generate_particles(&run_config, particles);
+            CImage output_image;
+            output_image.data = (unsigned char*)malloc(run_config.out_image_width * run_config.out_image_height * 3 * sizeof(unsigned char));
+            for (int runs = -(int)config->warmup; runs < (int)config->runs; ++runs) {
+                Runtimes warmup_log;
+                unsigned char *output_image_data = output_image.data;
+                memset(&output_image, 0, sizeof(CImage));
+                output_image.data = output_image_data;
+                render_run(&run_config, particles, run_config.circle_count, &output_image, runs < 0 ? &warmup_log : &run_log[runs], 0);
+            }
+            BenchResult *result = &results[results_count++];
+            bench_summarise(&run_config, run_config.circle_count, run_log, config->runs, result);
+            char dims[32];
+            sprintf(dims, "%ux%u", run_config.out_image_width, run_config.out_image_height);
+            const BenchStats *total = &result->stages[BENCH_STAGES - 1];
+            printf("%12u %12s %12.3f %12.3f %12.3f %12.3f\n", run_config.circle_count, dims, total->median, total->p95, total->p99, total->stddev);
+            free(output_image.data);
+            free(particles);
+        }
+    }
+    if (config->bench_output) {
+        if (bench_write(config->bench_output, argc, argv, results, results_count))
+            printf("Benchmark report written to %s\n", config->bench_output);
+        else
+            printf("%sUnable to write benchmark report to %s.%s\n", CONSOLE_YELLOW, config->bench_output, CONSOLE_RESET);
+    }
+    free(run_log);
+    free(results);
+}
+void generate_particles(const Config *config, Particle *particles) {
+    if (!config->legacy_generator) {
+        generator_particles(config->seed, config->circle_count, config->out_image_width, config->out_image_height,
+            0, config->circle_count, particles);
+        return;
+    }
+    // Legacy serial generator, reproduces the particles of earlier versions exactly (with the default seed)
+    // Random engine with a fixed seed and several distributions to be used
+    std::mt19937 rng((std::mt19937::result_type)config->seed);
+    std::uniform_real_distribution<float> normalised_float_dist(0, 1);
+    std::normal_distribution<float> circle_rad_dist(CIRCLE_RAD_AVERAGE, CIRCLE_RAD_STDDEV);
+    std::normal_distribution<float> circle_opacity_dist(CIRCLE_OPACITY_AVERAGE, CIRCLE_OPACITY_STDDEV);
+    std::uniform_int_distribution<int> color_palette_dist(0, sizeof(base_color_palette)/sizeof(unsigned char[3]) - 1);
+    std::vector<float> depths(config->circle_count);
+    depths[0]=0;
+    for (unsigned int i = 1; i < config->circle_count; ++i) {
+        depths[i] = nextafterf(depths[i-1], FLT_MAX);
+    }
+    shuffle(depths.begin(), depths.end(), rng);
+    // Common
+    for (unsigned int i = 0; i < config->circle_count; ++i) {
+        const int palette_index = color_palette_dist(rng);
+        particles[i].color[0] = base_color_palette[palette_index][0];
+        particles[i].color[1] = base_color_palette[palette_index][1];
+        particles[i].color[2] = base_color_palette[palette_index][2];
+        particles[i].location[0] = normalised_float_dist(rng) * config->out_image_width;
+        particles[i].location[1] = normalised_float_dist(rng) * config->out_image_height;
+        particles[i].location[2] = depths[i];
+        // Circle specific
+        particles[i].radius = circle_rad_dist(rng);
+        float t_opacity = circle_opacity_dist(rng);
+        t_opacity = t_opacity < MIN_OPACITY ? MIN_OPACITY : t_opacity;
+        t_opacity = t_opacity > MAX_OPACITY ? MAX_OPACITY : t_opacity;
+        particles[i].color[3] = (unsigned char)(255 * t_opacity);
+    }
+    // Clamp radius to bounds (use OpenMP in an attempt to trigger OpenMPs hidden init cost)
+#pragma omp parallel for 
+    for (int i = 0; i < (int)config->circle_count; ++i) {
+        particles[i].radius = particles[i].radius < MIN_RADIUS ? MIN_RADIUS : particles[i].radius;
+        particles[i].radius = particles[i].radius > MAX_RADIUS ? MAX_RADIUS : particles[i].radius;
+    }
+}
+void report_diagnostics(const Config *config, const Particle *particles, const unsigned int particles_count) {
+    const unsigned int width = config->out_image_width;
+    const unsigned int height = config->out_image_height;
+    unsigned int *pixel_contribs = (unsigned int*)malloc((size_t)width * height * sizeof(unsigned int));
+    Timestamp startT, stopT;
+    timestamp_create(&startT);
+    timestamp_create(&stopT);
+    timestamp_record(&startT);
+    reference_pixel_contribs(particles, particles_count, width, height, pixel_contribs);
+    DepthComplexity stats;
+    diagnostics_analyse(pixel_contribs, width, height, config->tile_size, 0, &stats);
+    timestamp_record(&stopT);
+    diagnostics_print(&stats);
+    printf("Analysed depth complexity in %.3fms\n", timestamp_elapsed(startT, stopT));
+    timestamp_destroy(startT);
+    timestamp_destroy(stopT);
+    if (config->heatmap_file) {
+        if (diagnostics_heatmap(config->heatmap_file, pixel_contribs, width, height, stats.max))
+            printf("Overdraw heatmap (log scale, max %u) written to %s\n", stats.max, config->heatmap_file);
+        else
+            printf("%sUnable to write overdraw heatmap to %s.%s\n", CONSOLE_YELLOW, config->heatmap_file, CONSOLE_RESET);
+    }
+    free(pixel_contribs);
+}
+void render_reference(const Config *config, const Particle *particles, const unsigned int particles_count, CImage *image) {
+    memset(image, 0, sizeof(CImage));
+    if (config->validation == VALIDATE_NONE)
+        return;
+    const unsigned int row_stride = config->validation == VALIDATE_SAMPLE ? VALIDATION_SAMPLE_STRIDE : 1;
+    Timestamp startT, stopT;
+    timestamp_create(&startT);
+    timestamp_create(&stopT);
+    timestamp_record(&startT);
+    // Only full reference images are cached, sampled images are cheap to render
+    unsigned long long hash = 0;
+    int cached = 0;
+    if (config->reference_cache && row_stride == 1) {
+        hash = reference_hash(particles, particles_count);
+        cached = reference_cache_load(config->reference_cache, hash, particles_count, config->out_image_width, config->out_image_height, image);
+    }
+    if (!cached) {
+        reference_render(particles, particles_count, config->out_image_width, config->out_image_height, row_stride, image);
+        if (config->reference_cache && row_stride == 1 && !reference_cache_store(config->reference_cache, hash, particles_count, image))
+            printf("%sUnable to store reference image in %s.%s\n", CONSOLE_YELLOW, config->reference_cache, CONSOLE_RESET);
+    }
+    timestamp_record(&stopT);
+    printf("Reference image %s in %.3fms", cached ? "loaded from cache" : "rendered", timestamp_elapsed(startT, stopT));
+    if (row_stride > 1)
+        printf(" (every %uth row sampled)", row_stride);
+    printf("\n");
+    timestamp_destroy(startT);
+    timestamp_destroy(stopT);
+}
+void validate_image(const Config *config, const CImage *validation_image, const CImage *output_image) {
+    if (!validation_image->data) {
+        printf("%sValidation skipped.%s\n", CONSOLE_YELLOW, CONSOLE_RESET);
+        return;
+    }
+    const int row_stride = config->validation == VALIDATE_SAMPLE ? VALIDATION_SAMPLE_STRIDE : 1;
+    printf("\rValidation Status%s: \n", row_stride > 1 ? " (sampled rows)" : "");
+    printf("\tImage width: %s%s%s\n", validation_image->width == output_image->width ? CONSOLE_GREEN : CONSOLE_RED, validation_image->width == output_image->width ? "Pass" :  "Fail", CONSOLE_RESET);
+    printf("\tImage height: %s%s%s\n", validation_image->height == output_image->height ? CONSOLE_GREEN : CONSOLE_RED, validation_image->height == output_image->height ? "Pass" : "Fail", CONSOLE_RESET);
+    printf("\tImage channels: %s%s%s\n", validation_image->channels == output_image->channels ? CONSOLE_GREEN : CONSOLE_RED, validation_image->channels == output_image->channels ? "Pass" : "Fail", CONSOLE_RESET);
+    const int v_size = validation_image->width * validation_image->height;
+    const int o_size = output_image->width * output_image->height;
+    const int s_size = v_size < o_size ? v_size : o_size;
+    const int max_channels = validation_image->channels > output_image->channels ? output_image->channels : validation_image->channels;
+    int bad_pixels = 0;
+    int close_pixels = 0;
+    if (output_image->data && s_size) {
+        for (int i = 0; i < s_size; ++i) {
+            if ((i / validation_image->width) % row_stride)
+                continue;
+            for (int ch = 0; ch < max_channels; ++ch) {
+                if (output_image->data[i * max_channels + ch] != validation_image->data[i * max_channels + ch]) {
+                    // Give a +-1 threshold for error (incase fast-math triggers a small difference in places)
+                    if (output_image->data[i * max_channels + ch]+1 == validation_image->data[i * max_channels + ch] ||
+                        output_image->data[i * max_channels + ch]-1 == validation_image->data[i * max_channels + ch]) {
+                        close_pixels++;
+                    } else {
+                        bad_pixels++;
+                    }
+                    break;
+                }
+            }
+        }
+        printf("\tImage pixels: ");
+        if (bad_pixels) {
+            printf("%sFail%s (%d/%u pixels contain the wrong colour)\n", CONSOLE_RED, CONSOLE_RESET, bad_pixels, o_size);
+        } else {
+            printf("%sPass%s\n", CONSOLE_GREEN, CONSOLE_RESET);
+        }
+    } else {
+        printf("\tImage pixels: %sFail%s\n", CONSOLE_RED, CONSOLE_RESET);
+    }
+}
+int write_image(const char *path, const CImage *image) {
+    ImageWriter *writer = image_writer_open(path, image->width, image->height);
+    if (!writer)
+        return 0;
+    const int success = image_writer_write_rows(writer, image->data, 0, image->height);
+    return image_writer_close(writer) && success;
+}
+void write_band_rows(const unsigned char *rows, const unsigned int first_row, const unsigned int row_count, void *user) {
+    Timestamp startT, stopT;
+    timestamp_create(&startT);
+    timestamp_create(&stopT);
+    timestamp_record(&startT);
+    const int success = image_writer_write_rows((ImageWriter*)user, rows, first_row, row_count);
+    timestamp_record(&stopT);
+    band_write_time += timestamp_elapsed(startT, stopT);
+    timestamp_destroy(startT);
+    timestamp_destroy(stopT);
+    if (!success) {
+        printf("%sUnable to write rows %u-%u of the output image.%s\n", CONSOLE_YELLOW, first_row, first_row + row_count - 1, CONSOLE_RESET);
+    }
+}
+void animate(const Config *config, Particle *particles, const unsigned int particles_count) {
+    if (config->mode != CPU && config->mode != OPENMP) {
+        fprintf(stderr, "Animation is only supported by the CPU and OPENMP modes.\n");
+        return;
+    }
+    const int width = (int)config->out_image_width;
+    const int height = (int)config->out_image_height;
+    // Give each particle a constant velocity, in a random direction with a random speed up to config->velocity
+    // This uses its own fixed seed, so that the first frame matches the static render
+    float *velocities = (float*)malloc(particles_count * 2 * sizeof(float));
+    {
+        std::mt19937 rng(13);
+        std::uniform_real_distribution<float> normalised_float_dist(0, 1);
+        for (unsigned int i = 0; i < particles_count; ++i) {
+            const float angle = normalised_float_dist(rng) * 2 * 3.14159265f;
+            // The first config->moving of the (randomly placed) particles move, the remainder are stationary
+            const float speed = (float)i < config->moving * (float)particles_count ? normalised_float_dist(rng) * config->velocity : 0.0f;
+            velocities[i * 2 + 0] = cosf(angle) * speed;
+            velocities[i * 2 + 1] = sinf(angle) * speed;
+        }
+    }
+    // Numbered PNG/PPM files insert _<frame> before the extension, raw output appends every frame to a single file
+    const int raw_output = config->output_file && image_format_from_path(config->output_file) == IMAGE_FORMAT_RAW;
+    FILE *raw_file = 0;
+    char *frame_path = 0;
+    if (raw_output) {
+        raw_file = fopen(config->output_file, "wb");
+        if (!raw_file)
+            printf("%sUnable to save image output to %s.%s\n", CONSOLE_YELLOW, config->output_file, CONSOLE_RESET);
+    } else if (config->output_file) {
+        frame_path = (char*)malloc(strlen(config->output_file) + 20);
+    }
+
+    CImage output_image;
+    output_image.width = width;
+    output_image.height = height;
+    output_image.channels = 3;
+    output_image.data = (unsigned char*)malloc(width * height * 3 * sizeof(unsigned char));
+    // Per frame timing, the update includes advancing the particles and passing them to the implementation
+    float *frame_times = (float*)malloc(config->frames * 5 * sizeof(float));
+    enum { UPDATE, STAGE1, STAGE2, STAGE3, WRITE };
+    Runtimes totals;
+    memset(&totals, 0, sizeof(Runtimes));
+    Timestamp startT, initT, updateT, stage1T, stage2T, stage3T, writeT, stopT;
+    timestamp_create(&startT);
+    timestamp_create(&initT);
+    timestamp_create(&updateT);
+    timestamp_create(&stage1T);
+    timestamp_create(&stage2T);
+    timestamp_create(&stage3T);
+    timestamp_create(&writeT);
+    timestamp_create(&stopT);
+
+    // Allocate once, then render every frame with the same state
+    timestamp_record(&startT);
+    if (config->mode == CPU) {
+        // cpu_begin() has reported why it failed
+        if (!cpu_begin(cpu_context, &cpu_options, particles, particles_count, config->out_image_width, config->out_image_height))
+            exit(EXIT_FAILURE);
+    } else {
+        openmp_begin(particles, particles_count, config->out_image_width, config->out_image_height);
+    }
+    timestamp_record(&initT);
+    totals.init = timestamp_elapsed(startT, initT);
+    printf("%8s %10s %10s %10s %10s %10s\n", "frame", "update", "stage 1", "stage 2", "stage 3", "write");
+    for (unsigned int frame = 0; frame < config->frames; ++frame) {
+        Timestamp frameT;
+        timestamp_create(&frameT);
+        timestamp_record(&frameT);
+        if (frame) {
+            // Integrate positions, wrapping at the image edges so that the particle density remains constant
+            for (unsigned int i = 0; i < particles_count; ++i) {
+                float x = particles[i].location[0] + velocities[i * 2 + 0];
+                float y = particles[i].location[1] + velocities[i * 2 + 1];
+                x = x < 0 ? x + width : (x >= width ? x - width : x);
+                y = y < 0 ? y + height : (y >= height ? y - height : y);
+                particles[i].location[0] = x;
+                particles[i].location[1] = y;
+            }
+            if (config->mode == CPU) {
+                cpu_update(cpu_context, particles);
+            } else {
+                openmp_update(particles);
+            }
+        }
+        timestamp_record(&updateT);
+        if (config->mode == CPU) {
+            // The stages have reported why they failed
+            if (!cpu_stage1(cpu_context))
+                exit(EXIT_FAILURE);
+            timestamp_record(&stage1T);
+            if (!cpu_stage2(cpu_context))
+                exit(EXIT_FAILURE);
+            timestamp_record(&stage2T);
+            if (!cpu_stage3(cpu_context))
+                exit(EXIT_FAILURE);
+            timestamp_record(&stage3T);
+            cpu_output(cpu_context, &output_image);
+        } else {
+            openmp_stage1();
+            timestamp_record(&stage1T);
+            openmp_stage2();
+            timestamp_record(&stage2T);
+            openmp_stage3();
+            timestamp_record(&stage3T);
+            openmp_output(&output_image);
+        }
+        if (raw_file) {
+            fwrite(output_image.data, sizeof(unsigned char), width * height * 3, raw_file);
+        } else if (frame_path) {
+            const size_t stem_len = strlen(config->output_file) - 4;
+            memcpy(frame_path, config->output_file, stem_len);
+            sprintf(frame_path + stem_len, "_%04u%s", frame, config->output_file + stem_len);
+            if (!write_image(frame_path, &output_image)) {
+                printf("%sUnable to save image output to %s.%s\n", CONSOLE_YELLOW, frame_path, CONSOLE_RESET);
+            }
+        }
+        timestamp_record(&writeT);
+        float *t = frame_times + frame * 5;
+        t[UPDATE] = timestamp_elapsed(frameT, updateT);
+        t[STAGE1] = timestamp_elapsed(updateT, stage1T);
+        t[STAGE2] = timestamp_elapsed(stage1T, stage2T);
+        t[STAGE3] = timestamp_elapsed(stage2T, stage3T);
+        t[WRITE] = timestamp_elapsed(stage3T, writeT);
+        printf("%8u %10.3f %10.3f %10.3f %10.3f %10.3f\n", frame, t[UPDATE], t[STAGE1], t[STAGE2], t[STAGE3], t[WRITE]);
+        timestamp_destroy(frameT);
+    }
+    timestamp_record(&stage3T);
+    if (config->mode == CPU) {
+        cpu_end(cpu_context, &output_image);
+    } else {
+        openmp_end(&output_image);
+    }
+    timestamp_record(&stopT);
+    totals.cleanup = timestamp_elapsed(stage3T, stopT);
+
+    // Validate the final frame
+    CImage validation_image;
+    render_reference(config, particles, particles_count, &validation_image);
+    validate_image(config, &validation_image, &output_image);
+
+    // Steady state excludes the first frame, which pays for the first touch of memory, amortised includes init and free
+    float steady[5] = {0, 0, 0, 0, 0};
+    for (unsigned int frame = config->frames > 1 ? 1 : 0; frame < config->frames; ++frame) {
+        for (int k = 0; k < 5; ++k)
+            steady[k] += frame_times[frame * 5 + k];
+    }
+    const unsigned int steady_frames = config->frames > 1 ? config->frames - 1 : 1;
+    float render_total = 0;
+    for (unsigned int frame = 0; frame < config->frames; ++frame) {
+        for (int k = UPDATE; k <= STAGE3; ++k)
+            render_total += frame_times[frame * 5 + k];
+    }
+    printf("%s animation timing from %u frames\n", mode_to_string(config->mode), config->frames);
+#ifdef _DEBUG
+    printf("%sCode built as DEBUG, timing results are invalid!\n%s", CONSOLE_YELLOW, CONSOLE_RESET);
+#endif
+    printf("Init: %.3fms\n", totals.init);
+    printf("First frame: %.3fms\n", frame_times[UPDATE] + frame_times[STAGE1] + frame_times[STAGE2] + frame_times[STAGE3]);
+    printf("Steady state per frame (excluding the first):\n");
+    printf("\tUpdate: %.3fms\n", steady[UPDATE] / steady_frames);
+    printf("\tStage 1: %.3fms\n", steady[STAGE1] / steady_frames);
+    printf("\tStage 2: %.3fms\n", steady[STAGE2] / steady_frames);
+    printf("\tStage 3: %.3fms\n", steady[STAGE3] / steady_frames);
+    printf("\tTotal: %.3fms (%.1f frames/s)\n", (steady[UPDATE] + steady[STAGE1] + steady[STAGE2] + steady[STAGE3]) / steady_frames,
+        1000.0f * steady_frames / (steady[UPDATE] + steady[STAGE1] + steady[STAGE2] + steady[STAGE3]));
+    printf("\tWrite: %.3fms\n", steady[WRITE] / steady_frames);
+    printf("Free: %.3fms\n", totals.cleanup);
+    printf("Amortised per frame (including init and free): %.3fms\n", (totals.init + render_total + totals.cleanup) / config->frames);
+
+    timestamp_destroy(startT);
+    timestamp_destroy(initT);
+    timestamp_destroy(updateT);
+    timestamp_destroy(stage1T);
+    timestamp_destroy(stage2T);
+    timestamp_destroy(stage3T);
+    timestamp_destroy(writeT);
+    timestamp_destroy(stopT);
+    if (raw_file)
+        fclose(raw_file);
+    free(frame_path);
+    free(frame_times);
+    free(validation_image.data);
+    free(output_image.data);
+    free(velocities);
+}
+/**
+ * Parse a comma separated list of values, returning the number parsed or 0 on failure
+ * @param values Set to an allocated array of values_per_item * (number of items) values, which must be freed by the caller
+ * @param values_per_item 1 to parse each item as a positive integer, 2 to parse each item as image dimensions
+ */
+static unsigned int parse_list(const char *arg, const unsigned int values_per_item, unsigned int **values) {
+    unsigned int count = 1;
+    for (const char *c = arg; *c; ++c)
+        count += *c == ',';
+    *values = (unsigned int*)malloc(count * values_per_item * sizeof(unsigned int));
+    const char *item = arg;
+    for (unsigned int i = 0; i < count; ++i) {
+        const size_t item_len = strcspn(item, ",");
+        char item_copy[64];
+        if (!item_len || item_len >= sizeof(item_copy))
+            return 0;
+        memcpy(item_copy, item, item_len);
+        item_copy[item_len] = '\0';
+        if (values_per_item == 2) {
+            if (!bench_parse_dimensions(item_copy, "xX", &(*values)[2 * i], &(*values)[2 * i + 1]))
+                return 0;
+        } else {
+            const int value = atoi(item_copy);
+            if (value <= 0)
+                return 0;
+            (*values)[i] = (unsigned int)value;
+        }
+        item += item_len + 1;
+    }
+    return count;
+}
 void parse_args(int argc, char **argv, Config *config) {
     // Clear config struct
     memset(config, 0, sizeof(Config));
-    if (argc < 4 || argc > 6) {
-        fprintf(stderr, "Program expects 3-5 arguments, only %d provided.\n", argc-1);
+    config->velocity = 1.0f;
+    config->moving = 1.0f;
+    config->seed = 12;
+    config->warmup = -1;
+    if (argc < 4) {
+        fprintf(stderr, "Program expects at least 3 arguments, only %d provided.\n", argc-1);
         print_help(argv[0]);
     }
     // Parse first arg as mode
@@ -335,40 +945,57 @@ void parse_args(int argc, char **argv, Config *config) {
             config->mode = CPU;
         } else if (!strcmp(lower_arg, "openmp")) {
             config->mode = OPENMP;
+        } else if (!strcmp(lower_arg, "export")) {
+            config->mode = EXPORT;
+        } else if (!strcmp(lower_arg, "serve")) {
+            config->mode = SERVE;
         } else if (!strcmp(lower_arg, "cuda") || !strcmp(lower_arg, "gpu")) {
+#ifdef CUDA_ENABLED
             config->mode = CUDA;
+#else
+            fprintf(stderr, "CUDA mode is not available, this executable was built without the CUDA toolkit.\n");
+            print_help(argv[0]);
+#endif
         } else {
             fprintf(stderr, "Unexpected string provided as first argument: '%s' .\n", argv[1]);
-            fprintf(stderr, "First argument expects a single mode as string: CPU, OPENMP, CUDA.\n");
+            fprintf(stderr, "First argument expects a single mode as string: CPU, OPENMP, CUDA, EXPORT, SERVE.\n");
             print_help(argv[0]);
         }
     }
-    // Parse second arg as number of particles
-    {
+    // Serve mode takes the number of workers and the source of its jobs, in place of the particles and image dimensions
+    if (config->mode == SERVE) {
+        char *end;
+        const long workers = strtol(argv[2], &end, 10);
+        if (*end || end == argv[2] || workers < 0) {
+            fprintf(stderr, "Unexpected uint provided as second argument: '%s' .\n", argv[2]);
+            fprintf(stderr, "Serve mode expects the number of worker threads (0 for one per OpenMP thread).\n");
+            print_help(argv[0]);
+        }
+        config->serve_workers = (unsigned int)workers;
+        if (strcmp(argv[3], "-")) {
+            config->serve_socket = (char*)malloc(strlen(argv[3]) + 1);
+            strcpy(config->serve_socket, argv[3]);
+        }
+    }
+    // Parse second arg as number of particles, or a scene file to load them from
+    if (config->mode != SERVE) {
         int particle_arg = atoi(argv[2]);
-        if (particle_arg > 0) {
+        if (config->mode != EXPORT && bench_has_extension(argv[2], SCENE_EXTENSION)) {
+            config->scene_file = (char*)malloc(strlen(argv[2]) + 1);
+            strcpy(config->scene_file, argv[2]);
+        } else if (particle_arg > 0) {
             config->circle_count = (unsigned int )particle_arg;
         } else {
             fprintf(stderr, "Unexpected uint provided as second argument: '%s' .\n", argv[2]);
-            fprintf(stderr, "Second argument expects the number of particles to generate.\n");
+            fprintf(stderr, "Second argument expects the number of particles to generate, or a %s file.\n", SCENE_EXTENSION);
             print_help(argv[0]);
         }
     }
     // Parse third arg as output image dimensions
-    {
+    if (config->mode != SERVE) {
         // Attempt to parse as two uints, delimited by , or x or X
-        const int in_width = atoi(strtok(argv[3], ",xX"));
-        const char *in_height_str = strtok(NULL, ",xX");
-        const int in_height = in_height_str ? atoi(in_height_str) : 0;
-        const char *in_end = strtok(NULL, ",x");
-        if (in_width > 0 && in_height > 0 && in_end == NULL) {  // width + height provided
-            config->out_image_width = (unsigned int)in_width;
-            config->out_image_height = (unsigned int)in_height;
-        } else if (in_width > 0 && in_height == 0 && in_end == NULL) {  // Only width provided
-            config->out_image_width = (unsigned int)in_width;
-            config->out_image_height = (unsigned int)in_width;
-        } else {
-            fprintf(stderr, "Unable to parse input provided as third argument: '%s' .\n", argv[2]);
+        if (!bench_parse_dimensions(argv[3], ",xX", &config->out_image_width, &config->out_image_height)) {
+            fprintf(stderr, "Unable to parse input provided as third argument: '%s' .\n", argv[3]);
             fprintf(stderr, "Third argument expects the image dimensions (e.g. 512 or 512x1024).\n");
             print_help(argv[0]);
         }
@@ -393,7 +1020,216 @@ void parse_args(int argc, char **argv, Config *config) {
             config->benchmark = 1;
             continue;
         }
-        if (!strcmp(t_arg + arg_len - 5, ".png")) {
+        if (!strcmp("--tile", t_arg) && i + 1 < argc) {
+            const int tile_arg = atoi(argv[++i]);
+            if (tile_arg <= 0) {
+                fprintf(stderr, "Unexpected value provided for --tile: '%s' .\n", argv[i]);
+                print_help(argv[0]);
+            }
+            config->tile_size = (unsigned int)tile_arg;
+            continue;
+        }
+        if (!strcmp("--spans", t_arg)) {
+            config->span_coverage = 1;
+            continue;
+        }
+        if (!strcmp("--presort", t_arg)) {
+            config->presort = 1;
+            continue;
+        }
+        if (!strcmp("--stream", t_arg)) {
+            config->stream = 1;
+            continue;
+        }
+        if (!strcmp("--packed", t_arg)) {
+            config->packed = 1;
+            continue;
+        }
+        if (!strcmp("--band-budget", t_arg) && i + 1 < argc) {
+            const int budget_arg = atoi(argv[++i]);
+            if (budget_arg <= 0) {
+                fprintf(stderr, "Unexpected value provided for --band-budget: '%s' .\n", argv[i]);
+                print_help(argv[0]);
+            }
+            config->band_budget = (size_t)budget_arg * 1024 * 1024;
+            continue;
+        }
+        if (!strcmp("--incremental", t_arg)) {
+            config->incremental = 1;
+            continue;
+        }
+        if (!strcmp("--arena", t_arg)) {
+            config->arena = 1;
+            continue;
+        }
+        if (!strcmp("--arena-huge", t_arg)) {
+            config->arena = 2;
+            continue;
+        }
+        if (!strcmp("--simd", t_arg) && i + 1 < argc) {
+            ++i;
+            SimdLevel level = SIMD_AUTO;
+            for (; level <= SIMD_AVX512; level = (SimdLevel)(level + 1)) {
+                if (!strcmp(simd_level_to_string(level), argv[i]))
+                    break;
+            }
+            if (level > SIMD_AVX512) {
+                fprintf(stderr, "Unexpected value provided for --simd: '%s' .\n", argv[i]);
+                print_help(argv[0]);
+            }
+            config->simd = level;
+            continue;
+        }
+        if (!strcmp("--blend", t_arg) && i + 1 < argc) {
+            ++i;
+            SimdBlendMode blend = SIMD_BLEND_FLOAT;
+            for (; blend <= SIMD_BLEND_FIXED; blend = (SimdBlendMode)(blend + 1)) {
+                if (!strcmp(simd_blend_mode_to_string(blend), argv[i]))
+                    break;
+            }
+            if (blend > SIMD_BLEND_FIXED) {
+                fprintf(stderr, "Unexpected value provided for --blend: '%s' .\n", argv[i]);
+                print_help(argv[0]);
+            }
+            config->blend = blend;
+            continue;
+        }
+        if (!strcmp("--frames", t_arg) && i + 1 < argc) {
+            const int frames_arg = atoi(argv[++i]);
+            if (frames_arg <= 0) {
+                fprintf(stderr, "Unexpected value provided for --frames: '%s' .\n", argv[i]);
+                print_help(argv[0]);
+            }
+            config->frames = (unsigned int)frames_arg;
+            continue;
+        }
+        if (!strcmp("--velocity", t_arg) && i + 1 < argc) {
+            config->velocity = (float)atof(argv[++i]);
+            if (config->velocity < 0) {
+                fprintf(stderr, "Unexpected value provided for --velocity: '%s' .\n", argv[i]);
+                print_help(argv[0]);
+            }
+            continue;
+        }
+        if (!strcmp("--moving", t_arg) && i + 1 < argc) {
+            config->moving = (float)atof(argv[++i]);
+            if (config->moving < 0 || config->moving > 1) {
+                fprintf(stderr, "Unexpected value provided for --moving: '%s' .\n", argv[i]);
+                print_help(argv[0]);
+            }
+            continue;
+        }
+        if (!strcmp("--seed", t_arg) && i + 1 < argc) {
+            char *seed_end;
+            config->seed = strtoull(argv[++i], &seed_end, 10);
+            if (seed_end == argv[i] || *seed_end) {
+                fprintf(stderr, "--seed expects an unsigned integer, '%s' provided.\n", argv[i]);
+                print_help(argv[0]);
+            }
+            continue;
+        }
+        if (!strcmp("--validate", t_arg) && i + 1 < argc) {
+            ++i;
+            if (!strcmp("full", argv[i])) {
+                config->validation = VALIDATE_FULL;
+            } else if (!strcmp("sample", argv[i])) {
+                config->validation = VALIDATE_SAMPLE;
+            } else if (!strcmp("none", argv[i])) {
+                config->validation = VALIDATE_NONE;
+            } else {
+                fprintf(stderr, "--validate expects one of: full, sample, none. '%s' provided.\n", argv[i]);
+                print_help(argv[0]);
+            }
+            continue;
+        }
+        if (!strcmp("--reference-cache", t_arg) && i + 1 < argc) {
+            ++i;
+            if (config->reference_cache)
+                free(config->reference_cache);
+            config->reference_cache = (char*)malloc(strlen(argv[i]) + 1);
+            strcpy(config->reference_cache, argv[i]);
+            continue;
+        }
+        if (!strcmp("--warmup", t_arg) && i + 1 < argc) {
+            config->warmup = atoi(argv[++i]);
+            if (config->warmup < 0) {
+                fprintf(stderr, "--warmup expects a non-negative integer, '%s' provided.\n", argv[i]);
+                print_help(argv[0]);
+            }
+            continue;
+        }
+        if (!strcmp("--runs", t_arg) && i + 1 < argc) {
+            const int runs_arg = atoi(argv[++i]);
+            if (runs_arg <= 0) {
+                fprintf(stderr, "--runs expects a positive integer, '%s' provided.\n", argv[i]);
+                print_help(argv[0]);
+            }
+            config->runs = (unsigned int)runs_arg;
+            continue;
+        }
+        if (!strcmp("--bench-output", t_arg) && i + 1 < argc) {
+            ++i;
+            if (!bench_format_supported(argv[i])) {
+                fprintf(stderr, "--bench-output expects a .json or .csv file, '%s' provided.\n", argv[i]);
+                print_help(argv[0]);
+            }
+            if (config->bench_output)
+                free(config->bench_output);
+            config->bench_output = (char*)malloc(strlen(argv[i]) + 1);
+            strcpy(config->bench_output, argv[i]);
+            continue;
+        }
+        if (!strcmp("--sweep-particles", t_arg) && i + 1 < argc) {
+            free(config->sweep_counts);
+            config->sweep_counts_count = parse_list(argv[++i], 1, &config->sweep_counts);
+            if (!config->sweep_counts_count) {
+                fprintf(stderr, "--sweep-particles expects a comma separated list of particle counts, '%s' provided.\n", argv[i]);
+                print_help(argv[0]);
+            }
+            continue;
+        }
+        if (!strcmp("--sweep-dims", t_arg) && i + 1 < argc) {
+            free(config->sweep_dims);
+            config->sweep_dims_count = parse_list(argv[++i], 2, &config->sweep_dims);
+            if (!config->sweep_dims_count) {
+                fprintf(stderr, "--sweep-dims expects a comma separated list of image dimensions (e.g. 512,1024x768), '%s' provided.\n", argv[i]);
+                print_help(argv[0]);
+            }
+            continue;
+        }
+        if (!strcmp("--diagnostics", t_arg)) {
+            config->diagnostics = 1;
+            continue;
+        }
+        if (!strcmp("--heatmap", t_arg) && i + 1 < argc) {
+            ++i;
+            if (image_format_from_path(argv[i]) == IMAGE_FORMAT_UNKNOWN) {
+                fprintf(stderr, "--heatmap expects a .png, .ppm or .raw image, '%s' provided.\n", argv[i]);
+                print_help(argv[0]);
+            }
+            if (config->heatmap_file)
+                free(config->heatmap_file);
+            config->heatmap_file = (char*)malloc(strlen(argv[i]) + 1);
+            strcpy(config->heatmap_file, argv[i]);
+            config->diagnostics = 1;
+            continue;
+        }
+        if (!strcmp("--perf", t_arg)) {
+            config->perf = 1;
+            continue;
+        }
+        if (!strcmp("--legacy-generator", t_arg)) {
+            config->legacy_generator = 1;
+            continue;
+        }
+        if (config->mode == EXPORT && bench_has_extension(argv[i], SCENE_EXTENSION)) {
+            if (config->scene_file)
+                free(config->scene_file);
+            config->scene_file = (char*)malloc(arg_len);
+            memcpy(config->scene_file, argv[i], arg_len);
+            continue;
+        }
+        if (image_format_from_path(t_arg) != IMAGE_FORMAT_UNKNOWN) {
             // Allocate memory and copy
             config->output_file = (char*)malloc(arg_len);
             memcpy(config->output_file, argv[i], arg_len);
@@ -404,18 +1240,68 @@ void parse_args(int argc, char **argv, Config *config) {
     }
     if (t_arg) 
         free(t_arg);
+    if (config->mode == EXPORT && !config->scene_file) {
+        fprintf(stderr, "Export mode expects a %s file to write the particles to.\n", SCENE_EXTENSION);
+        print_help(argv[0]);
+    }
+    if ((config->sweep_counts_count || config->sweep_dims_count) && (config->mode == EXPORT || config->scene_file || config->frames)) {
+        fprintf(stderr, "Sweeps generate their own particles, and cannot be combined with export, a scene file or animation.\n");
+        print_help(argv[0]);
+    }
+    if (config->mode == SERVE && (config->output_file || config->frames || config->benchmark || config->diagnostics ||
+        config->sweep_counts_count || config->sweep_dims_count)) {
+        fprintf(stderr, "Serve mode takes the scene and output image of each job, and cannot be combined with an output image, animation, benchmarking, diagnostics or sweeps.\n");
+        print_help(argv[0]);
+    }
+    // Benchmark mode defaults to BENCHMARK_RUNS timed runs after BENCHMARK_WARMUP_RUNS warmup runs, otherwise a single run
+    if (config->warmup < 0)
+        config->warmup = config->benchmark ? BENCHMARK_WARMUP_RUNS : 0;
+    if (!config->runs)
+        config->runs = config->benchmark ? BENCHMARK_RUNS : 1;
 }
 void print_help(const char *program_name) {
-    fprintf(stderr, "%s <mode> <particle count> <output image dimensions> (<output image>) (--bench)\n", program_name);
+    fprintf(stderr, "%s export <particle count> <output image dimensions> <scene file>\n", program_name);
+    fprintf(stderr, "%s serve <workers> <socket | -> (--tile <size>) (--spans) (--presort) (--stream) (--packed) (--simd <level>) (--blend <float|fixed>) (--arena-huge) (--band-budget <MiB>)\n", program_name);
+    fprintf(stderr, "%s <mode> <particle count | scene file> <output image dimensions> (<output image>) (--bench) (--tile <size>) (--spans) (--presort) (--stream) (--packed) (--simd <level>) (--blend <float|fixed>) (--arena) (--arena-huge) (--frames <count>) (--velocity <pixels>) (--moving <fraction>) (--incremental) (--band-budget <MiB>) (--seed <seed>) (--legacy-generator) (--validate <full|sample|none>) (--reference-cache <directory>) (--warmup <runs>) (--runs <runs>) (--bench-output <report>) (--sweep-particles <counts>) (--sweep-dims <dimensions>) (--perf) (--diagnostics) (--heatmap <image>)\n", program_name);
     
     const char *line_fmt = "%-18s %s\n";
     fprintf(stderr, "Required Arguments:\n");
-    fprintf(stderr, line_fmt, "<mode>", "The algorithm to use: CPU, OPENMP, CUDA");
+    fprintf(stderr, line_fmt, "<mode>", "The algorithm to use: CPU, OPENMP, CUDA, EXPORT to write the generated particles to <scene file>, or SERVE to render jobs");
     fprintf(stderr, line_fmt, "<particle count>", "The number of particles to generate");
+    fprintf(stderr, line_fmt, "<scene file>", "A " SCENE_EXTENSION " file to memory map the particles from, instead of generating them");
     fprintf(stderr, line_fmt, "<output image dimensions>", "The dimensions of the image to output e.g. 512 or 512x1024");
+    fprintf(stderr, line_fmt, "<workers>", "SERVE: The number of worker threads rendering jobs concurrently, 0 for one per OpenMP thread");
+    fprintf(stderr, line_fmt, "<socket | ->", "SERVE: Unix socket to accept jobs on (Linux only), or - to read jobs from stdin");
+    fprintf(stderr, line_fmt, "", "Each job is a line '<scene file> <output image dimensions> <output image>', answered by '<job> ok <latency ms> <output image>'");
     fprintf(stderr, "Optional Arguments:\n");
-    fprintf(stderr, line_fmt, "<output image>", "Output image, requires .png filetype");
+    fprintf(stderr, line_fmt, "<output image>", "Output image, .png, .ppm or .raw (8-bit RGB, every frame appended when animating)");
     fprintf(stderr, line_fmt, "-b, --bench", "Enable benchmark mode");
+    fprintf(stderr, line_fmt, "--tile <size>", "CPU: Bin particles into square screen tiles of this size (e.g. 16 or 32)");
+    fprintf(stderr, line_fmt, "--spans", "CPU: Compute each particle's per row coverage spans once, and reuse them in stages 1 and 2");
+    fprintf(stderr, line_fmt, "--presort", "CPU: Sort particles by depth during init, so stage 2 needs no per pixel sort");
+    fprintf(stderr, line_fmt, "--stream", "CPU: Blend depth sorted particles directly, without per contribution storage");
+    fprintf(stderr, line_fmt, "--packed", "CPU: Store each contribution as a single 64-bit depth and colour record");
+    fprintf(stderr, line_fmt, "--simd <level>", "CPU: Instruction set of the coverage and blend kernels: auto, scalar, avx2, avx512");
+    fprintf(stderr, line_fmt, "--blend <mode>", "CPU: Blend arithmetic: float (default, as the reference), or fixed (exact integer, may differ by 1)");
+    fprintf(stderr, line_fmt, "--arena", "CPU: Carve every buffer from a persistent arena, reused between benchmark runs");
+    fprintf(stderr, line_fmt, "--arena-huge", "CPU: As --arena, requesting transparent huge pages for the arena (Linux only)");
+    fprintf(stderr, line_fmt, "--frames <count>", "CPU/OPENMP: Render an animation of this many frames, PNG/PPM files are numbered <output image>_<frame>");
+    fprintf(stderr, line_fmt, "--velocity <pixels>", "CPU/OPENMP: Maximum distance each particle moves per frame when animating (default 1)");
+    fprintf(stderr, line_fmt, "--moving <fraction>", "CPU/OPENMP: Fraction of particles which move each frame when animating (default 1)");
+    fprintf(stderr, line_fmt, "--incremental", "CPU: Only re-render the tiles touched by particles changed since the previous frame");
+    fprintf(stderr, line_fmt, "--band-budget <MiB>", "CPU: Render in horizontal bands whose buffers fit this budget, output is written per band");
+    fprintf(stderr, line_fmt, "--seed <seed>", "Seed of the generated particles (default 12)");
+    fprintf(stderr, line_fmt, "--legacy-generator", "Generate particles serially with the original sequence, for regression checks");
+    fprintf(stderr, line_fmt, "--validate <level>", "Validate every pixel (full, default), a sample of rows (sample), or skip validation (none)");
+    fprintf(stderr, line_fmt, "--reference-cache <directory>", "Load full reference images from, and store them in, this existing directory");
+    fprintf(stderr, line_fmt, "--warmup <runs>", "Untimed runs before timing begins (default " XSTRINGIFY(BENCHMARK_WARMUP_RUNS) " with --bench, else 0)");
+    fprintf(stderr, line_fmt, "--runs <runs>", "Timed runs, reported by mean, median, p95, p99 and stddev (default " XSTRINGIFY(BENCHMARK_RUNS) " with --bench, else 1)");
+    fprintf(stderr, line_fmt, "--bench-output <report>", "Write the benchmark statistics, machine and build details to a .json or .csv report");
+    fprintf(stderr, line_fmt, "--sweep-particles <counts>", "Benchmark each of a comma separated list of particle counts (e.g. 1000,10000,100000)");
+    fprintf(stderr, line_fmt, "--sweep-dims <dimensions>", "Benchmark each of a comma separated list of image dimensions (e.g. 512,1024x768)");
+    fprintf(stderr, line_fmt, "--perf", "CPU/OPENMP: Report hardware performance counters of each stage (Linux perf_event)");
+    fprintf(stderr, line_fmt, "--diagnostics", "Report per pixel depth complexity, sort segment lengths and row/tile/thread imbalance");
+    fprintf(stderr, line_fmt, "--heatmap <image>", "Write a log scale heatmap of each pixel's overdraw (implies --diagnostics)");
 
     exit(EXIT_FAILURE);
 }
@@ -428,6 +1314,10 @@ const char *mode_to_string(Mode m) {
       return "OpenMP";
     case CUDA:
       return "CUDA";
+    case EXPORT:
+      return "Export";
+    case SERVE:
+      return "Serve";
     }
     return "?";
 }
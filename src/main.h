@@ -1,8 +1,18 @@
 #ifndef MAIN_H_
 #define MAIN_H_
 
-enum Mode{CPU, OPENMP, CUDA};
+#include "common.h"
+#include "simd.h"
+#include "bench.h"
+#include "counters.h"
+
+enum Mode{CPU, OPENMP, CUDA, EXPORT, SERVE};
 typedef enum Mode Mode;
+/**
+ * How the output image is validated against the reference image
+ */
+enum Validation{VALIDATE_FULL, VALIDATE_SAMPLE, VALIDATE_NONE};
+typedef enum Validation Validation;
 /**
  * Structure containing the options provided by runtime arguments
  */
@@ -16,9 +26,13 @@ struct Config {
      */
     unsigned int out_image_width, out_image_height;
     /**
-     * Path to output image (must be .png)
+     * Path to output image (.png, .ppm or .raw)
      */
     char *output_file;
+    /**
+     * Path to a scene file, the particles are loaded from it (or exported to it by EXPORT mode) rather than generated
+     */
+    char *scene_file;
     /**
      * Which algorithm to use CPU, OpenMP, CUDA
      */
@@ -29,6 +43,114 @@ struct Config {
      * It may also warn about incorrect settings
      */
     unsigned char benchmark;
+    /**
+     * Size of the screen tiles used by the CPU tile binned engine, 0 disables tile binning
+     */
+    unsigned int tile_size;
+    /**
+     * Treated as boolean, the CPU implementation will compute and cache per row particle coverage spans
+     */
+    unsigned char span_coverage;
+    /**
+     * Treated as boolean, the CPU implementation will sort particles by depth during init
+     */
+    unsigned char presort;
+    /**
+     * Treated as boolean, the CPU implementation will blend particles without storing every pixel contribution
+     */
+    unsigned char stream;
+    /**
+     * Treated as boolean, the CPU implementation will store each contribution as a packed 64-bit depth and colour record
+     */
+    unsigned char packed;
+    /**
+     * Instruction set used by the CPU implementation's vectorised kernels
+     */
+    SimdLevel simd;
+    /**
+     * Arithmetic used by the CPU implementation's blend kernels
+     */
+    SimdBlendMode blend;
+    /**
+     * If non zero, the CPU implementation will allocate from a persistent arena reused between runs
+     * 2 also requests huge pages (see CpuOptions::arena)
+     */
+    unsigned char arena;
+    /**
+     * The number of frames of animation to render, 0 renders a single static frame
+     */
+    unsigned int frames;
+    /**
+     * The maximum distance (in pixels) each particle moves per frame of animation
+     */
+    float velocity;
+    /**
+     * Treated as boolean, the CPU implementation will only re-render the tiles changed since the previous frame
+     */
+    unsigned char incremental;
+    /**
+     * The fraction of particles which move each frame of animation, the remainder are stationary
+     */
+    float moving;
+    /**
+     * If non zero, the CPU implementation will render in bands whose buffers fit within this many bytes
+     * The output file is then written as each band completes, without holding the full image (and without validation)
+     */
+    size_t band_budget;
+    /**
+     * Seed of the generated particles
+     */
+    unsigned long long seed;
+    /**
+     * Treated as boolean, generate particles with the original serial generator (mt19937 and shuffle)
+     * This reproduces the particles of earlier versions exactly, whereas the default generator is parallel (see generator.h)
+     */
+    unsigned char legacy_generator;
+    /**
+     * Whether the output is validated against every pixel of the reference image, a sample of its rows, or not at all
+     */
+    Validation validation;
+    /**
+     * Directory in which full reference images are cached between runs, 0 disables the cache
+     */
+    char *reference_cache;
+    /**
+     * The number of untimed warmup runs, and timed runs
+     */
+    int warmup;
+    unsigned int runs;
+    /**
+     * Path to a .json or .csv benchmark report, 0 if not requested
+     */
+    char *bench_output;
+    /**
+     * Lists of particle counts and image dimensions (width, height pairs) to benchmark every combination of
+     * A sweep is performed if either list is non empty, the other defaults to the value of the required arguments
+     */
+    unsigned int *sweep_counts;
+    unsigned int sweep_counts_count;
+    unsigned int *sweep_dims;
+    unsigned int sweep_dims_count;
+    /**
+     * Treated as boolean, hardware performance counters are sampled around each stage of the timed runs (see counters.h)
+     */
+    unsigned char perf;
+    /**
+     * Treated as boolean, the depth complexity of the scene is reported before rendering (see diagnostics.h)
+     */
+    unsigned char diagnostics;
+    /**
+     * Path to a heatmap image of each pixel's overdraw, 0 if not requested (implies diagnostics)
+     */
+    char *heatmap_file;
+    /**
+     * The number of worker threads of SERVE mode, 0 starts one per OpenMP thread
+     */
+    unsigned int serve_workers;
+    /**
+     * Path of the Unix socket SERVE mode listens on for jobs, 0 reads them from stdin (see server.h)
+     */
+    char *serve_socket;
 }; typedef struct Config Config;
 /**
  * Structure for holding calculated runtimes
@@ -41,7 +163,81 @@ struct Runtimes
     float stage3;
     float cleanup;
     float total;
+    float write;
 }; typedef struct Runtimes Runtimes;
+/**
+ * Perform a single run of the selected implementation, recording the time of each stage
+ * If an output file is set, the run writes it, streaming the rows during the stages if a band sink is enabled
+ * (cpu_options.band_sink), else once the stages are complete
+ * @param config The runtime options
+ * @param particles Pointer to an array of particle structures
+ * @param particles_count The number of elements within the particles array
+ * @param output_image Pointer to the output image, its data must be allocated unless a band sink is enabled
+ * @param runtimes Pointer to a struct to store the time of each stage
+ * @param stage_counts If not 0, the performance counters (if open) of each stage are added to it (CPU and OPENMP only)
+ */
+void render_run(const Config *config, const Particle *particles, unsigned int particles_count, CImage *output_image, Runtimes *runtimes,
+    double stage_counts[COUNTER_STAGES][COUNTER_EVENTS]);
+/**
+ * Summarise the runtimes of runs timed runs as a benchmark result
+ */
+void bench_summarise(const Config *config, unsigned int particles_count, const Runtimes *runtimes, unsigned int runs, BenchResult *result);
+/**
+ * Benchmark every combination of config->sweep_counts and config->sweep_dims, generating particles for each
+ * Prints a summary line per combination, and writes config->bench_output if requested
+ * @param config The runtime options
+ * @param argc argc from main(), recorded by the report
+ * @param argv argv from main(), recorded by the report
+ */
+void sweep(const Config *config, int argc, char **argv);
+/**
+ * Generate circle_count particles for the image dimensions in config, using config->seed and the distributions of config.h
+ * @param config The runtime options
+ * @param particles Pointer to storage for config->circle_count particle structures
+ */
+void generate_particles(const Config *config, Particle *particles);
+/**
+ * Count the contributions to each pixel of the particles, print their depth complexity statistics,
+ * and write config->heatmap_file if requested
+ * @param config The runtime options
+ * @param particles Pointer to an array of particle structures
+ * @param particles_count The number of elements within the particles array
+ */
+void report_diagnostics(const Config *config, const Particle *particles, unsigned int particles_count);
+/**
+ * Render (or load from config->reference_cache) the reference image for validation, see reference.h
+ * When config->validation is VALIDATE_SAMPLE only every VALIDATION_SAMPLE_STRIDE'th row is rendered
+ * @param config The runtime options
+ * @param particles Pointer to an array of particle structures
+ * @param particles_count The number of elements within the particles array
+ * @param image Pointer to a struct to store the image, image->data is allocated and must be freed by the caller
+ *              If config->validation is VALIDATE_NONE, image->data is left 0
+ */
+void render_reference(const Config *config, const Particle *particles, unsigned int particles_count, CImage *image);
+/**
+ * Compare output_image against validation_image (only the sampled rows when config->validation is VALIDATE_SAMPLE),
+ * printing the validation status, if validation_image has no data validation is reported as skipped
+ */
+void validate_image(const Config *config, const CImage *validation_image, const CImage *output_image);
+/**
+ * Write an image to disk with an ImageWriter, the format (PNG, raw 8-bit RGB or PPM) is selected by the path's extension
+ * @return Non-zero on success
+ */
+int write_image(const char *path, const CImage *image);
+/**
+ * CpuBandSink which passes each band's rows to an ImageWriter as soon as they are blended
+ * The time spent writing is accumulated to band_write_time, so that render_run() reports it as the write's
+ * @param user Pointer to the ImageWriter
+ */
+void write_band_rows(const unsigned char *rows, unsigned int first_row, unsigned int row_count, void *user);
+/**
+ * Render config->frames frames of animation, advancing the particles each frame and reusing the implementation's state
+ * Reports per frame, steady state and amortised timing, and validates the final frame
+ * @param config The runtime options
+ * @param particles Pointer to an array of particle structures, these are advanced to the final frame
+ * @param particles_count The number of elements within the particles array
+ */
+void animate(const Config *config, Particle *particles, unsigned int particles_count);
 /**
  * Parse the runtime args into config
  * @param argc argc from main()
@@ -0,0 +1,630 @@
+#include "sort.h"
+#include "simd.h"
+#include "scan.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+/**
+ * Micro benchmarks of individual components of the algorithm, used to select tuning parameters
+ * These are built as a separate executable (make microbench), as they do not require particles or the CUDA toolkit
+ */
+
+///
+/// Utility Methods
+///
+/**
+ * Reference quicksort pair sort, used as the baseline for the sort benchmark
+ * @note This function is implemented in helper.c
+ */
+void help_sort_pairs(float* keys_start, unsigned char* colours_start, int first, int last);
+/**
+ * Print usage and exit
+ * @param program_name argv[0] should always be passed to this parameter
+ */
+void print_help(const char *program_name);
+/**
+ * Sort benchmark, reports the time per item of each pair sort algorithm for a range of segment lengths
+ * This identifies the crossover points used by sort_pairs()
+ * @return The number of failed correctness checks, as for each benchmark below
+ */
+int bench_sort();
+/**
+ * SIMD benchmark, reports the time of each supported level of the coverage and blend kernels
+ * Coverage is timed per row for a range of circle radii, blend per contribution for a range of contributions per pixel
+ */
+int bench_simd();
+/**
+ * Contribution layout benchmark, compares the split colour and depth buffers with packed 64-bit records (CpuOptions::packed)
+ * Reports the bytes of contribution storage each stage reads and writes per contribution, and the time of each stage's loop
+ */
+int bench_layout();
+/**
+ * Scan benchmark, compares the serial prefix sum loop (and separate histogram memset) with scan.h, for a range of image sizes
+ */
+int bench_scan();
+/**
+ * Blend arithmetic benchmark, compares the fixed point blend (SIMD_BLEND_FIXED) with the float blend over every
+ * (src, dest, alpha) input, reporting where they differ, then reports the time of each for each supported SIMD level
+ */
+int bench_blend();
+
+/**
+ * Number of items sorted per timed run (split into segments of the length being benchmarked)
+ */
+#define BENCH_SORT_ITEMS (1 << 20)
+/**
+ * Number of timed runs per measurement, the fastest is reported
+ */
+#define BENCH_REPEATS 5
+/**
+ * Number of pixels blended per timed run of the blend benchmark
+ */
+#define BENCH_BLEND_PIXELS (1 << 16)
+/**
+ * Largest circle radius timed by the coverage benchmark
+ */
+#define MAX_BENCH_RADIUS 512
+/**
+ * Largest number of counts scanned by the scan benchmark
+ */
+#define MAX_BENCH_SCAN_COUNTS (1 << 24)
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        print_help(argv[0]);
+    }
+    int failures = 0;
+    if (!strcmp(argv[1], "sort")) {
+        failures = bench_sort();
+    } else if (!strcmp(argv[1], "simd")) {
+        failures = bench_simd();
+    } else if (!strcmp(argv[1], "layout")) {
+        failures = bench_layout();
+    } else if (!strcmp(argv[1], "scan")) {
+        failures = bench_scan();
+    } else if (!strcmp(argv[1], "blend")) {
+        failures = bench_blend();
+    } else {
+        fprintf(stderr, "Unexpected benchmark name: '%s' .\n", argv[1]);
+        print_help(argv[0]);
+    }
+    // The correctness checks are the only regression coverage of some kernels, so a failure must fail the process
+    if (failures) {
+        fprintf(stderr, "%d correctness checks failed.\n", failures);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+void print_help(const char *program_name) {
+    fprintf(stderr, "%s <benchmark>\n", program_name);
+
+    const char *line_fmt = "%-18s %s\n";
+    fprintf(stderr, "Benchmarks:\n");
+    fprintf(stderr, line_fmt, "sort", "Time per item of each pair sort algorithm, by segment length");
+    fprintf(stderr, line_fmt, "simd", "Time of each supported SIMD level of the coverage and blend kernels");
+    fprintf(stderr, line_fmt, "layout", "Bytes moved and time per contribution of split and packed contribution storage");
+    fprintf(stderr, line_fmt, "scan", "Time per count of the serial and blocked parallel pixel index scans");
+    fprintf(stderr, line_fmt, "blend", "Exhaustive comparison of the fixed point and float blends, and the time of each");
+
+    exit(EXIT_FAILURE);
+}
+
+typedef void (*SortFunction)(float*, unsigned char*, int, int);
+/**
+ * Time sorting every segment of length segment_length within the input, returning the fastest run's ns per item
+ */
+static double time_sort(SortFunction sort, const float *input_keys, const unsigned char *input_colours,
+    float *keys, unsigned char *colours, const int segment_length) {
+    const int segments = BENCH_SORT_ITEMS / segment_length;
+    double best = 0;
+    for (int r = 0; r < BENCH_REPEATS; ++r) {
+        memcpy(keys, input_keys, BENCH_SORT_ITEMS * sizeof(float));
+        memcpy(colours, input_colours, BENCH_SORT_ITEMS * 4 * sizeof(unsigned char));
+        const double start = omp_get_wtime();
+        for (int s = 0; s < segments; ++s) {
+            sort(keys, colours, s * segment_length, (s + 1) * segment_length - 1);
+        }
+        const double elapsed = omp_get_wtime() - start;
+        best = (r == 0 || elapsed < best) ? elapsed : best;
+    }
+    return best * 1e9 / ((double)segments * segment_length);
+}
+int bench_sort() {
+    const int segment_lengths[] = {2, 3, 4, 6, 8, 12, 16, 24, 32, 48, 64, 96, 128, 192, 256, 512, 1024, 4096, 16384};
+    float *input_keys = (float*)malloc(BENCH_SORT_ITEMS * sizeof(float));
+    unsigned char *input_colours = (unsigned char*)malloc(BENCH_SORT_ITEMS * 4 * sizeof(unsigned char));
+    float *keys = (float*)malloc(BENCH_SORT_ITEMS * sizeof(float));
+    unsigned char *colours = (unsigned char*)malloc(BENCH_SORT_ITEMS * 4 * sizeof(unsigned char));
+    // Keys match the depths generated by main.cu, a shuffled sequence of consecutive floats starting at 0
+    // A fixed seed LCG is used so that every run sorts the same data
+    unsigned int state = 12;
+    for (int i = 0; i < BENCH_SORT_ITEMS; ++i) {
+        const unsigned int bits = (unsigned int)i;
+        memcpy(&input_keys[i], &bits, sizeof(float));
+        memcpy(input_colours + (4 * i), &bits, sizeof(unsigned int));
+    }
+    for (int i = BENCH_SORT_ITEMS - 1; i > 0; --i) {
+        state = state * 1664525u + 1013904223u;
+        const int j = (int)(((unsigned long long)state * (i + 1)) >> 32);
+        const float t = input_keys[i];
+        input_keys[i] = input_keys[j];
+        input_keys[j] = t;
+    }
+
+    printf("Pair sort time per item (ns), %d items split into segments, fastest of %d runs\n", BENCH_SORT_ITEMS, BENCH_REPEATS);
+    printf("sort_pairs() uses network for [%d, %d], otherwise insertion <= %d < radix\n", SORT_NETWORK_MIN, SORT_NETWORK_MAX, SORT_INSERTION_MAX);
+    printf("%8s %10s %10s %10s %10s %10s\n", "length", "quicksort", "network", "insertion", "radix", "sort_pairs");
+    for (size_t i = 0; i < sizeof(segment_lengths) / sizeof(int); ++i) {
+        const int n = segment_lengths[i];
+        printf("%8d", n);
+        printf(" %10.2f", time_sort(help_sort_pairs, input_keys, input_colours, keys, colours, n));
+        if (n <= SORT_NETWORK_MAX) {
+            printf(" %10.2f", time_sort(sort_pairs_network, input_keys, input_colours, keys, colours, n));
+        } else {
+            printf(" %10s", "-");
+        }
+        // Insertion sort is quadratic, so skip it where it would dominate the benchmark's runtime
+        if (n <= 1024) {
+            printf(" %10.2f", time_sort(sort_pairs_insertion, input_keys, input_colours, keys, colours, n));
+        } else {
+            printf(" %10s", "-");
+        }
+        printf(" %10.2f", time_sort(sort_pairs_radix, input_keys, input_colours, keys, colours, n));
+        printf(" %10.2f\n", time_sort(sort_pairs, input_keys, input_colours, keys, colours, n));
+    }
+
+    free(colours);
+    free(keys);
+    free(input_colours);
+    free(input_keys);
+    // The sorts are compared by time only
+    return 0;
+}
+
+/**
+ * Time testing every row of a circle's bounding box with the row coverage kernel, returning the fastest run's ns per row
+ * @param covered_x Storage for the covered columns, see SimdRowCoveredFunction
+ */
+static double time_row_covered(const SimdKernels *kernels, const float radius, int *covered_x) {
+    // Offset the centre from the pixel grid, so that rows are not symmetric
+    const float centre = radius + 0.3f;
+    const int x_max = (int)(2 * radius) + 1;
+    const int rows = 1 << 16;
+    volatile int sink = 0;
+    double best = 0;
+    for (int r = 0; r < BENCH_REPEATS; ++r) {
+        int covered = 0;
+        const double start = omp_get_wtime();
+        for (int row = 0; row < rows; ++row) {
+            const float y_ab = (float)(row % (x_max + 1)) + 0.5f - centre;
+            covered += kernels->row_covered(0, x_max, centre, y_ab, radius, covered_x);
+        }
+        const double elapsed = omp_get_wtime() - start;
+        sink += covered;
+        best = (r == 0 || elapsed < best) ? elapsed : best;
+    }
+    return best * 1e9 / rows;
+}
+/**
+ * Time blending every pixel with the blend kernel, returning the fastest run's ns per contribution
+ */
+static double time_blend(const SimdKernels *kernels, const unsigned int *pixel_index, const unsigned char *colours, unsigned char *image) {
+    double best = 0;
+    for (int r = 0; r < BENCH_REPEATS; ++r) {
+        memset(image, 255, BENCH_BLEND_PIXELS * 3 * sizeof(unsigned char));
+        const double start = omp_get_wtime();
+        kernels->blend(pixel_index, colours, image, 0, BENCH_BLEND_PIXELS - 1);
+        const double elapsed = omp_get_wtime() - start;
+        best = (r == 0 || elapsed < best) ? elapsed : best;
+    }
+    return best * 1e9 / pixel_index[BENCH_BLEND_PIXELS];
+}
+int bench_simd() {
+    int failures = 0;
+    const float radii[] = {10, 16, 32, 64, 128, 512};
+    const int mean_contribs[] = {1, 4, 16, 64};
+    SimdKernels kernels[3];
+    int levels = 0;
+    for (SimdLevel level = SIMD_SCALAR; level <= simd_detect(); level = (SimdLevel)(level + 1)) {
+        kernels[levels++] = simd_kernels(level, SIMD_BLEND_FLOAT);
+    }
+    // Enough covered column storage for the largest radius' row
+    int *covered_x = (int*)malloc(((int)(2 * MAX_BENCH_RADIUS) + 1 + SIMD_ROW_PADDING) * sizeof(int));
+    printf("Row coverage time per row (ns), %d rows through the bounding box of a circle, fastest of %d runs\n", 1 << 16, BENCH_REPEATS);
+    printf("%8s", "radius");
+    for (int l = 0; l < levels; ++l)
+        printf(" %10s", simd_level_to_string(kernels[l].level));
+    printf("\n");
+    for (size_t i = 0; i < sizeof(radii) / sizeof(float); ++i) {
+        printf("%8.0f", radii[i]);
+        for (int l = 0; l < levels; ++l)
+            printf(" %10.2f", time_row_covered(&kernels[l], radii[i], covered_x));
+        printf("\n");
+    }
+    free(covered_x);
+
+    // Each pixel receives a pseudo random number of contributions, uniform in [0, 2 * mean], from a fixed seed LCG
+    unsigned int *pixel_index = (unsigned int*)malloc((BENCH_BLEND_PIXELS + 1) * sizeof(unsigned int));
+    unsigned char *image = (unsigned char*)malloc(BENCH_BLEND_PIXELS * 3 * sizeof(unsigned char));
+    unsigned char *reference = (unsigned char*)malloc(BENCH_BLEND_PIXELS * 3 * sizeof(unsigned char));
+    printf("Blend time per contribution (ns), %d pixels, fastest of %d runs\n", BENCH_BLEND_PIXELS, BENCH_REPEATS);
+    printf("%8s", "contribs");
+    for (int l = 0; l < levels; ++l)
+        printf(" %10s", simd_level_to_string(kernels[l].level));
+    printf("\n");
+    for (size_t i = 0; i < sizeof(mean_contribs) / sizeof(int); ++i) {
+        unsigned int state = 12;
+        pixel_index[0] = 0;
+        for (int p = 0; p < BENCH_BLEND_PIXELS; ++p) {
+            state = state * 1664525u + 1013904223u;
+            pixel_index[p + 1] = pixel_index[p] + (unsigned int)(((unsigned long long)state * (2 * mean_contribs[i] + 1)) >> 32);
+        }
+        unsigned char *colours = (unsigned char*)malloc(pixel_index[BENCH_BLEND_PIXELS] * 4 * sizeof(unsigned char));
+        for (unsigned int j = 0; j < pixel_index[BENCH_BLEND_PIXELS] * 4; ++j) {
+            state = state * 1664525u + 1013904223u;
+            colours[j] = (unsigned char)(state >> 24);
+        }
+        printf("%8d", mean_contribs[i]);
+        for (int l = 0; l < levels; ++l) {
+            printf(" %10.2f", time_blend(&kernels[l], pixel_index, colours, image));
+            // Every level must match the scalar kernel exactly
+            if (l == 0) {
+                memcpy(reference, image, BENCH_BLEND_PIXELS * 3 * sizeof(unsigned char));
+            } else if (memcmp(reference, image, BENCH_BLEND_PIXELS * 3 * sizeof(unsigned char))) {
+                printf(" (mismatch)");
+                ++failures;
+            }
+        }
+        printf("\n");
+        free(colours);
+    }
+    free(reference);
+    free(image);
+    free(pixel_index);
+    return failures;
+}
+
+/**
+ * Time to store, sort and blend every pixel's contributions with each layout, in ns per contribution
+ * The store writes each pixel's contributions in the order given, as stage 2 scatters particles
+ */
+struct LayoutTimes {
+    double store;
+    double sort;
+    double blend;
+};
+typedef struct LayoutTimes LayoutTimes;
+static void time_layout_split(const SimdKernels *kernels, const unsigned int *pixel_index, const float *input_keys, const unsigned char *input_colours,
+    float *keys, unsigned char *colours, unsigned char *image, LayoutTimes *times) {
+    const unsigned int contribs = pixel_index[BENCH_BLEND_PIXELS];
+    memset(times, 0, sizeof(LayoutTimes));
+    for (int r = 0; r < BENCH_REPEATS; ++r) {
+        double start = omp_get_wtime();
+        for (unsigned int j = 0; j < contribs; ++j) {
+            memcpy(colours + (4 * j), input_colours + (4 * j), 4 * sizeof(unsigned char));
+            keys[j] = input_keys[j];
+        }
+        const double store = omp_get_wtime() - start;
+        start = omp_get_wtime();
+        for (int p = 0; p < BENCH_BLEND_PIXELS; ++p)
+            sort_pairs(keys, colours, pixel_index[p], pixel_index[p + 1] - 1);
+        const double sort = omp_get_wtime() - start;
+        memset(image, 255, BENCH_BLEND_PIXELS * 3 * sizeof(unsigned char));
+        start = omp_get_wtime();
+        kernels->blend(pixel_index, colours, image, 0, BENCH_BLEND_PIXELS - 1);
+        const double blend = omp_get_wtime() - start;
+        times->store = (r == 0 || store < times->store) ? store : times->store;
+        times->sort = (r == 0 || sort < times->sort) ? sort : times->sort;
+        times->blend = (r == 0 || blend < times->blend) ? blend : times->blend;
+    }
+    times->store *= 1e9 / contribs;
+    times->sort *= 1e9 / contribs;
+    times->blend *= 1e9 / contribs;
+}
+static void time_layout_packed(const SimdKernels *kernels, const unsigned int *pixel_index, const float *input_keys, const unsigned char *input_colours,
+    unsigned long long *records, unsigned char *image, LayoutTimes *times) {
+    const unsigned int contribs = pixel_index[BENCH_BLEND_PIXELS];
+    memset(times, 0, sizeof(LayoutTimes));
+    for (int r = 0; r < BENCH_REPEATS; ++r) {
+        double start = omp_get_wtime();
+        for (unsigned int j = 0; j < contribs; ++j) {
+            unsigned int colour;
+            memcpy(&colour, input_colours + (4 * j), sizeof(unsigned int));
+            records[j] = ((unsigned long long)sort_key_bits(input_keys[j]) << 32) | colour;
+        }
+        const double store = omp_get_wtime() - start;
+        start = omp_get_wtime();
+        for (int p = 0; p < BENCH_BLEND_PIXELS; ++p)
+            sort_records(records, pixel_index[p], pixel_index[p + 1] - 1);
+        const double sort = omp_get_wtime() - start;
+        memset(image, 255, BENCH_BLEND_PIXELS * 3 * sizeof(unsigned char));
+        start = omp_get_wtime();
+        kernels->blend_records(pixel_index, records, image, 0, BENCH_BLEND_PIXELS - 1);
+        const double blend = omp_get_wtime() - start;
+        times->store = (r == 0 || store < times->store) ? store : times->store;
+        times->sort = (r == 0 || sort < times->sort) ? sort : times->sort;
+        times->blend = (r == 0 || blend < times->blend) ? blend : times->blend;
+    }
+    times->store *= 1e9 / contribs;
+    times->sort *= 1e9 / contribs;
+    times->blend *= 1e9 / contribs;
+}
+int bench_layout() {
+    int failures = 0;
+    const int mean_contribs[] = {1, 4, 16, 64, 256};
+    // Both layouts blend with the highest supported SIMD level
+    const SimdKernels kernels = simd_kernels(SIMD_AUTO, SIMD_BLEND_FLOAT);
+    unsigned int *pixel_index = (unsigned int*)malloc((BENCH_BLEND_PIXELS + 1) * sizeof(unsigned int));
+    unsigned char *image = (unsigned char*)malloc(BENCH_BLEND_PIXELS * 3 * sizeof(unsigned char));
+    unsigned char *reference = (unsigned char*)malloc(BENCH_BLEND_PIXELS * 3 * sizeof(unsigned char));
+    // Bytes of contribution storage read and written per contribution, by each stage's loop
+    // The store writes each contribution once, the sort reads and writes each at least once (more for insertion and radix sorts),
+    // and the blend reads only the colours of the split layout, but the whole record of the packed layout
+    printf("Contribution storage bytes moved per contribution (minimum), split (float depth + RGBA) vs packed (64-bit record)\n");
+    printf("%8s %10s %10s %10s %10s\n", "layout", "store", "sort", "blend", "total");
+    printf("%8s %10d %10d %10d %10d\n", "split", 8, 16, 4, 28);
+    printf("%8s %10d %10d %10d %10d\n", "packed", 8, 16, 8, 32);
+    printf("Split layout accesses touch two buffers (two cache lines per contribution moved), packed accesses touch one\n");
+    printf("Time per contribution (ns), %d pixels, fastest of %d runs, %s blend\n", BENCH_BLEND_PIXELS, BENCH_REPEATS, simd_level_to_string(kernels.level));
+    printf("%8s %10s %10s %10s %10s %10s %10s %10s %10s\n", "contribs",
+        "store", "sort", "blend", "total", "p.store", "p.sort", "p.blend", "p.total");
+    for (size_t i = 0; i < sizeof(mean_contribs) / sizeof(int); ++i) {
+        // Each pixel receives a pseudo random number of contributions, uniform in [0, 2 * mean], from a fixed seed LCG
+        unsigned int state = 12;
+        pixel_index[0] = 0;
+        for (int p = 0; p < BENCH_BLEND_PIXELS; ++p) {
+            state = state * 1664525u + 1013904223u;
+            pixel_index[p + 1] = pixel_index[p] + (unsigned int)(((unsigned long long)state * (2 * mean_contribs[i] + 1)) >> 32);
+        }
+        const unsigned int contribs = pixel_index[BENCH_BLEND_PIXELS];
+        // Depths are distinct floats (as generated by main.cu) in a random order, so both layouts sort identically
+        float *input_keys = (float*)malloc(contribs * sizeof(float));
+        unsigned char *input_colours = (unsigned char*)malloc(contribs * 4 * sizeof(unsigned char));
+        for (unsigned int j = 0; j < contribs; ++j) {
+            const unsigned int bits = j;
+            memcpy(&input_keys[j], &bits, sizeof(float));
+        }
+        for (unsigned int j = contribs - 1; j > 0; --j) {
+            state = state * 1664525u + 1013904223u;
+            const unsigned int k = (unsigned int)(((unsigned long long)state * (j + 1)) >> 32);
+            const float t = input_keys[j];
+            input_keys[j] = input_keys[k];
+            input_keys[k] = t;
+        }
+        for (unsigned int j = 0; j < contribs * 4; ++j) {
+            state = state * 1664525u + 1013904223u;
+            input_colours[j] = (unsigned char)(state >> 24);
+        }
+        float *keys = (float*)malloc(contribs * sizeof(float));
+        unsigned char *colours = (unsigned char*)malloc(contribs * 4 * sizeof(unsigned char));
+        unsigned long long *records = (unsigned long long*)malloc(contribs * sizeof(unsigned long long));
+        LayoutTimes split, packed;
+        time_layout_split(&kernels, pixel_index, input_keys, input_colours, keys, colours, image, &split);
+        memcpy(reference, image, BENCH_BLEND_PIXELS * 3 * sizeof(unsigned char));
+        time_layout_packed(&kernels, pixel_index, input_keys, input_colours, records, image, &packed);
+        printf("%8d %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f", mean_contribs[i],
+            split.store, split.sort, split.blend, split.store + split.sort + split.blend,
+            packed.store, packed.sort, packed.blend, packed.store + packed.sort + packed.blend);
+        // Both layouts must produce the same image
+        const int mismatch = memcmp(reference, image, BENCH_BLEND_PIXELS * 3 * sizeof(unsigned char)) != 0;
+        printf(mismatch ? " (mismatch)\n" : "\n");
+        failures += mismatch;
+        free(records);
+        free(colours);
+        free(keys);
+        free(input_colours);
+        free(input_keys);
+    }
+    free(reference);
+    free(image);
+    free(pixel_index);
+    return failures;
+}
+
+/**
+ * Scan implementations timed by the scan benchmark, reset zeroes the counts as scan_exclusive_reset()
+ */
+static void scan_serial(unsigned int *counts, unsigned int *index, const size_t count, const int reset) {
+    // The loop formerly used by stage 2, followed by its memset of the histogram
+    index[0] = 0;
+    for (size_t i = 0; i < count; ++i) {
+        index[i + 1] = index[i] + counts[i];
+    }
+    if (reset)
+        memset(counts, 0, count * sizeof(unsigned int));
+}
+static void scan_module(unsigned int *counts, unsigned int *index, const size_t count, const int reset) {
+    if (reset)
+        scan_exclusive_reset(counts, index, count);
+    else
+        scan_exclusive(counts, index, count);
+}
+typedef void (*ScanFunction)(unsigned int*, unsigned int*, size_t, int);
+/**
+ * Time scanning input, returning the fastest run's ns per count
+ * @param reference If not null, index is compared against it after each run and mismatch set on any difference
+ */
+static double time_scan(ScanFunction scan, const unsigned int *input, unsigned int *counts, unsigned int *index, const size_t count,
+    const int reset, const unsigned int *reference, int *mismatch) {
+    double best = 0;
+    for (int r = 0; r < BENCH_REPEATS; ++r) {
+        memcpy(counts, input, count * sizeof(unsigned int));
+        const double start = omp_get_wtime();
+        scan(counts, index, count, reset);
+        const double elapsed = omp_get_wtime() - start;
+        best = (r == 0 || elapsed < best) ? elapsed : best;
+        if (reference && memcmp(reference, index, (count + 1) * sizeof(unsigned int)))
+            *mismatch = 1;
+        // The reset must leave every count zero
+        if (reset) {
+            for (size_t i = 0; i < count; ++i)
+                *mismatch |= counts[i] != 0;
+        }
+    }
+    return best * 1e9 / count;
+}
+int bench_scan() {
+    int failures = 0;
+    // Sizes straddle SCAN_PARALLEL_MIN, and odd sizes exercise the scalar tail
+    const size_t sizes[] = {1000, 1 << 16, (1 << 18) + 3, 1 << 20, 1920 * 1080, 1 << 22, MAX_BENCH_SCAN_COUNTS};
+    unsigned int *input = (unsigned int*)malloc(MAX_BENCH_SCAN_COUNTS * sizeof(unsigned int));
+    unsigned int *counts = (unsigned int*)malloc(MAX_BENCH_SCAN_COUNTS * sizeof(unsigned int));
+    unsigned int *index = (unsigned int*)malloc((MAX_BENCH_SCAN_COUNTS + 1) * sizeof(unsigned int));
+    unsigned int *reference = (unsigned int*)malloc((MAX_BENCH_SCAN_COUNTS + 1) * sizeof(unsigned int));
+    // Each pixel receives a pseudo random number of contributions, uniform in [0, 16], from a fixed seed LCG
+    unsigned int state = 12;
+    for (size_t i = 0; i < MAX_BENCH_SCAN_COUNTS; ++i) {
+        state = state * 1664525u + 1013904223u;
+        input[i] = (unsigned int)(((unsigned long long)state * 17) >> 32);
+    }
+    printf("Pixel index scan time per count (ns), fastest of %d runs, %d threads\n", BENCH_REPEATS, omp_get_max_threads());
+    printf("The reset columns also zero the histogram, by a following memset (serial) or as it is read (scan_exclusive_reset())\n");
+    printf("%10s %10s %10s %10s %10s\n", "counts", "serial", "scan", "s.reset", "reset");
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(size_t); ++i) {
+        const size_t count = sizes[i];
+        int mismatch = 0;
+        const double serial = time_scan(scan_serial, input, counts, reference, count, 0, 0, &mismatch);
+        const double serial_reset = time_scan(scan_serial, input, counts, index, count, 1, 0, &mismatch);
+        const double module = time_scan(scan_module, input, counts, index, count, 0, reference, &mismatch);
+        const double module_reset = time_scan(scan_module, input, counts, index, count, 1, reference, &mismatch);
+        printf("%10zu %10.3f %10.3f %10.3f %10.3f", count, serial, module, serial_reset, module_reset);
+        // Every scan must match the serial loop exactly
+        printf(mismatch ? " (mismatch)\n" : "\n");
+        failures += mismatch;
+    }
+    free(reference);
+    free(index);
+    free(counts);
+    free(input);
+    return failures;
+}
+
+/**
+ * Number of pixels blended per alpha by the exhaustive comparison, one for every (src, dest) pair
+ */
+#define BENCH_BLEND_PAIRS (256 * 256)
+int bench_blend() {
+    int failures = 0;
+    SimdKernels fixed[3];
+    int levels = 0;
+    for (SimdLevel level = SIMD_SCALAR; level <= simd_detect(); level = (SimdLevel)(level + 1)) {
+        fixed[levels++] = simd_kernels(level, SIMD_BLEND_FIXED);
+    }
+    // Pixel p blends a single contribution, src = p >> 8 onto dest = p & 255 in red, and the inverse pair in green and blue
+    unsigned int *pixel_index = (unsigned int*)malloc((BENCH_BLEND_PAIRS + 1) * sizeof(unsigned int));
+    unsigned char *colours = (unsigned char*)malloc(BENCH_BLEND_PAIRS * 4 * sizeof(unsigned char));
+    unsigned char *background = (unsigned char*)malloc(BENCH_BLEND_PAIRS * 3 * sizeof(unsigned char));
+    unsigned char *reference = (unsigned char*)malloc(BENCH_BLEND_PAIRS * 3 * sizeof(unsigned char));
+    unsigned char *image = (unsigned char*)malloc(BENCH_BLEND_PAIRS * 3 * sizeof(unsigned char));
+    for (unsigned int p = 0; p <= BENCH_BLEND_PAIRS; ++p) {
+        pixel_index[p] = p;
+    }
+    for (unsigned int p = 0; p < BENCH_BLEND_PAIRS; ++p) {
+        const unsigned char src = (unsigned char)(p >> 8), dest = (unsigned char)p;
+        colours[p * 4 + 0] = src;
+        colours[p * 4 + 1] = (unsigned char)(255 - src);
+        colours[p * 4 + 2] = dest;
+        background[p * 3 + 0] = dest;
+        background[p * 3 + 1] = (unsigned char)(255 - dest);
+        background[p * 3 + 2] = src;
+    }
+    // The exact value floor((src * alpha + dest * (255 - alpha)) / 255), which the fixed point blend must always equal
+    // Differences of the float blend are counted from the red channel, which covers each input once
+    unsigned long long fixed_errors[3] = {0, 0, 0};
+    unsigned long long float_below = 0, float_above = 0, float_whole = 0;
+    unsigned int alphas_differing = 0;
+    int examples = 0;
+    printf("Exhaustive comparison of %u (src, dest, alpha) inputs with the exact blend floor((src * alpha + dest * (255 - alpha)) / 255)\n",
+        BENCH_BLEND_PAIRS * 256);
+    for (unsigned int alpha = 0; alpha < 256; ++alpha) {
+        for (unsigned int p = 0; p < BENCH_BLEND_PAIRS; ++p) {
+            colours[p * 4 + 3] = (unsigned char)alpha;
+        }
+        memcpy(reference, background, BENCH_BLEND_PAIRS * 3 * sizeof(unsigned char));
+        simd_blend_scalar(pixel_index, colours, reference, 0, BENCH_BLEND_PAIRS - 1);
+        unsigned long long alpha_differences = 0;
+        for (unsigned int p = 0; p < BENCH_BLEND_PAIRS; ++p) {
+            const unsigned int src = p >> 8, dest = p & 255;
+            const unsigned int v = src * alpha + dest * (255 - alpha);
+            const int difference = (int)reference[p * 3] - (int)(v / 255);
+            if (difference) {
+                ++alpha_differences;
+                float_below += difference < 0;
+                float_above += difference > 0;
+                float_whole += v % 255 == 0;
+                if (examples < 4) {
+                    printf("  e.g. src %3u, dest %3u, alpha %3u: exact %u, float %u\n", src, dest, alpha, v / 255, reference[p * 3]);
+                    ++examples;
+                }
+            }
+        }
+        alphas_differing += alpha_differences != 0;
+        for (int l = 0; l < levels; ++l) {
+            memcpy(image, background, BENCH_BLEND_PAIRS * 3 * sizeof(unsigned char));
+            fixed[l].blend(pixel_index, colours, image, 0, BENCH_BLEND_PAIRS - 1);
+            for (unsigned int p = 0; p < BENCH_BLEND_PAIRS; ++p) {
+                const unsigned int src = p >> 8, dest = p & 255;
+                fixed_errors[l] += image[p * 3 + 0] != (src * alpha + dest * (255 - alpha)) / 255;
+                fixed_errors[l] += image[p * 3 + 1] != ((255 - src) * alpha + (255 - dest) * (255 - alpha)) / 255;
+                fixed_errors[l] += image[p * 3 + 2] != (dest * alpha + src * (255 - alpha)) / 255;
+            }
+        }
+    }
+    for (int l = 0; l < levels; ++l) {
+        printf("%8s fixed: %llu channels differ from the exact blend\n", simd_level_to_string(fixed[l].level), fixed_errors[l]);
+        failures += fixed_errors[l] != 0;
+    }
+    printf("  float: %llu inputs differ from the exact blend (%llu below, %llu above), %llu of which have a whole exact value, %u alphas affected\n",
+        float_below + float_above, float_below, float_above, float_whole, alphas_differing);
+    free(image);
+    free(reference);
+    free(background);
+    free(colours);
+    free(pixel_index);
+
+    // Time both arithmetics with the workload of bench_simd()
+    const int mean_contribs[] = {1, 4, 16, 64};
+    pixel_index = (unsigned int*)malloc((BENCH_BLEND_PIXELS + 1) * sizeof(unsigned int));
+    image = (unsigned char*)malloc(BENCH_BLEND_PIXELS * 3 * sizeof(unsigned char));
+    reference = (unsigned char*)malloc(BENCH_BLEND_PIXELS * 3 * sizeof(unsigned char));
+    printf("Blend time per contribution (ns), %d pixels, fastest of %d runs\n", BENCH_BLEND_PIXELS, BENCH_REPEATS);
+    printf("%8s", "contribs");
+    for (int l = 0; l < levels; ++l)
+        printf(" %10s %10s", simd_level_to_string(fixed[l].level), "fixed");
+    printf("\n");
+    for (size_t i = 0; i < sizeof(mean_contribs) / sizeof(int); ++i) {
+        unsigned int state = 12;
+        pixel_index[0] = 0;
+        for (int p = 0; p < BENCH_BLEND_PIXELS; ++p) {
+            state = state * 1664525u + 1013904223u;
+            pixel_index[p + 1] = pixel_index[p] + (unsigned int)(((unsigned long long)state * (2 * mean_contribs[i] + 1)) >> 32);
+        }
+        colours = (unsigned char*)malloc(pixel_index[BENCH_BLEND_PIXELS] * 4 * sizeof(unsigned char));
+        for (unsigned int j = 0; j < pixel_index[BENCH_BLEND_PIXELS] * 4; ++j) {
+            state = state * 1664525u + 1013904223u;
+            colours[j] = (unsigned char)(state >> 24);
+        }
+        printf("%8d", mean_contribs[i]);
+        for (int l = 0; l < levels; ++l) {
+            const SimdKernels float_kernels = simd_kernels(fixed[l].level, SIMD_BLEND_FLOAT);
+            printf(" %10.2f", time_blend(&float_kernels, pixel_index, colours, image));
+            printf(" %10.2f", time_blend(&fixed[l], pixel_index, colours, image));
+            // Every level of the fixed point blend must match its scalar kernel exactly
+            if (l == 0) {
+                memcpy(reference, image, BENCH_BLEND_PIXELS * 3 * sizeof(unsigned char));
+            } else if (memcmp(reference, image, BENCH_BLEND_PIXELS * 3 * sizeof(unsigned char))) {
+                printf(" (mismatch)");
+                ++failures;
+            }
+        }
+        printf("\n");
+        free(colours);
+    }
+    free(reference);
+    free(image);
+    free(pixel_index);
+    return failures;
+}
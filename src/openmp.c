@@ -1,45 +1,338 @@
 #include "openmp.h"
 #include "helper.h"
+#include "sort.h"
+#include "scheduler.h"
+#include "scan.h"
+#include "simd.h"
 
 #include <stdlib.h>
 #include <string.h>
 #include <omp.h>
 #include <math.h>
 
+///
+/// Utility Methods
+///
+/**
+ * Compute a particle's bounding box [inclusive-inclusive], clamped to the output image
+ * @return 0 if the clamped bounding box is empty (the particle does not touch the image)
+ */
+static int openmp_particle_bounds(const Particle *p, int *x_min, int *y_min, int *x_max, int *y_max);
+/**
+ * Compute the first and last rows [inclusive-inclusive] of band b
+ */
+static void openmp_band_rows(int b, int *band_y_min, int *band_y_max);
+/**
+ * SchedulerTask callbacks, executing the bands [first, last)
+ * Count how many particles contribute to each pixel, or store each contribution's colour and depth according to the index
+ */
+static void openmp_count_bands(unsigned int first, unsigned int last, void *user);
+static void openmp_store_bands(unsigned int first, unsigned int last, void *user);
+/**
+ * SchedulerTask callbacks, executing the pixels [first, last)
+ * Pair sort each pixel's contributions by depth, or blend them into the output image
+ */
+static void openmp_sort_pixels(unsigned int first, unsigned int last, void *user);
+static void openmp_blend_pixels(unsigned int first, unsigned int last, void *user);
+
+///
+/// Algorithm storage
+///
+unsigned int openmp_particles_count;
+Particle *openmp_particles;
+unsigned int *openmp_pixel_contribs;
+unsigned int *openmp_pixel_index;
+unsigned char *openmp_pixel_contrib_colours;
+float *openmp_pixel_contrib_depth;
+unsigned int openmp_pixel_contrib_count;
+CImage openmp_output_image;
+// The image is split into horizontal bands of rows, each band is processed by a single thread at a time
+// so that no two threads ever write to the same pixel (no atomics or per-thread histograms required)
+int openmp_band_count;
+int openmp_band_height;
+// Exclusive prefix sum of the number of particles overlapping each band (openmp_band_count + 1 elements)
+unsigned int *openmp_band_index;
+// Indices of the particles overlapping each band, in ascending particle order within each band
+unsigned int *openmp_band_particles;
+// The number of elements openmp_band_particles has been allocated for
+unsigned int openmp_band_particles_capacity;
+// Exclusive prefix sum of the contributions to each band's pixels (openmp_band_count + 1 elements), gathered from openmp_pixel_index
+unsigned int *openmp_band_contribs_index;
+// Work stealing plans of the loops over bands and over pixels, their tasks are sized by particle or contribution count (see scheduler.h)
+SchedulerPlan openmp_band_plan;
+SchedulerPlan openmp_pixel_plan;
+// The vectorised blend kernel, as used by the CPU implementation's stage 3
+SimdKernels openmp_simd;
+
+///
+/// Implementation
+///
 void openmp_begin(const Particle* init_particles, const unsigned int init_particles_count,
     const unsigned int out_image_width, const unsigned int out_image_height) {
+    // Allocate a copy of the initial particles, to be used during computation
+    openmp_particles_count = init_particles_count;
+    openmp_particles = malloc(init_particles_count * sizeof(Particle));
+    memcpy(openmp_particles, init_particles, init_particles_count * sizeof(Particle));
+
+    // Allocate a histogram to track how many particles contribute to each pixel
+    openmp_pixel_contribs = (unsigned int *)malloc(out_image_width * out_image_height * sizeof(unsigned int));
+    // Allocate an index to track where data for each pixel's contributing colour starts/ends
+    openmp_pixel_index = (unsigned int*)malloc((out_image_width * out_image_height + 1) * sizeof(unsigned int));
+    // Init a buffer to store colours contributing to each pixel into (allocated in stage 2)
+    openmp_pixel_contrib_colours = 0;
+    // Init a buffer to store depth of colours contributing to each pixel into (allocated in stage 2)
+    openmp_pixel_contrib_depth = 0;
+    // This tracks the number of contributes the two above buffers are allocated for, init 0
+    openmp_pixel_contrib_count = 0;
 
+    // Select enough bands that a cluster of particles is split between several, the scheduler merges the sparse bands into larger tasks
+    openmp_band_count = omp_get_max_threads() * 32;
+    openmp_band_count = openmp_band_count > (int)out_image_height ? (int)out_image_height : openmp_band_count;
+    openmp_band_height = ((int)out_image_height + openmp_band_count - 1) / openmp_band_count;
+    openmp_band_count = ((int)out_image_height + openmp_band_height - 1) / openmp_band_height;
+    openmp_band_index = (unsigned int*)malloc((openmp_band_count + 1) * sizeof(unsigned int));
+    openmp_band_contribs_index = (unsigned int*)malloc((openmp_band_count + 1) * sizeof(unsigned int));
+    memset(&openmp_band_plan, 0, sizeof(SchedulerPlan));
+    memset(&openmp_pixel_plan, 0, sizeof(SchedulerPlan));
+    // Init a buffer to store the particle indices of each band into (allocated in stage 1)
+    openmp_band_particles = 0;
+    openmp_band_particles_capacity = 0;
+    openmp_simd = simd_kernels(SIMD_AUTO, SIMD_BLEND_FLOAT);
+
+    // Allocate output image
+    openmp_output_image.width = (int)out_image_width;
+    openmp_output_image.height = (int)out_image_height;
+    openmp_output_image.channels = 3;  // RGB
+    openmp_output_image.data = (unsigned char *)malloc(openmp_output_image.width * openmp_output_image.height * openmp_output_image.channels * sizeof(unsigned char));
+}
+void openmp_update(const Particle *particles) {
+    memcpy(openmp_particles, particles, openmp_particles_count * sizeof(Particle));
 }
 void openmp_stage1() {
-    // Optionally during development call the skip function with the correct inputs to skip this stage
-    // skip_pixel_contribs(particles, particles_count, return_pixel_contribs, out_image_width, out_image_height);
+    // Bin particles into the bands their bounding box overlaps
+    // Each thread counts a contiguous range of particles, so that the filled bins retain particle order
+    const int max_threads = omp_get_max_threads();
+    unsigned int *thread_band_counts = (unsigned int*)malloc(max_threads * openmp_band_count * sizeof(unsigned int));
+#pragma omp parallel
+    {
+        const int t = omp_get_thread_num();
+        const int threads = omp_get_num_threads();
+        const unsigned int p_begin = (unsigned int)(((unsigned long long)openmp_particles_count * t) / threads);
+        const unsigned int p_end = (unsigned int)(((unsigned long long)openmp_particles_count * (t + 1)) / threads);
+        unsigned int *band_counts = thread_band_counts + t * openmp_band_count;
+        int x_min, y_min, x_max, y_max;
+        memset(band_counts, 0, openmp_band_count * sizeof(unsigned int));
+        for (unsigned int i = p_begin; i < p_end; ++i) {
+            if (openmp_particle_bounds(&openmp_particles[i], &x_min, &y_min, &x_max, &y_max)) {
+                for (int b = y_min / openmp_band_height; b <= y_max / openmp_band_height; ++b) {
+                    ++band_counts[b];
+                }
+            }
+        }
+#pragma omp barrier
+#pragma omp single
+        {
+            // Convert the per thread counts into per thread write offsets, and build the band index
+            unsigned int total = 0;
+            for (int b = 0; b < openmp_band_count; ++b) {
+                openmp_band_index[b] = total;
+                for (int tt = 0; tt < threads; ++tt) {
+                    const unsigned int count = thread_band_counts[tt * openmp_band_count + b];
+                    thread_band_counts[tt * openmp_band_count + b] = total;
+                    total += count;
+                }
+            }
+            openmp_band_index[openmp_band_count] = total;
+            if (total > openmp_band_particles_capacity) {
+                // (Re)Allocate band storage
+                if (openmp_band_particles) free(openmp_band_particles);
+                openmp_band_particles = (unsigned int*)malloc(total * sizeof(unsigned int));
+                openmp_band_particles_capacity = total;
+            }
+        }  // Implicit barrier
+        for (unsigned int i = p_begin; i < p_end; ++i) {
+            if (openmp_particle_bounds(&openmp_particles[i], &x_min, &y_min, &x_max, &y_max)) {
+                for (int b = y_min / openmp_band_height; b <= y_max / openmp_band_height; ++b) {
+                    openmp_band_particles[band_counts[b]++] = i;
+                }
+            }
+        }
+    }
+    free(thread_band_counts);
 
+    // Calculate how many particles contribute to each pixel, one band at a time
+    // Contributions are not yet known, so bands are grouped into tasks by the number of particles overlapping them
+    scheduler_plan(&openmp_band_plan, openmp_band_index, openmp_band_count, 1);
+    scheduler_run(&openmp_band_plan, openmp_count_bands, 0);
 #ifdef VALIDATION
-    // TODO: Uncomment and call the validation function with the correct inputs
-    // validate_pixel_contribs(particles, particles_count, pixel_contribs, out_image_width, out_image_height);
+    validate_pixel_contribs(openmp_particles, openmp_particles_count, openmp_pixel_contribs, openmp_output_image.width, openmp_output_image.height);
 #endif
 }
 void openmp_stage2() {
-    // Optionally during development call the skip function/s with the correct inputs to skip this stage
-    // skip_pixel_index(pixel_contribs, return_pixel_index, out_image_width, out_image_height);
-    // skip_sorted_pairs(particles, particles_count, pixel_index, out_image_width, out_image_height, return_pixel_contrib_colours, return_pixel_contrib_depth);
+    const int PIXELS = openmp_output_image.width * openmp_output_image.height;
+    // Exclusive prefix sum across the histogram to create an index
+    // The histogram is reset as it is scanned, so that it can be reused as a counter by the scatter
+    scan_exclusive_reset(openmp_pixel_contribs, openmp_pixel_index, PIXELS);
+    // Recover the total from the index
+    const unsigned int TOTAL_CONTRIBS = openmp_pixel_index[PIXELS];
+    if (TOTAL_CONTRIBS > openmp_pixel_contrib_count) {
+        // (Re)Allocate colour storage
+        if (openmp_pixel_contrib_colours) free(openmp_pixel_contrib_colours);
+        if (openmp_pixel_contrib_depth) free(openmp_pixel_contrib_depth);
+        openmp_pixel_contrib_colours = (unsigned char*)malloc(TOTAL_CONTRIBS * 4 * sizeof(unsigned char));
+        openmp_pixel_contrib_depth = (float*)malloc(TOTAL_CONTRIBS * sizeof(float));
+        openmp_pixel_contrib_count = TOTAL_CONTRIBS;
+    }
 
+    // Store colours according to index, one band at a time
+    // Bands retain particle order, so each pixel's contributions are stored in the same order as cpu.c
+    // Each band's contributions are now known exactly, so bands are grouped into tasks by contribution count
+    for (int b = 0; b <= openmp_band_count; ++b) {
+        const int band_y_min = b * openmp_band_height < openmp_output_image.height ? b * openmp_band_height : openmp_output_image.height;
+        openmp_band_contribs_index[b] = openmp_pixel_index[band_y_min * openmp_output_image.width];
+    }
+    scheduler_plan(&openmp_band_plan, openmp_band_contribs_index, openmp_band_count, 1);
+    scheduler_run(&openmp_band_plan, openmp_store_bands, 0);
+
+    // Pair sort the colours contributing to each pixel based on ascending depth
+    // Pixels have very uneven numbers of contributors, so they are grouped into tasks by contribution count
+    // A pixel with more contributors than a task's share forms a task alone, the same tasks are reused by stage 3
+    scheduler_plan(&openmp_pixel_plan, openmp_pixel_index, PIXELS, 1);
+    scheduler_run(&openmp_pixel_plan, openmp_sort_pixels, 0);
 #ifdef VALIDATION
-    // TODO: Uncomment and call the validation functions with the correct inputs
-    // Note: Only validate_equalised_histogram() MUST be uncommented, the others are optional
-    // validate_pixel_index(pixel_contribs, pixel_index, output_image_width, cpu_output_image_height);
-    // validate_sorted_pairs(particles, particles_count, pixel_index, output_image_width, cpu_output_image_height, pixel_contrib_colours, pixel_contrib_depth);
-#endif    
+    validate_pixel_index(openmp_pixel_contribs, openmp_pixel_index, openmp_output_image.width, openmp_output_image.height);
+    validate_sorted_pairs(openmp_particles, openmp_particles_count, openmp_pixel_index, openmp_output_image.width, openmp_output_image.height,
+        openmp_pixel_contrib_colours, openmp_pixel_contrib_depth);
+#endif
 }
 void openmp_stage3() {
-    // Optionally during development call the skip function with the correct inputs to skip this stage
-    // skip_blend(pixel_index, pixel_contrib_colours, return_output_image);
-
+    // Order dependent blending into output image
+    // Each task's pixels are initialised to white, then blended by the vectorised kernel (see simd.h)
+    scheduler_run(&openmp_pixel_plan, openmp_blend_pixels, 0);
 #ifdef VALIDATION
-    // TODO: Uncomment and call the validation function with the correct inputs
-    // validate_blend(pixel_index, pixel_contrib_colours, &output_image);
-#endif    
+    validate_blend(openmp_pixel_index, openmp_pixel_contrib_colours, &openmp_output_image);
+#endif
+}
+void openmp_output(CImage *output_image) {
+    output_image->width = openmp_output_image.width;
+    output_image->height = openmp_output_image.height;
+    output_image->channels = openmp_output_image.channels;
+    memcpy(output_image->data, openmp_output_image.data, openmp_output_image.width * openmp_output_image.height * openmp_output_image.channels * sizeof(unsigned char));
 }
 void openmp_end(CImage* output_image) {
+    // Store return value
+    openmp_output(output_image);
+    // Release allocations
+    free(openmp_band_particles);
+    free(openmp_band_index);
+    free(openmp_band_contribs_index);
+    scheduler_release(&openmp_band_plan);
+    scheduler_release(&openmp_pixel_plan);
+    free(openmp_pixel_contrib_depth);
+    free(openmp_pixel_contrib_colours);
+    free(openmp_output_image.data);
+    free(openmp_pixel_index);
+    free(openmp_pixel_contribs);
+    free(openmp_particles);
+    // Return ptrs to nullptr
+    openmp_band_particles = 0;
+    openmp_band_index = 0;
+    openmp_band_contribs_index = 0;
+    openmp_pixel_contrib_depth = 0;
+    openmp_pixel_contrib_colours = 0;
+    openmp_output_image.data = 0;
+    openmp_pixel_index = 0;
+    openmp_pixel_contribs = 0;
+    openmp_particles = 0;
+}
 
-}
\ No newline at end of file
+static int openmp_particle_bounds(const Particle *p, int *x_min, int *y_min, int *x_max, int *y_max) {
+    // Compute bounding box [inclusive-inclusive]
+    *x_min = (int)roundf(p->location[0] - p->radius);
+    *y_min = (int)roundf(p->location[1] - p->radius);
+    *x_max = (int)roundf(p->location[0] + p->radius);
+    *y_max = (int)roundf(p->location[1] + p->radius);
+    // Clamp bounding box to image bounds
+    *x_min = *x_min < 0 ? 0 : *x_min;
+    *y_min = *y_min < 0 ? 0 : *y_min;
+    *x_max = *x_max >= openmp_output_image.width ? openmp_output_image.width - 1 : *x_max;
+    *y_max = *y_max >= openmp_output_image.height ? openmp_output_image.height - 1 : *y_max;
+    return *x_min <= *x_max && *y_min <= *y_max;
+}
+static void openmp_band_rows(const int b, int *band_y_min, int *band_y_max) {
+    *band_y_min = b * openmp_band_height;
+    *band_y_max = *band_y_min + openmp_band_height - 1 < openmp_output_image.height - 1 ? *band_y_min + openmp_band_height - 1 : openmp_output_image.height - 1;
+}
+static void openmp_count_bands(const unsigned int first, const unsigned int last, void *user) {
+    for (int b = (int)first; b < (int)last; ++b) {
+        int band_y_min, band_y_max;
+        openmp_band_rows(b, &band_y_min, &band_y_max);
+        // Reset this band's rows of the pixel contributions histogram
+        memset(openmp_pixel_contribs + band_y_min * openmp_output_image.width, 0, (band_y_max - band_y_min + 1) * openmp_output_image.width * sizeof(unsigned int));
+        for (unsigned int j = openmp_band_index[b]; j < openmp_band_index[b + 1]; ++j) {
+            const Particle *p = &openmp_particles[openmp_band_particles[j]];
+            int x_min, y_min, x_max, y_max;
+            openmp_particle_bounds(p, &x_min, &y_min, &x_max, &y_max);
+            // Clip bounding box to the band
+            y_min = y_min < band_y_min ? band_y_min : y_min;
+            y_max = y_max > band_y_max ? band_y_max : y_max;
+            // For each pixel in the bounding box, check that it falls within the radius
+            for (int y = y_min; y <= y_max; ++y) {
+                const float y_ab = (float)y + 0.5f - p->location[1];
+                for (int x = x_min; x <= x_max; ++x) {
+                    const float x_ab = (float)x + 0.5f - p->location[0];
+                    const float pixel_distance = sqrtf(x_ab * x_ab + y_ab * y_ab);
+                    if (pixel_distance <= p->radius) {
+                        ++openmp_pixel_contribs[y * openmp_output_image.width + x];
+                    }
+                }
+            }
+        }
+    }
+}
+static void openmp_store_bands(const unsigned int first, const unsigned int last, void *user) {
+    for (int b = (int)first; b < (int)last; ++b) {
+        int band_y_min, band_y_max;
+        openmp_band_rows(b, &band_y_min, &band_y_max);
+        for (unsigned int j = openmp_band_index[b]; j < openmp_band_index[b + 1]; ++j) {
+            const Particle *p = &openmp_particles[openmp_band_particles[j]];
+            int x_min, y_min, x_max, y_max;
+            openmp_particle_bounds(p, &x_min, &y_min, &x_max, &y_max);
+            // Clip bounding box to the band
+            y_min = y_min < band_y_min ? band_y_min : y_min;
+            y_max = y_max > band_y_max ? band_y_max : y_max;
+            // Store data for every pixel within the bounding box that falls within the radius
+            for (int y = y_min; y <= y_max; ++y) {
+                const float y_ab = (float)y + 0.5f - p->location[1];
+                for (int x = x_min; x <= x_max; ++x) {
+                    const float x_ab = (float)x + 0.5f - p->location[0];
+                    const float pixel_distance = sqrtf(x_ab * x_ab + y_ab * y_ab);
+                    if (pixel_distance <= p->radius) {
+                        const unsigned int pixel_offset = y * openmp_output_image.width + x;
+                        // Offset into openmp_pixel_contrib buffers is index + histogram
+                        // Increment openmp_pixel_contribs, so next contributor stores to correct offset
+                        const unsigned int storage_offset = openmp_pixel_index[pixel_offset] + (openmp_pixel_contribs[pixel_offset]++);
+                        // Copy data to openmp_pixel_contrib buffers
+                        memcpy(openmp_pixel_contrib_colours + (4 * storage_offset), p->color, 4 * sizeof(unsigned char));
+                        memcpy(openmp_pixel_contrib_depth + storage_offset, &p->location[2], sizeof(float));
+                    }
+                }
+            }
+        }
+    }
+}
+static void openmp_sort_pixels(const unsigned int first, const unsigned int last, void *user) {
+    for (unsigned int i = first; i < last; ++i) {
+        sort_pairs(
+            openmp_pixel_contrib_depth,
+            openmp_pixel_contrib_colours,
+            openmp_pixel_index[i],
+            openmp_pixel_index[i + 1] - 1
+        );
+    }
+}
+static void openmp_blend_pixels(const unsigned int first, const unsigned int last, void *user) {
+    // Each task's pixels are contiguous, so are initialised to white and then blended by a single call of the kernel
+    memset(openmp_output_image.data + (size_t)first * 3, 255, (size_t)(last - first) * 3 * sizeof(unsigned char));
+    openmp_simd.blend(openmp_pixel_index, openmp_pixel_contrib_colours, openmp_output_image.data, (int)first, (int)last - 1);
+}
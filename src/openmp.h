@@ -17,6 +17,11 @@ extern "C" {
  */
 void openmp_begin(const Particle* init_particles, unsigned int init_particles_count,
     unsigned int out_image_width, unsigned int out_image_height);
+/**
+ * Replace the particles with the next frame of an animation, reusing every allocation made by openmp_begin()
+ * @param particles Pointer to an array of particle structures, the same number as passed to openmp_begin()
+ */
+void openmp_update(const Particle *particles);
 /**
  * Create a locatlised histogram for each tile of the image
  */
@@ -29,6 +34,11 @@ void openmp_stage2();
  * Interpolate the histograms to construct the contrast enhanced image for output
  */
 void openmp_stage3();
+/**
+ * Copy the image produced by the last openmp_stage3() to output_image, without releasing any memory
+ * @param output_image Pointer to a struct to store the image to be output, output_image->data is pre-allocated
+ */
+void openmp_output(CImage *output_image);
 /**
  * The cleanup and return function for the CPU CLAHE implemention
  * Memory should be freed, and the final image copied to output_image
@@ -0,0 +1,326 @@
+#include "reference.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+///
+/// Utility Methods
+///
+/**
+ * Size (in bytes) of the chunks hashed independently by reference_hash(), fixed so the hash is independent of thread count
+ */
+#define REFERENCE_HASH_CHUNK (1024 * 1024)
+/**
+ * FNV-1a 64-bit parameters
+ */
+#define REFERENCE_FNV_OFFSET 0xCBF29CE484222325ull
+#define REFERENCE_FNV_PRIME 0x100000001B3ull
+/**
+ * A particle binned to a band, the index breaks depth ties so that the order is deterministic
+ */
+struct ReferenceEntry {
+    float depth;
+    unsigned int index;
+};
+typedef struct ReferenceEntry ReferenceEntry;
+/**
+ * The header at the start of a cache file
+ */
+struct ReferenceCacheHeader {
+    char magic[8];
+    unsigned int version;
+    unsigned int particles_count;
+    unsigned int width;
+    unsigned int height;
+    unsigned long long hash;
+};
+typedef struct ReferenceCacheHeader ReferenceCacheHeader;
+/**
+ * Magic bytes at the start of every cache file
+ */
+static const char reference_magic[8] = { 'P', 'R', 'E', 'F', 'I', 'M', 'G', '\0' };
+/**
+ * Compute the range of rendered rows [inclusive-inclusive] covered by particle's bounding box
+ * Rows are numbered by their index among rendered rows, so row k is image row k * row_stride
+ * @return Non-zero if the particle covers at least one rendered row
+ */
+static int reference_row_range(const Particle *particle, unsigned int height, unsigned int row_stride, unsigned int *first, unsigned int *last);
+/**
+ * Count the pixels of image rows [first, last] whose centre particle covers, within its bounding box as computed by the
+ * helper methods, shared by reference_pixel_contribs() and reference_contributions() so that their counts agree
+ * @param pixel_contribs If not null, the count of each covered pixel (of an image width pixels wide) is incremented
+ * @return The number of covered pixels
+ */
+static unsigned long long reference_cover(const Particle *particle, unsigned int width, unsigned int first, unsigned int last,
+    unsigned int *pixel_contribs);
+/**
+ * Bin particles into the bands of rendered rows their bounding box covers
+ * @param band_index Set to an allocated array of bands_count + 1 offsets into entries, band b's entries are [band_index[b], band_index[b + 1])
+ * @param entries Set to an allocated array of each band's particles, in index order
+ * @return The number of bands, each of REFERENCE_BAND_ROWS rendered rows
+ */
+static unsigned int reference_bin(const Particle *particles, unsigned int particles_count, unsigned int height, unsigned int row_stride,
+    size_t **band_index, ReferenceEntry **entries);
+/**
+ * qsort() comparator of ReferenceEntry, ascending depth then index
+ */
+static int reference_entry_compare(const void *a, const void *b);
+/**
+ * Continue an FNV-1a hash over size bytes of data
+ */
+static unsigned long long reference_fnv(const unsigned char *data, size_t size, unsigned long long hash);
+/**
+ * Return the path of the cache file for the key, which must be freed by the caller
+ */
+static char *reference_cache_path(const char *directory, unsigned long long hash, unsigned int particles_count, unsigned int width, unsigned int height);
+
+///
+/// Implementation
+///
+void reference_render(const Particle *particles, const unsigned int particles_count,
+    const unsigned int width, const unsigned int height, const unsigned int row_stride, CImage *image) {
+    image->width = (int)width;
+    image->height = (int)height;
+    image->channels = 3;
+    image->data = (unsigned char*)malloc(width * height * 3 * sizeof(unsigned char));
+    memset(image->data, 255, width * height * 3 * sizeof(unsigned char));
+    size_t *band_index;
+    ReferenceEntry *entries;
+    const unsigned int bands_count = reference_bin(particles, particles_count, height, row_stride, &band_index, &entries);
+    // Render each band independently, blending its particles in ascending depth order
+#pragma omp parallel for schedule(dynamic)
+    for (int b = 0; b < (int)bands_count; ++b) {
+        ReferenceEntry *band_entries = entries + band_index[b];
+        const size_t band_entries_count = band_index[b + 1] - band_index[b];
+        qsort(band_entries, band_entries_count, sizeof(ReferenceEntry), reference_entry_compare);
+        const unsigned int band_first = (unsigned int)b * REFERENCE_BAND_ROWS;
+        const unsigned int band_last = band_first + REFERENCE_BAND_ROWS - 1;
+        for (size_t e = 0; e < band_entries_count; ++e) {
+            const Particle *particle = &particles[band_entries[e].index];
+            unsigned int first = 0, last = 0;
+            reference_row_range(particle, height, row_stride, &first, &last);
+            first = first < band_first ? band_first : first;
+            last = last > band_last ? band_last : last;
+            // Bounding box columns, as computed by the helper methods
+            int x_min = (int)roundf(particle->location[0] - particle->radius);
+            int x_max = (int)roundf(particle->location[0] + particle->radius);
+            x_min = x_min < 0 ? 0 : x_min;
+            x_max = x_max >= (int)width ? (int)width - 1 : x_max;
+            const float opacity = (float)particle->color[3] / (float)255;
+            for (unsigned int k = first; k <= last; ++k) {
+                const int y = (int)(k * row_stride);
+                unsigned char *row = image->data + (size_t)y * width * 3;
+                for (int x = x_min; x <= x_max; ++x) {
+                    const float x_ab = (float)x + 0.5f - particle->location[0];
+                    const float y_ab = (float)y + 0.5f - particle->location[1];
+                    const float pixel_distance = sqrtf(x_ab * x_ab + y_ab * y_ab);
+                    if (pixel_distance <= particle->radius) {
+                        // dest = src * opacity + dest * (1 - opacity);
+                        row[(x * 3) + 0] = (unsigned char)((float)particle->color[0] * opacity + (float)row[(x * 3) + 0] * (1 - opacity));
+                        row[(x * 3) + 1] = (unsigned char)((float)particle->color[1] * opacity + (float)row[(x * 3) + 1] * (1 - opacity));
+                        row[(x * 3) + 2] = (unsigned char)((float)particle->color[2] * opacity + (float)row[(x * 3) + 2] * (1 - opacity));
+                    }
+                }
+            }
+        }
+    }
+    free(entries);
+    free(band_index);
+}
+void reference_pixel_contribs(const Particle *particles, const unsigned int particles_count,
+    const unsigned int width, const unsigned int height, unsigned int *pixel_contribs) {
+    memset(pixel_contribs, 0, width * height * sizeof(unsigned int));
+    size_t *band_index;
+    ReferenceEntry *entries;
+    const unsigned int bands_count = reference_bin(particles, particles_count, height, 1, &band_index, &entries);
+    // Each band's pixels are only counted by the thread processing the band
+#pragma omp parallel for schedule(dynamic)
+    for (int b = 0; b < (int)bands_count; ++b) {
+        const unsigned int band_first = (unsigned int)b * REFERENCE_BAND_ROWS;
+        const unsigned int band_last = band_first + REFERENCE_BAND_ROWS - 1;
+        for (size_t e = band_index[b]; e < band_index[b + 1]; ++e) {
+            const Particle *particle = &particles[entries[e].index];
+            unsigned int first = 0, last = 0;
+            reference_row_range(particle, height, 1, &first, &last);
+            first = first < band_first ? band_first : first;
+            last = last > band_last ? band_last : last;
+            reference_cover(particle, width, first, last, pixel_contribs);
+        }
+    }
+    free(entries);
+    free(band_index);
+}
+unsigned long long reference_contributions(const Particle *particles, const unsigned int particles_count,
+    const unsigned int width, const unsigned int height) {
+    unsigned long long contributions = 0;
+#pragma omp parallel for schedule(dynamic, 1024) reduction(+:contributions)
+    for (int i = 0; i < (int)particles_count; ++i) {
+        const Particle *particle = &particles[i];
+        unsigned int first, last;
+        if (!reference_row_range(particle, height, 1, &first, &last))
+            continue;
+        contributions += reference_cover(particle, width, first, last, 0);
+    }
+    return contributions;
+}
+unsigned long long reference_hash(const Particle *particles, const unsigned int particles_count) {
+    const unsigned char *data = (const unsigned char*)particles;
+    const size_t size = (size_t)particles_count * sizeof(Particle);
+    const int chunks_count = (int)((size + REFERENCE_HASH_CHUNK - 1) / REFERENCE_HASH_CHUNK);
+    unsigned long long *chunk_hashes = (unsigned long long*)malloc((chunks_count ? chunks_count : 1) * sizeof(unsigned long long));
+#pragma omp parallel for schedule(static)
+    for (int c = 0; c < chunks_count; ++c) {
+        const size_t offset = (size_t)c * REFERENCE_HASH_CHUNK;
+        const size_t chunk_size = size - offset < REFERENCE_HASH_CHUNK ? size - offset : REFERENCE_HASH_CHUNK;
+        chunk_hashes[c] = reference_fnv(data + offset, chunk_size, REFERENCE_FNV_OFFSET);
+    }
+    const unsigned long long hash = reference_fnv((const unsigned char*)chunk_hashes, chunks_count * sizeof(unsigned long long), REFERENCE_FNV_OFFSET);
+    free(chunk_hashes);
+    return hash;
+}
+int reference_cache_load(const char *directory, const unsigned long long hash, const unsigned int particles_count,
+    const unsigned int width, const unsigned int height, CImage *image) {
+    char *path = reference_cache_path(directory, hash, particles_count, width, height);
+    FILE *file = fopen(path, "rb");
+    free(path);
+    if (!file)
+        return 0;
+    ReferenceCacheHeader header;
+    int success = fread(&header, sizeof(ReferenceCacheHeader), 1, file) == 1 &&
+        !memcmp(header.magic, reference_magic, sizeof(reference_magic)) && header.version == REFERENCE_CACHE_VERSION &&
+        header.particles_count == particles_count && header.width == width && header.height == height && header.hash == hash;
+    if (success) {
+        const size_t image_size = (size_t)width * height * 3;
+        image->width = (int)width;
+        image->height = (int)height;
+        image->channels = 3;
+        image->data = (unsigned char*)malloc(image_size);
+        success = fread(image->data, 1, image_size, file) == image_size;
+        if (!success) {
+            free(image->data);
+            image->data = 0;
+        }
+    }
+    fclose(file);
+    return success;
+}
+int reference_cache_store(const char *directory, const unsigned long long hash, const unsigned int particles_count, const CImage *image) {
+    char *path = reference_cache_path(directory, hash, particles_count, (unsigned int)image->width, (unsigned int)image->height);
+    char *temp_path = (char*)malloc(strlen(path) + 5);
+    strcpy(temp_path, path);
+    strcat(temp_path, ".tmp");
+    ReferenceCacheHeader header;
+    memset(&header, 0, sizeof(ReferenceCacheHeader));
+    memcpy(header.magic, reference_magic, sizeof(reference_magic));
+    header.version = REFERENCE_CACHE_VERSION;
+    header.particles_count = particles_count;
+    header.width = (unsigned int)image->width;
+    header.height = (unsigned int)image->height;
+    header.hash = hash;
+    int success = 0;
+    FILE *file = fopen(temp_path, "wb");
+    if (file) {
+        const size_t image_size = (size_t)image->width * image->height * 3;
+        success = fwrite(&header, sizeof(ReferenceCacheHeader), 1, file) == 1;
+        success &= fwrite(image->data, 1, image_size, file) == image_size;
+        success &= fclose(file) == 0;
+        if (success) {
+            remove(path);  // rename() does not replace an existing file on every platform
+            success = rename(temp_path, path) == 0;
+        }
+        if (!success)
+            remove(temp_path);
+    }
+    free(temp_path);
+    free(path);
+    return success;
+}
+
+static unsigned int reference_bin(const Particle *particles, const unsigned int particles_count, const unsigned int height, const unsigned int row_stride,
+    size_t **band_index, ReferenceEntry **entries) {
+    const unsigned int rows_count = (height + row_stride - 1) / row_stride;
+    const unsigned int bands_count = (rows_count + REFERENCE_BAND_ROWS - 1) / REFERENCE_BAND_ROWS;
+    // Count then scatter
+    size_t *t_band_index = (size_t*)calloc(bands_count + 1, sizeof(size_t));
+    for (unsigned int i = 0; i < particles_count; ++i) {
+        unsigned int first, last;
+        if (reference_row_range(&particles[i], height, row_stride, &first, &last)) {
+            for (unsigned int b = first / REFERENCE_BAND_ROWS; b <= last / REFERENCE_BAND_ROWS; ++b)
+                ++t_band_index[b + 1];
+        }
+    }
+    for (unsigned int b = 0; b < bands_count; ++b)
+        t_band_index[b + 1] += t_band_index[b];
+    ReferenceEntry *t_entries = (ReferenceEntry*)malloc((t_band_index[bands_count] ? t_band_index[bands_count] : 1) * sizeof(ReferenceEntry));
+    size_t *band_fill = (size_t*)malloc((bands_count ? bands_count : 1) * sizeof(size_t));
+    memcpy(band_fill, t_band_index, bands_count * sizeof(size_t));
+    for (unsigned int i = 0; i < particles_count; ++i) {
+        unsigned int first, last;
+        if (reference_row_range(&particles[i], height, row_stride, &first, &last)) {
+            for (unsigned int b = first / REFERENCE_BAND_ROWS; b <= last / REFERENCE_BAND_ROWS; ++b) {
+                t_entries[band_fill[b]].depth = particles[i].location[2];
+                t_entries[band_fill[b]++].index = i;
+            }
+        }
+    }
+    free(band_fill);
+    *band_index = t_band_index;
+    *entries = t_entries;
+    return bands_count;
+}
+static int reference_row_range(const Particle *particle, const unsigned int height, const unsigned int row_stride, unsigned int *first, unsigned int *last) {
+    // Bounding box rows, as computed by the helper methods
+    int y_min = (int)roundf(particle->location[1] - particle->radius);
+    int y_max = (int)roundf(particle->location[1] + particle->radius);
+    y_min = y_min < 0 ? 0 : y_min;
+    y_max = y_max >= (int)height ? (int)height - 1 : y_max;
+    if (y_min > y_max)
+        return 0;
+    *first = ((unsigned int)y_min + row_stride - 1) / row_stride;
+    *last = (unsigned int)y_max / row_stride;
+    return *first <= *last;
+}
+static unsigned long long reference_cover(const Particle *particle, const unsigned int width, const unsigned int first, const unsigned int last,
+    unsigned int *pixel_contribs) {
+    // Bounding box columns, as computed by the helper methods
+    int x_min = (int)roundf(particle->location[0] - particle->radius);
+    int x_max = (int)roundf(particle->location[0] + particle->radius);
+    x_min = x_min < 0 ? 0 : x_min;
+    x_max = x_max >= (int)width ? (int)width - 1 : x_max;
+    unsigned long long covered = 0;
+    for (unsigned int y = first; y <= last; ++y) {
+        for (int x = x_min; x <= x_max; ++x) {
+            const float x_ab = (float)x + 0.5f - particle->location[0];
+            const float y_ab = (float)y + 0.5f - particle->location[1];
+            const unsigned int pixel_covered = sqrtf(x_ab * x_ab + y_ab * y_ab) <= particle->radius;
+            if (pixel_contribs)
+                pixel_contribs[(size_t)y * width + x] += pixel_covered;
+            covered += pixel_covered;
+        }
+    }
+    return covered;
+}
+static int reference_entry_compare(const void *a, const void *b) {
+    const ReferenceEntry *entry_a = (const ReferenceEntry*)a;
+    const ReferenceEntry *entry_b = (const ReferenceEntry*)b;
+    if (entry_a->depth != entry_b->depth)
+        return entry_a->depth < entry_b->depth ? -1 : 1;
+    return entry_a->index < entry_b->index ? -1 : entry_a->index > entry_b->index;
+}
+static unsigned long long reference_fnv(const unsigned char *data, const size_t size, unsigned long long hash) {
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= data[i];
+        hash *= REFERENCE_FNV_PRIME;
+    }
+    return hash;
+}
+static char *reference_cache_path(const char *directory, const unsigned long long hash, const unsigned int particles_count,
+    const unsigned int width, const unsigned int height) {
+    const char *format = "%s/reference_%u_%ux%u_%016llx.ref";
+    const int length = snprintf(0, 0, format, directory, particles_count, width, height, hash);
+    char *path = (char*)malloc(length + 1);
+    snprintf(path, length + 1, format, directory, particles_count, width, height, hash);
+    return path;
+}
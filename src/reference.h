@@ -0,0 +1,79 @@
+#ifndef REFERENCE_H_
+#define REFERENCE_H_
+
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Reference renderer used to validate the output of each implementation
+ *
+ * Particles are binned into horizontal bands of rows, then each band is rendered in parallel (OpenMP) by sorting its
+ * particles by depth and blending them directly into the image, so no per pixel contribution storage is required
+ * The coverage test and blend match the helper methods (helper.c) exactly, so the image is identical to that of skip_blend()
+ *
+ * Rendering may be restricted to every row_stride'th row, to sample the image at a fraction of the cost
+ * Full reference images may be cached on disk, keyed by particle count, resolution and a hash of the particles
+ * (the hash covers the seed and generator, and also identifies particles loaded from a scene file)
+ */
+
+/**
+ * Number of rendered rows within each band, bands are the unit of parallel work
+ */
+#define REFERENCE_BAND_ROWS 16
+/**
+ * Version of the cache file format, increment if the header or rendering change
+ */
+#define REFERENCE_CACHE_VERSION 1
+
+/**
+ * Render the reference image of the particles
+ * @param particles Pointer to an array of particle structures
+ * @param particles_count The number of elements within the particles array
+ * @param width The width of the image to render
+ * @param height The height of the image to render
+ * @param row_stride Only rows whose index is a multiple of this are rendered, 1 renders every row (others are left white)
+ * @param image Pointer to a struct to store the image, image->data is allocated and must be freed by the caller
+ */
+void reference_render(const Particle *particles, unsigned int particles_count,
+    unsigned int width, unsigned int height, unsigned int row_stride, CImage *image);
+/**
+ * Compute the number of particles contributing to each pixel (as stage 1 does), in parallel
+ * @param pixel_contribs Pointer to storage for width * height counts
+ */
+void reference_pixel_contribs(const Particle *particles, unsigned int particles_count,
+    unsigned int width, unsigned int height, unsigned int *pixel_contribs);
+/**
+ * Count the pixel contributions of the particles (the sum of every pixel's contributor count), in parallel
+ */
+unsigned long long reference_contributions(const Particle *particles, unsigned int particles_count, unsigned int width, unsigned int height);
+/**
+ * Return a 64-bit hash (FNV-1a) of the particles, computed in parallel over fixed size chunks
+ */
+unsigned long long reference_hash(const Particle *particles, unsigned int particles_count);
+/**
+ * Load a reference image from the cache
+ * @param directory The cache directory
+ * @param hash The hash of the particles, from reference_hash()
+ * @param particles_count The number of particles
+ * @param width The width of the image
+ * @param height The height of the image
+ * @param image Pointer to a struct to store the image, on success image->data is allocated and must be freed by the caller
+ * @return Non-zero if a matching image was found and loaded
+ */
+int reference_cache_load(const char *directory, unsigned long long hash, unsigned int particles_count,
+    unsigned int width, unsigned int height, CImage *image);
+/**
+ * Store a full (row_stride 1) reference image in the cache, the directory must already exist
+ * The file is written under a temporary name then renamed, so concurrent runs never load a partial image
+ * @return Non-zero on success
+ */
+int reference_cache_store(const char *directory, unsigned long long hash, unsigned int particles_count, const CImage *image);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // REFERENCE_H_
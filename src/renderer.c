@@ -0,0 +1,76 @@
+#include "renderer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+///
+/// Implementation
+///
+struct Renderer {
+    CpuContext *cpu;
+    CpuOptions options;
+    // Treated as boolean, cpu is between cpu_begin() and cpu_end()
+    int begun;
+    // The dimensions passed to the last cpu_begin()
+    unsigned int particles_count;
+    unsigned int width;
+    unsigned int height;
+};
+
+Renderer *renderer_create(const CpuOptions *options) {
+    Renderer *renderer = (Renderer*)malloc(sizeof(Renderer));
+    if (!renderer)
+        return 0;
+    memset(renderer, 0, sizeof(Renderer));
+    renderer->cpu = cpu_create();
+    if (!renderer->cpu) {
+        free(renderer);
+        return 0;
+    }
+    renderer->options = options ? *options : cpu_default_options;
+    return renderer;
+}
+int renderer_upload(Renderer *renderer, const Particle *particles, const unsigned int particles_count,
+    const unsigned int width, const unsigned int height) {
+    if (!renderer || (!particles && particles_count) || !width || !height)
+        return 0;
+    if (renderer->begun && renderer->particles_count == particles_count && renderer->width == width && renderer->height == height) {
+        // The same dimensions, so the particles can replace the previous without allocating
+        cpu_update(renderer->cpu, particles);
+        return 1;
+    }
+    if (renderer->begun) {
+        // The image is not required, cpu_end() only reports its dimensions
+        CImage discard;
+        memset(&discard, 0, sizeof(CImage));
+        cpu_end(renderer->cpu, &discard);
+    }
+    const int begun = cpu_begin(renderer->cpu, &renderer->options, particles, particles_count, width, height);
+    renderer->begun = 1;
+    renderer->particles_count = particles_count;
+    // A failed upload must not be reused by the next, so its width (never 0) is not recorded
+    renderer->width = begun ? width : 0;
+    renderer->height = height;
+    return begun;
+}
+int renderer_render(Renderer *renderer, unsigned char *rgb) {
+    if (!renderer || !renderer->begun)
+        return 0;
+    if (!cpu_stage1(renderer->cpu) || !cpu_stage2(renderer->cpu) || !cpu_stage3(renderer->cpu))
+        return 0;
+    CImage output_image;
+    output_image.data = rgb;
+    cpu_output(renderer->cpu, &output_image);
+    return 1;
+}
+void renderer_destroy(Renderer *renderer) {
+    if (!renderer)
+        return;
+    if (renderer->begun) {
+        CImage discard;
+        memset(&discard, 0, sizeof(CImage));
+        cpu_end(renderer->cpu, &discard);
+    }
+    cpu_destroy(renderer->cpu);
+    free(renderer);
+}
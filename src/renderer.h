@@ -0,0 +1,58 @@
+#ifndef RENDERER_H_
+#define RENDERER_H_
+
+#include "common.h"
+#include "cpu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Embeddable renderer, the CPU implementation behind an opaque handle, built as a static library (make lib)
+ *
+ * A renderer retains its particles and buffers between renders, so uploading the same number of particles for an image
+ * of the same size (e.g. the next frame, or a repeated request) reuses every allocation of the previous upload
+ * Renderers share no state, so separate renderers may render concurrently from different threads
+ *
+ *   Renderer *renderer = renderer_create(0);
+ *   renderer_upload(renderer, particles, particles_count, width, height);
+ *   renderer_render(renderer, rgb);  // width * height * 3 bytes
+ *   renderer_destroy(renderer);
+ */
+typedef struct Renderer Renderer;
+
+/**
+ * Create a renderer
+ * @param options The options of every render, copied, null selects cpu_default_options
+ * @return The renderer, or null if it could not be allocated
+ */
+Renderer *renderer_create(const CpuOptions *options);
+/**
+ * Pass the particles of the next render(s), the particles are copied so may be released after the call
+ * @param particles Pointer to an array of particle structures
+ * @param particles_count The number of elements within the particles array
+ * @param width The width of the image to render
+ * @param height The height of the image to render
+ * @return Non-zero on success, 0 if the arguments are invalid or the buffers could not be allocated
+ */
+int renderer_upload(Renderer *renderer, const Particle *particles, unsigned int particles_count, unsigned int width, unsigned int height);
+/**
+ * Render the uploaded particles
+ * @param rgb Pointer to width * height * 3 bytes, to store the RGB image (top to bottom, without row padding)
+ *        May be null if CpuOptions::band_sink is set, as the rows are then passed to the sink
+ * @return Non-zero on success, 0 if no particles have been uploaded, the buffers could not be allocated, or the scene's
+ *         contributions exceed a 32-bit index (without CpuOptions::band_budget)
+ *         The error is reported to stderr and rgb is left unchanged
+ */
+int renderer_render(Renderer *renderer, unsigned char *rgb);
+/**
+ * Release the renderer and every buffer it retains, passing null does nothing
+ */
+void renderer_destroy(Renderer *renderer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // RENDERER_H_
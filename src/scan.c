@@ -0,0 +1,123 @@
+#include "scan.h"
+
+#include <stdlib.h>
+#include <omp.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SCAN_SSE2
+#include <emmintrin.h>
+#endif
+
+///
+/// Utility Methods
+///
+/**
+ * Scan counts[first, last) into index[first, last), starting from offset
+ * @param reset Treated as boolean, zero each count as it is read
+ * @param offset The sum of every count before first
+ * @return The sum of counts[first, last) as a 64-bit value
+ */
+static unsigned long long scan_block(unsigned int *counts, unsigned int *index, size_t first, size_t last, int reset, unsigned int offset);
+/**
+ * Return the sum of counts[first, last) as a 64-bit value
+ */
+static unsigned long long scan_reduce(const unsigned int *counts, size_t first, size_t last);
+/**
+ * Scan counts into index, serially or in parallel according to count
+ * @param parallel Treated as boolean, large inputs may be scanned in parallel, otherwise the scan is always serial
+ */
+static unsigned long long scan(unsigned int *counts, unsigned int *index, size_t count, int reset, int parallel);
+
+///
+/// Implementation
+///
+unsigned long long scan_exclusive(const unsigned int *counts, unsigned int *index, const size_t count) {
+    // The counts are only written when reset is set
+    return scan((unsigned int*)counts, index, count, 0, 1);
+}
+unsigned long long scan_exclusive_reset(unsigned int *counts, unsigned int *index, const size_t count) {
+    return scan(counts, index, count, 1, 1);
+}
+unsigned long long scan_exclusive_reset_serial(unsigned int *counts, unsigned int *index, const size_t count) {
+    return scan(counts, index, count, 1, 0);
+}
+
+static unsigned long long scan(unsigned int *counts, unsigned int *index, const size_t count, const int reset, const int parallel) {
+    const int max_threads = parallel ? omp_get_max_threads() : 1;
+    if (count < SCAN_PARALLEL_MIN || max_threads == 1) {
+        const unsigned long long total = scan_block(counts, index, 0, count, reset, 0);
+        index[count] = (unsigned int)total;
+        return total;
+    }
+    // Reduce each thread's block, scan the block sums, then scan each block from its offset
+    unsigned long long *block_sums = (unsigned long long*)malloc((max_threads + 1) * sizeof(unsigned long long));
+    // The parallel region may have fewer threads than the maximum, the total follows the last thread's block
+    int blocks = 1;
+#pragma omp parallel
+    {
+        const int t = omp_get_thread_num();
+        const int threads = omp_get_num_threads();
+        // Blocks are aligned to 16 counts, so that each block's vector loads start on a cache line boundary if counts does
+        const size_t first = (count * t / threads) & ~(size_t)15;
+        const size_t last = t == threads - 1 ? count : (count * (t + 1) / threads) & ~(size_t)15;
+        block_sums[t + 1] = scan_reduce(counts, first, last);
+#pragma omp barrier
+#pragma omp single
+        {
+            block_sums[0] = 0;
+            for (int tt = 0; tt < threads; ++tt) {
+                block_sums[tt + 1] += block_sums[tt];
+            }
+            blocks = threads;
+        }  // Implicit barrier
+        scan_block(counts, index, first, last, reset, (unsigned int)block_sums[t]);
+    }
+    const unsigned long long total = block_sums[blocks];
+    free(block_sums);
+    index[count] = (unsigned int)total;
+    return total;
+}
+static unsigned long long scan_block(unsigned int *counts, unsigned int *index, const size_t first, const size_t last,
+    const int reset, const unsigned int offset) {
+    size_t i = first;
+    unsigned int running = offset;
+    unsigned long long sum = 0;
+#ifdef SCAN_SSE2
+    __m128i carry = _mm_set1_epi32((int)offset);
+    __m128i sum64 = _mm_setzero_si128();
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 4 <= last; i += 4) {
+        const __m128i x = _mm_loadu_si128((const __m128i*)(counts + i));
+        if (reset)
+            _mm_storeu_si128((__m128i*)(counts + i), zero);
+        // Inclusive prefix sum of the 4 counts, in two shift and add steps
+        __m128i inclusive = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+        inclusive = _mm_add_epi32(inclusive, _mm_slli_si128(inclusive, 8));
+        // The exclusive sum is the inclusive sum less each count, offset by the total of every earlier group
+        _mm_storeu_si128((__m128i*)(index + i), _mm_add_epi32(carry, _mm_sub_epi32(inclusive, x)));
+        carry = _mm_add_epi32(carry, _mm_shuffle_epi32(inclusive, 0xFF));
+        // Accumulate the 64-bit total, widening the counts so that it cannot wrap
+        sum64 = _mm_add_epi64(sum64, _mm_add_epi64(_mm_unpacklo_epi32(x, zero), _mm_unpackhi_epi32(x, zero)));
+    }
+    running = (unsigned int)_mm_cvtsi128_si32(carry);
+    unsigned long long sums[2];
+    _mm_storeu_si128((__m128i*)sums, sum64);
+    sum = sums[0] + sums[1];
+#endif
+    for (; i < last; ++i) {
+        const unsigned int c = counts[i];
+        if (reset)
+            counts[i] = 0;
+        index[i] = running;
+        running += c;
+        sum += c;
+    }
+    return sum;
+}
+static unsigned long long scan_reduce(const unsigned int *counts, const size_t first, const size_t last) {
+    unsigned long long sum = 0;
+    for (size_t i = first; i < last; ++i) {
+        sum += counts[i];
+    }
+    return sum;
+}
@@ -0,0 +1,50 @@
+#ifndef SCAN_H_
+#define SCAN_H_
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Exclusive prefix sum (scan) of 32-bit counts, used to build the pixel index from the pixel contribution histogram
+ *
+ * Large inputs are scanned in parallel (OpenMP) by a blocked reduce-then-scan, each thread sums a contiguous block,
+ * the block sums are scanned serially, then each thread scans its block from its block's offset
+ * Within a block, groups of 4 counts are prefix summed in register (SSE2) by two shift and add steps, so the serial
+ * dependency is a single add per group, carrying the running total between groups
+ *
+ * scan_exclusive_reset() also zeroes each count as it is read, so a histogram which is then reused as a counter
+ * (as by stage 2's scatter) is read and written by the scan, rather than read by the scan and written again by a memset
+ */
+
+/**
+ * Inputs with fewer counts than this are scanned serially, as the parallel scan reads its input twice
+ */
+#define SCAN_PARALLEL_MIN (1 << 18)
+
+/**
+ * Compute the exclusive prefix sum of counts
+ * @param counts The counts to be scanned
+ * @param index Pointer to storage for count + 1 elements, index[i] is the sum of counts[0, i), index[count] the total
+ * @param count The number of counts
+ * @return The total as a 64-bit value, if it exceeds 32 bits the index has wrapped
+ */
+unsigned long long scan_exclusive(const unsigned int *counts, unsigned int *index, size_t count);
+/**
+ * As scan_exclusive(), also setting every element of counts to 0
+ */
+unsigned long long scan_exclusive_reset(unsigned int *counts, unsigned int *index, size_t count);
+/**
+ * As scan_exclusive_reset(), always scanning on the calling thread
+ * Used by the single threaded CPU implementation, so that it neither competes with concurrent contexts for cores
+ * nor gains threads the OPENMP implementation is compared against
+ */
+unsigned long long scan_exclusive_reset_serial(unsigned int *counts, unsigned int *index, size_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SCAN_H_
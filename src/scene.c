@@ -0,0 +1,142 @@
+#include "scene.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+///
+/// Utility Methods
+///
+/**
+ * Magic bytes at the start of every scene file
+ */
+static const char scene_magic[8] = { 'P', 'S', 'C', 'E', 'N', 'E', '\0', '\0' };
+/**
+ * Check the header and size of a scene file, printing the reason it is rejected to stderr
+ * @return Non-zero if the file is valid
+ */
+static int scene_validate(const char *path, const SceneHeader *header, size_t file_size);
+
+///
+/// Implementation
+///
+int scene_write(const char *path, const Particle *particles, const unsigned int particles_count, const unsigned int width, const unsigned int height) {
+    SceneHeader header;
+    memset(&header, 0, sizeof(SceneHeader));
+    memcpy(header.magic, scene_magic, sizeof(scene_magic));
+    header.version = SCENE_VERSION;
+    header.byte_order = SCENE_BYTE_ORDER;
+    header.particles_offset = sizeof(SceneHeader);
+    header.particle_size = sizeof(Particle);
+    header.particles_count = particles_count;
+    header.width = width;
+    header.height = height;
+    FILE *file = fopen(path, "wb");
+    if (!file)
+        return 0;
+    int success = fwrite(&header, sizeof(SceneHeader), 1, file) == 1;
+    success &= fwrite(particles, sizeof(Particle), particles_count, file) == particles_count;
+    success &= fclose(file) == 0;
+    return success;
+}
+int scene_open(const char *path, Scene *scene) {
+    memset(scene, 0, sizeof(Scene));
+#ifdef __linux__
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Unable to open scene file %s.\n", path);
+        return 0;
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) || (size_t)file_stat.st_size < sizeof(SceneHeader)) {
+        fprintf(stderr, "Scene file %s is too small to contain a header.\n", path);
+        close(fd);
+        return 0;
+    }
+    // A private mapping allows the particles to be modified (e.g. animated), without copying pages which are not
+    void *data = mmap(0, (size_t)file_stat.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "Unable to map scene file %s.\n", path);
+        return 0;
+    }
+    scene->data_size = (size_t)file_stat.st_size;
+#else
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "Unable to open scene file %s.\n", path);
+        return 0;
+    }
+    fseek(file, 0, SEEK_END);
+    const long file_size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (file_size < (long)sizeof(SceneHeader)) {
+        fprintf(stderr, "Scene file %s is too small to contain a header.\n", path);
+        fclose(file);
+        return 0;
+    }
+    void *data = malloc((size_t)file_size);
+    const int read = fread(data, 1, (size_t)file_size, file) == (size_t)file_size;
+    fclose(file);
+    if (!read) {
+        fprintf(stderr, "Unable to read scene file %s.\n", path);
+        free(data);
+        return 0;
+    }
+    scene->data_size = (size_t)file_size;
+#endif
+    scene->data = data;
+    const SceneHeader *header = (const SceneHeader*)data;
+    if (!scene_validate(path, header, scene->data_size)) {
+        scene_close(scene);
+        return 0;
+    }
+    scene->particles = (Particle*)((unsigned char*)data + header->particles_offset);
+    scene->particles_count = header->particles_count;
+    scene->width = header->width;
+    scene->height = header->height;
+    return 1;
+}
+void scene_close(Scene *scene) {
+    if (scene->data) {
+#ifdef __linux__
+        munmap(scene->data, scene->data_size);
+#else
+        free(scene->data);
+#endif
+    }
+    memset(scene, 0, sizeof(Scene));
+}
+
+static int scene_validate(const char *path, const SceneHeader *header, const size_t file_size) {
+    if (memcmp(header->magic, scene_magic, sizeof(scene_magic))) {
+        fprintf(stderr, "%s is not a scene file.\n", path);
+        return 0;
+    }
+    if (header->byte_order != SCENE_BYTE_ORDER) {
+        fprintf(stderr, "Scene file %s was written on a host of the opposite byte order.\n", path);
+        return 0;
+    }
+    if (header->version != SCENE_VERSION || header->particle_size != sizeof(Particle)) {
+        fprintf(stderr, "Scene file %s has version %u (record size %u), expected version %u (record size %u).\n",
+            path, header->version, header->particle_size, SCENE_VERSION, (unsigned int)sizeof(Particle));
+        return 0;
+    }
+    if (header->particles_offset < sizeof(SceneHeader) || header->particles_offset % sizeof(float) ||
+        file_size < header->particles_offset + (size_t)header->particles_count * sizeof(Particle)) {
+        fprintf(stderr, "Scene file %s is truncated, or its header is corrupt.\n", path);
+        return 0;
+    }
+    if (!header->particles_count) {
+        fprintf(stderr, "Scene file %s contains no particles.\n", path);
+        return 0;
+    }
+    return 1;
+}
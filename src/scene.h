@@ -0,0 +1,106 @@
+#ifndef SCENE_H_
+#define SCENE_H_
+
+#include "common.h"
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Binary particle scene files, so that scenes can be rendered without generating them at start up
+ *
+ * A scene file is a SceneHeader, followed by the particles as an array of Particle records (little endian)
+ * The records match the in memory layout of Particle exactly, so a scene is memory mapped and used without parsing
+ * Files are rejected if their version, record size or byte order do not match this build
+ */
+
+/**
+ * File extension of scene files
+ */
+#define SCENE_EXTENSION ".scene"
+/**
+ * Version of the scene format written, increment if SceneHeader or Particle change
+ */
+#define SCENE_VERSION 1
+/**
+ * Value of SceneHeader::byte_order as written, it reads differently on a host of the opposite byte order
+ */
+#define SCENE_BYTE_ORDER 0x01020304u
+
+/**
+ * The header at the start of a scene file, padded to 64 bytes so that the particle records are cache line aligned
+ */
+struct SceneHeader {
+    /**
+     * "PSCENE" followed by two null characters
+     */
+    char magic[8];
+    unsigned int version;
+    unsigned int byte_order;
+    /**
+     * Offset (in bytes) of the particle records from the start of the file
+     */
+    unsigned int particles_offset;
+    /**
+     * Size (in bytes) of each particle record, sizeof(Particle)
+     */
+    unsigned int particle_size;
+    unsigned int particles_count;
+    /**
+     * The image dimensions the particles were generated for, informational only
+     */
+    unsigned int width;
+    unsigned int height;
+    unsigned char reserved[28];
+};
+typedef struct SceneHeader SceneHeader;
+/**
+ * A scene loaded by scene_open()
+ */
+struct Scene {
+    /**
+     * The particles, these may be modified as the mapping is private (copy on write)
+     */
+    Particle *particles;
+    unsigned int particles_count;
+    unsigned int width;
+    unsigned int height;
+    /**
+     * The file mapping (or allocation if mapping is unavailable), and its size
+     */
+    void *data;
+    size_t data_size;
+};
+typedef struct Scene Scene;
+
+/**
+ * Write particles to a scene file
+ * @param path The path of the file to create
+ * @param particles Pointer to an array of particle structures
+ * @param particles_count The number of elements within the particles array
+ * @param width The image width the particles were generated for
+ * @param height The image height the particles were generated for
+ * @return Non-zero on success
+ */
+int scene_write(const char *path, const Particle *particles, unsigned int particles_count, unsigned int width, unsigned int height);
+/**
+ * Memory map a scene file (Linux only, elsewhere it is read into memory)
+ * The reason a file is rejected is printed to stderr
+ * @param path The path of the file to open
+ * @param scene Pointer to a struct to store the scene, release it with scene_close()
+ * @return Non-zero on success
+ */
+int scene_open(const char *path, Scene *scene);
+/**
+ * Release a scene opened by scene_open()
+ */
+void scene_close(Scene *scene);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SCENE_H_
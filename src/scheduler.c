@@ -0,0 +1,178 @@
+#include "scheduler.h"
+
+#include <stdlib.h>
+#include <omp.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+///
+/// Utility Methods
+///
+/**
+ * Stride (in elements) between each thread's range, so that each occupies its own cache line
+ */
+#define SCHEDULER_RANGE_STRIDE (64 / sizeof(unsigned long long))
+/**
+ * Pack and unpack a range of tasks [first, last), first occupies the low 32 bits
+ */
+#define SCHEDULER_RANGE(first, last) ((unsigned long long)(first) | ((unsigned long long)(last) << 32))
+#define SCHEDULER_FIRST(range) ((unsigned int)(range))
+#define SCHEDULER_LAST(range) ((unsigned int)((range) >> 32))
+/**
+ * Atomically load or store a range
+ */
+static unsigned long long scheduler_load(const unsigned long long *range);
+static void scheduler_store(unsigned long long *range, unsigned long long value);
+/**
+ * Atomically replace range with desired, if it still holds expected
+ * @return Non-zero if range was replaced
+ */
+static int scheduler_cas(unsigned long long *range, unsigned long long expected, unsigned long long desired);
+/**
+ * Take the first task of range
+ * @param task Set to the index of the task taken
+ * @return Non-zero if a task was taken, 0 if the range is empty
+ */
+static int scheduler_pop(unsigned long long *range, unsigned int *task);
+/**
+ * Steal the back half of another thread's range into thread's (empty) range
+ * @return Non-zero if tasks were stolen, 0 if every thread's range is empty
+ */
+static int scheduler_steal(unsigned long long *ranges, int thread, int threads);
+
+///
+/// Implementation
+///
+void scheduler_plan(SchedulerPlan *plan, const unsigned int *cost_index, const unsigned int items, const unsigned int item_cost) {
+    unsigned int tasks = (unsigned int)omp_get_max_threads() * SCHEDULER_TASKS_PER_THREAD;
+    tasks = tasks > items ? items : tasks;
+    if (tasks + 1 > plan->tasks_capacity) {
+        free(plan->task_first);
+        plan->task_first = (unsigned int*)malloc((tasks + 1) * sizeof(unsigned int));
+        plan->tasks_capacity = tasks + 1;
+    }
+    plan->tasks_count = 0;
+    if (!tasks)
+        return;
+    const unsigned long long base = cost_index[0];
+    const unsigned long long total = (unsigned long long)cost_index[items] - base + (unsigned long long)item_cost * items;
+    // Task k begins at the first item whose prefix cost reaches k / tasks of the total, found by binary search
+#pragma omp parallel for
+    for (int k = 1; k < (int)tasks; ++k) {
+        const unsigned long long goal = total * (unsigned long long)k / tasks;
+        unsigned int lo = 0, hi = items;
+        while (lo < hi) {
+            const unsigned int mid = lo + (hi - lo) / 2;
+            if ((unsigned long long)cost_index[mid] - base + (unsigned long long)item_cost * mid < goal)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        plan->task_first[k] = lo;
+    }
+    // An item costing more than a task reaches several goals at once, so drop the empty tasks between them
+    plan->task_first[0] = 0;
+    unsigned int count = 0;
+    for (unsigned int k = 1; k < tasks; ++k) {
+        if (plan->task_first[k] > plan->task_first[count] && plan->task_first[k] < items)
+            plan->task_first[++count] = plan->task_first[k];
+    }
+    plan->task_first[++count] = items;
+    plan->tasks_count = count;
+}
+void scheduler_run(SchedulerPlan *plan, const SchedulerTask task, void *user) {
+    const unsigned int tasks = plan->tasks_count;
+    if (!tasks)
+        return;
+    const int max_threads = omp_get_max_threads();
+    if (max_threads > plan->ranges_capacity) {
+        free(plan->ranges);
+        plan->ranges = (unsigned long long*)malloc(max_threads * SCHEDULER_RANGE_STRIDE * sizeof(unsigned long long));
+        plan->ranges_capacity = max_threads;
+    }
+    unsigned long long *ranges = plan->ranges;
+    const unsigned int *task_first = plan->task_first;
+#pragma omp parallel
+    {
+        const int t = omp_get_thread_num();
+        const int threads = omp_get_num_threads();
+        // Tasks are of roughly equal cost, so each thread starts with an equal number of them
+        const unsigned int first = (unsigned int)(((unsigned long long)tasks * t) / threads);
+        const unsigned int last = (unsigned int)(((unsigned long long)tasks * (t + 1)) / threads);
+        unsigned long long *range = ranges + t * SCHEDULER_RANGE_STRIDE;
+        scheduler_store(range, SCHEDULER_RANGE(first, last));
+#pragma omp barrier
+        do {
+            unsigned int i;
+            while (scheduler_pop(range, &i)) {
+                task(task_first[i], task_first[i + 1], user);
+            }
+        } while (scheduler_steal(ranges, t, threads));
+    }
+}
+void scheduler_release(SchedulerPlan *plan) {
+    free(plan->task_first);
+    free(plan->ranges);
+    plan->task_first = 0;
+    plan->tasks_count = 0;
+    plan->tasks_capacity = 0;
+    plan->ranges = 0;
+    plan->ranges_capacity = 0;
+}
+
+#ifdef _MSC_VER
+static unsigned long long scheduler_load(const unsigned long long *range) {
+    // A locked no-op exchange, 64-bit loads of aligned values are atomic on x64 but this also orders them
+    return (unsigned long long)_InterlockedCompareExchange64((volatile long long*)range, 0, 0);
+}
+static void scheduler_store(unsigned long long *range, const unsigned long long value) {
+    _InterlockedExchange64((volatile long long*)range, (long long)value);
+}
+static int scheduler_cas(unsigned long long *range, const unsigned long long expected, const unsigned long long desired) {
+    return _InterlockedCompareExchange64((volatile long long*)range, (long long)desired, (long long)expected) == (long long)expected;
+}
+#else
+static unsigned long long scheduler_load(const unsigned long long *range) {
+    return __atomic_load_n(range, __ATOMIC_ACQUIRE);
+}
+static void scheduler_store(unsigned long long *range, const unsigned long long value) {
+    __atomic_store_n(range, value, __ATOMIC_RELEASE);
+}
+static int scheduler_cas(unsigned long long *range, unsigned long long expected, const unsigned long long desired) {
+    return __atomic_compare_exchange_n(range, &expected, desired, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+#endif
+static int scheduler_pop(unsigned long long *range, unsigned int *task) {
+    for (;;) {
+        const unsigned long long current = scheduler_load(range);
+        const unsigned int first = SCHEDULER_FIRST(current);
+        const unsigned int last = SCHEDULER_LAST(current);
+        if (first >= last)
+            return 0;
+        if (scheduler_cas(range, current, SCHEDULER_RANGE(first + 1, last))) {
+            *task = first;
+            return 1;
+        }
+    }
+}
+static int scheduler_steal(unsigned long long *ranges, const int thread, const int threads) {
+    for (int v = 1; v < threads; ++v) {
+        unsigned long long *victim = ranges + ((thread + v) % threads) * SCHEDULER_RANGE_STRIDE;
+        for (;;) {
+            const unsigned long long current = scheduler_load(victim);
+            const unsigned int first = SCHEDULER_FIRST(current);
+            const unsigned int last = SCHEDULER_LAST(current);
+            if (first >= last)
+                break;
+            // Take the back half (rounded up, so a single remaining task can be stolen), the victim keeps the front
+            const unsigned int split = last - (last - first + 1) / 2;
+            if (scheduler_cas(victim, current, SCHEDULER_RANGE(first, split))) {
+                // This thread's range is empty, so no other thread modifies it concurrently
+                scheduler_store(ranges + thread * SCHEDULER_RANGE_STRIDE, SCHEDULER_RANGE(split, last));
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
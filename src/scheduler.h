@@ -0,0 +1,73 @@
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Work stealing scheduler, for loops whose iterations (items) have very uneven costs
+ *
+ * The items are split into contiguous tasks of roughly equal cost, as given by an exclusive prefix sum of each item's cost
+ * (e.g. the pixel index, whose differences are each pixel's number of contributions), so a pixel with thousands of
+ * contributors forms a task alone, whilst runs of empty pixels are merged into a single task
+ *
+ * Each thread starts with an equal share of the tasks, held as a range [first, last) packed into a single 64-bit word
+ * The owner takes tasks one at a time from the front of its range, an idle thread steals the back half of another
+ * thread's range, both with a compare and swap of the word, so no locks are taken
+ * Tasks are never split or created once a run starts, so a range is never restored after it is consumed (there is no ABA)
+ */
+
+/**
+ * The number of tasks planned per thread, enough that stealing can even out the error of each task's estimated cost
+ */
+#define SCHEDULER_TASKS_PER_THREAD 16
+/**
+ * Callback executing the items [first, last) of a task
+ * @param user The pointer passed to scheduler_run()
+ */
+typedef void (*SchedulerTask)(unsigned int first, unsigned int last, void *user);
+/**
+ * A plan of tasks, zero initialise before first use
+ * Storage is retained between plans, so replanning a loop of the same size does not allocate
+ */
+struct SchedulerPlan {
+    /**
+     * The first item of each task, tasks_count + 1 elements (the last being the number of items)
+     */
+    unsigned int *task_first;
+    unsigned int tasks_count;
+    unsigned int tasks_capacity;
+    /**
+     * The range of tasks held by each thread, each padded to a cache line
+     */
+    unsigned long long *ranges;
+    int ranges_capacity;
+};
+typedef struct SchedulerPlan SchedulerPlan;
+
+/**
+ * Split items into tasks of roughly equal cost
+ * @param plan The plan to (re)build
+ * @param cost_index Exclusive prefix sum of the cost of each item, items + 1 elements
+ * @param items The number of items
+ * @param item_cost A fixed cost added to every item, so that items with no cost (e.g. empty pixels) are not free
+ */
+void scheduler_plan(SchedulerPlan *plan, const unsigned int *cost_index, unsigned int items, unsigned int item_cost);
+/**
+ * Execute every task of plan across the OpenMP thread pool, returns once all tasks are complete
+ * @param plan The plan to execute
+ * @param task The callback executing each task
+ * @param user Passed to each call of task
+ */
+void scheduler_run(SchedulerPlan *plan, SchedulerTask task, void *user);
+/**
+ * Release the plan's storage, leaving it zero initialised
+ */
+void scheduler_release(SchedulerPlan *plan);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SCHEDULER_H_
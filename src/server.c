@@ -0,0 +1,427 @@
+#include "server.h"
+
+#include "renderer.h"
+#include "scene.h"
+#include "image_writer.h"
+#include "bench.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <omp.h>
+
+#ifdef __linux__
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+///
+/// Utility Methods
+///
+/**
+ * A connection jobs are read from, and their responses written to
+ */
+struct ServerStream {
+    FILE *in;
+    /**
+     * The socket responses are written to, or -1 for stdout (stdin and stdout are shared by every worker)
+     */
+    int fd;
+};
+typedef struct ServerStream ServerStream;
+/**
+ * The state each worker holds for the whole session
+ */
+struct ServerWorker {
+    Renderer *renderer;
+    /**
+     * The image rendered to when the output file is not memory mapped, grown as required
+     */
+    unsigned char *image;
+    size_t image_size;
+};
+typedef struct ServerWorker ServerWorker;
+/**
+ * The state shared by every worker
+ */
+struct Server {
+    /**
+     * Treated as boolean, set by "quit" so that no further lines of stdin, or connections, are taken
+     */
+    int stop;
+    /**
+     * The listening socket, or -1 when reading from stdin
+     */
+    int listen_fd;
+    unsigned int jobs;
+    unsigned int failed;
+    /**
+     * The latency of each job (in milliseconds), in order of completion
+     */
+    float *latencies;
+    unsigned int latencies_count;
+    unsigned int latencies_capacity;
+};
+typedef struct Server Server;
+/**
+ * Outcomes of server_read_job()
+ */
+#define SERVER_READ_END -1
+#define SERVER_READ_SKIP 0
+#define SERVER_READ_JOB 1
+#define SERVER_READ_TOO_LONG 2
+/**
+ * Read the next line of stream, numbering it as a job
+ * @param line Storage for SERVER_LINE_MAX characters
+ * @param job Set to the number of the job
+ * @param start Set to the time the job was read
+ * @return One of SERVER_READ_END (end of input, or "quit"), SERVER_READ_SKIP (blank or comment), SERVER_READ_JOB,
+ *         or SERVER_READ_TOO_LONG (the line was numbered as a job, and discarded)
+ */
+static int server_read_job(Server *server, ServerStream *stream, char *line, unsigned int *job, double *start);
+/**
+ * Return non-zero once "quit" has been read
+ */
+static int server_stopped(Server *server);
+/**
+ * Serve the jobs of stream until it ends
+ */
+static void server_serve(Server *server, ServerWorker *worker, ServerStream *stream);
+/**
+ * Render the job held by line, and respond with its outcome
+ */
+static void server_job(Server *server, ServerWorker *worker, ServerStream *stream, char *line, unsigned int job, double start);
+/**
+ * Write a formatted response line to stream
+ */
+static void server_respond(ServerStream *stream, const char *format, ...);
+/**
+ * Record the outcome of a job
+ */
+static void server_record(Server *server, int success, float latency);
+/**
+ * Null terminate and return the next whitespace separated token at *cursor, advancing it, or return 0 if there is none
+ */
+static char *server_token(char **cursor);
+#ifdef __linux__
+/**
+ * Create a Unix socket listening at path, replacing a stale socket left by a previous server
+ * @return The socket, or -1 on failure (the reason is printed to stderr)
+ */
+static int server_listen(const char *path);
+#endif
+
+///
+/// Implementation
+///
+int server_run(const CpuOptions *options, const unsigned int workers, const char *socket_path) {
+    Server server;
+    memset(&server, 0, sizeof(Server));
+    server.listen_fd = -1;
+    if (socket_path) {
+#ifdef __linux__
+        server.listen_fd = server_listen(socket_path);
+        if (server.listen_fd < 0)
+            return 0;
+#else
+        fprintf(stderr, "server_run(): Unix sockets are only available on Linux, read jobs from stdin instead.\n");
+        return 0;
+#endif
+    }
+    CpuOptions worker_options = *options;
+    if (!worker_options.arena)
+        worker_options.arena = 1;
+#if _OPENMP >= 200805
+    // Each job renders serially on its worker, so the renderer's own parallel regions must not spawn further threads
+    omp_set_max_active_levels(1);
+#endif
+    const int threads = workers ? (int)workers : omp_get_max_threads();
+    fprintf(stderr, "Serving jobs from %s with %d workers\n", socket_path ? socket_path : "stdin", threads);
+    const double start = omp_get_wtime();
+#pragma omp parallel num_threads(threads)
+    {
+        ServerWorker worker;
+        memset(&worker, 0, sizeof(ServerWorker));
+        worker.renderer = renderer_create(&worker_options);
+        if (!worker.renderer) {
+            fprintf(stderr, "server_run(): Unable to create the renderer of worker %d.\n", omp_get_thread_num());
+        } else if (server.listen_fd < 0) {
+            ServerStream stream;
+            stream.in = stdin;
+            stream.fd = -1;
+            server_serve(&server, &worker, &stream);
+        } else {
+#ifdef __linux__
+            while (!server_stopped(&server)) {
+                const int fd = accept(server.listen_fd, 0, 0);
+                if (fd < 0) {
+                    // The listening socket is shut down by "quit", which fails every pending accept()
+                    if (errno == EINTR || errno == ECONNABORTED)
+                        continue;
+                    break;
+                }
+                ServerStream stream;
+                stream.in = fdopen(fd, "r");
+                stream.fd = fd;
+                if (!stream.in) {
+                    close(fd);
+                    continue;
+                }
+                server_serve(&server, &worker, &stream);
+                fclose(stream.in);
+            }
+#endif
+        }
+        renderer_destroy(worker.renderer);
+        free(worker.image);
+    }
+    const double elapsed = omp_get_wtime() - start;
+#ifdef __linux__
+    if (server.listen_fd >= 0) {
+        close(server.listen_fd);
+        unlink(socket_path);
+    }
+#endif
+    fprintf(stderr, "Served %u jobs (%u failed) in %.3fs, %.1f jobs/s\n", server.jobs, server.failed, elapsed,
+        elapsed > 0 ? server.jobs / elapsed : 0.0);
+    if (server.latencies_count) {
+        BenchStats stats;
+        bench_stats(server.latencies, server.latencies_count, &stats);
+        fprintf(stderr, "Latency: mean %.3fms, median %.3fms, p95 %.3fms, p99 %.3fms, max %.3fms\n",
+            stats.mean, stats.median, stats.p95, stats.p99, stats.max);
+    }
+    free(server.latencies);
+    return 1;
+}
+
+static int server_read_job(Server *server, ServerStream *stream, char *line, unsigned int *job, double *start) {
+    // stdin is shared, so "quit" ends it for every worker, whereas an open connection is served until its client closes it
+    if ((stream->fd < 0 && server_stopped(server)) || !fgets(line, SERVER_LINE_MAX, stream->in))
+        return SERVER_READ_END;
+    *start = omp_get_wtime();
+    const size_t length = strlen(line);
+    int result = SERVER_READ_JOB;
+    if (length && line[length - 1] != '\n' && !feof(stream->in)) {
+        // Discard the remainder of the line, so that it is not read as further jobs
+        int c;
+        while ((c = fgetc(stream->in)) != '\n' && c != EOF) { }
+        result = SERVER_READ_TOO_LONG;
+    } else {
+        char *cursor = line;
+        while (*cursor == ' ' || *cursor == '\t' || *cursor == '\r' || *cursor == '\n')
+            ++cursor;
+        if (!*cursor || *cursor == '#')
+            return SERVER_READ_SKIP;
+        if (!strncmp(cursor, "quit", 4) && !cursor[4 + strspn(cursor + 4, " \t\r\n")]) {
+#pragma omp critical(server_state)
+            server->stop = 1;
+#ifdef __linux__
+            if (server->listen_fd >= 0)
+                shutdown(server->listen_fd, SHUT_RDWR);
+#endif
+            return SERVER_READ_END;
+        }
+    }
+#pragma omp critical(server_state)
+    *job = ++server->jobs;
+    return result;
+}
+static int server_stopped(Server *server) {
+    int stop;
+#pragma omp critical(server_state)
+    stop = server->stop;
+    return stop;
+}
+static void server_serve(Server *server, ServerWorker *worker, ServerStream *stream) {
+    char line[SERVER_LINE_MAX];
+    for (;;) {
+        unsigned int job = 0;
+        double start = 0;
+        int result;
+        if (stream->fd < 0) {
+            // stdin is shared, so each line is taken by a single worker
+#pragma omp critical(server_input)
+            result = server_read_job(server, stream, line, &job, &start);
+        } else {
+            result = server_read_job(server, stream, line, &job, &start);
+        }
+        if (result == SERVER_READ_END)
+            break;
+        if (result == SERVER_READ_TOO_LONG) {
+            server_respond(stream, "%u error job exceeds %d characters\n", job, SERVER_LINE_MAX - 1);
+            server_record(server, 0, (float)((omp_get_wtime() - start) * 1000));
+        } else if (result == SERVER_READ_JOB) {
+            server_job(server, worker, stream, line, job, start);
+        }
+    }
+}
+static void server_job(Server *server, ServerWorker *worker, ServerStream *stream, char *line, const unsigned int job, const double start) {
+    char *cursor = line;
+    const char *scene_path = server_token(&cursor);
+    const char *dimensions = server_token(&cursor);
+    const char *output_path = server_token(&cursor);
+    unsigned int width, height;
+    if (!output_path || server_token(&cursor)) {
+        server_respond(stream, "%u error expected <scene file> <output image dimensions> <output image>\n", job);
+        server_record(server, 0, (float)((omp_get_wtime() - start) * 1000));
+        return;
+    }
+    if (!bench_parse_dimensions(dimensions, ",xX", &width, &height)) {
+        server_respond(stream, "%u error invalid dimensions '%s', expected e.g. 256 or 256x128 of at most %d pixels\n",
+            job, dimensions, INT_MAX / 3);
+        server_record(server, 0, (float)((omp_get_wtime() - start) * 1000));
+        return;
+    }
+    if (image_format_from_path(output_path) == IMAGE_FORMAT_UNKNOWN) {
+        server_respond(stream, "%u error output image '%s' is not .png, .ppm or .raw\n", job, output_path);
+        server_record(server, 0, (float)((omp_get_wtime() - start) * 1000));
+        return;
+    }
+    Scene scene;
+    if (!scene_open(scene_path, &scene)) {
+        server_respond(stream, "%u error unable to open scene '%s'\n", job, scene_path);
+        server_record(server, 0, (float)((omp_get_wtime() - start) * 1000));
+        return;
+    }
+    // The renderer copies the particles, so the scene can be released before rendering
+    const int uploaded = renderer_upload(worker->renderer, scene.particles, scene.particles_count, width, height);
+    scene_close(&scene);
+    if (!uploaded) {
+        server_respond(stream, "%u error unable to allocate the buffers of %ux%u\n", job, width, height);
+        server_record(server, 0, (float)((omp_get_wtime() - start) * 1000));
+        return;
+    }
+    ImageWriter *writer = image_writer_open(output_path, width, height);
+    if (!writer) {
+        server_respond(stream, "%u error unable to create '%s'\n", job, output_path);
+        server_record(server, 0, (float)((omp_get_wtime() - start) * 1000));
+        return;
+    }
+    // A memory mapped image is rendered in place, otherwise to the worker's image and then written
+    unsigned char *rgb = image_writer_mapped(writer);
+    if (!rgb) {
+        const size_t image_size = (size_t)width * height * 3;
+        if (image_size > worker->image_size) {
+            free(worker->image);
+            worker->image = (unsigned char*)malloc(image_size);
+            worker->image_size = worker->image ? image_size : 0;
+        }
+        rgb = worker->image;
+    }
+    const int rendered = rgb && renderer_render(worker->renderer, rgb);
+    int success = rendered;
+    if (success && rgb == worker->image)
+        success = image_writer_write_rows(writer, rgb, 0, height);
+    success = image_writer_close(writer) && success;
+    const float latency = (float)((omp_get_wtime() - start) * 1000);
+    if (!success) {
+        // A failed job leaves no partial image behind
+        remove(output_path);
+    }
+    if (success) {
+        server_respond(stream, "%u ok %.3f %s\n", job, latency, output_path);
+    } else if (rgb && !rendered) {
+        server_respond(stream, "%u error unable to render '%s' at %ux%u, too many contributions or too little memory\n",
+            job, scene_path, width, height);
+    } else {
+        server_respond(stream, "%u error unable to write '%s'\n", job, output_path);
+    }
+    server_record(server, success, latency);
+}
+static void server_respond(ServerStream *stream, const char *format, ...) {
+    char response[SERVER_LINE_MAX + 256];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(response, sizeof(response), format, args);
+    va_end(args);
+    if (length < 0)
+        return;
+    if (length >= (int)sizeof(response))
+        length = (int)sizeof(response) - 1;
+    if (stream->fd < 0) {
+#pragma omp critical(server_output)
+        {
+            fwrite(response, 1, length, stdout);
+            fflush(stdout);
+        }
+        return;
+    }
+#ifdef __linux__
+    // A client which has disconnected must not raise SIGPIPE, its remaining responses are dropped
+    for (int written = 0; written < length;) {
+        const ssize_t result = send(stream->fd, response + written, length - written, MSG_NOSIGNAL);
+        if (result < 0 && errno == EINTR)
+            continue;
+        if (result <= 0)
+            return;
+        written += (int)result;
+    }
+#endif
+}
+static void server_record(Server *server, const int success, const float latency) {
+#pragma omp critical(server_stats)
+    {
+        if (!success)
+            ++server->failed;
+        if (server->latencies_count == server->latencies_capacity) {
+            const unsigned int capacity = server->latencies_capacity ? server->latencies_capacity * 2 : 1024;
+            float *latencies = (float*)realloc(server->latencies, capacity * sizeof(float));
+            if (latencies) {
+                server->latencies = latencies;
+                server->latencies_capacity = capacity;
+            }
+        }
+        if (server->latencies_count < server->latencies_capacity)
+            server->latencies[server->latencies_count++] = latency;
+    }
+}
+static char *server_token(char **cursor) {
+    char *c = *cursor;
+    while (*c == ' ' || *c == '\t' || *c == '\r' || *c == '\n')
+        ++c;
+    if (!*c)
+        return 0;
+    char *token = c;
+    while (*c && *c != ' ' && *c != '\t' && *c != '\r' && *c != '\n')
+        ++c;
+    if (*c)
+        *c++ = '\0';
+    *cursor = c;
+    return token;
+}
+#ifdef __linux__
+static int server_listen(const char *path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "server_listen(): Socket path '%s' exceeds %d characters.\n", path, (int)sizeof(address.sun_path) - 1);
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+    struct stat st;
+    if (!stat(path, &st)) {
+        if (!S_ISSOCK(st.st_mode)) {
+            fprintf(stderr, "server_listen(): '%s' already exists, and is not a socket.\n", path);
+            return -1;
+        }
+        unlink(path);
+    }
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        fprintf(stderr, "server_listen(): Unable to create a socket: %s\n", strerror(errno));
+        return -1;
+    }
+    if (bind(fd, (struct sockaddr*)&address, sizeof(address)) || listen(fd, SERVER_BACKLOG)) {
+        fprintf(stderr, "server_listen(): Unable to listen on '%s': %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+#endif
@@ -0,0 +1,59 @@
+#ifndef SERVER_H_
+#define SERVER_H_
+
+#include "cpu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Batch rendering server, a long running process which renders a stream of small jobs
+ *
+ * Spawning the executable per render repeats process start up, particle generation and validation for every image,
+ * which for small images (e.g. 256x256 with a few thousand particles) costs far more than the render itself
+ * Instead each worker thread (of an OpenMP parallel region) holds its own Renderer (see renderer.h) for the whole
+ * session, whose buffers are carved from an arena, so after the first few jobs a render allocates no memory
+ * Each job renders serially on its worker, throughput comes from running one job per worker concurrently
+ *
+ * Jobs are read one per line, whitespace separated:
+ *   <scene file> <output image dimensions> <output image>
+ * e.g. "scenes/a.scene 256x256 out/a.png", paths may not contain whitespace
+ * Blank lines and lines starting with '#' are ignored, "quit" stops the server
+ *
+ * One response line is written per job, in order of completion (which may differ from the order of the jobs):
+ *   <job> ok <latency ms> <output image>
+ *   <job> error <message>
+ * where <job> counts the jobs received from 1, and the latency is measured from the job being read to the image being closed
+ *
+ * From stdin, jobs are taken by whichever worker is free and responses are written to stdout, the server stops at end of input
+ * From a Unix socket (Linux only), each worker accepts a connection and serves its jobs in order, responding on the
+ * connection, so a client wanting several concurrent jobs opens several connections
+ * "quit" from any connection stops accepting new connections, connections already open are served until they close
+ *
+ * Once stopped, the number of jobs, throughput and latency statistics are printed to stderr
+ */
+
+/**
+ * The longest job line accepted, including its line break
+ */
+#define SERVER_LINE_MAX 4096
+/**
+ * The number of pending connections the socket queues whilst every worker is busy
+ */
+#define SERVER_BACKLOG 64
+
+/**
+ * Serve jobs until the end of input or "quit"
+ * @param options The options of every render, the arena is always enabled so that buffers are reused between jobs
+ * @param workers The number of worker threads, 0 starts one per OpenMP thread
+ * @param socket_path Path of the Unix socket to listen on, or null to read jobs from stdin
+ * @return Non-zero if the server started, failed jobs are reported in their response but do not fail the server
+ */
+int server_run(const CpuOptions *options, unsigned int workers, const char *socket_path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SERVER_H_
@@ -0,0 +1,562 @@
+#include "simd.h"
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SIMD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+// MSVC allows intrinsics of any instruction set to be used without enabling it for the whole translation unit
+#define SIMD_TARGET_AVX2
+#define SIMD_TARGET_AVX512
+#else
+// GCC requires each function using AVX intrinsics to enable the instruction set, so that the rest of the file remains portable
+// AVX-512F implies FMA in GCC, so contraction of mul/add into FMA is disabled to keep results identical to the scalar variant
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2"), optimize("fp-contract=off")))
+#define SIMD_TARGET_AVX512 __attribute__((target("avx512f"), optimize("fp-contract=off")))
+#endif
+#endif
+
+///
+/// Utility Methods
+///
+#ifdef SIMD_X86
+/**
+ * Left packing permutation of each 8 bit AVX2 lane mask, used to compress the covered lanes to the front of a vector
+ * Entry m holds the indices of the set bits of m in ascending order, 3 bits per index starting from the lowest bits
+ */
+static const unsigned int simd_compress_avx2[256] = {
+    0x000000, 0x000000, 0x000001, 0x000008, 0x000002, 0x000010, 0x000011, 0x000088,
+    0x000003, 0x000018, 0x000019, 0x0000C8, 0x00001A, 0x0000D0, 0x0000D1, 0x000688,
+    0x000004, 0x000020, 0x000021, 0x000108, 0x000022, 0x000110, 0x000111, 0x000888,
+    0x000023, 0x000118, 0x000119, 0x0008C8, 0x00011A, 0x0008D0, 0x0008D1, 0x004688,
+    0x000005, 0x000028, 0x000029, 0x000148, 0x00002A, 0x000150, 0x000151, 0x000A88,
+    0x00002B, 0x000158, 0x000159, 0x000AC8, 0x00015A, 0x000AD0, 0x000AD1, 0x005688,
+    0x00002C, 0x000160, 0x000161, 0x000B08, 0x000162, 0x000B10, 0x000B11, 0x005888,
+    0x000163, 0x000B18, 0x000B19, 0x0058C8, 0x000B1A, 0x0058D0, 0x0058D1, 0x02C688,
+    0x000006, 0x000030, 0x000031, 0x000188, 0x000032, 0x000190, 0x000191, 0x000C88,
+    0x000033, 0x000198, 0x000199, 0x000CC8, 0x00019A, 0x000CD0, 0x000CD1, 0x006688,
+    0x000034, 0x0001A0, 0x0001A1, 0x000D08, 0x0001A2, 0x000D10, 0x000D11, 0x006888,
+    0x0001A3, 0x000D18, 0x000D19, 0x0068C8, 0x000D1A, 0x0068D0, 0x0068D1, 0x034688,
+    0x000035, 0x0001A8, 0x0001A9, 0x000D48, 0x0001AA, 0x000D50, 0x000D51, 0x006A88,
+    0x0001AB, 0x000D58, 0x000D59, 0x006AC8, 0x000D5A, 0x006AD0, 0x006AD1, 0x035688,
+    0x0001AC, 0x000D60, 0x000D61, 0x006B08, 0x000D62, 0x006B10, 0x006B11, 0x035888,
+    0x000D63, 0x006B18, 0x006B19, 0x0358C8, 0x006B1A, 0x0358D0, 0x0358D1, 0x1AC688,
+    0x000007, 0x000038, 0x000039, 0x0001C8, 0x00003A, 0x0001D0, 0x0001D1, 0x000E88,
+    0x00003B, 0x0001D8, 0x0001D9, 0x000EC8, 0x0001DA, 0x000ED0, 0x000ED1, 0x007688,
+    0x00003C, 0x0001E0, 0x0001E1, 0x000F08, 0x0001E2, 0x000F10, 0x000F11, 0x007888,
+    0x0001E3, 0x000F18, 0x000F19, 0x0078C8, 0x000F1A, 0x0078D0, 0x0078D1, 0x03C688,
+    0x00003D, 0x0001E8, 0x0001E9, 0x000F48, 0x0001EA, 0x000F50, 0x000F51, 0x007A88,
+    0x0001EB, 0x000F58, 0x000F59, 0x007AC8, 0x000F5A, 0x007AD0, 0x007AD1, 0x03D688,
+    0x0001EC, 0x000F60, 0x000F61, 0x007B08, 0x000F62, 0x007B10, 0x007B11, 0x03D888,
+    0x000F63, 0x007B18, 0x007B19, 0x03D8C8, 0x007B1A, 0x03D8D0, 0x03D8D1, 0x1EC688,
+    0x00003E, 0x0001F0, 0x0001F1, 0x000F88, 0x0001F2, 0x000F90, 0x000F91, 0x007C88,
+    0x0001F3, 0x000F98, 0x000F99, 0x007CC8, 0x000F9A, 0x007CD0, 0x007CD1, 0x03E688,
+    0x0001F4, 0x000FA0, 0x000FA1, 0x007D08, 0x000FA2, 0x007D10, 0x007D11, 0x03E888,
+    0x000FA3, 0x007D18, 0x007D19, 0x03E8C8, 0x007D1A, 0x03E8D0, 0x03E8D1, 0x1F4688,
+    0x0001F5, 0x000FA8, 0x000FA9, 0x007D48, 0x000FAA, 0x007D50, 0x007D51, 0x03EA88,
+    0x000FAB, 0x007D58, 0x007D59, 0x03EAC8, 0x007D5A, 0x03EAD0, 0x03EAD1, 0x1F5688,
+    0x000FAC, 0x007D60, 0x007D61, 0x03EB08, 0x007D62, 0x03EB10, 0x03EB11, 0x1F5888,
+    0x007D63, 0x03EB18, 0x03EB19, 0x1F58C8, 0x03EB1A, 0x1F58D0, 0x1F58D1, 0xFAC688
+};
+int simd_row_covered_avx2(int x_min, int x_max, float centre_x, float y_ab, float radius, int *covered_x);
+void simd_blend_avx2(const unsigned int *pixel_index, const unsigned char *pixel_contrib_colours,
+    unsigned char *image, int first_pixel, int last_pixel);
+int simd_row_covered_avx512(int x_min, int x_max, float centre_x, float y_ab, float radius, int *covered_x);
+void simd_blend_avx512(const unsigned int *pixel_index, const unsigned char *pixel_contrib_colours,
+    unsigned char *image, int first_pixel, int last_pixel);
+void simd_blend_records_avx2(const unsigned int *pixel_index, const unsigned long long *pixel_contrib_records,
+    unsigned char *image, int first_pixel, int last_pixel);
+void simd_blend_records_avx512(const unsigned int *pixel_index, const unsigned long long *pixel_contrib_records,
+    unsigned char *image, int first_pixel, int last_pixel);
+void simd_blend_fixed_avx2(const unsigned int *pixel_index, const unsigned char *pixel_contrib_colours,
+    unsigned char *image, int first_pixel, int last_pixel);
+void simd_blend_records_fixed_avx2(const unsigned int *pixel_index, const unsigned long long *pixel_contrib_records,
+    unsigned char *image, int first_pixel, int last_pixel);
+void simd_blend_fixed_avx512(const unsigned int *pixel_index, const unsigned char *pixel_contrib_colours,
+    unsigned char *image, int first_pixel, int last_pixel);
+void simd_blend_records_fixed_avx512(const unsigned int *pixel_index, const unsigned long long *pixel_contrib_records,
+    unsigned char *image, int first_pixel, int last_pixel);
+/**
+ * The blend of simd_blend_avx2() and simd_blend_avx512(), gathering each contribution's colour from colours[j * stride]
+ * A stride of 1 blends RGBA colours, 2 blends the colours of packed records
+ * @return The first pixel not blended, the remainder (fewer than a vector of pixels) are left to a scalar tail
+ */
+static int simd_blend_strided_avx2(const unsigned int *pixel_index, const int *colours, int stride,
+    unsigned char *image, int first_pixel, int last_pixel);
+static int simd_blend_strided_avx512(const unsigned int *pixel_index, const int *colours, int stride,
+    unsigned char *image, int first_pixel, int last_pixel);
+/**
+ * As simd_blend_strided_avx2() and simd_blend_strided_avx512(), with fixed point arithmetic (SIMD_BLEND_FIXED)
+ */
+static int simd_blend_fixed_strided_avx2(const unsigned int *pixel_index, const int *colours, int stride,
+    unsigned char *image, int first_pixel, int last_pixel);
+static int simd_blend_fixed_strided_avx512(const unsigned int *pixel_index, const int *colours, int stride,
+    unsigned char *image, int first_pixel, int last_pixel);
+#endif
+/**
+ * Blend a single RGBA colour onto a pixel held as 16-bit lanes of a 64-bit word (red in the lowest 16 bits)
+ * Each lane computes floor((src * alpha + dest * (255 - alpha)) / 255), the sum is at most 255 * 255 so lanes never carry
+ * The division is exact as (v + 1 + (v >> 8)) >> 8, which holds for every v < 65535
+ */
+static unsigned long long simd_fixed_blend(unsigned long long dest, const unsigned char *colour);
+
+///
+/// Implementation
+///
+SimdLevel simd_detect() {
+#ifdef SIMD_X86
+#ifdef _MSC_VER
+    // CPUID leaf 7 reports AVX2 (EBX bit 5) and AVX-512F (EBX bit 16)
+    // XCR0 must also show the OS saves the YMM (bits 1-2) and ZMM (bits 5-7) state
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return SIMD_SCALAR;
+    __cpuid(info, 1);
+    if (!(info[2] & (1 << 27)))  // OSXSAVE
+        return SIMD_SCALAR;
+    const unsigned long long xcr0 = _xgetbv(0);
+    __cpuidex(info, 7, 0);
+    if ((info[1] & (1 << 16)) && (xcr0 & 0xE6) == 0xE6)
+        return SIMD_AVX512;
+    if ((info[1] & (1 << 5)) && (xcr0 & 0x6) == 0x6)
+        return SIMD_AVX2;
+#else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return SIMD_AVX512;
+    if (__builtin_cpu_supports("avx2"))
+        return SIMD_AVX2;
+#endif
+#endif
+    return SIMD_SCALAR;
+}
+SimdKernels simd_kernels(SimdLevel level, const SimdBlendMode blend_mode) {
+    const SimdLevel supported = simd_detect();
+    if (level == SIMD_AUTO || level > supported)
+        level = supported;
+    const int fixed = blend_mode == SIMD_BLEND_FIXED;
+    SimdKernels kernels;
+    kernels.level = level;
+    kernels.blend_mode = fixed ? SIMD_BLEND_FIXED : SIMD_BLEND_FLOAT;
+    switch (level) {
+#ifdef SIMD_X86
+    case SIMD_AVX512:
+        kernels.row_covered = simd_row_covered_avx512;
+        kernels.blend = fixed ? simd_blend_fixed_avx512 : simd_blend_avx512;
+        kernels.blend_records = fixed ? simd_blend_records_fixed_avx512 : simd_blend_records_avx512;
+        break;
+    case SIMD_AVX2:
+        kernels.row_covered = simd_row_covered_avx2;
+        kernels.blend = fixed ? simd_blend_fixed_avx2 : simd_blend_avx2;
+        kernels.blend_records = fixed ? simd_blend_records_fixed_avx2 : simd_blend_records_avx2;
+        break;
+#endif
+    default:
+        kernels.level = SIMD_SCALAR;
+        kernels.row_covered = simd_row_covered_scalar;
+        kernels.blend = fixed ? simd_blend_fixed_scalar : simd_blend_scalar;
+        kernels.blend_records = fixed ? simd_blend_records_fixed_scalar : simd_blend_records_scalar;
+        break;
+    }
+    return kernels;
+}
+const char *simd_level_to_string(const SimdLevel level) {
+    switch (level) {
+    case SIMD_AUTO:
+        return "auto";
+    case SIMD_SCALAR:
+        return "scalar";
+    case SIMD_AVX2:
+        return "avx2";
+    case SIMD_AVX512:
+        return "avx512";
+    }
+    return "?";
+}
+const char *simd_blend_mode_to_string(const SimdBlendMode blend_mode) {
+    switch (blend_mode) {
+    case SIMD_BLEND_FLOAT:
+        return "float";
+    case SIMD_BLEND_FIXED:
+        return "fixed";
+    }
+    return "?";
+}
+
+int simd_row_covered_scalar(const int x_min, const int x_max, const float centre_x, const float y_ab, const float radius, int *covered_x) {
+    int count = 0;
+    for (int x = x_min; x <= x_max; ++x) {
+        const float x_ab = (float)x + 0.5f - centre_x;
+        const float pixel_distance = sqrtf(x_ab * x_ab + y_ab * y_ab);
+        if (pixel_distance <= radius) {
+            covered_x[count++] = x;
+        }
+    }
+    return count;
+}
+void simd_blend_scalar(const unsigned int *pixel_index, const unsigned char *pixel_contrib_colours,
+    unsigned char *image, const int first_pixel, const int last_pixel) {
+    for (int i = first_pixel; i <= last_pixel; ++i) {
+        for (unsigned int j = pixel_index[i]; j < pixel_index[i + 1]; ++j) {
+            // dest = src * opacity + dest * (1 - opacity);
+            const float opacity = (float)pixel_contrib_colours[j * 4 + 3] / (float)255;
+            image[(i * 3) + 0] = (unsigned char)((float)pixel_contrib_colours[j * 4 + 0] * opacity + (float)image[(i * 3) + 0] * (1 - opacity));
+            image[(i * 3) + 1] = (unsigned char)((float)pixel_contrib_colours[j * 4 + 1] * opacity + (float)image[(i * 3) + 1] * (1 - opacity));
+            image[(i * 3) + 2] = (unsigned char)((float)pixel_contrib_colours[j * 4 + 2] * opacity + (float)image[(i * 3) + 2] * (1 - opacity));
+        }
+    }
+}
+void simd_blend_records_scalar(const unsigned int *pixel_index, const unsigned long long *pixel_contrib_records,
+    unsigned char *image, const int first_pixel, const int last_pixel) {
+    for (int i = first_pixel; i <= last_pixel; ++i) {
+        for (unsigned int j = pixel_index[i]; j < pixel_index[i + 1]; ++j) {
+            // The colour was packed from its RGBA bytes, so unpack it to bytes in the same way
+            const unsigned int packed = (unsigned int)pixel_contrib_records[j];
+            unsigned char colour[4];
+            memcpy(colour, &packed, sizeof(unsigned int));
+            // dest = src * opacity + dest * (1 - opacity);
+            const float opacity = (float)colour[3] / (float)255;
+            image[(i * 3) + 0] = (unsigned char)((float)colour[0] * opacity + (float)image[(i * 3) + 0] * (1 - opacity));
+            image[(i * 3) + 1] = (unsigned char)((float)colour[1] * opacity + (float)image[(i * 3) + 1] * (1 - opacity));
+            image[(i * 3) + 2] = (unsigned char)((float)colour[2] * opacity + (float)image[(i * 3) + 2] * (1 - opacity));
+        }
+    }
+}
+void simd_blend_fixed_scalar(const unsigned int *pixel_index, const unsigned char *pixel_contrib_colours,
+    unsigned char *image, const int first_pixel, const int last_pixel) {
+    for (int i = first_pixel; i <= last_pixel; ++i) {
+        unsigned char *pixel = image + (i * 3);
+        unsigned long long dest = pixel[0] | ((unsigned long long)pixel[1] << 16) | ((unsigned long long)pixel[2] << 32);
+        for (unsigned int j = pixel_index[i]; j < pixel_index[i + 1]; ++j) {
+            dest = simd_fixed_blend(dest, pixel_contrib_colours + (j * 4));
+        }
+        pixel[0] = (unsigned char)dest;
+        pixel[1] = (unsigned char)(dest >> 16);
+        pixel[2] = (unsigned char)(dest >> 32);
+    }
+}
+void simd_blend_records_fixed_scalar(const unsigned int *pixel_index, const unsigned long long *pixel_contrib_records,
+    unsigned char *image, const int first_pixel, const int last_pixel) {
+    for (int i = first_pixel; i <= last_pixel; ++i) {
+        unsigned char *pixel = image + (i * 3);
+        unsigned long long dest = pixel[0] | ((unsigned long long)pixel[1] << 16) | ((unsigned long long)pixel[2] << 32);
+        for (unsigned int j = pixel_index[i]; j < pixel_index[i + 1]; ++j) {
+            // The colour was packed from its RGBA bytes, so unpack it to bytes in the same way
+            const unsigned int packed = (unsigned int)pixel_contrib_records[j];
+            unsigned char colour[4];
+            memcpy(colour, &packed, sizeof(unsigned int));
+            dest = simd_fixed_blend(dest, colour);
+        }
+        pixel[0] = (unsigned char)dest;
+        pixel[1] = (unsigned char)(dest >> 16);
+        pixel[2] = (unsigned char)(dest >> 32);
+    }
+}
+
+static unsigned long long simd_fixed_blend(const unsigned long long dest, const unsigned char *colour) {
+    const unsigned long long alpha = colour[3];
+    const unsigned long long src = colour[0] | ((unsigned long long)colour[1] << 16) | ((unsigned long long)colour[2] << 32);
+    const unsigned long long v = src * alpha + dest * (255 - alpha);
+    return ((v + 0x000100010001ull + ((v >> 8) & 0x00FF00FF00FFull)) >> 8) & 0x00FF00FF00FFull;
+}
+
+#ifdef SIMD_X86
+SIMD_TARGET_AVX2 int simd_row_covered_avx2(const int x_min, const int x_max, const float centre_x, const float y_ab, const float radius, int *covered_x) {
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i shifts = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+    const __m256i index_mask = _mm256_set1_epi32(7);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 centre = _mm256_set1_ps(centre_x);
+    const __m256 y_ab_sq = _mm256_set1_ps(y_ab * y_ab);
+    const __m256 r = _mm256_set1_ps(radius);
+    int count = 0;
+    for (int x = x_min; x <= x_max; x += 8) {
+        // Same operations as the scalar test, (float)x + 0.5f - centre_x, then sqrtf(x_ab * x_ab + y_ab * y_ab) <= radius
+        const __m256i xi = _mm256_add_epi32(_mm256_set1_epi32(x), lanes);
+        const __m256 xf = _mm256_cvtepi32_ps(xi);
+        const __m256 x_ab = _mm256_sub_ps(_mm256_add_ps(xf, half), centre);
+        const __m256 distance = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(x_ab, x_ab), y_ab_sq));
+        unsigned int mask = (unsigned int)_mm256_movemask_ps(_mm256_cmp_ps(distance, r, _CMP_LE_OQ));
+        // Discard lanes beyond the end of the row
+        if (x_max - x < 7)
+            mask &= (1u << (x_max - x + 1)) - 1;
+        // Left pack the covered lanes and store all 8, lanes beyond the covered count are overwritten by the next store
+        const __m256i permutation = _mm256_and_si256(
+            _mm256_srlv_epi32(_mm256_set1_epi32((int)simd_compress_avx2[mask]), shifts), index_mask);
+        _mm256_storeu_si256((__m256i*)(covered_x + count), _mm256_permutevar8x32_epi32(xi, permutation));
+        count += _mm_popcnt_u32(mask);
+    }
+    return count;
+}
+SIMD_TARGET_AVX2 static int simd_blend_strided_avx2(const unsigned int *pixel_index, const int *colours, const int stride,
+    unsigned char *image, const int first_pixel, const int last_pixel) {
+    const __m256 max_byte = _mm256_set1_ps(255.0f);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256i byte_mask = _mm256_set1_epi32(0xFF);
+    int i = first_pixel;
+    // Each lane blends a different pixel, lanes with fewer contributions blend transparent black (opacity 0) when done
+    // As dest is always a whole number, dest * 1 + 0 leaves it unchanged
+    for (; i + 7 <= last_pixel; i += 8) {
+        const __m256i start = _mm256_loadu_si256((const __m256i*)(pixel_index + i));
+        const __m256i count = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)(pixel_index + i + 1)), start);
+        const __m256i first = _mm256_mullo_epi32(start, _mm256_set1_epi32(stride));
+        int counts[8], max_count = 0;
+        _mm256_storeu_si256((__m256i*)counts, count);
+        float dest[3][8];
+        for (int k = 0; k < 8; ++k) {
+            max_count = counts[k] > max_count ? counts[k] : max_count;
+            dest[0][k] = (float)image[((i + k) * 3) + 0];
+            dest[1][k] = (float)image[((i + k) * 3) + 1];
+            dest[2][k] = (float)image[((i + k) * 3) + 2];
+        }
+        __m256 red = _mm256_loadu_ps(dest[0]);
+        __m256 green = _mm256_loadu_ps(dest[1]);
+        __m256 blue = _mm256_loadu_ps(dest[2]);
+        for (int s = 0; s < max_count; ++s) {
+            const __m256i step = _mm256_set1_epi32(s);
+            const __m256i active = _mm256_cmpgt_epi32(count, step);
+            const __m256i colour = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), colours,
+                _mm256_add_epi32(first, _mm256_set1_epi32(s * stride)), active, 4);
+            const __m256 opacity = _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(colour, 24)), max_byte);
+            const __m256 transparency = _mm256_sub_ps(one, opacity);
+            // dest = (unsigned char)(src * opacity + dest * (1 - opacity));
+            const __m256 src_red = _mm256_cvtepi32_ps(_mm256_and_si256(colour, byte_mask));
+            const __m256 src_green = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(colour, 8), byte_mask));
+            const __m256 src_blue = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(colour, 16), byte_mask));
+            red = _mm256_cvtepi32_ps(_mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(src_red, opacity), _mm256_mul_ps(red, transparency))));
+            green = _mm256_cvtepi32_ps(_mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(src_green, opacity), _mm256_mul_ps(green, transparency))));
+            blue = _mm256_cvtepi32_ps(_mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(src_blue, opacity), _mm256_mul_ps(blue, transparency))));
+        }
+        _mm256_storeu_ps(dest[0], red);
+        _mm256_storeu_ps(dest[1], green);
+        _mm256_storeu_ps(dest[2], blue);
+        for (int k = 0; k < 8; ++k) {
+            image[((i + k) * 3) + 0] = (unsigned char)dest[0][k];
+            image[((i + k) * 3) + 1] = (unsigned char)dest[1][k];
+            image[((i + k) * 3) + 2] = (unsigned char)dest[2][k];
+        }
+    }
+    return i;
+}
+SIMD_TARGET_AVX2 void simd_blend_avx2(const unsigned int *pixel_index, const unsigned char *pixel_contrib_colours,
+    unsigned char *image, const int first_pixel, const int last_pixel) {
+    const int i = simd_blend_strided_avx2(pixel_index, (const int*)pixel_contrib_colours, 1, image, first_pixel, last_pixel);
+    // Scalar tail
+    simd_blend_scalar(pixel_index, pixel_contrib_colours, image, i, last_pixel);
+}
+SIMD_TARGET_AVX2 void simd_blend_records_avx2(const unsigned int *pixel_index, const unsigned long long *pixel_contrib_records,
+    unsigned char *image, const int first_pixel, const int last_pixel) {
+    // x86 is little endian, so each record's colour is the first of its two ints
+    const int i = simd_blend_strided_avx2(pixel_index, (const int*)pixel_contrib_records, 2, image, first_pixel, last_pixel);
+    // Scalar tail
+    simd_blend_records_scalar(pixel_index, pixel_contrib_records, image, i, last_pixel);
+}
+SIMD_TARGET_AVX2 static int simd_blend_fixed_strided_avx2(const unsigned int *pixel_index, const int *colours, const int stride,
+    unsigned char *image, const int first_pixel, const int last_pixel) {
+    const __m256i byte_mask = _mm256_set1_epi32(0xFF);
+    const __m256i one = _mm256_set1_epi32(1);
+    int i = first_pixel;
+    // As simd_blend_strided_avx2(), transparent black (alpha 0) leaves dest unchanged, as floor(dest * 255 / 255) is exact
+    for (; i + 7 <= last_pixel; i += 8) {
+        const __m256i start = _mm256_loadu_si256((const __m256i*)(pixel_index + i));
+        const __m256i count = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)(pixel_index + i + 1)), start);
+        const __m256i first = _mm256_mullo_epi32(start, _mm256_set1_epi32(stride));
+        int counts[8], max_count = 0;
+        _mm256_storeu_si256((__m256i*)counts, count);
+        int dest[3][8];
+        for (int k = 0; k < 8; ++k) {
+            max_count = counts[k] > max_count ? counts[k] : max_count;
+            dest[0][k] = image[((i + k) * 3) + 0];
+            dest[1][k] = image[((i + k) * 3) + 1];
+            dest[2][k] = image[((i + k) * 3) + 2];
+        }
+        __m256i red = _mm256_loadu_si256((const __m256i*)dest[0]);
+        __m256i green = _mm256_loadu_si256((const __m256i*)dest[1]);
+        __m256i blue = _mm256_loadu_si256((const __m256i*)dest[2]);
+        for (int s = 0; s < max_count; ++s) {
+            const __m256i step = _mm256_set1_epi32(s);
+            const __m256i active = _mm256_cmpgt_epi32(count, step);
+            const __m256i colour = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), colours,
+                _mm256_add_epi32(first, _mm256_set1_epi32(s * stride)), active, 4);
+            // Each 32-bit lane holds the 16-bit pair (src, dest), multiplied and summed with (alpha, 255 - alpha) by a single madd
+            // v = src * alpha + dest * (255 - alpha), then dest = floor(v / 255)
+            const __m256i alpha = _mm256_srli_epi32(colour, 24);
+            const __m256i weights = _mm256_or_si256(alpha, _mm256_slli_epi32(_mm256_sub_epi32(byte_mask, alpha), 16));
+            const __m256i src_red = _mm256_and_si256(colour, byte_mask);
+            const __m256i src_green = _mm256_and_si256(_mm256_srli_epi32(colour, 8), byte_mask);
+            const __m256i src_blue = _mm256_and_si256(_mm256_srli_epi32(colour, 16), byte_mask);
+            __m256i v = _mm256_madd_epi16(_mm256_or_si256(src_red, _mm256_slli_epi32(red, 16)), weights);
+            red = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(v, one), _mm256_srli_epi32(v, 8)), 8);
+            v = _mm256_madd_epi16(_mm256_or_si256(src_green, _mm256_slli_epi32(green, 16)), weights);
+            green = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(v, one), _mm256_srli_epi32(v, 8)), 8);
+            v = _mm256_madd_epi16(_mm256_or_si256(src_blue, _mm256_slli_epi32(blue, 16)), weights);
+            blue = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(v, one), _mm256_srli_epi32(v, 8)), 8);
+        }
+        _mm256_storeu_si256((__m256i*)dest[0], red);
+        _mm256_storeu_si256((__m256i*)dest[1], green);
+        _mm256_storeu_si256((__m256i*)dest[2], blue);
+        for (int k = 0; k < 8; ++k) {
+            image[((i + k) * 3) + 0] = (unsigned char)dest[0][k];
+            image[((i + k) * 3) + 1] = (unsigned char)dest[1][k];
+            image[((i + k) * 3) + 2] = (unsigned char)dest[2][k];
+        }
+    }
+    return i;
+}
+SIMD_TARGET_AVX2 void simd_blend_fixed_avx2(const unsigned int *pixel_index, const unsigned char *pixel_contrib_colours,
+    unsigned char *image, const int first_pixel, const int last_pixel) {
+    const int i = simd_blend_fixed_strided_avx2(pixel_index, (const int*)pixel_contrib_colours, 1, image, first_pixel, last_pixel);
+    // Scalar tail
+    simd_blend_fixed_scalar(pixel_index, pixel_contrib_colours, image, i, last_pixel);
+}
+SIMD_TARGET_AVX2 void simd_blend_records_fixed_avx2(const unsigned int *pixel_index, const unsigned long long *pixel_contrib_records,
+    unsigned char *image, const int first_pixel, const int last_pixel) {
+    const int i = simd_blend_fixed_strided_avx2(pixel_index, (const int*)pixel_contrib_records, 2, image, first_pixel, last_pixel);
+    // Scalar tail
+    simd_blend_records_fixed_scalar(pixel_index, pixel_contrib_records, image, i, last_pixel);
+}
+
+SIMD_TARGET_AVX512 int simd_row_covered_avx512(const int x_min, const int x_max, const float centre_x, const float y_ab, const float radius, int *covered_x) {
+    const __m512i lanes = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m512 half = _mm512_set1_ps(0.5f);
+    const __m512 centre = _mm512_set1_ps(centre_x);
+    const __m512 y_ab_sq = _mm512_set1_ps(y_ab * y_ab);
+    const __m512 r = _mm512_set1_ps(radius);
+    int count = 0;
+    for (int x = x_min; x <= x_max; x += 16) {
+        const __m512i xi = _mm512_add_epi32(_mm512_set1_epi32(x), lanes);
+        const __m512 x_ab = _mm512_sub_ps(_mm512_add_ps(_mm512_cvtepi32_ps(xi), half), centre);
+        const __m512 distance = _mm512_sqrt_ps(_mm512_add_ps(_mm512_mul_ps(x_ab, x_ab), y_ab_sq));
+        __mmask16 mask = _mm512_cmp_ps_mask(distance, r, _CMP_LE_OQ);
+        // Discard lanes beyond the end of the row
+        if (x_max - x < 15)
+            mask &= (__mmask16)((1u << (x_max - x + 1)) - 1);
+        // Compress in register and store all 16 lanes, as a masked compress store to memory is slow on some CPUs
+        _mm512_storeu_si512((void*)(covered_x + count), _mm512_maskz_compress_epi32(mask, xi));
+        count += _mm_popcnt_u32(mask);
+    }
+    return count;
+}
+SIMD_TARGET_AVX512 static int simd_blend_strided_avx512(const unsigned int *pixel_index, const int *colours, const int stride,
+    unsigned char *image, const int first_pixel, const int last_pixel) {
+    const __m512 max_byte = _mm512_set1_ps(255.0f);
+    const __m512 one = _mm512_set1_ps(1.0f);
+    const __m512i byte_mask = _mm512_set1_epi32(0xFF);
+    int i = first_pixel;
+    // As simd_blend_avx2(), lanes with fewer contributions blend transparent black when done
+    for (; i + 15 <= last_pixel; i += 16) {
+        const __m512i start = _mm512_loadu_si512((const void*)(pixel_index + i));
+        const __m512i count = _mm512_sub_epi32(_mm512_loadu_si512((const void*)(pixel_index + i + 1)), start);
+        const __m512i first = _mm512_mullo_epi32(start, _mm512_set1_epi32(stride));
+        const int max_count = _mm512_reduce_max_epi32(count);
+        float dest[3][16];
+        for (int k = 0; k < 16; ++k) {
+            dest[0][k] = (float)image[((i + k) * 3) + 0];
+            dest[1][k] = (float)image[((i + k) * 3) + 1];
+            dest[2][k] = (float)image[((i + k) * 3) + 2];
+        }
+        __m512 red = _mm512_loadu_ps(dest[0]);
+        __m512 green = _mm512_loadu_ps(dest[1]);
+        __m512 blue = _mm512_loadu_ps(dest[2]);
+        for (int s = 0; s < max_count; ++s) {
+            const __m512i step = _mm512_set1_epi32(s);
+            const __mmask16 active = _mm512_cmpgt_epi32_mask(count, step);
+            const __m512i colour = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), active,
+                _mm512_add_epi32(first, _mm512_set1_epi32(s * stride)), (const void*)colours, 4);
+            const __m512 opacity = _mm512_div_ps(_mm512_cvtepi32_ps(_mm512_srli_epi32(colour, 24)), max_byte);
+            const __m512 transparency = _mm512_sub_ps(one, opacity);
+            const __m512 src_red = _mm512_cvtepi32_ps(_mm512_and_si512(colour, byte_mask));
+            const __m512 src_green = _mm512_cvtepi32_ps(_mm512_and_si512(_mm512_srli_epi32(colour, 8), byte_mask));
+            const __m512 src_blue = _mm512_cvtepi32_ps(_mm512_and_si512(_mm512_srli_epi32(colour, 16), byte_mask));
+            red = _mm512_cvtepi32_ps(_mm512_cvttps_epi32(_mm512_add_ps(_mm512_mul_ps(src_red, opacity), _mm512_mul_ps(red, transparency))));
+            green = _mm512_cvtepi32_ps(_mm512_cvttps_epi32(_mm512_add_ps(_mm512_mul_ps(src_green, opacity), _mm512_mul_ps(green, transparency))));
+            blue = _mm512_cvtepi32_ps(_mm512_cvttps_epi32(_mm512_add_ps(_mm512_mul_ps(src_blue, opacity), _mm512_mul_ps(blue, transparency))));
+        }
+        _mm512_storeu_ps(dest[0], red);
+        _mm512_storeu_ps(dest[1], green);
+        _mm512_storeu_ps(dest[2], blue);
+        for (int k = 0; k < 16; ++k) {
+            image[((i + k) * 3) + 0] = (unsigned char)dest[0][k];
+            image[((i + k) * 3) + 1] = (unsigned char)dest[1][k];
+            image[((i + k) * 3) + 2] = (unsigned char)dest[2][k];
+        }
+    }
+    return i;
+}
+SIMD_TARGET_AVX512 void simd_blend_avx512(const unsigned int *pixel_index, const unsigned char *pixel_contrib_colours,
+    unsigned char *image, const int first_pixel, const int last_pixel) {
+    const int i = simd_blend_strided_avx512(pixel_index, (const int*)pixel_contrib_colours, 1, image, first_pixel, last_pixel);
+    // Scalar tail
+    simd_blend_scalar(pixel_index, pixel_contrib_colours, image, i, last_pixel);
+}
+SIMD_TARGET_AVX512 void simd_blend_records_avx512(const unsigned int *pixel_index, const unsigned long long *pixel_contrib_records,
+    unsigned char *image, const int first_pixel, const int last_pixel) {
+    const int i = simd_blend_strided_avx512(pixel_index, (const int*)pixel_contrib_records, 2, image, first_pixel, last_pixel);
+    // Scalar tail
+    simd_blend_records_scalar(pixel_index, pixel_contrib_records, image, i, last_pixel);
+}
+SIMD_TARGET_AVX512 static int simd_blend_fixed_strided_avx512(const unsigned int *pixel_index, const int *colours, const int stride,
+    unsigned char *image, const int first_pixel, const int last_pixel) {
+    const __m512i byte_mask = _mm512_set1_epi32(0xFF);
+    const __m512i one = _mm512_set1_epi32(1);
+    int i = first_pixel;
+    // As simd_blend_fixed_strided_avx2(), the 16-bit madd requires AVX-512BW, so v is computed with 32-bit multiplies as
+    // v = src * alpha + dest * (255 - alpha) = (src - dest) * alpha + (dest << 8) - dest
+    for (; i + 15 <= last_pixel; i += 16) {
+        const __m512i start = _mm512_loadu_si512((const void*)(pixel_index + i));
+        const __m512i count = _mm512_sub_epi32(_mm512_loadu_si512((const void*)(pixel_index + i + 1)), start);
+        const __m512i first = _mm512_mullo_epi32(start, _mm512_set1_epi32(stride));
+        const int max_count = _mm512_reduce_max_epi32(count);
+        int dest[3][16];
+        for (int k = 0; k < 16; ++k) {
+            dest[0][k] = image[((i + k) * 3) + 0];
+            dest[1][k] = image[((i + k) * 3) + 1];
+            dest[2][k] = image[((i + k) * 3) + 2];
+        }
+        __m512i red = _mm512_loadu_si512((const void*)dest[0]);
+        __m512i green = _mm512_loadu_si512((const void*)dest[1]);
+        __m512i blue = _mm512_loadu_si512((const void*)dest[2]);
+        for (int s = 0; s < max_count; ++s) {
+            const __m512i step = _mm512_set1_epi32(s);
+            const __mmask16 active = _mm512_cmpgt_epi32_mask(count, step);
+            const __m512i colour = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), active,
+                _mm512_add_epi32(first, _mm512_set1_epi32(s * stride)), (const void*)colours, 4);
+            const __m512i alpha = _mm512_srli_epi32(colour, 24);
+            const __m512i src_red = _mm512_and_si512(colour, byte_mask);
+            const __m512i src_green = _mm512_and_si512(_mm512_srli_epi32(colour, 8), byte_mask);
+            const __m512i src_blue = _mm512_and_si512(_mm512_srli_epi32(colour, 16), byte_mask);
+            __m512i v = _mm512_add_epi32(_mm512_mullo_epi32(_mm512_sub_epi32(src_red, red), alpha), _mm512_sub_epi32(_mm512_slli_epi32(red, 8), red));
+            red = _mm512_srli_epi32(_mm512_add_epi32(_mm512_add_epi32(v, one), _mm512_srli_epi32(v, 8)), 8);
+            v = _mm512_add_epi32(_mm512_mullo_epi32(_mm512_sub_epi32(src_green, green), alpha), _mm512_sub_epi32(_mm512_slli_epi32(green, 8), green));
+            green = _mm512_srli_epi32(_mm512_add_epi32(_mm512_add_epi32(v, one), _mm512_srli_epi32(v, 8)), 8);
+            v = _mm512_add_epi32(_mm512_mullo_epi32(_mm512_sub_epi32(src_blue, blue), alpha), _mm512_sub_epi32(_mm512_slli_epi32(blue, 8), blue));
+            blue = _mm512_srli_epi32(_mm512_add_epi32(_mm512_add_epi32(v, one), _mm512_srli_epi32(v, 8)), 8);
+        }
+        _mm512_storeu_si512((void*)dest[0], red);
+        _mm512_storeu_si512((void*)dest[1], green);
+        _mm512_storeu_si512((void*)dest[2], blue);
+        for (int k = 0; k < 16; ++k) {
+            image[((i + k) * 3) + 0] = (unsigned char)dest[0][k];
+            image[((i + k) * 3) + 1] = (unsigned char)dest[1][k];
+            image[((i + k) * 3) + 2] = (unsigned char)dest[2][k];
+        }
+    }
+    return i;
+}
+SIMD_TARGET_AVX512 void simd_blend_fixed_avx512(const unsigned int *pixel_index, const unsigned char *pixel_contrib_colours,
+    unsigned char *image, const int first_pixel, const int last_pixel) {
+    const int i = simd_blend_fixed_strided_avx512(pixel_index, (const int*)pixel_contrib_colours, 1, image, first_pixel, last_pixel);
+    // Scalar tail
+    simd_blend_fixed_scalar(pixel_index, pixel_contrib_colours, image, i, last_pixel);
+}
+SIMD_TARGET_AVX512 void simd_blend_records_fixed_avx512(const unsigned int *pixel_index, const unsigned long long *pixel_contrib_records,
+    unsigned char *image, const int first_pixel, const int last_pixel) {
+    const int i = simd_blend_fixed_strided_avx512(pixel_index, (const int*)pixel_contrib_records, 2, image, first_pixel, last_pixel);
+    // Scalar tail
+    simd_blend_records_fixed_scalar(pixel_index, pixel_contrib_records, image, i, last_pixel);
+}
+#endif
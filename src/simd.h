@@ -0,0 +1,127 @@
+#ifndef SIMD_H_
+#define SIMD_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Vectorised kernels for the per pixel loops of the CPU implementation
+ * Each kernel has a scalar, AVX2 and AVX-512 variant, the variant is selected at runtime according to the host CPU
+ *
+ * Every variant performs the same float operations in the same order as the scalar code (FMA is not used),
+ * so that results are bit identical regardless of the variant selected
+ *
+ * The blend kernels also have a fixed point variant (SIMD_BLEND_FIXED), which computes each channel with integers only
+ * dest = floor((src * alpha + dest * (255 - alpha)) / 255), the exact value of the float blend's expression, so its results
+ * do not depend on the compiler's float contraction or fast-math settings
+ * Microbench blend compares the two over every (src, dest, alpha) input, the float blend is 1 less for 15,467 of the
+ * 16,777,216 inputs (GCC -O3, x86-64), each of which has a whole exact value that the float rounding falls just short of
+ * It is never greater, so after any number of layers the two blends differ by at most 1 per channel
+ */
+
+/**
+ * Number of ints by which the covered_x storage of SimdRowCoveredFunction must exceed the width of the row tested
+ */
+#define SIMD_ROW_PADDING 16
+
+/**
+ * Instruction set used by the kernels
+ */
+enum SimdLevel { SIMD_AUTO, SIMD_SCALAR, SIMD_AVX2, SIMD_AVX512 };
+typedef enum SimdLevel SimdLevel;
+/**
+ * Arithmetic used by the blend kernels
+ * SIMD_BLEND_FLOAT matches the reference implementation, SIMD_BLEND_FIXED is exact and uses integers only
+ */
+enum SimdBlendMode { SIMD_BLEND_FLOAT, SIMD_BLEND_FIXED };
+typedef enum SimdBlendMode SimdBlendMode;
+
+/**
+ * Find the pixels [x_min, x_max] of a row whose centre falls within a circle's radius
+ * This is the coverage test of cpu_count_contribs(), applied to 8 (AVX2) or 16 (AVX-512) pixels at once
+ * @param x_min First pixel of the row to test
+ * @param x_max Last pixel of the row to test (inclusive)
+ * @param centre_x The x coordinate of the circle's centre
+ * @param y_ab The distance between the row's pixel centres and the circle's centre along the y axis
+ * @param radius The circle's radius
+ * @param covered_x Pointer to storage for (x_max - x_min + SIMD_ROW_PADDING) ints, to return the covered pixels in ascending order
+ *        The vector variants store whole vectors, so the elements after the covered pixels may be overwritten
+ * @return The number of covered pixels
+ */
+typedef int (*SimdRowCoveredFunction)(int x_min, int x_max, float centre_x, float y_ab, float radius, int *covered_x);
+/**
+ * Blend the depth sorted colours contributing to each of the pixels [first_pixel, last_pixel] into the RGB image
+ * This is the blend of cpu_stage3(), applied to 8 (AVX2) or 16 (AVX-512) pixels at once
+ * @param pixel_index Exclusive prefix sum of the number of colours contributing to each pixel
+ * @param pixel_contrib_colours The RGBA colours contributing to each pixel
+ * @param image RGB image data, each pixel must already be initialised to its background
+ * @param first_pixel Index of the first pixel to blend
+ * @param last_pixel Index of the last pixel to blend (inclusive)
+ */
+typedef void (*SimdBlendFunction)(const unsigned int *pixel_index, const unsigned char *pixel_contrib_colours,
+    unsigned char *image, int first_pixel, int last_pixel);
+
+/**
+ * As SimdBlendFunction, blending packed contribution records (depth << 32 | RGBA colour, see sort_records())
+ * @param pixel_contrib_records The records contributing to each pixel
+ */
+typedef void (*SimdBlendRecordsFunction)(const unsigned int *pixel_index, const unsigned long long *pixel_contrib_records,
+    unsigned char *image, int first_pixel, int last_pixel);
+
+/**
+ * The kernels for a single SimdLevel
+ */
+struct SimdKernels {
+    SimdLevel level;
+    SimdBlendMode blend_mode;
+    SimdRowCoveredFunction row_covered;
+    SimdBlendFunction blend;
+    SimdBlendRecordsFunction blend_records;
+};
+typedef struct SimdKernels SimdKernels;
+
+/**
+ * Return the highest SimdLevel supported by the host CPU (and compiler)
+ */
+SimdLevel simd_detect();
+/**
+ * Return the kernels for the requested level
+ * SIMD_AUTO, or a level which is not supported by the host, selects the highest supported level (no higher than requested)
+ * @param blend_mode The arithmetic of the blend kernels
+ */
+SimdKernels simd_kernels(SimdLevel level, SimdBlendMode blend_mode);
+/**
+ * Return the corresponding string for the provided SimdLevel enum
+ */
+const char *simd_level_to_string(SimdLevel level);
+/**
+ * Return the corresponding string for the provided SimdBlendMode enum
+ */
+const char *simd_blend_mode_to_string(SimdBlendMode blend_mode);
+
+/**
+ * Scalar kernel variants, these are always available
+ */
+int simd_row_covered_scalar(int x_min, int x_max, float centre_x, float y_ab, float radius, int *covered_x);
+void simd_blend_scalar(const unsigned int *pixel_index, const unsigned char *pixel_contrib_colours,
+    unsigned char *image, int first_pixel, int last_pixel);
+/**
+ * As simd_blend_scalar(), blending packed contribution records, the colour is read from the low half of each record
+ */
+void simd_blend_records_scalar(const unsigned int *pixel_index, const unsigned long long *pixel_contrib_records,
+    unsigned char *image, int first_pixel, int last_pixel);
+/**
+ * Fixed point (SIMD_BLEND_FIXED) variants of simd_blend_scalar() and simd_blend_records_scalar()
+ * Each pixel's RGB channels are held in 16-bit lanes of a single 64-bit word whilst its contributions are blended
+ */
+void simd_blend_fixed_scalar(const unsigned int *pixel_index, const unsigned char *pixel_contrib_colours,
+    unsigned char *image, int first_pixel, int last_pixel);
+void simd_blend_records_fixed_scalar(const unsigned int *pixel_index, const unsigned long long *pixel_contrib_records,
+    unsigned char *image, int first_pixel, int last_pixel);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SIMD_H_
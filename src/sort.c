@@ -0,0 +1,276 @@
+#include "sort.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+///
+/// Utility Methods
+///
+/**
+ * Stable LSD radix sort of items according to their upper 32 bits, using 8 bit digits
+ * Passes where every item shares the same digit are skipped
+ * @param src The items to be sorted
+ * @param dst Temporary storage for the same number of items
+ * @param count The number of items
+ * @return Whichever of src or dst holds the sorted items
+ */
+static unsigned long long *sort_items_radix(unsigned long long *src, unsigned long long *dst, unsigned int count);
+
+///
+/// Sorting networks for 2-8 items
+/// Each network is a fixed sequence of branchless compare-exchanges, so the items remain in registers
+///
+#define SORT_CAS(a, b) { \
+    const int swap = keys[b] < keys[a]; \
+    const float key_a = keys[a]; \
+    const unsigned int colour_a = colours[a]; \
+    keys[a] = swap ? keys[b] : key_a; \
+    keys[b] = swap ? key_a : keys[b]; \
+    colours[a] = swap ? colours[b] : colour_a; \
+    colours[b] = swap ? colour_a : colours[b]; \
+}
+/**
+ * Compare-exchange of two packed records, the depth occupies the upper bits so the whole record is compared
+ */
+#define SORT_RECORD_CAS(a, b) { \
+    const unsigned long long record_a = records[a]; \
+    const unsigned long long record_b = records[b]; \
+    records[a] = record_b < record_a ? record_b : record_a; \
+    records[b] = record_b < record_a ? record_a : record_b; \
+}
+
+///
+/// Implementation
+///
+void sort_pairs(float* keys_start, unsigned char* colours_start, const int first, const int last) {
+    const int count = last - first + 1;
+    if (count <= 1) {
+        return;
+    } else if (count >= SORT_NETWORK_MIN && count <= SORT_NETWORK_MAX) {
+        sort_pairs_network(keys_start, colours_start, first, last);
+    } else if (count <= SORT_INSERTION_MAX) {
+        sort_pairs_insertion(keys_start, colours_start, first, last);
+    } else {
+        sort_pairs_radix(keys_start, colours_start, first, last);
+    }
+}
+void sort_pairs_network(float* keys_start, unsigned char* colours_start, const int first, const int last) {
+    const int count = last - first + 1;
+    if (count <= 1)
+        return;
+    // Load the items to registers, colours are moved as a single 32 bit value
+    float keys[SORT_NETWORK_MAX];
+    unsigned int colours[SORT_NETWORK_MAX];
+    for (int i = 0; i < count; ++i) {
+        keys[i] = keys_start[first + i];
+        memcpy(&colours[i], colours_start + (4 * (first + i)), sizeof(unsigned int));
+    }
+    // Apply the network for this number of items
+    switch (count) {
+    case 2:
+        SORT_CAS(0,1);
+        break;
+    case 3:
+        SORT_CAS(0,2); SORT_CAS(0,1); SORT_CAS(1,2);
+        break;
+    case 4:
+        SORT_CAS(0,1); SORT_CAS(2,3); SORT_CAS(0,2); SORT_CAS(1,3); SORT_CAS(1,2);
+        break;
+    case 5:
+        SORT_CAS(0,3); SORT_CAS(1,4); SORT_CAS(0,2); SORT_CAS(1,3); SORT_CAS(0,1); SORT_CAS(2,4); SORT_CAS(1,2);
+        SORT_CAS(3,4); SORT_CAS(2,3);
+        break;
+    case 6:
+        SORT_CAS(0,5); SORT_CAS(1,3); SORT_CAS(2,4); SORT_CAS(1,2); SORT_CAS(3,4); SORT_CAS(0,3); SORT_CAS(2,5);
+        SORT_CAS(0,1); SORT_CAS(2,3); SORT_CAS(4,5); SORT_CAS(1,2); SORT_CAS(3,4);
+        break;
+    case 7:
+        SORT_CAS(0,6); SORT_CAS(2,3); SORT_CAS(4,5); SORT_CAS(0,2); SORT_CAS(1,4); SORT_CAS(3,6); SORT_CAS(0,1);
+        SORT_CAS(2,5); SORT_CAS(3,4); SORT_CAS(1,2); SORT_CAS(4,6); SORT_CAS(2,3); SORT_CAS(4,5); SORT_CAS(1,2);
+        SORT_CAS(3,4); SORT_CAS(5,6);
+        break;
+    case 8:
+        SORT_CAS(0,2); SORT_CAS(1,3); SORT_CAS(4,6); SORT_CAS(5,7); SORT_CAS(0,4); SORT_CAS(1,5); SORT_CAS(2,6);
+        SORT_CAS(3,7); SORT_CAS(0,1); SORT_CAS(2,3); SORT_CAS(4,5); SORT_CAS(6,7); SORT_CAS(2,4); SORT_CAS(3,5);
+        SORT_CAS(1,4); SORT_CAS(3,6); SORT_CAS(1,2); SORT_CAS(3,4); SORT_CAS(5,6);
+        break;
+    }
+    for (int i = 0; i < count; ++i) {
+        keys_start[first + i] = keys[i];
+        memcpy(colours_start + (4 * (first + i)), &colours[i], sizeof(unsigned int));
+    }
+}
+void sort_pairs_insertion(float* keys_start, unsigned char* colours_start, const int first, const int last) {
+    for (int i = first + 1; i <= last; ++i) {
+        const float key = keys_start[i];
+        unsigned int colour;
+        memcpy(&colour, colours_start + (4 * i), sizeof(unsigned int));
+        // Shift larger items right, until the insertion point is found
+        int j = i - 1;
+        while (j >= first && keys_start[j] > key) {
+            keys_start[j + 1] = keys_start[j];
+            memcpy(colours_start + (4 * (j + 1)), colours_start + (4 * j), sizeof(unsigned int));
+            --j;
+        }
+        keys_start[j + 1] = key;
+        memcpy(colours_start + (4 * (j + 1)), &colour, sizeof(unsigned int));
+    }
+}
+void sort_pairs_radix(float* keys_start, unsigned char* colours_start, const int first, const int last) {
+    const int count = last - first + 1;
+    if (count <= 1)
+        return;
+    // Each item is packed as (key << 32 | colour), so that a single array is permuted by each pass
+    unsigned long long stack_items[2 * SORT_RADIX_STACK];
+    unsigned long long *items = count <= SORT_RADIX_STACK ? stack_items : (unsigned long long*)malloc(2 * count * sizeof(unsigned long long));
+    for (int i = 0; i < count; ++i) {
+        unsigned int colour;
+        memcpy(&colour, colours_start + (4 * (first + i)), sizeof(unsigned int));
+        items[i] = ((unsigned long long)sort_key_bits(keys_start[first + i]) << 32) | colour;
+    }
+    const unsigned long long *sorted = sort_items_radix(items, items + count, (unsigned int)count);
+    // Unpack the sorted items, reversing the key conversion
+    for (int i = 0; i < count; ++i) {
+        unsigned int key = (unsigned int)(sorted[i] >> 32);
+        const unsigned int colour = (unsigned int)sorted[i];
+        key ^= (key & 0x80000000u) ? 0x80000000u : 0xFFFFFFFFu;
+        memcpy(keys_start + first + i, &key, sizeof(unsigned int));
+        memcpy(colours_start + (4 * (first + i)), &colour, sizeof(unsigned int));
+    }
+    if (items != stack_items)
+        free(items);
+}
+void sort_records(unsigned long long* records, const int first, const int last) {
+    const int count = last - first + 1;
+    if (count <= 1) {
+        return;
+    } else if (count >= SORT_NETWORK_MIN && count <= SORT_NETWORK_MAX) {
+        sort_records_network(records, first, last);
+    } else if (count <= SORT_INSERTION_MAX) {
+        sort_records_insertion(records, first, last);
+    } else {
+        sort_records_radix(records, first, last);
+    }
+}
+void sort_records_network(unsigned long long* records_start, const int first, const int last) {
+    const int count = last - first + 1;
+    if (count <= 1)
+        return;
+    // Load the records to registers
+    unsigned long long records[SORT_NETWORK_MAX];
+    memcpy(records, records_start + first, count * sizeof(unsigned long long));
+    // Apply the network for this number of records, the same networks as sort_pairs_network()
+    switch (count) {
+    case 2:
+        SORT_RECORD_CAS(0,1);
+        break;
+    case 3:
+        SORT_RECORD_CAS(0,2); SORT_RECORD_CAS(0,1); SORT_RECORD_CAS(1,2);
+        break;
+    case 4:
+        SORT_RECORD_CAS(0,1); SORT_RECORD_CAS(2,3); SORT_RECORD_CAS(0,2); SORT_RECORD_CAS(1,3); SORT_RECORD_CAS(1,2);
+        break;
+    case 5:
+        SORT_RECORD_CAS(0,3); SORT_RECORD_CAS(1,4); SORT_RECORD_CAS(0,2); SORT_RECORD_CAS(1,3); SORT_RECORD_CAS(0,1);
+        SORT_RECORD_CAS(2,4); SORT_RECORD_CAS(1,2); SORT_RECORD_CAS(3,4); SORT_RECORD_CAS(2,3);
+        break;
+    case 6:
+        SORT_RECORD_CAS(0,5); SORT_RECORD_CAS(1,3); SORT_RECORD_CAS(2,4); SORT_RECORD_CAS(1,2); SORT_RECORD_CAS(3,4);
+        SORT_RECORD_CAS(0,3); SORT_RECORD_CAS(2,5); SORT_RECORD_CAS(0,1); SORT_RECORD_CAS(2,3); SORT_RECORD_CAS(4,5);
+        SORT_RECORD_CAS(1,2); SORT_RECORD_CAS(3,4);
+        break;
+    case 7:
+        SORT_RECORD_CAS(0,6); SORT_RECORD_CAS(2,3); SORT_RECORD_CAS(4,5); SORT_RECORD_CAS(0,2); SORT_RECORD_CAS(1,4);
+        SORT_RECORD_CAS(3,6); SORT_RECORD_CAS(0,1); SORT_RECORD_CAS(2,5); SORT_RECORD_CAS(3,4); SORT_RECORD_CAS(1,2);
+        SORT_RECORD_CAS(4,6); SORT_RECORD_CAS(2,3); SORT_RECORD_CAS(4,5); SORT_RECORD_CAS(1,2); SORT_RECORD_CAS(3,4);
+        SORT_RECORD_CAS(5,6);
+        break;
+    case 8:
+        SORT_RECORD_CAS(0,2); SORT_RECORD_CAS(1,3); SORT_RECORD_CAS(4,6); SORT_RECORD_CAS(5,7); SORT_RECORD_CAS(0,4);
+        SORT_RECORD_CAS(1,5); SORT_RECORD_CAS(2,6); SORT_RECORD_CAS(3,7); SORT_RECORD_CAS(0,1); SORT_RECORD_CAS(2,3);
+        SORT_RECORD_CAS(4,5); SORT_RECORD_CAS(6,7); SORT_RECORD_CAS(2,4); SORT_RECORD_CAS(3,5); SORT_RECORD_CAS(1,4);
+        SORT_RECORD_CAS(3,6); SORT_RECORD_CAS(1,2); SORT_RECORD_CAS(3,4); SORT_RECORD_CAS(5,6);
+        break;
+    }
+    memcpy(records_start + first, records, count * sizeof(unsigned long long));
+}
+void sort_records_insertion(unsigned long long* records, const int first, const int last) {
+    for (int i = first + 1; i <= last; ++i) {
+        const unsigned long long record = records[i];
+        // Shift larger records right, until the insertion point is found
+        int j = i - 1;
+        while (j >= first && records[j] > record) {
+            records[j + 1] = records[j];
+            --j;
+        }
+        records[j + 1] = record;
+    }
+}
+void sort_records_radix(unsigned long long* records, const int first, const int last) {
+    const int count = last - first + 1;
+    if (count <= 1)
+        return;
+    // The records are already in the form sorted by sort_items_radix(), so only the temporary storage is required
+    unsigned long long stack_temp[SORT_RADIX_STACK];
+    unsigned long long *temp = count <= SORT_RADIX_STACK ? stack_temp : (unsigned long long*)malloc(count * sizeof(unsigned long long));
+    const unsigned long long *sorted = sort_items_radix(records + first, temp, (unsigned int)count);
+    if (sorted != records + first)
+        memcpy(records + first, sorted, count * sizeof(unsigned long long));
+    if (temp != stack_temp)
+        free(temp);
+}
+void sort_index_radix(const float* keys, const unsigned int count, unsigned int* index) {
+    if (count == 0)
+        return;
+    // Each item is packed as (key << 32 | original index), so the low bits recover the permutation
+    unsigned long long *items = (unsigned long long*)malloc(2 * (size_t)count * sizeof(unsigned long long));
+    for (unsigned int i = 0; i < count; ++i) {
+        items[i] = ((unsigned long long)sort_key_bits(keys[i]) << 32) | i;
+    }
+    const unsigned long long *sorted = sort_items_radix(items, items + count, count);
+    for (unsigned int i = 0; i < count; ++i) {
+        index[i] = (unsigned int)sorted[i];
+    }
+    free(items);
+}
+unsigned int sort_key_bits(const float key) {
+    unsigned int bits;
+    memcpy(&bits, &key, sizeof(unsigned int));
+    // Convert the float's bits to an unsigned integer which sorts in the same order
+    // Negative floats have all bits flipped, positive floats have only their sign bit flipped
+    return bits ^ ((bits & 0x80000000u) ? 0xFFFFFFFFu : 0x80000000u);
+}
+
+static unsigned long long *sort_items_radix(unsigned long long *src, unsigned long long *dst, const unsigned int count) {
+    // Build the histogram of every digit in a single pass over the input
+    unsigned int histograms[4][256];
+    memset(histograms, 0, sizeof(histograms));
+    for (unsigned int i = 0; i < count; ++i) {
+        const unsigned int key = (unsigned int)(src[i] >> 32);
+        ++histograms[0][key & 0xFF];
+        ++histograms[1][(key >> 8) & 0xFF];
+        ++histograms[2][(key >> 16) & 0xFF];
+        ++histograms[3][key >> 24];
+    }
+    // Stable scatter by each 8 bit digit of the key, least significant first
+    for (int d = 0; d < 4; ++d) {
+        const int shift = 32 + 8 * d;
+        unsigned int *histogram = histograms[d];
+        // Skip the pass if every key shares this digit (common, as keys are often clustered)
+        if (histogram[(src[0] >> shift) & 0xFF] == count)
+            continue;
+        unsigned int offset = 0;
+        for (int b = 0; b < 256; ++b) {
+            const unsigned int t = histogram[b];
+            histogram[b] = offset;
+            offset += t;
+        }
+        for (unsigned int i = 0; i < count; ++i) {
+            dst[histogram[(src[i] >> shift) & 0xFF]++] = src[i];
+        }
+        unsigned long long *t = src;
+        src = dst;
+        dst = t;
+    }
+    return src;
+}
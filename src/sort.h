@@ -0,0 +1,99 @@
+#ifndef SORT_H_
+#define SORT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Pair sort implementations, used to sort the colours contributing to each pixel according to their depth
+ * Items at the matching index within keys and values are sorted according to keys in ascending order
+ *
+ * Most pixels have very few contributors, with a long tail of pixels with thousands of contributors,
+ * so sort_pairs() selects an algorithm according to the length of the segment being sorted
+ * The thresholds were selected using the sort benchmark of the microbench executable (make microbench)
+ */
+
+/**
+ * Segments with lengths in the range [SORT_NETWORK_MIN, SORT_NETWORK_MAX] are sorted with a sorting network
+ * Shorter segments are faster to sort with insertion sort, as it performs very few comparisons
+ * SORT_NETWORK_MAX must not exceed 8, the largest network implemented
+ */
+#define SORT_NETWORK_MIN 5
+#define SORT_NETWORK_MAX 8
+/**
+ * Other segments of this length or shorter are sorted with insertion sort
+ * Longer segments are sorted with LSD radix sort
+ */
+#define SORT_INSERTION_MAX 32
+/**
+ * Radix sorts of segments up to this length use temporary storage on the stack (16 bytes per item), so that the
+ * per pixel sorts of stage 2 do not allocate, only the rare longer segments allocate their temporary storage
+ */
+#define SORT_RADIX_STACK 1024
+
+/**
+ * Sort the items [first, last] according to their key, selecting an algorithm according to the number of items
+ * @param keys_start Pointer to the start of the keys (depth) buffer
+ * @param colours_start Pointer to the start of the values (colours) buffer (each color consists of four unsigned char)
+ * @param first Index of the first item to be sorted
+ * @param last Index of the last item to be sorted
+ */
+void sort_pairs(float* keys_start, unsigned char* colours_start, int first, int last);
+/**
+ * Sort the items [first, last] with a sorting network
+ * @note At most SORT_NETWORK_MAX items may be sorted
+ */
+void sort_pairs_network(float* keys_start, unsigned char* colours_start, int first, int last);
+/**
+ * Sort the items [first, last] with insertion sort
+ */
+void sort_pairs_insertion(float* keys_start, unsigned char* colours_start, int first, int last);
+/**
+ * Sort the items [first, last] with an LSD radix sort, of the order preserving unsigned integer form of each key
+ * Radix passes where every key shares the same digit are skipped
+ * @note Temporary storage for more than SORT_RADIX_STACK items is allocated internally
+ */
+void sort_pairs_radix(float* keys_start, unsigned char* colours_start, int first, int last);
+/**
+ * Sort the packed contribution records [first, last] in ascending order, selecting an algorithm as sort_pairs() does
+ * Each record is (sort_key_bits(depth) << 32 | RGBA colour), so ascending records are in ascending depth order
+ * Records of equal depth may be ordered differently by each algorithm, as with sort_pairs()
+ * @param records Pointer to the start of the records buffer
+ * @param first Index of the first record to be sorted
+ * @param last Index of the last record to be sorted
+ */
+void sort_records(unsigned long long* records, int first, int last);
+/**
+ * Sort the records [first, last] with a sorting network
+ * @note At most SORT_NETWORK_MAX records may be sorted
+ */
+void sort_records_network(unsigned long long* records, int first, int last);
+/**
+ * Sort the records [first, last] with insertion sort
+ */
+void sort_records_insertion(unsigned long long* records, int first, int last);
+/**
+ * Sort the records [first, last] with an LSD radix sort of their upper 32 bits (the depth)
+ * @note Temporary storage for more than SORT_RADIX_STACK records is allocated internally
+ */
+void sort_records_radix(unsigned long long* records, int first, int last);
+/**
+ * Convert a float key to an unsigned integer with the same sort order
+ */
+unsigned int sort_key_bits(float key);
+/**
+ * Compute the stable permutation which sorts keys in ascending order, with an LSD radix sort of (key, index) pairs
+ * The keys are not modified, keys[index[0]] is the smallest key
+ * @param keys The keys to be sorted
+ * @param count The number of keys
+ * @param index Pointer to storage for count indices, to return the permutation
+ * @note Temporary storage is allocated internally
+ */
+void sort_index_radix(const float* keys, unsigned int count, unsigned int* index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SORT_H_